@@ -3302,12 +3302,11 @@ touch_handle_frame(void *data, struct wl_touch *wl_touch)
 		return;
 	}
 
+	/* The frame closes one set of changes, not the touch sequence;
+	 * points stay until their up event. */
 	wl_list_for_each_safe(tp, tmp, &input->touch_point_list, link) {
 		if (tp->widget->touch_frame_handler)
 			(*tp->widget->touch_frame_handler)(tp->widget, tp->widget->user_data);
-
-		wl_list_remove(&tp->link);
-		free(tp);
 	}
 }
 
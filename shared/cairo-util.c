@@ -405,10 +405,8 @@ theme_render_frame(struct theme *t,
 		   cairo_t *cr, int width, int height,
 		   const char *title, uint32_t flags)
 {
-	cairo_text_extents_t extents;
-	cairo_font_extents_t font_extents;
 	cairo_surface_t *source;
-	int x, y, margin;
+	int margin;
 
 	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
 	cairo_set_source_rgba(cr, 0, 0, 0, 0);
@@ -434,6 +432,23 @@ theme_render_frame(struct theme *t,
 		    width - margin * 2, height - margin * 2,
 		    t->width, t->titlebar_height);
 
+	if (title)
+		theme_render_title(t, cr, width, title, flags);
+}
+
+void
+theme_render_title(struct theme *t,
+		   cairo_t *cr, int width, const char *title, uint32_t flags)
+{
+	cairo_text_extents_t extents;
+	cairo_font_extents_t font_extents;
+	int x, y, margin;
+
+	if (flags & THEME_FRAME_MAXIMIZED)
+		margin = 0;
+	else
+		margin = t->margin;
+
 	cairo_rectangle (cr, margin + t->width, margin,
 			 width - (margin + t->width) * 2,
 			 t->titlebar_height - t->width);
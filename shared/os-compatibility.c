@@ -30,6 +30,8 @@
 #include <sys/epoll.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <sys/stat.h>
 
 #include "os-compatibility.h"
 
@@ -169,6 +171,48 @@ os_create_anonymous_file(off_t size)
 	return fd;
 }
 
+/*
+ * Return the per-user weston cache directory, $XDG_CACHE_HOME/weston
+ * or ~/.cache/weston, creating it if needed. The caller frees the
+ * returned path. Returns NULL and sets errno on failure.
+ */
+char *
+os_create_cache_dir(void)
+{
+	const char *base, *suffix;
+	char *path;
+	size_t len;
+
+	base = getenv("XDG_CACHE_HOME");
+	suffix = "/weston";
+	if (!base) {
+		base = getenv("HOME");
+		suffix = "/.cache/weston";
+	}
+	if (!base) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	len = strlen(base) + strlen(suffix) + 1;
+	path = malloc(len);
+	if (!path)
+		return NULL;
+
+	/* Create the parent too, ~/.cache may not exist yet. */
+	snprintf(path, len, "%s%s", base, suffix);
+	*strrchr(path, '/') = '\0';
+	mkdir(path, 0700);
+	snprintf(path, len, "%s%s", base, suffix);
+
+	if (mkdir(path, 0700) < 0 && errno != EEXIST) {
+		free(path);
+		return NULL;
+	}
+
+	return path;
+}
+
 #ifndef HAVE_STRCHRNUL
 char *
 strchrnul(const char *s, int c)
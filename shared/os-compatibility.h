@@ -46,6 +46,9 @@ os_epoll_create_cloexec(void);
 int
 os_create_anonymous_file(off_t size);
 
+char *
+os_create_cache_dir(void);
+
 #ifndef HAVE_STRCHRNUL
 char *
 strchrnul(const char *s, int c);
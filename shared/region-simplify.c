@@ -0,0 +1,210 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "region-simplify.h"
+
+/* How many of the previously collected boxes a box is considered for
+ * merging with. The boxes come in pixman's y-x banded order, so the
+ * candidates worth merging with are the most recent ones. Overlap is
+ * still checked against all of them.
+ */
+#define MERGE_WINDOW 8
+
+static int64_t
+box_area(const pixman_box32_t *b)
+{
+	return (int64_t) (b->x2 - b->x1) * (b->y2 - b->y1);
+}
+
+static pixman_box32_t
+box_union(const pixman_box32_t *a, const pixman_box32_t *b)
+{
+	pixman_box32_t u;
+
+	u.x1 = a->x1 < b->x1 ? a->x1 : b->x1;
+	u.y1 = a->y1 < b->y1 ? a->y1 : b->y1;
+	u.x2 = a->x2 > b->x2 ? a->x2 : b->x2;
+	u.y2 = a->y2 > b->y2 ? a->y2 : b->y2;
+
+	return u;
+}
+
+static int
+box_intersects(const pixman_box32_t *a, const pixman_box32_t *b)
+{
+	return a->x1 < b->x2 && b->x1 < a->x2 &&
+	       a->y1 < b->y2 && b->y1 < a->y2;
+}
+
+/* Pixels uploaded for nothing when 'a' and 'b' are replaced by
+ * their bounding box. */
+static int64_t
+merge_waste(const pixman_box32_t *a, const pixman_box32_t *b)
+{
+	pixman_box32_t u = box_union(a, b);
+
+	return box_area(&u) - box_area(a) - box_area(b);
+}
+
+/* Grow boxes[j] by 'box', then swallow every other box it now
+ * overlaps, so that the boxes never overlap and no pixel is uploaded
+ * twice. Returns the new number of boxes.
+ */
+static int
+merge_box(pixman_box32_t *boxes, int count, int j, const pixman_box32_t *box)
+{
+	int k, swallowed;
+
+	boxes[j] = box_union(&boxes[j], box);
+
+	/* Each swallow removes a box, so the passes after the first are
+	 * paid for by the boxes they remove. */
+	do {
+		swallowed = 0;
+		k = 0;
+		while (k < count) {
+			if (k == j ||
+			    !box_intersects(&boxes[j], &boxes[k])) {
+				k++;
+				continue;
+			}
+
+			boxes[j] = box_union(&boxes[j], &boxes[k]);
+			memmove(&boxes[k], &boxes[k + 1],
+				(count - k - 1) * sizeof *boxes);
+			count--;
+			if (k < j)
+				j--;
+			swallowed = 1;
+
+			/* Go on from the box that moved into slot k;
+			 * the boxes before it are checked again in the
+			 * next pass, as boxes[j] grew. */
+		}
+	} while (swallowed);
+
+	return count;
+}
+
+/* Index of a box overlapping 'box', or -1. */
+static int
+find_overlap(const pixman_box32_t *boxes, int count, const pixman_box32_t *box)
+{
+	int j;
+
+	for (j = count - 1; j >= 0; j--)
+		if (box_intersects(&boxes[j], box))
+			return j;
+
+	return -1;
+}
+
+int
+region_simplify(pixman_region32_t *region,
+		const struct region_simplify_cost *cost,
+		pixman_box32_t *boxes)
+{
+	pixman_box32_t *rects, *tmp, merged;
+	int64_t waste, best_waste, threshold;
+	int i, j, n, count, best_i, best_j, max_boxes;
+
+	max_boxes = cost->max_boxes > 0 ? cost->max_boxes : 1;
+
+	rects = pixman_region32_rectangles(region, &n);
+	if (n == 0)
+		return 0;
+
+	if (n == 1) {
+		boxes[0] = rects[0];
+		return 1;
+	}
+
+	tmp = malloc(n * sizeof *tmp);
+	if (!tmp) {
+		boxes[0] = *pixman_region32_extents(region);
+		return 1;
+	}
+
+	/* Merging pays off as long as the pixels wasted cost less than
+	 * the call saved. */
+	threshold = cost->call_overhead /
+		(cost->bytes_per_pixel > 0 ? cost->bytes_per_pixel : 1);
+
+	count = 0;
+	for (i = 0; i < n; i++) {
+		best_j = -1;
+		best_waste = 0;
+		for (j = count - 1; j >= 0 && j >= count - MERGE_WINDOW; j--) {
+			waste = merge_waste(&tmp[j], &rects[i]);
+			if (waste > threshold)
+				continue;
+			if (best_j < 0 || waste < best_waste) {
+				best_j = j;
+				best_waste = waste;
+			}
+		}
+
+		/* A box merged earlier may have grown over this one,
+		 * outside of the window. */
+		if (best_j < 0)
+			best_j = find_overlap(tmp, count, &rects[i]);
+
+		if (best_j >= 0)
+			count = merge_box(tmp, count, best_j, &rects[i]);
+		else
+			tmp[count++] = rects[i];
+	}
+
+	/* Still too many boxes: merge the cheapest neighbouring pairs,
+	 * whatever it costs, until we are within the budget. */
+	while (count > max_boxes) {
+		best_i = 0;
+		best_j = 1;
+		best_waste = INT64_MAX;
+		for (i = 0; i < count; i++) {
+			for (j = i + 1; j < count && j <= i + MERGE_WINDOW; j++) {
+				waste = merge_waste(&tmp[i], &tmp[j]);
+				if (waste < best_waste) {
+					best_i = i;
+					best_j = j;
+					best_waste = waste;
+				}
+			}
+		}
+
+		merged = tmp[best_j];
+		memmove(&tmp[best_j], &tmp[best_j + 1],
+			(count - best_j - 1) * sizeof *tmp);
+		count = merge_box(tmp, count - 1, best_i, &merged);
+	}
+
+	memcpy(boxes, tmp, count * sizeof *tmp);
+	free(tmp);
+
+	return count;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef WESTON_REGION_SIMPLIFY_H
+#define WESTON_REGION_SIMPLIFY_H
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <pixman.h>
+
+/* Cost model for region_simplify(). Uploading a box costs
+ * call_overhead plus its area times bytes_per_pixel, both in bytes.
+ */
+struct region_simplify_cost {
+	int bytes_per_pixel;
+	int call_overhead;
+	int max_boxes;
+};
+
+/* Cover 'region' with at most cost->max_boxes non-overlapping boxes,
+ * merging boxes whenever the extra bytes it costs to upload the merged
+ * box are cheaper than the call it saves. The boxes are written to
+ * 'boxes', which must have room for cost->max_boxes entries, and the
+ * number of boxes is returned.
+ */
+int
+region_simplify(pixman_region32_t *region,
+		const struct region_simplify_cost *cost,
+		pixman_box32_t *boxes);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif /* WESTON_REGION_SIMPLIFY_H */
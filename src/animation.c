@@ -150,6 +150,42 @@ handle_animation_surface_destroy(struct wl_listener *listener, void *data)
 	weston_surface_animation_destroy(animation);
 }
 
+/* Whether the surface is covered by opaque surfaces or outside of every
+ * output, both where it is drawn now and where it ends up once the
+ * animation is done.  Zooms and fades stay within that, slides move
+ * between the two.  Surfaces with a parent or other transforms than the
+ * animation's own are never taken as hidden. */
+static int
+weston_surface_animation_hidden(struct weston_surface_animation *animation)
+{
+	struct weston_surface *surface = animation->surface;
+	struct weston_compositor *ec = surface->compositor;
+	pixman_box32_t *extents, box;
+	int32_t x, y;
+
+	if (surface->geometry.parent ||
+	    surface->plane != &ec->primary_plane ||
+	    wl_list_length(&surface->geometry.transformation_list) != 2 ||
+	    !pixman_region32_not_empty(&surface->transform.boundingbox))
+		return 0;
+
+	x = surface->geometry.x + surface->transform.layer_x;
+	y = surface->geometry.y + surface->transform.layer_y;
+	extents = pixman_region32_extents(&surface->transform.boundingbox);
+	box.x1 = MIN(extents->x1, x);
+	box.y1 = MIN(extents->y1, y);
+	box.x2 = extents->x2;
+	if (box.x2 < x + surface->geometry.width)
+		box.x2 = x + surface->geometry.width;
+	box.y2 = extents->y2;
+	if (box.y2 < y + surface->geometry.height)
+		box.y2 = y + surface->geometry.height;
+
+	/* The clip the last repaint left would miss occluders that
+	 * went away since. */
+	return weston_surface_box_is_hidden(surface, &box);
+}
+
 static void
 weston_surface_animation_frame(struct weston_animation *base,
 			       struct weston_output *output, uint32_t msecs)
@@ -164,15 +200,26 @@ weston_surface_animation_frame(struct weston_animation *base,
 	weston_spring_update(&animation->spring, msecs);
 
 	if (weston_spring_done(&animation->spring)) {
+		/* Steps may have been skipped while hidden. */
+		if (animation->frame)
+			animation->frame(animation);
 		weston_surface_animation_destroy(animation);
 		return;
 	}
 
+	/* The spring keeps time, but nobody would see the step.  The
+	 * surface catches up on the first frame it shows again. */
+	if (base->frame_counter > 1 &&
+	    weston_surface_animation_hidden(animation))
+		return;
+
 	if (animation->frame)
 		animation->frame(animation);
 
+	/* Not worth batching: this only flags the surface and its
+	 * children, the transforms are recomputed once per frame when
+	 * the surface list is built. */
 	weston_surface_geometry_dirty(animation->surface);
-	weston_compositor_schedule_repaint(animation->surface->compositor);
 }
 
 static struct weston_surface_animation *
@@ -208,6 +255,7 @@ weston_surface_animation_run(struct weston_surface *surface,
 
 	wl_list_insert(&surface->output->animation_list,
 		       &animation->animation.link);
+	weston_output_schedule_repaint(surface->output);
 
 	return animation;
 }
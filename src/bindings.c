@@ -34,8 +34,64 @@ struct weston_binding {
 	void *handler;
 	void *data;
 	struct wl_list link;
+	struct wl_list hash_link;
 };
 
+/* Key, button and axis bindings are additionally hashed by code and
+ * modifier mask, so dispatch only looks at the bindings that can
+ * match.  Bindings with equal code and modifier stay in the order
+ * they were added. */
+#define BINDING_HASH_SIZE 64
+
+struct weston_binding_table {
+	struct wl_list key[BINDING_HASH_SIZE];
+	struct wl_list button[BINDING_HASH_SIZE];
+	struct wl_list axis[BINDING_HASH_SIZE];
+};
+
+static uint32_t
+binding_hash(uint32_t code, uint32_t modifier)
+{
+	return (code * 31 + modifier * 131) % BINDING_HASH_SIZE;
+}
+
+WL_EXPORT int
+weston_compositor_init_bindings(struct weston_compositor *compositor)
+{
+	struct weston_binding_table *table;
+	int i;
+
+	wl_list_init(&compositor->key_binding_list);
+	wl_list_init(&compositor->button_binding_list);
+	wl_list_init(&compositor->axis_binding_list);
+	wl_list_init(&compositor->debug_binding_list);
+
+	table = malloc(sizeof *table);
+	if (table == NULL)
+		return -1;
+
+	for (i = 0; i < BINDING_HASH_SIZE; i++) {
+		wl_list_init(&table->key[i]);
+		wl_list_init(&table->button[i]);
+		wl_list_init(&table->axis[i]);
+	}
+	compositor->binding_table = table;
+
+	return 0;
+}
+
+WL_EXPORT void
+weston_compositor_release_bindings(struct weston_compositor *compositor)
+{
+	weston_binding_list_destroy_all(&compositor->key_binding_list);
+	weston_binding_list_destroy_all(&compositor->button_binding_list);
+	weston_binding_list_destroy_all(&compositor->axis_binding_list);
+	weston_binding_list_destroy_all(&compositor->debug_binding_list);
+
+	free(compositor->binding_table);
+	compositor->binding_table = NULL;
+}
+
 static struct weston_binding *
 weston_compositor_add_binding(struct weston_compositor *compositor,
 			      uint32_t key, uint32_t button, uint32_t axis,
@@ -53,6 +109,7 @@ weston_compositor_add_binding(struct weston_compositor *compositor,
 	binding->modifier = modifier;
 	binding->handler = handler;
 	binding->data = data;
+	wl_list_init(&binding->hash_link);
 
 	return binding;
 }
@@ -71,6 +128,9 @@ weston_compositor_add_key_binding(struct weston_compositor *compositor,
 		return NULL;
 
 	wl_list_insert(compositor->key_binding_list.prev, &binding->link);
+	wl_list_insert(compositor->binding_table->
+		       key[binding_hash(key, modifier)].prev,
+		       &binding->hash_link);
 
 	return binding;
 }
@@ -89,6 +149,9 @@ weston_compositor_add_button_binding(struct weston_compositor *compositor,
 		return NULL;
 
 	wl_list_insert(compositor->button_binding_list.prev, &binding->link);
+	wl_list_insert(compositor->binding_table->
+		       button[binding_hash(button, modifier)].prev,
+		       &binding->hash_link);
 
 	return binding;
 }
@@ -107,6 +170,9 @@ weston_compositor_add_axis_binding(struct weston_compositor *compositor,
 		return NULL;
 
 	wl_list_insert(compositor->axis_binding_list.prev, &binding->link);
+	wl_list_insert(compositor->binding_table->
+		       axis[binding_hash(axis, modifier)].prev,
+		       &binding->hash_link);
 
 	return binding;
 }
@@ -121,6 +187,8 @@ weston_compositor_add_debug_binding(struct weston_compositor *compositor,
 
 	binding = weston_compositor_add_binding(compositor, key, 0, 0, 0,
 						handler, data);
+	if (binding == NULL)
+		return NULL;
 
 	wl_list_insert(compositor->debug_binding_list.prev, &binding->link);
 
@@ -131,6 +199,7 @@ WL_EXPORT void
 weston_binding_destroy(struct weston_binding *binding)
 {
 	wl_list_remove(&binding->link);
+	wl_list_remove(&binding->hash_link);
 	free(binding);
 }
 
@@ -212,11 +281,14 @@ weston_compositor_run_key_binding(struct weston_compositor *compositor,
 				  enum wl_keyboard_key_state state)
 {
 	struct weston_binding *b;
+	struct wl_list *bucket;
 
 	if (state == WL_KEYBOARD_KEY_STATE_RELEASED)
 		return;
 
-	wl_list_for_each(b, &compositor->key_binding_list, link) {
+	bucket = &compositor->binding_table->
+		key[binding_hash(key, seat->modifier_state)];
+	wl_list_for_each(b, bucket, hash_link) {
 		if (b->key == key && b->modifier == seat->modifier_state) {
 			weston_key_binding_handler_t handler = b->handler;
 			handler(seat, time, key, b->data);
@@ -238,11 +310,14 @@ weston_compositor_run_button_binding(struct weston_compositor *compositor,
 				     enum wl_pointer_button_state state)
 {
 	struct weston_binding *b;
+	struct wl_list *bucket;
 
 	if (state == WL_POINTER_BUTTON_STATE_RELEASED)
 		return;
 
-	wl_list_for_each(b, &compositor->button_binding_list, link) {
+	bucket = &compositor->binding_table->
+		button[binding_hash(button, seat->modifier_state)];
+	wl_list_for_each(b, bucket, hash_link) {
 		if (b->button == button && b->modifier == seat->modifier_state) {
 			weston_button_binding_handler_t handler = b->handler;
 			handler(seat, time, button, b->data);
@@ -257,8 +332,11 @@ weston_compositor_run_axis_binding(struct weston_compositor *compositor,
 				   wl_fixed_t value)
 {
 	struct weston_binding *b;
+	struct wl_list *bucket;
 
-	wl_list_for_each(b, &compositor->axis_binding_list, link) {
+	bucket = &compositor->binding_table->
+		axis[binding_hash(axis, seat->modifier_state)];
+	wl_list_for_each(b, bucket, hash_link) {
 		if (b->axis == axis && b->modifier == seat->modifier_state) {
 			weston_axis_binding_handler_t handler = b->handler;
 			handler(seat, time, axis, value, b->data);
@@ -27,18 +27,41 @@
 #include <linux/input.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <linux/falloc.h>
 
 #include "compositor.h"
+#include "../shared/os-compatibility.h"
+
+/* The persisted selection is kept in an unlinked file rather than on
+ * the heap.  Data moves from the source pipe into the file with splice
+ * and out to pasting clients with sendfile, without passing through
+ * compositor memory.  A selection larger than the configured limit is
+ * not persisted at all; it stays available only for as long as the
+ * client that offered it is around.
+ *
+ * A copy that is dropped before it is complete still reads its source
+ * to the end, so the writer never runs into a closed pipe.  Pastes
+ * already served from it get the rest of the data, with the file kept
+ * at most a chunk ahead of the slowest one and punched out behind it;
+ * with nobody left to serve, the data is thrown away. */
+#define CLIPBOARD_CHUNK_SIZE		(1024 * 1024)
+#define DEFAULT_CLIPBOARD_SIZE_LIMIT	(64 * 1024)	/* KiB */
 
 struct clipboard_source {
 	struct weston_data_source base;
-	struct wl_array contents;
 	struct clipboard *clipboard;
 	struct wl_event_source *event_source;
+	struct wl_list client_list;
 	uint32_t serial;
 	int refcount;
 	int fd;
+	int file_fd;
+	off_t size;
+	off_t trimmed;
+	int dropped;
 };
 
 struct clipboard {
@@ -46,9 +69,47 @@ struct clipboard {
 	struct wl_listener selection_listener;
 	struct wl_listener destroy_listener;
 	struct clipboard_source *source;
+	off_t size_limit;
+};
+
+struct clipboard_client {
+	struct wl_event_source *event_source;
+	struct wl_list link;
+	off_t offset;
+	struct clipboard_source *source;
+	int fd;
 };
 
 static void clipboard_client_create(struct clipboard_source *source, int fd);
+static void clipboard_source_unref(struct clipboard_source *source);
+
+static void
+clipboard_source_wake_clients(struct clipboard_source *source)
+{
+	struct clipboard_client *client;
+
+	wl_list_for_each(client, &source->client_list, link)
+		wl_event_source_fd_update(client->event_source,
+					  WL_EVENT_WRITABLE);
+}
+
+static void
+clipboard_source_stop_reading(struct clipboard_source *source)
+{
+	if (source->event_source == NULL)
+		return;
+
+	wl_event_source_remove(source->event_source);
+	close(source->fd);
+	source->event_source = NULL;
+
+	/* Let clients waiting for more data finish up. */
+	clipboard_source_wake_clients(source);
+
+	/* Only the reading kept a dropped copy around. */
+	if (source->dropped)
+		clipboard_source_unref(source);
+}
 
 static void
 clipboard_source_unref(struct clipboard_source *source)
@@ -59,44 +120,137 @@ clipboard_source_unref(struct clipboard_source *source)
 	if (source->refcount > 0)
 		return;
 
-	if (source->event_source) {
-		wl_event_source_remove(source->event_source);
-		close(source->fd);
-	}
+	clipboard_source_stop_reading(source);
+	close(source->file_fd);
 	wl_signal_emit(&source->base.destroy_signal,
 		       &source->base);
 	s = source->base.mime_types.data;
 	free(*s);
 	wl_array_release(&source->base.mime_types);
-	wl_array_release(&source->contents);
 	free(source);
 }
 
+static void
+clipboard_drop_source(struct clipboard *clipboard)
+{
+	struct clipboard_source *source = clipboard->source;
+
+	clipboard->source = NULL;
+	if (source->event_source)
+		source->dropped = 1;
+	else
+		clipboard_source_unref(source);
+}
+
+/* Punch out what every paste of a dropped copy has already sent and
+ * return the offset of the slowest one. */
+static off_t
+clipboard_source_trim(struct clipboard_source *source)
+{
+	struct clipboard_client *client;
+	off_t start = source->size;
+
+	wl_list_for_each(client, &source->client_list, link)
+		if (client->offset < start)
+			start = client->offset;
+
+	if (start > source->trimmed &&
+	    fallocate(source->file_fd,
+		      FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+		      source->trimmed, start - source->trimmed) == 0)
+		source->trimmed = start;
+
+	return start;
+}
+
+static ssize_t
+clipboard_source_discard(struct clipboard_source *source, size_t size)
+{
+	char buffer[4096];
+
+	if (size > sizeof buffer)
+		size = sizeof buffer;
+
+	return read(source->fd, buffer, size);
+}
+
+static ssize_t
+clipboard_source_fill(struct clipboard_source *source, size_t size)
+{
+	char buffer[4096];
+	loff_t offset = source->size;
+	ssize_t len;
+
+	len = splice(source->fd, NULL, source->file_fd, &offset, size,
+		     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (len >= 0 || errno != EINVAL)
+		return len;
+
+	/* The file system can't splice, copy by hand. */
+	if (size > sizeof buffer)
+		size = sizeof buffer;
+	len = read(source->fd, buffer, size);
+	if (len > 0 && pwrite(source->file_fd, buffer, len, offset) != len)
+		return -1;
+
+	return len;
+}
+
 static int
 clipboard_source_data(int fd, uint32_t mask, void *data)
 {
 	struct clipboard_source *source = data;
 	struct clipboard *clipboard = source->clipboard;
-	char *p;
-	int len, size;
-
-	if (source->contents.alloc - source->contents.size < 1024) {
-		wl_array_add(&source->contents, 1024);
-		source->contents.size -= 1024;
+	size_t size = CLIPBOARD_CHUNK_SIZE;
+	ssize_t len;
+	off_t ahead;
+
+	if (source->dropped) {
+		if (wl_list_empty(&source->client_list)) {
+			len = clipboard_source_discard(source, size);
+			if (len == 0 || (len < 0 && errno != EAGAIN))
+				clipboard_source_stop_reading(source);
+			return 1;
+		}
+
+		/* Wait for the slowest paste before reading further
+		 * ahead of it than a chunk. */
+		ahead = source->size - clipboard_source_trim(source);
+		if (ahead >= (off_t) size) {
+			wl_event_source_fd_update(source->event_source, 0);
+			return 1;
+		}
+		size -= ahead;
+	} else if (clipboard->size_limit > 0 &&
+		   clipboard->size_limit + 1 - source->size < (off_t) size) {
+		/* Ask for one byte more than the limit allows, so a
+		 * selection of exactly the limit still fits. */
+		size = clipboard->size_limit + 1 - source->size;
 	}
 
-	p = source->contents.data + source->contents.size;
-	size = source->contents.alloc - source->contents.size;
-	len = read(fd, p, size);
+	len = clipboard_source_fill(source, size);
 	if (len == 0) {
-		wl_event_source_remove(source->event_source);
-		close(fd);
-		source->event_source = NULL;
+		clipboard_source_stop_reading(source);
+	} else if (len < 0 && errno == EAGAIN) {
+		/* spurious wakeup */
 	} else if (len < 0) {
-		clipboard_source_unref(source);
-		clipboard->source = NULL;
+		/* Pastes in progress end where the data does. */
+		if (!source->dropped)
+			clipboard_drop_source(clipboard);
+		clipboard_source_stop_reading(source);
+	} else if (source->dropped) {
+		source->size += len;
+		clipboard_source_wake_clients(source);
 	} else {
-		source->contents.size += len;
+		source->size += len;
+		if (clipboard->size_limit > 0 &&
+		    source->size > clipboard->size_limit) {
+			weston_log("clipboard: selection larger than %lld "
+				   "bytes, not keeping a copy\n",
+				   (long long) clipboard->size_limit);
+			clipboard_drop_source(clipboard);
+		}
+		clipboard_source_wake_clients(source);
 	}
 
 	return 1;
@@ -116,8 +270,9 @@ clipboard_source_send(struct weston_data_source *base,
 		container_of(base, struct clipboard_source, base);
 	char **s;
 
+	/* A dropped copy no longer has the start of the data. */
 	s = source->base.mime_types.data;
-	if (strcmp(mime_type, s[0]) == 0)
+	if (strcmp(mime_type, s[0]) == 0 && !source->dropped)
 		clipboard_client_create(source, fd);
 	else
 		close(fd);
@@ -141,8 +296,8 @@ clipboard_source_create(struct clipboard *clipboard,
 	if (source == NULL)
 		return NULL;
 
-	wl_array_init(&source->contents);
 	wl_array_init(&source->base.mime_types);
+	wl_list_init(&source->client_list);
 	source->base.resource = NULL;
 	source->base.accept = clipboard_source_accept;
 	source->base.send = clipboard_source_send;
@@ -151,6 +306,14 @@ clipboard_source_create(struct clipboard *clipboard,
 	source->refcount = 1;
 	source->clipboard = clipboard;
 	source->serial = serial;
+	source->fd = fd;
+	source->size = 0;
+	source->trimmed = 0;
+	source->dropped = 0;
+
+	source->file_fd = os_create_anonymous_file(0);
+	if (source->file_fd < 0)
+		goto err_file;
 
 	s = wl_array_add(&source->base.mime_types, sizeof *s);
 	if (s == NULL)
@@ -171,36 +334,80 @@ clipboard_source_create(struct clipboard *clipboard,
  err_strdup:
 	wl_array_release(&source->base.mime_types);
  err_add:
+	close(source->file_fd);
+ err_file:
 	free(source);
 
 	return NULL;
 }
 
-struct clipboard_client {
-	struct wl_event_source *event_source;
-	size_t offset;
-	struct clipboard_source *source;
-};
+/* A dropped copy may have stopped reading to let its slowest paste
+ * catch up. */
+static void
+clipboard_source_resume(struct clipboard_source *source)
+{
+	if (source->dropped && source->event_source)
+		wl_event_source_fd_update(source->event_source,
+					  WL_EVENT_READABLE);
+}
 
-static int
-clipboard_client_data(int fd, uint32_t mask, void *data)
+static void
+clipboard_client_destroy(struct clipboard_client *client)
 {
-	struct clipboard_client *client = data;
-	char *p;
-	size_t size;
-	int len;
+	close(client->fd);
+	wl_event_source_remove(client->event_source);
+	wl_list_remove(&client->link);
+	clipboard_source_resume(client->source);
+	clipboard_source_unref(client->source);
+	free(client);
+}
 
-	size = client->source->contents.size;
-	p = client->source->contents.data;
-	len = write(fd, p + client->offset, size - client->offset);
+static ssize_t
+clipboard_client_send(struct clipboard_client *client, size_t size)
+{
+	char buffer[4096];
+	ssize_t len;
+
+	len = sendfile(client->fd, client->source->file_fd,
+		       &client->offset, size);
+	if (len >= 0 || errno != EINVAL)
+		return len;
+
+	if (size > sizeof buffer)
+		size = sizeof buffer;
+	len = pread(client->source->file_fd, buffer, size, client->offset);
+	if (len <= 0)
+		return -1;
+	len = write(client->fd, buffer, len);
 	if (len > 0)
 		client->offset += len;
 
-	if (client->offset == size || len <= 0) {
-		close(fd);
-		wl_event_source_remove(client->event_source);
-		clipboard_source_unref(client->source);
-		free(client);
+	return len;
+}
+
+static int
+clipboard_client_data(int fd, uint32_t mask, void *data)
+{
+	struct clipboard_client *client = data;
+	struct clipboard_source *source = client->source;
+	ssize_t len = 0;
+
+	if (client->offset < source->size) {
+		len = clipboard_client_send(client,
+					    source->size - client->offset);
+		if (len < 0 && errno == EAGAIN)
+			return 1;
+		if (len > 0)
+			clipboard_source_resume(source);
+	}
+
+	if (len < 0 ||
+	    (client->offset == source->size && !source->event_source)) {
+		clipboard_client_destroy(client);
+	} else if (client->offset == source->size) {
+		/* Caught up with a selection that is still being read,
+		 * wait until there is more. */
+		wl_event_source_fd_update(client->event_source, 0);
 	}
 
 	return 1;
@@ -215,13 +422,26 @@ clipboard_client_create(struct clipboard_source *source, int fd)
 		wl_display_get_event_loop(seat->compositor->wl_display);
 
 	client = malloc(sizeof *client);
+	if (client == NULL) {
+		close(fd);
+		return;
+	}
 
+	fcntl(fd, F_SETFL, O_WRONLY | O_NONBLOCK);
+	client->fd = fd;
 	client->offset = 0;
 	client->source = source;
-	source->refcount++;
 	client->event_source =
 		wl_event_loop_add_fd(loop, fd, WL_EVENT_WRITABLE,
 				     clipboard_client_data, client);
+	if (client->event_source == NULL) {
+		close(fd);
+		free(client);
+		return;
+	}
+
+	source->refcount++;
+	wl_list_insert(&source->client_list, &client->link);
 }
 
 static void
@@ -246,14 +466,13 @@ clipboard_set_selection(struct wl_listener *listener, void *data)
 	}
 
 	if (clipboard->source)
-		clipboard_source_unref(clipboard->source);
-
-	clipboard->source = NULL;
+		clipboard_drop_source(clipboard);
 
 	mime_types = source->mime_types.data;
 
 	if (pipe2(p, O_CLOEXEC) == -1)
 		return;
+	fcntl(p[0], F_SETFL, O_RDONLY | O_NONBLOCK);
 
 	source->send(source, mime_types[0], p[1]);
 
@@ -282,12 +501,20 @@ struct clipboard *
 clipboard_create(struct weston_seat *seat)
 {
 	struct clipboard *clipboard;
+	struct weston_config_section *section;
+	uint32_t limit;
 
 	clipboard = zalloc(sizeof *clipboard);
 	if (clipboard == NULL)
 		return NULL;
 
 	clipboard->seat = seat;
+
+	section = weston_config_get_section(seat->compositor->config,
+					    "core", NULL, NULL);
+	weston_config_section_get_uint(section, "clipboard-size-limit",
+				       &limit, DEFAULT_CLIPBOARD_SIZE_LIMIT);
+	clipboard->size_limit = (off_t) limit * 1024;
 	clipboard->selection_listener.notify = clipboard_set_selection;
 	clipboard->destroy_listener.notify = clipboard_destroy;
 
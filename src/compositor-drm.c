@@ -440,8 +440,8 @@ drm_output_prepare_scanout_surface(struct weston_output *_output,
 	struct gbm_bo *bo;
 	uint32_t format;
 
-	if (es->geometry.x != output->base.x ||
-	    es->geometry.y != output->base.y ||
+	if (es->transform.x != output->base.x ||
+	    es->transform.y != output->base.y ||
 	    buffer == NULL || c->gbm == NULL ||
 	    buffer->width != output->base.current->width ||
 	    buffer->height != output->base.current->height ||
@@ -923,6 +923,46 @@ drm_output_prepare_cursor_surface(struct weston_output *output_base,
 	return &output->cursor_plane;
 }
 
+static int
+drm_output_move_cursor_plane(struct drm_output *output,
+			     struct weston_surface *es)
+{
+	struct drm_compositor *c =
+		(struct drm_compositor *) output->base.compositor;
+	int x, y;
+
+	x = (es->transform.x - output->base.x) * output->base.scale;
+	y = (es->transform.y - output->base.y) * output->base.scale;
+	if (output->cursor_plane.x == x && output->cursor_plane.y == y)
+		return 0;
+
+	if (drmModeMoveCursor(c->drm.fd, output->crtc_id, x, y)) {
+		weston_log("failed to move cursor: %m\n");
+		c->cursors_are_broken = 1;
+		return -1;
+	}
+
+	output->cursor_plane.x = x;
+	output->cursor_plane.y = y;
+
+	return 0;
+}
+
+static int
+drm_output_move_cursor(struct weston_output *output_base,
+		       struct weston_surface *es)
+{
+	struct drm_output *output = (struct drm_output *) output_base;
+	struct drm_compositor *c =
+		(struct drm_compositor *) output->base.compositor;
+
+	if (es->plane != &output->cursor_plane || c->cursors_are_broken ||
+	    !c->base.focus)
+		return -1;
+
+	return drm_output_move_cursor_plane(output, es);
+}
+
 static void
 drm_output_set_cursor(struct drm_output *output)
 {
@@ -933,7 +973,7 @@ drm_output_set_cursor(struct drm_output *output)
 	struct gbm_bo *bo;
 	uint32_t buf[64 * 64];
 	unsigned char *s;
-	int i, x, y;
+	int i;
 
 	output->cursor_surface = NULL;
 	if (es == NULL) {
@@ -965,17 +1005,7 @@ drm_output_set_cursor(struct drm_output *output)
 		}
 	}
 
-	x = (es->geometry.x - output->base.x) * output->base.scale;
-	y = (es->geometry.y - output->base.y) * output->base.scale;
-	if (output->cursor_plane.x != x || output->cursor_plane.y != y) {
-		if (drmModeMoveCursor(c->drm.fd, output->crtc_id, x, y)) {
-			weston_log("failed to move cursor: %m\n");
-			c->cursors_are_broken = 1;
-		}
-
-		output->cursor_plane.x = x;
-		output->cursor_plane.y = y;
-	}
+	drm_output_move_cursor_plane(output, es);
 }
 
 static void
@@ -1937,6 +1967,7 @@ create_output_for_connector(struct drm_compositor *ec,
 	output->base.assign_planes = drm_assign_planes;
 	output->base.set_dpms = drm_set_dpms;
 	output->base.switch_mode = drm_output_switch_mode;
+	output->base.move_cursor = drm_output_move_cursor;
 
 	output->base.gamma_size = output->original_crtc->gamma_size;
 	output->base.set_gamma = drm_output_set_gamma;
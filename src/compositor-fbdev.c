@@ -502,6 +502,7 @@ fbdev_output_create(struct fbdev_compositor *compositor,
 	output->base.set_backlight = NULL;
 	output->base.set_dpms = NULL;
 	output->base.switch_mode = NULL;
+	output->base.move_cursor = NULL;
 
 	/* only one static mode in list */
 	output->mode.flags =
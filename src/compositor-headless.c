@@ -23,21 +23,34 @@
 
 #include "config.h"
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
 
 #include "compositor.h"
+#ifdef BUILD_HEADLESS_REPLAY
+#include "evdev.h"
+#endif
 
 struct headless_compositor {
 	struct weston_compositor base;
 	struct weston_seat fake_seat;
+#ifdef BUILD_HEADLESS_REPLAY
+	struct evdev_replay *replay;
+#endif
 };
 
 struct headless_output {
 	struct weston_output base;
 	struct weston_mode mode;
 	struct wl_event_source *finish_frame_timer;
+
+	/* Stand-in for a hardware cursor plane, so the cursor fast path
+	 * can be exercised without real hardware. */
+	struct weston_plane cursor_plane;
+	uint32_t cursor_moves;
+	uint32_t repaints;
 };
 
 
@@ -72,16 +85,82 @@ headless_output_repaint(struct weston_output *output_base,
 	pixman_region32_subtract(&ec->primary_plane.damage,
 				 &ec->primary_plane.damage, damage);
 
+	/* There is no cursor image to update, but consume the damage
+	 * like the drm backend does when it uploads a new one. */
+	if (pixman_region32_not_empty(&output->cursor_plane.damage)) {
+		pixman_region32_fini(&output->cursor_plane.damage);
+		pixman_region32_init(&output->cursor_plane.damage);
+	}
+
 	wl_event_source_timer_update(output->finish_frame_timer, 16);
+	output->repaints++;
 
 	return;
 }
 
+static int
+surface_is_pointer_sprite(struct weston_compositor *ec,
+			  struct weston_surface *es)
+{
+	struct weston_seat *seat;
+
+	wl_list_for_each(seat, &ec->seat_list, link)
+		if (seat->pointer && seat->pointer->sprite == es)
+			return 1;
+
+	return 0;
+}
+
+static void
+headless_output_assign_planes(struct weston_output *output_base)
+{
+	struct headless_output *output = (struct headless_output *) output_base;
+	struct weston_compositor *ec = output->base.compositor;
+	struct weston_surface *es, *next;
+	struct weston_plane *plane;
+	int first = 1;
+
+	wl_list_for_each_safe(es, next, &ec->surface_list, link) {
+		plane = &ec->primary_plane;
+		if (first && es->buffer_ref.buffer &&
+		    surface_is_pointer_sprite(ec, es) &&
+		    es->output_mask == (1u << output->base.id) &&
+		    es->geometry.width <= 64 && es->geometry.height <= 64) {
+			plane = &output->cursor_plane;
+			plane->x = es->transform.x - output->base.x;
+			plane->y = es->transform.y - output->base.y;
+		}
+		first = 0;
+
+		weston_surface_move_to_plane(es, plane);
+	}
+}
+
+static int
+headless_output_move_cursor(struct weston_output *output_base,
+			    struct weston_surface *es)
+{
+	struct headless_output *output = (struct headless_output *) output_base;
+
+	if (es->plane != &output->cursor_plane)
+		return -1;
+
+	output->cursor_plane.x = es->transform.x - output->base.x;
+	output->cursor_plane.y = es->transform.y - output->base.y;
+	output->cursor_moves++;
+
+	return 0;
+}
+
 static void
 headless_output_destroy(struct weston_output *output_base)
 {
 	struct headless_output *output = (struct headless_output *) output_base;
 
+	weston_log("headless: %u cursor plane moves, %u repaints\n",
+		   output->cursor_moves, output->repaints);
+
+	weston_plane_release(&output->cursor_plane);
 	wl_event_source_remove(output->finish_frame_timer);
 	free(output);
 
@@ -124,10 +203,14 @@ headless_compositor_create_output(struct headless_compositor *c,
 	output->base.start_repaint_loop = headless_output_start_repaint_loop;
 	output->base.repaint = headless_output_repaint;
 	output->base.destroy = headless_output_destroy;
-	output->base.assign_planes = NULL;
+	output->base.assign_planes = headless_output_assign_planes;
 	output->base.set_backlight = NULL;
 	output->base.set_dpms = NULL;
 	output->base.switch_mode = NULL;
+	output->base.move_cursor = headless_output_move_cursor;
+
+	weston_plane_init(&output->cursor_plane, 0, 0);
+	weston_compositor_stack_plane(&c->base, &output->cursor_plane, NULL);
 
 	wl_list_insert(c->base.output_list.prev, &output->base.link);
 
@@ -146,6 +229,10 @@ headless_destroy(struct weston_compositor *ec)
 
 	ec->renderer->destroy(ec);
 
+#ifdef BUILD_HEADLESS_REPLAY
+	if (c->replay)
+		evdev_replay_destroy(c->replay);
+#endif
 	weston_seat_release(&c->fake_seat);
 	weston_compositor_shutdown(ec);
 
@@ -155,6 +242,7 @@ headless_destroy(struct weston_compositor *ec)
 static struct weston_compositor *
 headless_compositor_create(struct wl_display *display,
 			   int width, int height, const char *display_name,
+			   const char *replay, double replay_speed,
 			   int *argc, char *argv[],
 			   struct weston_config *config)
 {
@@ -178,8 +266,23 @@ headless_compositor_create(struct wl_display *display,
 	if (noop_renderer_init(&c->base) < 0)
 		goto err_compositor;
 
+	if (replay) {
+#ifdef BUILD_HEADLESS_REPLAY
+		c->replay = evdev_replay_create(&c->fake_seat,
+						replay, replay_speed);
+		if (c->replay == NULL)
+			goto err_renderer;
+#else
+		weston_log("headless backend built without input replay\n");
+		goto err_renderer;
+#endif
+	}
+
 	return &c->base;
 
+err_renderer:
+	c->base.renderer->destroy(&c->base);
+
 err_compositor:
 	weston_compositor_shutdown(&c->base);
 err_free:
@@ -193,15 +296,30 @@ backend_init(struct wl_display *display, int *argc, char *argv[],
 {
 	int width = 1024, height = 640;
 	char *display_name = NULL;
+	char *replay = NULL, *replay_speed = NULL, *end;
+	double speed = 1.0;
 
 	const struct weston_option headless_options[] = {
 		{ WESTON_OPTION_INTEGER, "width", 0, &width },
 		{ WESTON_OPTION_INTEGER, "height", 0, &height },
+		{ WESTON_OPTION_STRING, "replay", 0, &replay },
+		{ WESTON_OPTION_STRING, "replay-speed", 0, &replay_speed },
 	};
 
 	parse_options(headless_options,
 		      ARRAY_LENGTH(headless_options), argc, argv);
 
+	if (replay_speed) {
+		errno = 0;
+		speed = strtod(replay_speed, &end);
+		if (errno != 0 || end == replay_speed || *end != '\0' ||
+		    !(speed > 0.0)) {
+			weston_log("invalid --replay-speed: %s\n",
+				   replay_speed);
+			return NULL;
+		}
+	}
+
 	return headless_compositor_create(display, width, height, display_name,
-					  argc, argv, config);
+					  replay, speed, argc, argv, config);
 }
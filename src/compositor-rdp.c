@@ -497,6 +497,7 @@ rdp_compositor_create_output(struct rdp_compositor *c, int width, int height,
 	output->base.set_backlight = NULL;
 	output->base.set_dpms = NULL;
 	output->base.switch_mode = rdp_switch_mode;
+	output->base.move_cursor = NULL;
 	c->output = output;
 
 	wl_list_insert(c->base.output_list.prev, &output->base.link);
@@ -766,7 +767,7 @@ xf_mouseEvent(rdpInput *input, UINT16 flags, UINT16 x, UINT16 y) {
 		if(x < output->base.width && y < output->base.height) {
 			wl_x = wl_fixed_from_int((int)x);
 			wl_y = wl_fixed_from_int((int)y);
-			notify_motion_absolute(&peerContext->item.seat, weston_compositor_get_time(),
+			notify_motion_absolute(&peerContext->item.seat, weston_compositor_get_time_usec(),
 					wl_x, wl_y);
 		}
 	}
@@ -779,7 +780,7 @@ xf_mouseEvent(rdpInput *input, UINT16 flags, UINT16 x, UINT16 y) {
 		button = BTN_MIDDLE;
 
 	if(button) {
-		notify_button(&peerContext->item.seat, weston_compositor_get_time(), button,
+		notify_button(&peerContext->item.seat, weston_compositor_get_time_usec(), button,
 			(flags & PTR_FLAGS_DOWN) ? WL_POINTER_BUTTON_STATE_PRESSED : WL_POINTER_BUTTON_STATE_RELEASED
 		);
 	}
@@ -795,7 +796,7 @@ xf_mouseEvent(rdpInput *input, UINT16 flags, UINT16 x, UINT16 y) {
 		if (flags & PTR_FLAGS_WHEEL_NEGATIVE)
 			axis = -axis;
 
-		notify_axis(&peerContext->item.seat, weston_compositor_get_time(),
+		notify_axis(&peerContext->item.seat, weston_compositor_get_time_usec(),
 					    WL_POINTER_AXIS_VERTICAL_SCROLL,
 					    axis);
 	}
@@ -811,7 +812,7 @@ xf_extendedMouseEvent(rdpInput *input, UINT16 flags, UINT16 x, UINT16 y) {
 	if(x < output->base.width && y < output->base.height) {
 		wl_x = wl_fixed_from_int((int)x);
 		wl_y = wl_fixed_from_int((int)y);
-		notify_motion_absolute(&peerContext->item.seat, weston_compositor_get_time(),
+		notify_motion_absolute(&peerContext->item.seat, weston_compositor_get_time_usec(),
 				wl_x, wl_y);
 	}
 }
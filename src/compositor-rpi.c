@@ -353,6 +353,7 @@ rpi_output_create(struct rpi_compositor *compositor, uint32_t transform)
 	output->base.set_backlight = NULL;
 	output->base.set_dpms = NULL;
 	output->base.switch_mode = NULL;
+	output->base.move_cursor = NULL;
 
 	/* XXX: use tvservice to get information from and control the
 	 * HDMI and SDTV outputs. See:
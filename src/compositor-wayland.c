@@ -303,6 +303,7 @@ wayland_compositor_create_output(struct wayland_compositor *c,
 	output->base.set_backlight = NULL;
 	output->base.set_dpms = NULL;
 	output->base.switch_mode = NULL;
+	output->base.move_cursor = NULL;
 
 	wl_list_insert(c->base.output_list.prev, &output->base.link);
 
@@ -445,7 +446,7 @@ input_handle_motion(void *data, struct wl_pointer *pointer,
 
 	check_focus(input, x, y);
 	if (input->focus)
-		notify_motion(&input->base, time,
+		notify_motion(&input->base, (uint64_t) time * 1000,
 			      x - wl_fixed_from_int(c->border.left) -
 			      input->base.pointer->x,
 			      y - wl_fixed_from_int(c->border.top) -
@@ -460,7 +461,7 @@ input_handle_button(void *data, struct wl_pointer *pointer,
 	struct wayland_input *input = data;
 	enum wl_pointer_button_state state = state_w;
 
-	notify_button(&input->base, time, button, state);
+	notify_button(&input->base, (uint64_t) time * 1000, button, state);
 }
 
 static void
@@ -469,7 +470,7 @@ input_handle_axis(void *data, struct wl_pointer *pointer,
 {
 	struct wayland_input *input = data;
 
-	notify_axis(&input->base, time, axis, value);
+	notify_axis(&input->base, (uint64_t) time * 1000, axis, value);
 }
 
 static const struct wl_pointer_listener pointer_listener = {
@@ -891,6 +891,7 @@ x11_compositor_create_output(struct x11_compositor *c, int x, int y,
 	output->base.set_backlight = NULL;
 	output->base.set_dpms = NULL;
 	output->base.switch_mode = NULL;
+	output->base.move_cursor = NULL;
 	output->base.current = &output->mode;
 	output->base.origin = output->base.current;
 	output->base.make = "xwayland";
@@ -1023,35 +1024,35 @@ x11_compositor_deliver_button_event(struct x11_compositor *c,
 		 * steps. Therefore move the axis by some pixels every step. */
 		if (state)
 			notify_axis(&c->core_seat,
-				    weston_compositor_get_time(),
+				    weston_compositor_get_time_usec(),
 				    WL_POINTER_AXIS_VERTICAL_SCROLL,
 				    -DEFAULT_AXIS_STEP_DISTANCE);
 		return;
 	case 5:
 		if (state)
 			notify_axis(&c->core_seat,
-				    weston_compositor_get_time(),
+				    weston_compositor_get_time_usec(),
 				    WL_POINTER_AXIS_VERTICAL_SCROLL,
 				    DEFAULT_AXIS_STEP_DISTANCE);
 		return;
 	case 6:
 		if (state)
 			notify_axis(&c->core_seat,
-				    weston_compositor_get_time(),
+				    weston_compositor_get_time_usec(),
 				    WL_POINTER_AXIS_HORIZONTAL_SCROLL,
 				    -DEFAULT_AXIS_STEP_DISTANCE);
 		return;
 	case 7:
 		if (state)
 			notify_axis(&c->core_seat,
-				    weston_compositor_get_time(),
+				    weston_compositor_get_time_usec(),
 				    WL_POINTER_AXIS_HORIZONTAL_SCROLL,
 				    DEFAULT_AXIS_STEP_DISTANCE);
 		return;
 	}
 
 	notify_button(&c->core_seat,
-		      weston_compositor_get_time(), button,
+		      weston_compositor_get_time_usec(), button,
 		      state ? WL_POINTER_BUTTON_STATE_PRESSED :
 			      WL_POINTER_BUTTON_STATE_RELEASED);
 }
@@ -1072,7 +1073,7 @@ x11_compositor_deliver_motion_event(struct x11_compositor *c,
 					   motion_notify->event_x,
 					   motion_notify->event_y, &x, &y);
 
-	notify_motion(&c->core_seat, weston_compositor_get_time(),
+	notify_motion(&c->core_seat, weston_compositor_get_time_usec(),
 		      x - c->prev_x, y - c->prev_y);
 
 	c->prev_x = x;
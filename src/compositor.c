@@ -358,8 +358,8 @@ weston_surface_to_global_float(struct weston_surface *surface,
 		*x = v.f[0] / v.f[3];
 		*y = v.f[1] / v.f[3];
 	} else {
-		*x = sx + surface->geometry.x;
-		*y = sy + surface->geometry.y;
+		*x = sx + surface->transform.x;
+		*y = sy + surface->transform.y;
 	}
 }
 
@@ -484,12 +484,25 @@ WL_EXPORT void
 weston_surface_move_to_plane(struct weston_surface *surface,
 			     struct weston_plane *plane)
 {
+	pixman_region32_t damage;
+
 	if (surface->plane == plane)
 		return;
 
 	weston_surface_damage_below(surface);
 	surface->plane = plane;
-	weston_surface_damage(surface);
+
+	/* Only where the surface is composited changes, not its
+	 * contents. Damage the new plane directly instead of the
+	 * surface, so that the renderer does not reupload the whole
+	 * texture when the surface returns to the primary plane. */
+	pixman_region32_init(&damage);
+	pixman_region32_copy(&damage, &surface->transform.boundingbox);
+	pixman_region32_translate(&damage, -plane->x, -plane->y);
+	pixman_region32_union(&plane->damage, &plane->damage, &damage);
+	pixman_region32_fini(&damage);
+
+	weston_surface_schedule_repaint(surface);
 }
 
 WL_EXPORT void
@@ -621,21 +634,25 @@ weston_surface_update_transform_disable(struct weston_surface *surface)
 	/* round off fractions when not transformed */
 	surface->geometry.x = roundf(surface->geometry.x);
 	surface->geometry.y = roundf(surface->geometry.y);
+	surface->transform.x =
+		surface->geometry.x + surface->transform.layer_x;
+	surface->transform.y =
+		surface->geometry.y + surface->transform.layer_y;
 
 	/* Otherwise identity matrix, but with x and y translation. */
 	surface->transform.position.matrix.type = WESTON_MATRIX_TRANSFORM_TRANSLATE;
-	surface->transform.position.matrix.d[12] = surface->geometry.x;
-	surface->transform.position.matrix.d[13] = surface->geometry.y;
+	surface->transform.position.matrix.d[12] = surface->transform.x;
+	surface->transform.position.matrix.d[13] = surface->transform.y;
 
 	surface->transform.matrix = surface->transform.position.matrix;
 
 	surface->transform.inverse = surface->transform.position.matrix;
-	surface->transform.inverse.d[12] = -surface->geometry.x;
-	surface->transform.inverse.d[13] = -surface->geometry.y;
+	surface->transform.inverse.d[12] = -surface->transform.x;
+	surface->transform.inverse.d[13] = -surface->transform.y;
 
 	pixman_region32_init_rect(&surface->transform.boundingbox,
-				  surface->geometry.x,
-				  surface->geometry.y,
+				  surface->transform.x,
+				  surface->transform.y,
 				  surface->geometry.width,
 				  surface->geometry.height);
 
@@ -643,8 +660,8 @@ weston_surface_update_transform_disable(struct weston_surface *surface)
 		pixman_region32_copy(&surface->transform.opaque,
 				     &surface->opaque);
 		pixman_region32_translate(&surface->transform.opaque,
-					  surface->geometry.x,
-					  surface->geometry.y);
+					  surface->transform.x,
+					  surface->transform.y);
 	}
 }
 
@@ -658,10 +675,18 @@ weston_surface_update_transform_enable(struct weston_surface *surface)
 
 	surface->transform.enabled = 1;
 
+	/* A child moves with its parent's layer through the parent. */
+	surface->transform.x = surface->geometry.x;
+	surface->transform.y = surface->geometry.y;
+	if (!parent) {
+		surface->transform.x += surface->transform.layer_x;
+		surface->transform.y += surface->transform.layer_y;
+	}
+
 	/* Otherwise identity matrix, but with x and y translation. */
 	surface->transform.position.matrix.type = WESTON_MATRIX_TRANSFORM_TRANSLATE;
-	surface->transform.position.matrix.d[12] = surface->geometry.x;
-	surface->transform.position.matrix.d[13] = surface->geometry.y;
+	surface->transform.position.matrix.d[12] = surface->transform.x;
+	surface->transform.position.matrix.d[13] = surface->transform.y;
 
 	weston_matrix_init(matrix);
 	wl_list_for_each(tform, &surface->geometry.transformation_list, link)
@@ -780,8 +805,8 @@ weston_surface_from_global_float(struct weston_surface *surface,
 		*sx = v.f[0] / v.f[3];
 		*sy = v.f[1] / v.f[3];
 	} else {
-		*sx = x - surface->geometry.x;
-		*sy = y - surface->geometry.y;
+		*sx = x - surface->transform.x;
+		*sy = y - surface->transform.y;
 	}
 }
 
@@ -851,6 +876,40 @@ weston_surface_set_position(struct weston_surface *surface,
 	weston_surface_geometry_dirty(surface);
 }
 
+/* Fast path for moving a surface that sits on a hardware cursor plane.
+ * If only its position changes and it stays the topmost surface on the
+ * same single output, the backend moves its plane directly and the
+ * move needs no repaint.  Returns 0 if the caller must fall back to
+ * weston_surface_set_position() and a repaint. */
+WL_EXPORT int
+weston_surface_move_cursor(struct weston_surface *surface, float x, float y)
+{
+	struct weston_compositor *ec = surface->compositor;
+	struct weston_output *output = surface->output;
+	uint32_t output_mask = surface->output_mask;
+
+	if (output == NULL || output->move_cursor == NULL)
+		return 0;
+	if (ec->state == WESTON_COMPOSITOR_SLEEPING ||
+	    ec->state == WESTON_COMPOSITOR_OFFSCREEN)
+		return 0;
+	if (surface->plane == &ec->primary_plane ||
+	    output_mask != (1u << output->id) ||
+	    ec->surface_list.next != &surface->link ||
+	    surface->geometry.parent != NULL)
+		return 0;
+
+	weston_surface_set_position(surface, x, y);
+	weston_surface_update_transform(surface);
+
+	if (surface->output != output ||
+	    surface->output_mask != output_mask ||
+	    output->move_cursor(output, surface) < 0)
+		return 0;
+
+	return 1;
+}
+
 static void
 transform_parent_handle_parent_destroy(struct wl_listener *listener,
 				       void *data)
@@ -930,14 +989,51 @@ weston_surface_buffer_height(struct weston_surface *surface)
 	return height / surface->buffer_scale;
 }
 
+/* The compositor clock is CLOCK_MONOTONIC, the same clock evdev
+ * devices are asked to stamp their events with. Millisecond times, as
+ * sent to clients, wrap around. */
 WL_EXPORT uint32_t
 weston_compositor_get_time(void)
 {
-       struct timeval tv;
+	return weston_compositor_get_time_usec() / 1000;
+}
+
+WL_EXPORT uint64_t
+weston_compositor_get_time_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Startup tracing: each phase on the way to the first frame on screen
+ * is logged with the time since main() started and the time it took.
+ * Marks come from the main thread only. */
+static struct {
+	uint64_t start, last;
+	int painted, done;
+} startup;
+
+WL_EXPORT void
+weston_startup_mark(const char *fmt, ...)
+{
+	uint64_t now = weston_compositor_get_time_usec();
+	char phase[128];
+	va_list ap;
+
+	if (startup.done)
+		return;
 
-       gettimeofday(&tv, NULL);
+	va_start(ap, fmt);
+	vsnprintf(phase, sizeof phase, fmt, ap);
+	va_end(ap);
 
-       return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+	weston_log("startup: %s at %.1f ms (+%.1f ms)\n", phase,
+		   (now - startup.start) / 1000.0,
+		   (now - startup.last) / 1000.0);
+	startup.last = now;
 }
 
 WL_EXPORT struct weston_surface *
@@ -995,12 +1091,6 @@ weston_surface_unmap(struct weston_surface *surface)
 	weston_surface_schedule_repaint(surface);
 }
 
-struct weston_frame_callback {
-	struct wl_resource *resource;
-	struct wl_list link;
-};
-
-
 WL_EXPORT void
 weston_surface_destroy(struct weston_surface *surface)
 {
@@ -1192,8 +1282,8 @@ surface_accumulate_damage(struct weston_surface *surface,
 					  -surface->plane->y);
 	} else {
 		pixman_region32_translate(&surface->damage,
-					  surface->geometry.x - surface->plane->x,
-					  surface->geometry.y - surface->plane->y);
+					  surface->transform.x - surface->plane->x,
+					  surface->transform.y - surface->plane->y);
 	}
 
 	pixman_region32_subtract(&surface->damage, &surface->damage, opaque);
@@ -1204,14 +1294,120 @@ surface_accumulate_damage(struct weston_surface *surface,
 	pixman_region32_union(opaque, opaque, &surface->transform.opaque);
 }
 
+/* Whether any part of the box, in global coordinates, is left
+ * uncovered by the clip inside the output. */
+static int
+box_is_visible(pixman_box32_t *box, pixman_region32_t *clip,
+	       struct weston_output *output)
+{
+	if (pixman_region32_contains_rectangle(&output->region,
+					       box) == PIXMAN_REGION_OUT)
+		return 0;
+
+	return pixman_region32_contains_rectangle(clip,
+						  box) != PIXMAN_REGION_IN;
+}
+
+/* Whether any part of the surface on the primary plane is left
+ * uncovered by the opaque surfaces above it, inside the output. */
+static int
+surface_is_visible(struct weston_surface *surface,
+		   struct weston_output *output)
+{
+	if (!pixman_region32_not_empty(&surface->transform.boundingbox))
+		return 0;
+
+	return box_is_visible(
+		pixman_region32_extents(&surface->transform.boundingbox),
+		&surface->clip, output);
+}
+
+static int
+surface_moved_since_update(struct weston_surface *surface,
+			   struct weston_layer *layer)
+{
+	return surface->transform.dirty ||
+		(!surface->geometry.parent &&
+		 (surface->transform.layer_x != layer->x ||
+		  surface->transform.layer_y != layer->y));
+}
+
+/* Whether the box, in global coordinates, shows on no output, covered
+ * by the opaque surfaces stacked above the surface as they stand now.
+ * Unlike surface->clip, which the last repaint left behind, this sees
+ * occluders that went away since.  When a surface above, or the
+ * surface itself, has moved since its transform was last updated,
+ * that can't be told before the next repaint and the box is taken as
+ * shown. */
+WL_EXPORT int
+weston_surface_box_is_hidden(struct weston_surface *surface,
+			     pixman_box32_t *box)
+{
+	struct weston_compositor *ec = surface->compositor;
+	struct weston_output *output;
+	struct weston_layer *layer;
+	struct weston_surface *above;
+	pixman_region32_t clip;
+	int hidden = 0;
+
+	pixman_region32_init(&clip);
+
+	wl_list_for_each(layer, &ec->layer_list, link) {
+		wl_list_for_each(above, &layer->surface_list, layer_link) {
+			if (surface_moved_since_update(above, layer))
+				goto out;
+			if (above == surface)
+				goto found;
+			pixman_region32_union(&clip, &clip,
+					      &above->transform.opaque);
+		}
+	}
+
+	/* Not stacked in a layer of its own. */
+	goto out;
+
+found:
+	hidden = 1;
+	wl_list_for_each(output, &ec->output_list, link)
+		if (box_is_visible(box, &clip, output)) {
+			hidden = 0;
+			break;
+		}
+
+out:
+	pixman_region32_fini(&clip);
+
+	return hidden;
+}
+
+/* Whether the surface shows on no output at all.  Surfaces on other
+ * planes than the primary one are not clipped, and always show. */
+static int
+surface_is_hidden(struct weston_surface *surface)
+{
+	struct weston_compositor *ec = surface->compositor;
+	struct weston_output *output;
+
+	if (surface->plane != &ec->primary_plane)
+		return 0;
+
+	wl_list_for_each(output, &ec->output_list, link)
+		if (surface_is_visible(surface, output))
+			return 0;
+
+	return 1;
+}
+
 static void
-compositor_accumulate_damage(struct weston_compositor *ec)
+compositor_accumulate_damage(struct weston_compositor *ec,
+			     struct weston_output *output)
 {
 	struct weston_plane *plane;
-	struct weston_surface *es;
+	struct weston_surface *es, **visible;
 	pixman_region32_t opaque, clip;
 
 	pixman_region32_init(&clip);
+	output->visible_surfaces.size = 0;
 
 	wl_list_for_each(plane, &ec->plane_list, link) {
 		pixman_region32_copy(&plane->clip, &clip);
@@ -1223,6 +1419,15 @@ compositor_accumulate_damage(struct weston_compositor *ec)
 				continue;
 
 			surface_accumulate_damage(es, &opaque);
+
+			if (plane != &ec->primary_plane ||
+			    !surface_is_visible(es, output))
+				continue;
+
+			visible = wl_array_add(&output->visible_surfaces,
+					       sizeof *visible);
+			if (visible)
+				*visible = es;
 		}
 
 		pixman_region32_union(&clip, &clip, &opaque);
@@ -1271,6 +1476,22 @@ surface_list_add(struct weston_compositor *compositor,
 	}
 }
 
+/* Picks up a change of the layer position.  Only the surfaces of a
+ * layer that moved get their transform recomputed, and those stay on
+ * the untransformed path. */
+static void
+surface_set_layer_position(struct weston_surface *surface,
+			   struct weston_layer *layer)
+{
+	if (surface->transform.layer_x == layer->x &&
+	    surface->transform.layer_y == layer->y)
+		return;
+
+	surface->transform.layer_x = layer->x;
+	surface->transform.layer_y = layer->y;
+	weston_surface_geometry_dirty(surface);
+}
+
 static void
 weston_compositor_build_surface_list(struct weston_compositor *compositor)
 {
@@ -1280,21 +1501,116 @@ weston_compositor_build_surface_list(struct weston_compositor *compositor)
 	wl_list_init(&compositor->surface_list);
 	wl_list_for_each(layer, &compositor->layer_list, link) {
 		wl_list_for_each(surface, &layer->surface_list, layer_link) {
+			surface_set_layer_position(surface, layer);
 			surface_list_add(compositor, surface);
 		}
 	}
 }
 
+/* Advances every animation on the output to the time of the frame about
+ * to be drawn.  This runs before the surface list is built, so the
+ * transforms the animations dirty are brought up to date in that one
+ * pass and the frame shows the step just taken, the first one included.
+ * Animations schedule no repaints of their own, the next frame is
+ * scheduled here once for as long as any of them are running. */
+static void
+weston_output_run_animations(struct weston_output *output, uint32_t msecs)
+{
+	struct weston_animation *animation, *next;
+
+	wl_list_for_each_safe(animation, next, &output->animation_list, link) {
+		animation->frame_counter++;
+		animation->frame(animation, output, msecs);
+	}
+
+	if (!wl_list_empty(&output->animation_list))
+		weston_compositor_schedule_repaint(output->compositor);
+}
+
+/* Whether a hidden surface is due another frame callback.  A client
+ * drawing into a surface nobody sees is throttled to the configured
+ * rate; the next repaint that shows the surface again releases its
+ * callbacks at once. */
+static int
+surface_hidden_frame_due(struct weston_surface *surface)
+{
+	struct weston_compositor *ec = surface->compositor;
+
+	return ec->hidden_frame_interval &&
+		weston_compositor_get_time() - surface->frame_callback_time >=
+		ec->hidden_frame_interval;
+}
+
+/* Arms the hidden frame timer for when the surface is due its next
+ * frame callbacks, unless it goes off before that already. */
+static void
+surface_hidden_frame_schedule(struct weston_surface *surface)
+{
+	struct weston_compositor *ec = surface->compositor;
+	uint32_t now, due;
+
+	if (!ec->hidden_frame_interval)
+		return;
+
+	due = surface->frame_callback_time + ec->hidden_frame_interval;
+	if (weston_timer_is_armed(&ec->hidden_frame_timer) &&
+	    (int32_t) (ec->hidden_frame_due - due) <= 0)
+		return;
+
+	now = weston_compositor_get_time();
+	ec->hidden_frame_due = due;
+	weston_timer_arm(ec, &ec->hidden_frame_timer,
+			 (int32_t) (due - now) > 0 ? due - now : 1);
+}
+
+static void
+hidden_frame_timer_func(struct weston_timer *timer, void *data)
+{
+	struct weston_compositor *ec = data;
+	struct weston_frame_callback *cb, *cnext;
+	struct weston_surface *es;
+	uint32_t msecs;
+
+	/* Nothing is drawn, so nothing is due.  The repaint on waking
+	 * up sends what is held or arms the timer again. */
+	if (ec->state == WESTON_COMPOSITOR_SLEEPING ||
+	    ec->state == WESTON_COMPOSITOR_OFFSCREEN)
+		return;
+
+	/* Visible surfaces get theirs with the next repaint. */
+	wl_list_for_each(es, &ec->surface_list, link) {
+		if (wl_list_empty(&es->frame_callback_list) ||
+		    !surface_is_hidden(es))
+			continue;
+
+		if (!surface_hidden_frame_due(es)) {
+			surface_hidden_frame_schedule(es);
+			continue;
+		}
+
+		msecs = weston_compositor_get_time();
+		es->frame_callback_time = msecs;
+		wl_list_for_each_safe(cb, cnext, &es->frame_callback_list,
+				      link) {
+			wl_callback_send_done(cb->resource, msecs);
+			wl_resource_destroy(cb->resource);
+		}
+	}
+}
+
 static void
 weston_output_repaint(struct weston_output *output, uint32_t msecs)
 {
 	struct weston_compositor *ec = output->compositor;
 	struct weston_surface *es;
-	struct weston_animation *animation, *next;
 	struct weston_frame_callback *cb, *cnext;
 	struct wl_list frame_callback_list;
 	pixman_region32_t output_damage;
 
+	/* Cleared first, so repaints the animations ask for stick. */
+	output->repaint_needed = 0;
+	weston_output_run_animations(output, msecs);
+
 	/* Rebuild the surface list and update surface transforms up front. */
 	weston_compositor_build_surface_list(ec);
 
@@ -1304,16 +1620,25 @@ weston_output_repaint(struct weston_output *output, uint32_t msecs)
 		wl_list_for_each(es, &ec->surface_list, link)
 			weston_surface_move_to_plane(es, &ec->primary_plane);
 
+	compositor_accumulate_damage(ec, output);
+
 	wl_list_init(&frame_callback_list);
 	wl_list_for_each(es, &ec->surface_list, link) {
-		if (es->output == output) {
-			wl_list_insert_list(&frame_callback_list,
-					    &es->frame_callback_list);
-			wl_list_init(&es->frame_callback_list);
+		if (es->output != output ||
+		    wl_list_empty(&es->frame_callback_list))
+			continue;
+
+		if (surface_is_hidden(es) &&
+		    !surface_hidden_frame_due(es)) {
+			surface_hidden_frame_schedule(es);
+			continue;
 		}
-	}
 
-	compositor_accumulate_damage(ec);
+		es->frame_callback_time = weston_compositor_get_time();
+		wl_list_insert_list(&frame_callback_list,
+				    &es->frame_callback_list);
+		wl_list_init(&es->frame_callback_list);
+	}
 
 	pixman_region32_init(&output_damage);
 	pixman_region32_intersect(&output_damage,
@@ -1325,23 +1650,21 @@ weston_output_repaint(struct weston_output *output, uint32_t msecs)
 		weston_output_update_matrix(output);
 
 	output->repaint(output, &output_damage);
+	startup.painted = 1;
 
 	pixman_region32_fini(&output_damage);
 
-	output->repaint_needed = 0;
-
 	weston_compositor_repick(ec);
 	wl_event_loop_dispatch(ec->input_loop, 0);
 
+	/* Deliver coalesced motion before the frame callbacks, so clients
+	 * draw their next frame with the latest pointer position. */
+	weston_compositor_flush_motion(ec);
+
 	wl_list_for_each_safe(cb, cnext, &frame_callback_list, link) {
 		wl_callback_send_done(cb->resource, msecs);
 		wl_resource_destroy(cb->resource);
 	}
-
-	wl_list_for_each_safe(animation, next, &output->animation_list, link) {
-		animation->frame_counter++;
-		animation->frame(animation, output, msecs);
-	}
 }
 
 static int
@@ -1362,6 +1685,13 @@ weston_output_finish_frame(struct weston_output *output, uint32_t msecs)
 		wl_display_get_event_loop(compositor->wl_display);
 	int fd;
 
+	/* The first repaint loop starts off a finish_frame() with nothing
+	 * drawn yet. */
+	if (startup.painted && !startup.done) {
+		weston_startup_mark("first frame on %s", output->name);
+		startup.done = 1;
+	}
+
 	output->frame_time = msecs;
 	if (output->repaint_needed) {
 		weston_output_repaint(output, msecs);
@@ -1392,6 +1722,18 @@ weston_layer_init(struct weston_layer *layer, struct wl_list *below)
 	wl_list_init(&layer->surface_list);
 	if (below != NULL)
 		wl_list_insert(below, &layer->link);
+	layer->x = 0;
+	layer->y = 0;
+}
+
+/* Moves all surfaces in the layer by x, y from their own position.
+ * Surfaces pick the new position up in the next repaint, which the
+ * caller schedules. */
+WL_EXPORT void
+weston_layer_set_position(struct weston_layer *layer, int32_t x, int32_t y)
+{
+	layer->x = x;
+	layer->y = y;
 }
 
 WL_EXPORT void
@@ -2467,11 +2809,23 @@ weston_compositor_wake(struct weston_compositor *compositor)
 		/* fall through */
 	default:
 		compositor->state = WESTON_COMPOSITOR_ACTIVE;
-		wl_event_source_timer_update(compositor->idle_source,
-					     compositor->idle_time * 1000);
+		compositor->last_activity = weston_compositor_get_time_usec();
+		if (!compositor->idle_timer_armed && compositor->idle_time > 0) {
+			wl_event_source_timer_update(compositor->idle_source,
+						     compositor->idle_time *
+						     1000);
+			compositor->idle_timer_armed = 1;
+		}
 	}
 }
 
+static void
+idle_timer_disarm(struct weston_compositor *compositor)
+{
+	wl_event_source_timer_update(compositor->idle_source, 0);
+	compositor->idle_timer_armed = 0;
+}
+
 WL_EXPORT void
 weston_compositor_offscreen(struct weston_compositor *compositor)
 {
@@ -2483,7 +2837,7 @@ weston_compositor_offscreen(struct weston_compositor *compositor)
 		/* fall through */
 	default:
 		compositor->state = WESTON_COMPOSITOR_OFFSCREEN;
-		wl_event_source_timer_update(compositor->idle_source, 0);
+		idle_timer_disarm(compositor);
 	}
 }
 
@@ -2493,7 +2847,7 @@ weston_compositor_sleep(struct weston_compositor *compositor)
 	if (compositor->state == WESTON_COMPOSITOR_SLEEPING)
 		return;
 
-	wl_event_source_timer_update(compositor->idle_source, 0);
+	idle_timer_disarm(compositor);
 	compositor->state = WESTON_COMPOSITOR_SLEEPING;
 	weston_compositor_dpms(compositor, WESTON_DPMS_OFF);
 }
@@ -2502,10 +2856,25 @@ static int
 idle_handler(void *data)
 {
 	struct weston_compositor *compositor = data;
+	uint64_t timeout = (uint64_t) compositor->idle_time * 1000000;
+	uint64_t elapsed;
 
+	compositor->idle_timer_armed = 0;
+
+	/* Releasing the last inhibit wakes the compositor, which arms
+	 * the timer again. */
 	if (compositor->idle_inhibit)
 		return 1;
 
+	elapsed = weston_compositor_get_time_usec() -
+		compositor->last_activity;
+	if (elapsed < timeout) {
+		wl_event_source_timer_update(compositor->idle_source,
+					     (timeout - elapsed + 999) / 1000);
+		compositor->idle_timer_armed = 1;
+		return 1;
+	}
+
 	compositor->state = WESTON_COMPOSITOR_IDLE;
 	wl_signal_emit(&compositor->idle_signal, compositor);
 
@@ -2600,6 +2969,7 @@ weston_output_destroy(struct weston_output *output)
 	free(output->name);
 	pixman_region32_fini(&output->region);
 	pixman_region32_fini(&output->previous_damage);
+	wl_array_release(&output->visible_surfaces);
 	output->compositor->output_id_pool &= ~(1 << output->id);
 
 	wl_global_destroy(output->global);
@@ -2765,6 +3135,7 @@ weston_output_init(struct weston_output *output, struct weston_compositor *c,
 	wl_signal_init(&output->destroy_signal);
 	wl_list_init(&output->animation_list);
 	wl_list_init(&output->resource_list);
+	wl_array_init(&output->visible_surfaces);
 
 	output->id = ffs(~output->compositor->output_id_pool) - 1;
 	output->compositor->output_id_pool |= 1 << output->id;
@@ -2887,6 +3258,7 @@ weston_compositor_init(struct weston_compositor *ec,
 	struct wl_event_loop *loop;
 	struct xkb_rule_names xkb_names;
 	struct weston_config_section *s;
+	uint32_t hidden_frame_rate;
 
 	ec->config = config;
 	ec->wl_display = display;
@@ -2901,6 +3273,7 @@ weston_compositor_init(struct weston_compositor *ec,
 	wl_signal_init(&ec->update_input_panel_signal);
 	wl_signal_init(&ec->seat_created_signal);
 	wl_signal_init(&ec->output_created_signal);
+	wl_signal_init(&ec->input_latency_signal);
 
 	ec->output_id_pool = 0;
 
@@ -2917,10 +3290,8 @@ weston_compositor_init(struct weston_compositor *ec,
 	wl_list_init(&ec->layer_list);
 	wl_list_init(&ec->seat_list);
 	wl_list_init(&ec->output_list);
-	wl_list_init(&ec->key_binding_list);
-	wl_list_init(&ec->button_binding_list);
-	wl_list_init(&ec->axis_binding_list);
-	wl_list_init(&ec->debug_binding_list);
+	if (weston_compositor_init_bindings(ec) < 0)
+		return -1;
 
 	weston_plane_init(&ec->primary_plane, 0, 0);
 	weston_compositor_stack_plane(ec, &ec->primary_plane, NULL);
@@ -2940,6 +3311,14 @@ weston_compositor_init(struct weston_compositor *ec,
 	if (weston_compositor_xkb_init(ec, &xkb_names) < 0)
 		return -1;
 
+	s = weston_config_get_section(ec->config, "core", NULL, NULL);
+	weston_config_section_get_bool(s, "coalesce-motion",
+				       &ec->coalesce_motion, 0);
+	weston_config_section_get_uint(s, "hidden-frame-rate",
+				       &hidden_frame_rate, 1);
+	ec->hidden_frame_interval =
+		hidden_frame_rate ? 1000 / MIN(hidden_frame_rate, 1000) : 0;
+
 	ec->ping_handler = NULL;
 
 	screenshooter_create(ec);
@@ -2952,7 +3331,13 @@ weston_compositor_init(struct weston_compositor *ec,
 
 	loop = wl_display_get_event_loop(ec->wl_display);
 	ec->idle_source = wl_event_loop_add_timer(loop, idle_handler, ec);
-	wl_event_source_timer_update(ec->idle_source, ec->idle_time * 1000);
+	ec->idle_timer_armed = 0;
+
+	ec->timer_wheel = weston_timer_wheel_create(ec);
+	if (ec->timer_wheel == NULL)
+		return -1;
+	weston_timer_init(&ec->hidden_frame_timer,
+			  hidden_frame_timer_func, ec);
 
 	ec->input_loop = wl_event_loop_create();
 
@@ -2972,18 +3357,20 @@ weston_compositor_shutdown(struct weston_compositor *ec)
 	wl_event_source_remove(ec->idle_source);
 	if (ec->input_loop_source)
 		wl_event_source_remove(ec->input_loop_source);
+	if (ec->motion_flush_source)
+		wl_event_source_remove(ec->motion_flush_source);
 
 	/* Destroy all outputs associated with this compositor */
 	wl_list_for_each_safe(output, next, &ec->output_list, link)
 		output->destroy(output);
 
-	weston_binding_list_destroy_all(&ec->key_binding_list);
-	weston_binding_list_destroy_all(&ec->button_binding_list);
-	weston_binding_list_destroy_all(&ec->axis_binding_list);
-	weston_binding_list_destroy_all(&ec->debug_binding_list);
+	weston_compositor_release_bindings(ec);
 
 	weston_plane_release(&ec->primary_plane);
 
+	weston_timer_cancel(&ec->hidden_frame_timer);
+	weston_timer_wheel_destroy(ec->timer_wheel);
+
 	wl_event_loop_destroy(ec->input_loop);
 
 	weston_config_destroy(ec->config);
@@ -3181,8 +3568,10 @@ load_modules(struct weston_compositor *ec, const char *modules,
 		end = strchrnul(p, ',');
 		snprintf(buffer, sizeof buffer, "%.*s", (int) (end - p), p);
 		module_init = load_module(buffer, "module_init");
-		if (module_init)
+		if (module_init) {
 			module_init(ec, argc, argv);
+			weston_startup_mark("%s initialized", buffer);
+		}
 		p = end;
 		while (*p == ',')
 			p++;
@@ -3284,6 +3673,15 @@ usage(int error_code)
 		"  --height=HEIGHT\tHeight of Wayland surface\n"
 		"  --display=DISPLAY\tWayland display to connect to\n\n");
 
+	fprintf(stderr,
+		"Options for headless-backend.so:\n\n"
+		"  --width=WIDTH\t\tWidth of the output\n"
+		"  --height=HEIGHT\tHeight of the output\n"
+		"  --replay=FILE\t\tReplay input recorded with "
+		"WESTON_INPUT_RECORD\n"
+		"  --replay-speed=FACTOR\tReplay speed, 1 is the recorded rate\n"
+		"\n");
+
 #if defined(BUILD_RPI_COMPOSITOR) && defined(HAVE_BCM_HOST)
 	fprintf(stderr,
 		"Options for rpi-backend.so:\n\n"
@@ -3356,6 +3754,9 @@ int main(int argc, char *argv[])
 		{ WESTON_OPTION_BOOLEAN, "version", 0, &version },
 	};
 
+	/* The startup trace counts from here, not from the first mark. */
+	startup.start = startup.last = weston_compositor_get_time_usec();
+
 	parse_options(core_options, ARRAY_LENGTH(core_options), &argc, argv);
 
 	if (help)
@@ -3375,6 +3776,7 @@ int main(int argc, char *argv[])
 		   PACKAGE_STRING, PACKAGE_URL, PACKAGE_BUGREPORT,
 		   BUILD_ID);
 	log_uname();
+	weston_startup_mark("started");
 
 	verify_xdg_runtime_dir();
 
@@ -3392,6 +3794,10 @@ int main(int argc, char *argv[])
 	signals[3] = wl_event_loop_add_signal(loop, SIGCHLD, sigchld_handler,
 					      NULL);
 
+	/* A write to a pipe whose reader went away, such as a paste that
+	 * was given up halfway, should fail with EPIPE, not kill us. */
+	signal(SIGPIPE, SIG_IGN);
+
 	if (!backend) {
 		if (getenv("WAYLAND_DISPLAY"))
 			backend = "wayland-backend.so";
@@ -3408,6 +3814,7 @@ int main(int argc, char *argv[])
 	section = weston_config_get_section(config, "core", NULL, NULL);
 	weston_config_section_get_string(section, "modules",
 					 &modules, "desktop-shell.so");
+	weston_startup_mark("configuration parsed");
 
 	backend_init = load_module(backend, "backend_init");
 	if (!backend_init)
@@ -3418,6 +3825,7 @@ int main(int argc, char *argv[])
 		weston_log("fatal: failed to create compositor\n");
 		exit(EXIT_FAILURE);
 	}
+	weston_startup_mark("%s initialized", backend);
 
 	catch_signals();
 	segv_compositor = ec;
@@ -3447,6 +3855,7 @@ int main(int argc, char *argv[])
 	}
 
 	weston_compositor_wake(ec);
+	weston_startup_mark("entering main loop");
 
 	wl_display_run(display);
 
@@ -121,6 +121,20 @@ struct weston_animation {
 	struct wl_list link;
 };
 
+struct weston_timer;
+typedef void (*weston_timer_func_t)(struct weston_timer *timer, void *data);
+
+/* A one-shot timer on the compositor's timer wheel, see
+ * weston_timer_arm().  Embed it and set it up with weston_timer_init(). */
+struct weston_timer {
+	struct weston_timer_wheel *wheel;	/* NULL when not armed */
+	struct wl_list link;
+	uint64_t expire;			/* ms */
+	int level;
+	weston_timer_func_t func;
+	void *data;
+};
+
 enum {
 	WESTON_SPRING_OVERSHOOT,
 	WESTON_SPRING_CLAMP,
@@ -189,6 +203,10 @@ struct weston_output {
 	struct weston_border border;
 	pixman_region32_t region;
 	pixman_region32_t previous_damage;
+	/* struct weston_surface *, top to bottom. The primary plane
+	 * surfaces not fully occluded on this output, valid during
+	 * repaint() only. */
+	struct wl_array visible_surfaces;
 	int repaint_needed;
 	int repaint_scheduled;
 	struct weston_output_zoom zoom;
@@ -215,6 +233,13 @@ struct weston_output {
 	void (*assign_planes)(struct weston_output *output);
 	int (*switch_mode)(struct weston_output *output, struct weston_mode *mode);
 
+	/* Move the cursor plane to the current position of surface, which
+	 * assign_planes put there, without a repaint.  Returns -1 if the
+	 * surface is not on the cursor plane or the move failed.
+	 * Optional. */
+	int (*move_cursor)(struct weston_output *output,
+			   struct weston_surface *surface);
+
 	/* backlight values are on 0-255 range, where higher is brighter */
 	int32_t backlight_current;
 	void (*set_backlight)(struct weston_output *output, uint32_t value);
@@ -230,11 +255,13 @@ struct weston_output {
 };
 
 struct weston_pointer_grab;
+/* Pointer event times are in microseconds, see
+ * weston_compositor_get_time_usec(). */
 struct weston_pointer_grab_interface {
 	void (*focus)(struct weston_pointer_grab *grab);
-	void (*motion)(struct weston_pointer_grab *grab, uint32_t time);
+	void (*motion)(struct weston_pointer_grab *grab, uint64_t time_us);
 	void (*button)(struct weston_pointer_grab *grab,
-		       uint32_t time, uint32_t button, uint32_t state);
+		       uint64_t time_us, uint32_t button, uint32_t state);
 };
 
 struct weston_pointer_grab {
@@ -271,6 +298,8 @@ struct weston_touch_grab_interface {
 			int touch_id,
 			wl_fixed_t sx,
 			wl_fixed_t sy);
+	/* End of a set of contact changes that belong together */
+	void (*frame)(struct weston_touch_grab *grab);
 };
 
 struct weston_touch_grab {
@@ -296,10 +325,20 @@ struct weston_data_source {
 	void (*cancel)(struct weston_data_source *source);
 };
 
+/* Resources of one kind (wl_pointer, wl_keyboard, ...) hashed by
+ * client, so focus changes don't have to scan every client's
+ * resources.  Entries are removed when their resource is destroyed. */
+#define WESTON_RESOURCE_MAP_SIZE 128
+
+struct weston_resource_map {
+	struct wl_list buckets[WESTON_RESOURCE_MAP_SIZE];
+};
+
 struct weston_pointer {
 	struct weston_seat *seat;
 
 	struct wl_list resource_list;
+	struct weston_resource_map resource_map;
 	struct weston_surface *focus;
 	struct wl_resource *focus_resource;
 	struct wl_listener focus_listener;
@@ -315,10 +354,15 @@ struct weston_pointer {
 	wl_fixed_t grab_x, grab_y;
 	uint32_t grab_button;
 	uint32_t grab_serial;
-	uint32_t grab_time;
+	uint64_t grab_time; /* in microseconds */
 
 	wl_fixed_t x, y;
 	uint32_t button_count;
+
+	/* Motion held back for coalescing, see
+	 * weston_compositor_flush_motion(). */
+	int motion_pending;
+	uint64_t motion_time; /* in microseconds */
 };
 
 
@@ -326,6 +370,7 @@ struct weston_touch {
 	struct weston_seat *seat;
 
 	struct wl_list resource_list;
+	struct weston_resource_map resource_map;
 	struct weston_surface *focus;
 	struct wl_resource *focus_resource;
 	struct wl_listener focus_listener;
@@ -353,6 +398,8 @@ weston_pointer_start_grab(struct weston_pointer *pointer,
 void
 weston_pointer_end_grab(struct weston_pointer *pointer);
 void
+weston_pointer_flush_motion(struct weston_pointer *pointer);
+void
 weston_pointer_clamp(struct weston_pointer *pointer,
 			    wl_fixed_t *fx, wl_fixed_t *fy);
 
@@ -415,6 +462,7 @@ struct weston_keyboard {
 	struct weston_seat *seat;
 
 	struct wl_list resource_list;
+	struct weston_resource_map resource_map;
 	struct weston_surface *focus;
 	struct wl_resource *focus_resource;
 	struct wl_listener focus_listener;
@@ -466,6 +514,9 @@ struct weston_seat {
 
 	uint32_t num_tp;
 
+	/* Keys, buttons and touch points held on this seat */
+	uint32_t idle_inhibit;
+
 	void (*led_update)(struct weston_seat *ws, enum weston_led leds);
 
 	struct weston_xkb_info xkb_info;
@@ -489,6 +540,10 @@ enum {
 struct weston_layer {
 	struct wl_list surface_list;
 	struct wl_list link;
+
+	/* Moves every surface in the layer, see
+	 * weston_layer_set_position(). */
+	int32_t x, y;
 };
 
 struct weston_plane {
@@ -523,6 +578,12 @@ enum weston_capability {
 	WESTON_CAP_CAPTURE_YFLIP		= 0x0002,
 };
 
+struct weston_input_latency {
+	struct weston_seat *seat;
+	uint64_t event_time; /* in microseconds, CLOCK_MONOTONIC */
+	uint64_t dispatch_time; /* in microseconds, CLOCK_MONOTONIC */
+};
+
 struct weston_compositor {
 	struct wl_signal destroy_signal;
 
@@ -545,9 +606,18 @@ struct weston_compositor {
 	struct wl_signal seat_created_signal;
 	struct wl_signal output_created_signal;
 
+	/* Emitted with a struct weston_input_latency for each pointer
+	 * event, when it is dispatched to the grab. */
+	struct wl_signal input_latency_signal;
+
 	struct wl_event_loop *input_loop;
 	struct wl_event_source *input_loop_source;
 
+	/* When set, pointer motion is accumulated and delivered to the
+	 * grab once per input batch or output frame. */
+	int coalesce_motion;
+	struct wl_event_source *motion_flush_source;
+
 	struct weston_layer fade_layer;
 	struct weston_layer cursor_layer;
 
@@ -560,11 +630,26 @@ struct weston_compositor {
 	struct wl_list button_binding_list;
 	struct wl_list axis_binding_list;
 	struct wl_list debug_binding_list;
+	struct weston_binding_table *binding_table;
 
 	uint32_t state;
 	struct wl_event_source *idle_source;
-	uint32_t idle_inhibit;
+	uint32_t idle_inhibit;		/* seats inhibiting idle */
 	int idle_time;			/* timeout, s */
+	/* Time of the last weston_compositor_wake(), in microseconds.
+	 * Activity only records it; the idle timer is re-armed when it
+	 * fires early. */
+	uint64_t last_activity;
+	int idle_timer_armed;
+
+	struct weston_timer_wheel *timer_wheel;
+
+	/* Frame callbacks of surfaces the last repaint left hidden are
+	 * sent at most once per interval, in ms, off this timer.  0 holds
+	 * them until the surface shows again. */
+	uint32_t hidden_frame_interval;
+	struct weston_timer hidden_frame_timer;
+	uint32_t hidden_frame_due;	/* when the timer goes off */
 
 	/* Repaint state. */
 	struct weston_plane primary_plane;
@@ -589,6 +674,7 @@ struct weston_compositor {
 	struct xkb_rule_names xkb_names;
 	struct xkb_context *xkb_context;
 	struct weston_xkb_info xkb_info;
+	struct weston_keymap_job *keymap_job;	/* see input.c */
 
 	/* Raw keyboard processing (no libxkbcommon initialization or handling) */
 	int use_xkbcommon;
@@ -617,6 +703,11 @@ struct weston_region {
 	pixman_region32_t region;
 };
 
+struct weston_frame_callback {
+	struct wl_resource *resource;
+	struct wl_list link;
+};
+
 struct weston_subsurface {
 	struct wl_resource *resource;
 
@@ -737,11 +828,20 @@ struct weston_surface {
 	struct {
 		int dirty;
 
+		/* Position of the layer this was last computed in. */
+		int32_t layer_x, layer_y;
+
+		/* Global position of the surface: geometry x, y moved by
+		 * the layer position, or by the parent's transform.
+		 * Use this rather than geometry x, y if enabled = 0. */
+		float x, y;
+
 		pixman_region32_t boundingbox;
 		pixman_region32_t opaque;
 
 		/* matrix and inverse are used only if enabled = 1.
-		 * If enabled = 0, use x, y, width, height directly.
+		 * If enabled = 0, use transform x, y and geometry width,
+		 * height directly.
 		 */
 		int enabled;
 		struct weston_matrix matrix;
@@ -764,11 +864,16 @@ struct weston_surface {
 	uint32_t output_mask;
 
 	struct wl_list frame_callback_list;
+	/* When frame callbacks were last sent, by the compositor clock;
+	 * see weston_compositor::hidden_frame_interval. */
+	uint32_t frame_callback_time;
 
 	struct weston_buffer_reference buffer_ref;
 	uint32_t buffer_transform;
 	int32_t buffer_scale;
 	int keep_buffer; /* bool for backends to prevent early release */
+	int fixed_scale; /* bool for shells: the transform holds a steady
+			  * scale, renderers may draw from a scaled copy */
 
 	/* All the pending state, that wl_surface.commit will apply. */
 	struct {
@@ -874,18 +979,20 @@ void
 weston_surface_activate(struct weston_surface *surface,
 			struct weston_seat *seat);
 void
-notify_motion(struct weston_seat *seat, uint32_t time,
+notify_motion(struct weston_seat *seat, uint64_t time_us,
 	      wl_fixed_t dx, wl_fixed_t dy);
 void
-notify_motion_absolute(struct weston_seat *seat, uint32_t time,
+notify_motion_absolute(struct weston_seat *seat, uint64_t time_us,
 		       wl_fixed_t x, wl_fixed_t y);
 void
-notify_button(struct weston_seat *seat, uint32_t time, int32_t button,
+notify_button(struct weston_seat *seat, uint64_t time_us, int32_t button,
 	      enum wl_pointer_button_state state);
 void
-notify_axis(struct weston_seat *seat, uint32_t time, uint32_t axis,
+notify_axis(struct weston_seat *seat, uint64_t time_us, uint32_t axis,
 	    wl_fixed_t value);
 void
+weston_compositor_flush_motion(struct weston_compositor *compositor);
+void
 notify_key(struct weston_seat *seat, uint32_t time, uint32_t key,
 	   enum wl_keyboard_key_state state,
 	   enum weston_key_state_update update_state);
@@ -905,9 +1012,13 @@ notify_keyboard_focus_out(struct weston_seat *seat);
 void
 notify_touch(struct weston_seat *seat, uint32_t time, int touch_id,
 	     wl_fixed_t x, wl_fixed_t y, int touch_type);
+void
+notify_touch_frame(struct weston_seat *seat);
 
 void
 weston_layer_init(struct weston_layer *layer, struct wl_list *below);
+void
+weston_layer_set_position(struct weston_layer *layer, int32_t x, int32_t y);
 
 void
 weston_plane_init(struct weston_plane *plane, int32_t x, int32_t y);
@@ -986,6 +1097,11 @@ weston_binding_destroy(struct weston_binding *binding);
 void
 weston_binding_list_destroy_all(struct wl_list *list);
 
+int
+weston_compositor_init_bindings(struct weston_compositor *compositor);
+void
+weston_compositor_release_bindings(struct weston_compositor *compositor);
+
 void
 weston_compositor_run_key_binding(struct weston_compositor *compositor,
 				  struct weston_seat *seat, uint32_t time,
@@ -1033,9 +1149,16 @@ weston_surface_set_transform_parent(struct weston_surface *surface,
 int
 weston_surface_is_mapped(struct weston_surface *surface);
 
+int
+weston_surface_box_is_hidden(struct weston_surface *surface,
+			     pixman_box32_t *box);
+
 void
 weston_surface_schedule_repaint(struct weston_surface *surface);
 
+int
+weston_surface_move_cursor(struct weston_surface *surface, float x, float y);
+
 void
 weston_surface_damage(struct weston_surface *surface);
 
@@ -1060,6 +1183,22 @@ weston_buffer_reference(struct weston_buffer_reference *ref,
 
 uint32_t
 weston_compositor_get_time(void);
+uint64_t
+weston_compositor_get_time_usec(void);
+void
+weston_startup_mark(const char *fmt, ...)
+	__attribute__ ((format (printf, 1, 2)));
+
+void
+weston_timer_init(struct weston_timer *timer,
+		  weston_timer_func_t func, void *data);
+void
+weston_timer_arm(struct weston_compositor *compositor,
+		 struct weston_timer *timer, uint32_t msecs);
+void
+weston_timer_cancel(struct weston_timer *timer);
+int
+weston_timer_is_armed(struct weston_timer *timer);
 
 int
 weston_compositor_init(struct weston_compositor *ec, struct wl_display *display,
@@ -1157,6 +1296,11 @@ text_cursor_position_notifier_create(struct weston_compositor *ec);
 int
 text_backend_init(struct weston_compositor *ec);
 
+struct weston_timer_wheel *
+weston_timer_wheel_create(struct weston_compositor *compositor);
+void
+weston_timer_wheel_destroy(struct weston_timer_wheel *wheel);
+
 struct weston_process;
 typedef void (*weston_process_cleanup_func_t)(struct weston_process *process,
 					    int status);
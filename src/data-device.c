@@ -266,7 +266,7 @@ drag_grab_focus(struct weston_pointer_grab *grab)
 }
 
 static void
-drag_grab_motion(struct weston_pointer_grab *grab, uint32_t time)
+drag_grab_motion(struct weston_pointer_grab *grab, uint64_t time_us)
 {
 	struct weston_drag *drag =
 		container_of(grab, struct weston_drag, grab);
@@ -286,7 +286,8 @@ drag_grab_motion(struct weston_pointer_grab *grab, uint32_t time)
 						 pointer->x, pointer->y,
 						 &sx, &sy);
 
-		wl_data_device_send_motion(drag->focus_resource, time, sx, sy);
+		wl_data_device_send_motion(drag->focus_resource,
+					   time_us / 1000, sx, sy);
 	}
 }
 
@@ -311,7 +312,7 @@ data_device_end_drag_grab(struct weston_drag *drag)
 
 static void
 drag_grab_button(struct weston_pointer_grab *grab,
-		 uint32_t time, uint32_t button, uint32_t state_w)
+		 uint64_t time_us, uint32_t button, uint32_t state_w)
 {
 	struct weston_drag *drag =
 		container_of(grab, struct weston_drag, grab);
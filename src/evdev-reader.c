@@ -0,0 +1,466 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * The evdev reader thread owns reading from the evdev (and mtdev) file
+ * descriptors of all input devices. Events are stamped with the time
+ * they were read and handed to the main thread through a single
+ * producer, single consumer ring. The main thread is woken through an
+ * eventfd in the compositor input loop, so input is still dispatched
+ * at the same points as before, but the kernel buffers are drained
+ * even while a slow frame keeps the main thread busy.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <mtdev.h>
+
+#include "compositor.h"
+#include "evdev.h"
+
+#define EVDEV_RING_SIZE 1024 /* in events, power of two */
+
+struct evdev_ring_entry {
+	struct evdev_device *device; /* NULL if the device went away */
+	struct input_event event;
+	uint64_t read_time; /* CLOCK_MONOTONIC, in microseconds */
+};
+
+struct evdev_reader {
+	struct weston_compositor *compositor;
+	int ref_count;
+
+	pthread_t thread;
+	int epoll_fd;
+	int control_fd; /* wakes up the reader thread */
+	int wake_fd; /* wakes up the main thread */
+	struct wl_event_source *source;
+
+	/* Commands to the reader thread. */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond; /* ring space or a command is pending */
+	pthread_cond_t done_cond; /* a command was carried out */
+	struct evdev_device *remove_device;
+	int quit;
+
+	int wake_pending;
+
+	/* head is only written by the reader thread, tail only by
+	 * the main thread. */
+	uint32_t head, tail;
+	struct evdev_ring_entry ring[EVDEV_RING_SIZE];
+
+	struct {
+		uint64_t events;
+		uint32_t max_depth;
+		uint64_t latency_total; /* in microseconds */
+		uint32_t latency_max; /* in microseconds */
+	} stats;
+};
+
+static struct evdev_reader *input_reader;
+static int stats_binding_added;
+
+static uint64_t
+monotonic_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t
+ring_space(struct evdev_reader *reader)
+{
+	return EVDEV_RING_SIZE -
+		(reader->head - __atomic_load_n(&reader->tail,
+						__ATOMIC_ACQUIRE));
+}
+
+/* Move as many events as fit in the ring from the device to the ring.
+ * Returns the number of events queued. */
+static int
+reader_read_device(struct evdev_reader *reader, struct evdev_device *device)
+{
+	struct input_event ev[32];
+	struct evdev_ring_entry *entry;
+	uint32_t head = reader->head, space;
+	uint64_t now;
+	int i, count, len, queued = 0;
+
+	do {
+		space = ring_space(reader);
+		if (space == 0)
+			break;
+
+		count = space < ARRAY_LENGTH(ev) ? space : ARRAY_LENGTH(ev);
+		if (device->mtdev)
+			len = mtdev_get(device->mtdev, device->fd, ev, count) *
+				sizeof (struct input_event);
+		else
+			len = read(device->fd, &ev, count * sizeof ev[0]);
+
+		if (len < 0 && errno == ENODEV) {
+			/* Stop polling a device that is gone, udev will
+			 * tell the main thread to destroy it. */
+			epoll_ctl(reader->epoll_fd, EPOLL_CTL_DEL,
+				  device->fd, NULL);
+			break;
+		}
+
+		if (len < 0 || len % sizeof ev[0] != 0)
+			break;
+
+		now = monotonic_usec();
+		for (i = 0; i < len / (int) sizeof ev[0]; i++) {
+			entry = &reader->ring[head++ & (EVDEV_RING_SIZE - 1)];
+			entry->device = device;
+			entry->event = ev[i];
+			entry->read_time = now;
+		}
+
+		__atomic_store_n(&reader->head, head, __ATOMIC_SEQ_CST);
+		queued += i;
+	} while (len > 0);
+
+	return queued;
+}
+
+/* Returns -1 when the thread is asked to quit. */
+static int
+reader_handle_commands(struct evdev_reader *reader,
+		       struct evdev_device **removed)
+{
+	int quit;
+
+	pthread_mutex_lock(&reader->mutex);
+
+	*removed = reader->remove_device;
+	if (*removed) {
+		epoll_ctl(reader->epoll_fd, EPOLL_CTL_DEL,
+			  (*removed)->fd, NULL);
+		reader->remove_device = NULL;
+		pthread_cond_signal(&reader->done_cond);
+	}
+	quit = reader->quit;
+
+	pthread_mutex_unlock(&reader->mutex);
+
+	return quit ? -1 : 0;
+}
+
+static void *
+reader_thread(void *data)
+{
+	struct evdev_reader *reader = data;
+	struct evdev_device *removed;
+	struct epoll_event ep[16];
+	eventfd_t value;
+	int i, n, queued;
+
+	for (;;) {
+		/* While the ring is full, leave the events in the
+		 * kernel until the main thread catches up. */
+		pthread_mutex_lock(&reader->mutex);
+		while (ring_space(reader) == 0 &&
+		       !reader->remove_device && !reader->quit)
+			pthread_cond_wait(&reader->cond, &reader->mutex);
+		pthread_mutex_unlock(&reader->mutex);
+
+		n = epoll_wait(reader->epoll_fd, ep, ARRAY_LENGTH(ep), -1);
+		if (n < 0 && errno != EINTR)
+			break;
+
+		for (i = 0; i < n; i++)
+			if (ep[i].data.ptr == reader)
+				eventfd_read(reader->control_fd, &value);
+
+		if (reader_handle_commands(reader, &removed) < 0)
+			break;
+
+		queued = 0;
+		for (i = 0; i < n; i++) {
+			if (ep[i].data.ptr == reader ||
+			    ep[i].data.ptr == removed)
+				continue;
+
+			queued += reader_read_device(reader, ep[i].data.ptr);
+		}
+
+		if (queued &&
+		    __atomic_exchange_n(&reader->wake_pending, 1,
+					__ATOMIC_SEQ_CST) == 0)
+			eventfd_write(reader->wake_fd, 1);
+	}
+
+	return NULL;
+}
+
+/* Main thread: dispatch everything queued so far. */
+static int
+reader_dispatch(int fd, uint32_t mask, void *data)
+{
+	struct evdev_reader *reader = data;
+	struct weston_compositor *ec = reader->compositor;
+	struct evdev_device *device = NULL;
+	struct evdev_ring_entry *entry;
+	struct input_event ev[32];
+	uint32_t head, tail, latency;
+	uint64_t now;
+	eventfd_t value;
+	int n = 0;
+
+	eventfd_read(fd, &value);
+	__atomic_store_n(&reader->wake_pending, 0, __ATOMIC_SEQ_CST);
+
+	head = __atomic_load_n(&reader->head, __ATOMIC_SEQ_CST);
+	tail = reader->tail;
+	if (head - tail > reader->stats.max_depth)
+		reader->stats.max_depth = head - tail;
+
+	now = monotonic_usec();
+	while (tail != head) {
+		entry = &reader->ring[tail & (EVDEV_RING_SIZE - 1)];
+
+		/* Runs of events from one device go out in one batch,
+		 * as if they came from a single read(). The entry is
+		 * looked at only after the previous run was processed,
+		 * so devices destroyed meanwhile are seen as NULL. */
+		if (n > 0 &&
+		    (entry->device != device || n == (int) ARRAY_LENGTH(ev))) {
+			__atomic_store_n(&reader->tail, tail,
+					 __ATOMIC_RELEASE);
+			evdev_process_events(device, ev, n);
+			n = 0;
+			continue;
+		}
+
+		device = entry->device;
+		tail++;
+
+		if (device == NULL || !ec->focus)
+			continue;
+
+		ev[n++] = entry->event;
+
+		latency = now - entry->read_time;
+		reader->stats.events++;
+		reader->stats.latency_total += latency;
+		if (latency > reader->stats.latency_max)
+			reader->stats.latency_max = latency;
+	}
+
+	__atomic_store_n(&reader->tail, tail, __ATOMIC_RELEASE);
+	if (n > 0)
+		evdev_process_events(device, ev, n);
+
+	pthread_mutex_lock(&reader->mutex);
+	pthread_cond_signal(&reader->cond);
+	pthread_mutex_unlock(&reader->mutex);
+
+	return 1;
+}
+
+static void
+stats_binding(struct weston_seat *seat, uint32_t time, uint32_t key,
+	      void *data)
+{
+	struct evdev_reader *reader = input_reader;
+
+	if (!reader) {
+		weston_log("input reader thread not running\n");
+		return;
+	}
+
+	weston_log("input reader: %llu events, queue depth max %u/%u, "
+		   "read to dispatch latency avg %llu us, max %u us\n",
+		   (unsigned long long) reader->stats.events,
+		   reader->stats.max_depth, EVDEV_RING_SIZE,
+		   (unsigned long long) (reader->stats.events ?
+			reader->stats.latency_total / reader->stats.events : 0),
+		   reader->stats.latency_max);
+
+	memset(&reader->stats, 0, sizeof reader->stats);
+}
+
+static struct evdev_reader *
+evdev_reader_create(struct weston_compositor *ec)
+{
+	struct evdev_reader *reader;
+	struct epoll_event ep;
+	sigset_t all, saved;
+
+	reader = zalloc(sizeof *reader);
+	if (reader == NULL)
+		return NULL;
+
+	reader->compositor = ec;
+	reader->ref_count = 1;
+	pthread_mutex_init(&reader->mutex, NULL);
+	pthread_cond_init(&reader->cond, NULL);
+	pthread_cond_init(&reader->done_cond, NULL);
+
+	reader->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	reader->control_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	reader->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (reader->epoll_fd < 0 || reader->control_fd < 0 ||
+	    reader->wake_fd < 0)
+		goto err_fds;
+
+	memset(&ep, 0, sizeof ep);
+	ep.events = EPOLLIN;
+	ep.data.ptr = reader;
+	if (epoll_ctl(reader->epoll_fd, EPOLL_CTL_ADD,
+		      reader->control_fd, &ep) < 0)
+		goto err_fds;
+
+	reader->source = wl_event_loop_add_fd(ec->input_loop, reader->wake_fd,
+					      WL_EVENT_READABLE,
+					      reader_dispatch, reader);
+	if (reader->source == NULL)
+		goto err_fds;
+
+	/* Signals are handled by the main loop through signalfd, they
+	 * must stay blocked in the reader thread. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &saved);
+	if (pthread_create(&reader->thread, NULL, reader_thread, reader)) {
+		pthread_sigmask(SIG_SETMASK, &saved, NULL);
+		goto err_source;
+	}
+	pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+	if (!stats_binding_added) {
+		weston_compositor_add_debug_binding(ec, KEY_I,
+						    stats_binding, NULL);
+		stats_binding_added = 1;
+	}
+
+	return reader;
+
+err_source:
+	wl_event_source_remove(reader->source);
+err_fds:
+	if (reader->epoll_fd >= 0)
+		close(reader->epoll_fd);
+	if (reader->control_fd >= 0)
+		close(reader->control_fd);
+	if (reader->wake_fd >= 0)
+		close(reader->wake_fd);
+	free(reader);
+
+	return NULL;
+}
+
+static void
+evdev_reader_destroy(struct evdev_reader *reader)
+{
+	pthread_mutex_lock(&reader->mutex);
+	reader->quit = 1;
+	pthread_cond_signal(&reader->cond);
+	pthread_mutex_unlock(&reader->mutex);
+	eventfd_write(reader->control_fd, 1);
+
+	pthread_join(reader->thread, NULL);
+
+	wl_event_source_remove(reader->source);
+	close(reader->epoll_fd);
+	close(reader->control_fd);
+	close(reader->wake_fd);
+	pthread_cond_destroy(&reader->done_cond);
+	pthread_cond_destroy(&reader->cond);
+	pthread_mutex_destroy(&reader->mutex);
+	free(reader);
+}
+
+/* Start reading the device in the reader thread, which is started
+ * along with the first device. Returns the reader, or NULL if the
+ * device has to be read on the main thread. */
+struct evdev_reader *
+evdev_reader_add_device(struct evdev_device *device)
+{
+	struct evdev_reader *reader = input_reader;
+	struct epoll_event ep;
+
+	if (reader)
+		reader->ref_count++;
+	else
+		reader = evdev_reader_create(device->seat->compositor);
+	if (reader == NULL)
+		return NULL;
+
+	memset(&ep, 0, sizeof ep);
+	ep.events = EPOLLIN;
+	ep.data.ptr = device;
+	if (epoll_ctl(reader->epoll_fd, EPOLL_CTL_ADD, device->fd, &ep) < 0) {
+		if (--reader->ref_count == 0) {
+			evdev_reader_destroy(reader);
+			reader = NULL;
+		}
+		input_reader = reader;
+		return NULL;
+	}
+
+	input_reader = reader;
+
+	return reader;
+}
+
+/* Stop reading the device. Once this returns, the reader thread no
+ * longer touches the device and none of its events are dispatched. */
+void
+evdev_reader_remove_device(struct evdev_reader *reader,
+			   struct evdev_device *device)
+{
+	uint32_t i, head;
+
+	pthread_mutex_lock(&reader->mutex);
+	reader->remove_device = device;
+	pthread_cond_signal(&reader->cond);
+	eventfd_write(reader->control_fd, 1);
+	while (reader->remove_device)
+		pthread_cond_wait(&reader->done_cond, &reader->mutex);
+	pthread_mutex_unlock(&reader->mutex);
+
+	/* The slots between tail and head belong to the main thread
+	 * until tail moves past them. */
+	head = __atomic_load_n(&reader->head, __ATOMIC_ACQUIRE);
+	for (i = reader->tail; i != head; i++)
+		if (reader->ring[i & (EVDEV_RING_SIZE - 1)].device == device)
+			reader->ring[i & (EVDEV_RING_SIZE - 1)].device = NULL;
+
+	if (--reader->ref_count == 0) {
+		evdev_reader_destroy(reader);
+		input_reader = NULL;
+	}
+}
@@ -0,0 +1,535 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Input recording and replay.
+ *
+ * When WESTON_INPUT_RECORD names a file, every evdev device is written
+ * to it when it is set up (its evdev_device_description) and every
+ * batch of events handed to evdev_process_events() follows, so the
+ * file holds exactly what the dispatch code saw.  Devices that need
+ * mtdev are recorded after conversion and described as slotted.
+ *
+ * A replay recreates the devices without kernel counterparts and feeds
+ * the batches back through evdev_process_events() from a timer in the
+ * compositor input loop, paced at the recorded rate times a speed
+ * factor.  Event timestamps keep their recorded spacing, so filters and
+ * the touchpad code see the same input regardless of the pacing.  The
+ * touchpad's timeouts are scaled by the same factor and its timeout
+ * handler reads the replay clock, see evdev_device_timeout().
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <mtdev.h>
+
+#include "compositor.h"
+#include "evdev.h"
+
+#define RECORD_MAGIC		0x52495745 /* "EWIR" */
+#define RECORD_VERSION		1
+#define RECORD_FLUSH_INTERVAL	1000000 /* us */
+
+struct record_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t description_size;
+	uint32_t reserved;
+};
+
+enum record_type {
+	RECORD_ADD_DEVICE = 1,	/* followed by the device description */
+	RECORD_EVENTS = 2,	/* followed by count struct record_event */
+	RECORD_REMOVE_DEVICE = 3,
+};
+
+struct record_chunk {
+	uint32_t type;
+	uint32_t device;
+	uint32_t count;
+	uint32_t reserved;
+};
+
+struct record_event {
+	uint64_t time; /* us */
+	uint16_t type;
+	uint16_t code;
+	int32_t value;
+};
+
+static struct {
+	int initialized;
+	FILE *fp;
+	uint32_t next_id;
+	uint64_t last_flush;
+} recorder;
+
+static FILE *
+recorder_get_file(void)
+{
+	struct record_header header;
+	const char *path;
+	int fd;
+
+	if (recorder.initialized)
+		return recorder.fp;
+
+	recorder.initialized = 1;
+	path = getenv("WESTON_INPUT_RECORD");
+	if (!path)
+		return NULL;
+
+	/* The recording holds every key typed, passwords included, so
+	 * only the user gets to read it. */
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd >= 0) {
+		recorder.fp = fdopen(fd, "w");
+		if (!recorder.fp)
+			close(fd);
+	}
+	if (!recorder.fp) {
+		weston_log("evdev: failed to open input recording %s: %m\n",
+			   path);
+		return NULL;
+	}
+
+	memset(&header, 0, sizeof header);
+	header.magic = RECORD_MAGIC;
+	header.version = RECORD_VERSION;
+	header.description_size = sizeof(struct evdev_device_description);
+	fwrite(&header, sizeof header, 1, recorder.fp);
+
+	weston_log("evdev: recording input to %s\n", path);
+
+	return recorder.fp;
+}
+
+static void
+recorder_write_chunk(uint32_t type, uint32_t device, uint32_t count)
+{
+	struct record_chunk chunk;
+
+	memset(&chunk, 0, sizeof chunk);
+	chunk.type = type;
+	chunk.device = device;
+	chunk.count = count;
+	fwrite(&chunk, sizeof chunk, 1, recorder.fp);
+}
+
+void
+evdev_record_add_device(struct evdev_device *device)
+{
+	struct evdev_device_description desc;
+
+	if (!recorder_get_file())
+		return;
+
+	device->record_id = ++recorder.next_id;
+
+	desc = device->desc;
+	if (device->mtdev) {
+		desc.abs_bits[LONG(ABS_MT_SLOT)] |= BIT(ABS_MT_SLOT);
+		desc.absinfo[ABS_MT_SLOT] = device->mtdev->caps.slot;
+	}
+
+	recorder_write_chunk(RECORD_ADD_DEVICE, device->record_id, 0);
+	fwrite(&desc, sizeof desc, 1, recorder.fp);
+	fflush(recorder.fp);
+}
+
+void
+evdev_record_events(struct evdev_device *device,
+		    struct input_event *ev, int count)
+{
+	struct record_event out[32];
+	uint64_t now;
+	int i, n;
+
+	recorder_write_chunk(RECORD_EVENTS, device->record_id, count);
+
+	for (i = 0; i < count; i += n) {
+		for (n = 0; n < (int) ARRAY_LENGTH(out) && i + n < count; n++) {
+			out[n].time =
+				(uint64_t) ev[i + n].time.tv_sec * 1000000 +
+				ev[i + n].time.tv_usec;
+			out[n].type = ev[i + n].type;
+			out[n].code = ev[i + n].code;
+			out[n].value = ev[i + n].value;
+		}
+		fwrite(out, sizeof out[0], n, recorder.fp);
+	}
+
+	/* Keep the recording useful if the compositor goes away
+	 * uncleanly, without a write for every batch. */
+	now = weston_compositor_get_time_usec();
+	if (now - recorder.last_flush > RECORD_FLUSH_INTERVAL) {
+		fflush(recorder.fp);
+		recorder.last_flush = now;
+	}
+}
+
+void
+evdev_record_remove_device(struct evdev_device *device)
+{
+	recorder_write_chunk(RECORD_REMOVE_DEVICE, device->record_id, 0);
+	fflush(recorder.fp);
+	device->record_id = 0;
+}
+
+struct replay_device {
+	uint32_t id;
+	struct evdev_device *device; /* NULL if it was not handled */
+	struct wl_list link;
+};
+
+struct evdev_replay {
+	struct weston_seat *seat;
+	struct wl_event_source *timer;
+	struct wl_list device_list;
+	struct wl_array events;
+	double speed;
+
+	char *data;
+	size_t size;
+	size_t offset;
+
+	uint64_t start_time;	/* when the first batch was replayed */
+	uint64_t first_time;	/* recorded time of the first batch */
+	uint64_t last_time;	/* recorded time of the latest batch */
+
+	uint64_t event_count;
+	uint32_t batch_count;
+	uint64_t busy_time;	/* spent in evdev_process_events() */
+};
+
+static struct replay_device *
+replay_find_device(struct evdev_replay *replay, uint32_t id)
+{
+	struct replay_device *rd;
+
+	wl_list_for_each(rd, &replay->device_list, link)
+		if (rd->id == id)
+			return rd;
+
+	return NULL;
+}
+
+static void
+replay_remove_device(struct replay_device *rd)
+{
+	if (rd->device)
+		evdev_device_destroy(rd->device);
+	wl_list_remove(&rd->link);
+	free(rd);
+}
+
+static int
+replay_add_device(struct evdev_replay *replay, uint32_t id,
+		  const struct evdev_device_description *desc)
+{
+	struct replay_device *rd;
+	char path[32];
+
+	rd = zalloc(sizeof *rd);
+	if (rd == NULL)
+		return -1;
+
+	snprintf(path, sizeof path, "replay:%u", id);
+	rd->id = id;
+	rd->device = evdev_device_create_replay(replay->seat, path, desc,
+						replay);
+	if (rd->device == EVDEV_UNHANDLED_DEVICE) {
+		rd->device = NULL;
+	} else if (rd->device == NULL) {
+		free(rd);
+		return -1;
+	}
+
+	wl_list_insert(replay->device_list.prev, &rd->link);
+
+	return 0;
+}
+
+static void
+replay_dispatch_events(struct evdev_replay *replay, struct replay_device *rd,
+		       const struct record_event *in, uint32_t count,
+		       uint64_t now)
+{
+	struct input_event *ev;
+	uint64_t time;
+	uint32_t i;
+
+	replay->events.size = 0;
+	ev = wl_array_add(&replay->events, count * sizeof *ev);
+	if (ev == NULL)
+		return;
+
+	for (i = 0; i < count; i++) {
+		time = replay->start_time + (in[i].time - replay->first_time);
+		ev[i].time.tv_sec = time / 1000000;
+		ev[i].time.tv_usec = time % 1000000;
+		ev[i].type = in[i].type;
+		ev[i].code = in[i].code;
+		ev[i].value = in[i].value;
+	}
+
+	evdev_process_events(rd->device, ev, count);
+
+	replay->event_count += count;
+	replay->batch_count++;
+	replay->busy_time += weston_compositor_get_time_usec() - now;
+}
+
+static void
+replay_finish(struct evdev_replay *replay)
+{
+	uint64_t wall = weston_compositor_get_time_usec() - replay->start_time;
+
+	weston_log("input replay: %llu events in %u batches, "
+		   "%.1f ms replayed in %.1f ms, "
+		   "%.2f us per event in evdev_process_events\n",
+		   (unsigned long long) replay->event_count,
+		   replay->batch_count,
+		   (replay->last_time - replay->first_time) / 1000.0,
+		   wall / 1000.0,
+		   replay->event_count ?
+			(double) replay->busy_time / replay->event_count : 0.0);
+}
+
+/* Replay everything that is due and return the delay in milliseconds
+ * until the next batch, or 0 when the recording is exhausted. */
+static int
+replay_step(struct evdev_replay *replay)
+{
+	const struct record_chunk *chunk;
+	const struct record_event *events;
+	struct replay_device *rd;
+	uint64_t now, due;
+	size_t length;
+
+	while (replay->offset + sizeof *chunk <= replay->size) {
+		chunk = (const struct record_chunk *)
+			(replay->data + replay->offset);
+		length = sizeof *chunk;
+
+		switch (chunk->type) {
+		case RECORD_ADD_DEVICE:
+			length += sizeof(struct evdev_device_description);
+			if (replay->offset + length > replay->size)
+				goto truncated;
+			if (replay_add_device(replay, chunk->device,
+					      (const void *) (chunk + 1)) < 0)
+				weston_log("input replay: failed to create "
+					   "device %u\n", chunk->device);
+			break;
+
+		case RECORD_EVENTS:
+			length += (size_t) chunk->count * sizeof *events;
+			if (replay->offset + length > replay->size)
+				goto truncated;
+			if (chunk->count == 0)
+				break;
+
+			events = (const struct record_event *) (chunk + 1);
+			now = weston_compositor_get_time_usec();
+			if (replay->batch_count == 0) {
+				replay->start_time = now;
+				replay->first_time = events[0].time;
+			}
+
+			due = replay->start_time +
+				(events[0].time - replay->first_time) /
+				replay->speed;
+			if (due > now)
+				return (due - now + 999) / 1000;
+
+			replay->last_time = events[0].time;
+			rd = replay_find_device(replay, chunk->device);
+			if (rd && rd->device)
+				replay_dispatch_events(replay, rd, events,
+						       chunk->count, now);
+			break;
+
+		case RECORD_REMOVE_DEVICE:
+			rd = replay_find_device(replay, chunk->device);
+			if (rd)
+				replay_remove_device(rd);
+			break;
+
+		default:
+			weston_log("input replay: unknown record type %u\n",
+				   chunk->type);
+			return 0;
+		}
+
+		replay->offset += length;
+	}
+
+	replay_finish(replay);
+	return 0;
+
+truncated:
+	weston_log("input replay: recording is truncated\n");
+	replay_finish(replay);
+	return 0;
+}
+
+static int
+replay_timer_handler(void *data)
+{
+	struct evdev_replay *replay = data;
+	int delay;
+
+	delay = replay_step(replay);
+	if (delay > 0)
+		wl_event_source_timer_update(replay->timer, delay);
+
+	return 1;
+}
+
+static int
+replay_map_file(struct evdev_replay *replay, const char *path)
+{
+	const struct record_header *header;
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		weston_log("input replay: failed to open %s: %m\n", path);
+		return -1;
+	}
+
+	if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof *header) {
+		weston_log("input replay: %s is not a recording\n", path);
+		close(fd);
+		return -1;
+	}
+
+	replay->size = st.st_size;
+	replay->data = mmap(NULL, replay->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (replay->data == MAP_FAILED) {
+		replay->data = NULL;
+		return -1;
+	}
+
+	header = (const struct record_header *) replay->data;
+	if (header->magic != RECORD_MAGIC ||
+	    header->version != RECORD_VERSION ||
+	    header->description_size !=
+			sizeof(struct evdev_device_description)) {
+		weston_log("input replay: %s was recorded by an incompatible "
+			   "build\n", path);
+		return -1;
+	}
+
+	replay->offset = sizeof *header;
+
+	return 0;
+}
+
+struct evdev_replay *
+evdev_replay_create(struct weston_seat *seat, const char *path,
+		    double speed)
+{
+	struct evdev_replay *replay;
+
+	replay = zalloc(sizeof *replay);
+	if (replay == NULL)
+		return NULL;
+
+	replay->seat = seat;
+	replay->speed = speed > 0.0 ? speed : 1.0;
+	wl_list_init(&replay->device_list);
+	wl_array_init(&replay->events);
+
+	if (replay_map_file(replay, path) < 0)
+		goto err;
+
+	replay->timer = wl_event_loop_add_timer(seat->compositor->input_loop,
+						replay_timer_handler, replay);
+	if (replay->timer == NULL)
+		goto err;
+	wl_event_source_timer_update(replay->timer, 1);
+
+	weston_log("input replay: playing %s at %.2fx speed\n",
+		   path, replay->speed);
+
+	return replay;
+
+err:
+	evdev_replay_destroy(replay);
+	return NULL;
+}
+
+/* The replay clock: the replayed events' timestamps are the time the
+ * replay started plus their recorded offset, so this clock advances
+ * speed times as fast as the compositor's once the first batch ran. */
+uint64_t
+evdev_replay_get_time_usec(struct evdev_replay *replay)
+{
+	uint64_t now = weston_compositor_get_time_usec();
+
+	if (replay->batch_count == 0)
+		return now;
+
+	return replay->start_time + (now - replay->start_time) * replay->speed;
+}
+
+uint32_t
+evdev_replay_timeout(struct evdev_replay *replay, uint32_t msecs)
+{
+	uint32_t scaled;
+
+	/* 0 disarms a timer, so never round a running one down to it. */
+	if (msecs == 0)
+		return 0;
+
+	scaled = msecs / replay->speed;
+
+	return scaled > 0 ? scaled : 1;
+}
+
+void
+evdev_replay_destroy(struct evdev_replay *replay)
+{
+	struct replay_device *rd, *next;
+
+	if (replay->timer)
+		wl_event_source_remove(replay->timer);
+
+	wl_list_for_each_safe(rd, next, &replay->device_list, link)
+		replay_remove_device(rd);
+
+	if (replay->data)
+		munmap(replay->data, replay->size);
+	wl_array_release(&replay->events);
+	free(replay);
+}
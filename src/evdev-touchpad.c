@@ -38,6 +38,9 @@
 #define DEFAULT_MIN_ACCEL_FACTOR 0.16
 #define DEFAULT_MAX_ACCEL_FACTOR 1.0
 #define DEFAULT_HYSTERESIS_MARGIN_DENOMINATOR 700.0
+#define DEFAULT_ACCEL_CURVE_STEP 1.0
+#define ACCEL_TABLE_SIZE 64
+#define MAX_ACCEL_CURVE_POINTS 256
 
 #define DEFAULT_TOUCHPAD_SINGLE_TAP_BUTTON BTN_LEFT
 #define DEFAULT_TOUCHPAD_SINGLE_TAP_TIMEOUT 100
@@ -119,6 +122,11 @@ struct touchpad_dispatch {
 	double min_accel_factor;
 	double max_accel_factor;
 
+	/* Custom acceleration curve from weston.ini, in device units */
+	double accel_curve[MAX_ACCEL_CURVE_POINTS];
+	int accel_curve_size;
+	double accel_curve_step;
+
 	unsigned int event_mask;
 	unsigned int event_mask_filter;
 
@@ -160,16 +168,13 @@ struct touchpad_dispatch {
 static enum touchpad_model
 get_touchpad_model(struct evdev_device *device)
 {
-	struct input_id id;
+	const struct input_id *id = &device->desc.id;
 	unsigned int i;
 
-	if (ioctl(device->fd, EVIOCGID, &id) < 0)
-		return TOUCHPAD_MODEL_UNKNOWN;
-
 	for (i = 0; i < ARRAY_LENGTH(touchpad_spec_table); i++)
-		if (touchpad_spec_table[i].vendor == id.vendor &&
+		if (touchpad_spec_table[i].vendor == id->vendor &&
 		    (!touchpad_spec_table[i].product ||
-		     touchpad_spec_table[i].product == id.product))
+		     touchpad_spec_table[i].product == id->product))
 			return touchpad_spec_table[i].model;
 
 	return TOUCHPAD_MODEL_UNKNOWN;
@@ -201,7 +206,7 @@ static double
 touchpad_profile(struct weston_motion_filter *filter,
 		 void *data,
 		 double velocity,
-		 uint32_t time)
+		 uint64_t time_us)
 {
 	struct touchpad_dispatch *touchpad =
 		(struct touchpad_dispatch *) data;
@@ -263,44 +268,44 @@ touchpad_get_delta(struct touchpad_dispatch *touchpad, double *dx, double *dy)
 
 static void
 filter_motion(struct touchpad_dispatch *touchpad,
-	      double *dx, double *dy, uint32_t time)
+	      double *dx, double *dy, uint64_t time_us)
 {
 	struct weston_motion_params motion;
 
 	motion.dx = *dx;
 	motion.dy = *dy;
 
-	weston_filter_dispatch(touchpad->filter, &motion, touchpad, time);
+	weston_filter_dispatch(touchpad->filter, &motion, touchpad, time_us);
 
 	*dx = motion.dx;
 	*dy = motion.dy;
 }
 
 static void
-notify_button_pressed(struct touchpad_dispatch *touchpad, uint32_t time)
+notify_button_pressed(struct touchpad_dispatch *touchpad, uint64_t time_us)
 {
-	notify_button(touchpad->device->seat, time,
+	notify_button(touchpad->device->seat, time_us,
 		      DEFAULT_TOUCHPAD_SINGLE_TAP_BUTTON,
 		      WL_POINTER_BUTTON_STATE_PRESSED);
 }
 
 static void
-notify_button_released(struct touchpad_dispatch *touchpad, uint32_t time)
+notify_button_released(struct touchpad_dispatch *touchpad, uint64_t time_us)
 {
-	notify_button(touchpad->device->seat, time,
+	notify_button(touchpad->device->seat, time_us,
 		      DEFAULT_TOUCHPAD_SINGLE_TAP_BUTTON,
 		      WL_POINTER_BUTTON_STATE_RELEASED);
 }
 
 static void
-notify_tap(struct touchpad_dispatch *touchpad, uint32_t time)
+notify_tap(struct touchpad_dispatch *touchpad, uint64_t time_us)
 {
-	notify_button_pressed(touchpad, time);
-	notify_button_released(touchpad, time);
+	notify_button_pressed(touchpad, time_us);
+	notify_button_released(touchpad, time_us);
 }
 
 static void
-process_fsm_events(struct touchpad_dispatch *touchpad, uint32_t time)
+process_fsm_events(struct touchpad_dispatch *touchpad, uint64_t time_us)
 {
 	uint32_t timeout = UINT32_MAX;
 	enum fsm_event *pevent;
@@ -340,11 +345,11 @@ process_fsm_events(struct touchpad_dispatch *touchpad, uint32_t time)
 		case FSM_TAP:
 			switch (event) {
 			case FSM_EVENT_TIMEOUT:
-				notify_tap(touchpad, time);
+				notify_tap(touchpad, time_us);
 				touchpad->fsm.state = FSM_IDLE;
 				break;
 			case FSM_EVENT_TOUCH:
-				notify_button_pressed(touchpad, time);
+				notify_button_pressed(touchpad, time_us);
 				touchpad->fsm.state = FSM_TAP_2;
 				break;
 			default:
@@ -358,8 +363,8 @@ process_fsm_events(struct touchpad_dispatch *touchpad, uint32_t time)
 				touchpad->fsm.state = FSM_DRAG;
 				break;
 			case FSM_EVENT_RELEASE:
-				notify_button_released(touchpad, time);
-				notify_tap(touchpad, time);
+				notify_button_released(touchpad, time_us);
+				notify_tap(touchpad, time_us);
 				touchpad->fsm.state = FSM_IDLE;
 				break;
 			default:
@@ -370,7 +375,7 @@ process_fsm_events(struct touchpad_dispatch *touchpad, uint32_t time)
 		case FSM_DRAG:
 			switch (event) {
 			case FSM_EVENT_RELEASE:
-				notify_button_released(touchpad, time);
+				notify_button_released(touchpad, time_us);
 				touchpad->fsm.state = FSM_IDLE;
 				break;
 			default:
@@ -386,9 +391,11 @@ process_fsm_events(struct touchpad_dispatch *touchpad, uint32_t time)
 		}
 	}
 
-	if (timeout != UINT32_MAX)
+	if (timeout != UINT32_MAX) {
+		timeout = evdev_device_timeout(touchpad->device, timeout);
 		wl_event_source_timer_update(touchpad->fsm.timer_source,
 					     timeout);
+	}
 
 	wl_array_release(&touchpad->fsm.events);
 	wl_array_init(&touchpad->fsm.events);
@@ -417,14 +424,15 @@ fsm_timout_handler(void *data)
 
 	if (touchpad->fsm.events.size == 0) {
 		push_fsm_event(touchpad, FSM_EVENT_TIMEOUT);
-		process_fsm_events(touchpad, weston_compositor_get_time());
+		process_fsm_events(touchpad,
+				   evdev_device_get_time_usec(touchpad->device));
 	}
 
 	return 1;
 }
 
 static void
-touchpad_update_state(struct touchpad_dispatch *touchpad, uint32_t time)
+touchpad_update_state(struct touchpad_dispatch *touchpad, uint64_t time_us)
 {
 	int motion_index;
 	int center_x, center_y;
@@ -440,7 +448,7 @@ touchpad_update_state(struct touchpad_dispatch *touchpad, uint32_t time)
 
 		touchpad->last_finger_state = touchpad->finger_state;
 
-		process_fsm_events(touchpad, time);
+		process_fsm_events(touchpad, time_us);
 
 		return;
 	}
@@ -487,7 +495,7 @@ touchpad_update_state(struct touchpad_dispatch *touchpad, uint32_t time)
 	if (touchpad->motion_count >= 4) {
 		touchpad_get_delta(touchpad, &dx, &dy);
 
-		filter_motion(touchpad, &dx, &dy, time);
+		filter_motion(touchpad, &dx, &dy, time_us);
 
 		if (touchpad->finger_state == TOUCHPAD_FINGERS_ONE) {
 			touchpad->device->rel.dx = wl_fixed_from_double(dx);
@@ -497,12 +505,12 @@ touchpad_update_state(struct touchpad_dispatch *touchpad, uint32_t time)
 		} else if (touchpad->finger_state == TOUCHPAD_FINGERS_TWO) {
 			if (dx != 0.0)
 				notify_axis(touchpad->device->seat,
-					    time,
+					    time_us,
 					    WL_POINTER_AXIS_HORIZONTAL_SCROLL,
 					    wl_fixed_from_double(dx));
 			if (dy != 0.0)
 				notify_axis(touchpad->device->seat,
-					    time,
+					    time_us,
 					    WL_POINTER_AXIS_VERTICAL_SCROLL,
 					    wl_fixed_from_double(dy));
 		}
@@ -514,7 +522,7 @@ touchpad_update_state(struct touchpad_dispatch *touchpad, uint32_t time)
 		push_fsm_event(touchpad, FSM_EVENT_MOTION);
 	}
 
-	process_fsm_events(touchpad, time);
+	process_fsm_events(touchpad, time_us);
 }
 
 static void
@@ -571,7 +579,7 @@ static inline void
 process_key(struct touchpad_dispatch *touchpad,
 	    struct evdev_device *device,
 	    struct input_event *e,
-	    uint32_t time)
+	    uint64_t time_us)
 {
 	uint32_t code;
 
@@ -597,7 +605,7 @@ process_key(struct touchpad_dispatch *touchpad,
 			code = BTN_RIGHT;
 		else
 			code = e->code;
-		notify_button(device->seat, time, code,
+		notify_button(device->seat, time_us, code,
 			      e->value ? WL_POINTER_BUTTON_STATE_PRESSED :
 			                 WL_POINTER_BUTTON_STATE_RELEASED);
 		break;
@@ -635,7 +643,7 @@ static void
 touchpad_process(struct evdev_dispatch *dispatch,
 		 struct evdev_device *device,
 		 struct input_event *e,
-		 uint32_t time)
+		 uint64_t time_us)
 {
 	struct touchpad_dispatch *touchpad =
 		(struct touchpad_dispatch *) dispatch;
@@ -649,11 +657,11 @@ touchpad_process(struct evdev_dispatch *dispatch,
 		process_absolute(touchpad, device, e);
 		break;
 	case EV_KEY:
-		process_key(touchpad, device, e, time);
+		process_key(touchpad, device, e, time_us);
 		break;
 	}
 
-	touchpad_update_state(touchpad, time);
+	touchpad_update_state(touchpad, time_us);
 }
 
 static void
@@ -672,6 +680,30 @@ struct evdev_dispatch_interface touchpad_interface = {
 	touchpad_destroy
 };
 
+static int
+parse_accel_curve(const char *string, double *curve, int max)
+{
+	char *end;
+	int count = 0;
+
+	while (*string) {
+		if (*string == ' ' || *string == ',') {
+			string++;
+			continue;
+		}
+		if (count == max)
+			return -1;
+
+		curve[count] = strtod(string, &end);
+		if (end == string || curve[count] < 0.0)
+			return -1;
+		count++;
+		string = end;
+	}
+
+	return count;
+}
+
 static void
 touchpad_parse_config(struct touchpad_dispatch *touchpad, double diagonal)
 {
@@ -682,6 +714,8 @@ touchpad_parse_config(struct touchpad_dispatch *touchpad, double diagonal)
 	double constant_accel_factor;
 	double min_accel_factor;
 	double max_accel_factor;
+	double accel_curve_step;
+	char *accel_curve;
 
 	config_fd = open_config_file("weston.ini");
 	config = weston_config_parse(config_fd);
@@ -702,6 +736,56 @@ touchpad_parse_config(struct touchpad_dispatch *touchpad, double diagonal)
 		constant_accel_factor / diagonal;
 	touchpad->min_accel_factor = min_accel_factor;
 	touchpad->max_accel_factor = max_accel_factor;
+
+	/* The curve step is given in touchpad diagonals per second, so
+	 * one curve fits touchpads of any resolution. */
+	weston_config_section_get_string(s, "accel_curve", &accel_curve, NULL);
+	weston_config_section_get_double(s, "accel_curve_step",
+					 &accel_curve_step,
+					 DEFAULT_ACCEL_CURVE_STEP);
+
+	touchpad->accel_curve_size = 0;
+	touchpad->accel_curve_step = accel_curve_step * diagonal / 1000.0;
+	if (accel_curve) {
+		touchpad->accel_curve_size =
+			parse_accel_curve(accel_curve, touchpad->accel_curve,
+					  MAX_ACCEL_CURVE_POINTS);
+		if (touchpad->accel_curve_size < 0 ||
+		    touchpad->accel_curve_step <= 0.0) {
+			weston_log("touchpad: invalid accel_curve \"%s\", "
+				   "using the default profile\n", accel_curve);
+			touchpad->accel_curve_size = 0;
+		}
+		free(accel_curve);
+	}
+
+	weston_config_destroy(config);
+}
+
+static int
+touchpad_configure_accel_table(struct touchpad_dispatch *touchpad)
+{
+	double min_velocity, max_velocity;
+
+	if (touchpad->accel_curve_size > 0)
+		return pointer_accelerator_set_table(touchpad->filter,
+						     touchpad->accel_curve,
+						     touchpad->accel_curve_size,
+						     touchpad->accel_curve_step);
+
+	/* touchpad_profile() is linear between the velocities where it
+	 * hits its two clamps, so a table spanning exactly that range
+	 * reproduces it, knees included. */
+	if (touchpad->constant_accel_factor <= 0.0)
+		return -1;
+	min_velocity = touchpad->min_accel_factor /
+		touchpad->constant_accel_factor;
+	max_velocity = touchpad->max_accel_factor /
+		touchpad->constant_accel_factor;
+
+	return pointer_accelerator_sample_profile(touchpad->filter, touchpad,
+						  min_velocity, max_velocity,
+						  ACCEL_TABLE_SIZE);
 }
 
 static int
@@ -710,10 +794,7 @@ touchpad_init(struct touchpad_dispatch *touchpad,
 {
 	struct weston_motion_filter *accel;
 	struct wl_event_loop *loop;
-
-	unsigned long prop_bits[INPUT_PROP_MAX];
-	struct input_absinfo absinfo;
-	unsigned long abs_bits[NBITS(ABS_MAX)];
+	const struct evdev_device_description *desc = &device->desc;
 
 	bool has_buttonpad;
 
@@ -727,17 +808,13 @@ touchpad_init(struct touchpad_dispatch *touchpad,
 	/* Detect model */
 	touchpad->model = get_touchpad_model(device);
 
-	ioctl(device->fd, EVIOCGPROP(sizeof(prop_bits)), prop_bits);
-	has_buttonpad = TEST_BIT(prop_bits, INPUT_PROP_BUTTONPAD);
+	has_buttonpad = TEST_BIT(desc->prop_bits, INPUT_PROP_BUTTONPAD);
 
 	/* Configure pressure */
-	ioctl(device->fd, EVIOCGBIT(EV_ABS, sizeof(abs_bits)), abs_bits);
-	if (TEST_BIT(abs_bits, ABS_PRESSURE)) {
-		ioctl(device->fd, EVIOCGABS(ABS_PRESSURE), &absinfo);
+	if (TEST_BIT(desc->abs_bits, ABS_PRESSURE))
 		configure_touchpad_pressure(touchpad,
-					    absinfo.minimum,
-					    absinfo.maximum);
-	}
+					    desc->absinfo[ABS_PRESSURE].minimum,
+					    desc->absinfo[ABS_PRESSURE].maximum);
 
 	/* Configure acceleration factor */
 	width = abs(device->abs.max_x - device->abs.min_x);
@@ -759,6 +836,9 @@ touchpad_init(struct touchpad_dispatch *touchpad,
 		return -1;
 	touchpad->filter = accel;
 
+	if (touchpad_configure_accel_table(touchpad) < 0)
+		weston_log("touchpad: not using an acceleration table\n");
+
 	/* Setup initial state */
 	touchpad->reset = 1;
 
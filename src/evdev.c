@@ -27,6 +27,7 @@
 #include <linux/input.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
 #include <mtdev.h>
 
 #include "compositor.h"
@@ -74,13 +75,19 @@ evdev_led_update(struct evdev_device *device, enum weston_led leds)
 	ev[i].type = EV_SYN;
 	ev[i].code = SYN_REPORT;
 
+	if (device->fd < 0)
+		return;
+
 	i = write(device->fd, ev, sizeof ev);
 	(void)i; /* no, we really don't care about the return value */
 }
 
 static inline void
-evdev_process_key(struct evdev_device *device, struct input_event *e, int time)
+evdev_process_key(struct evdev_device *device, struct input_event *e,
+		  uint64_t time_us)
 {
+	uint32_t time = time_us / 1000;
+
 	/* ignore kernel key repeat */
 	if (e->value == 2)
 		return;
@@ -95,15 +102,17 @@ evdev_process_key(struct evdev_device *device, struct input_event *e, int time)
 	case BTN_BACK:
 	case BTN_TASK:
 		notify_button(device->seat,
-			      time, e->code,
+			      time_us, e->code,
 			      e->value ? WL_POINTER_BUTTON_STATE_PRESSED :
 					 WL_POINTER_BUTTON_STATE_RELEASED);
 		break;
 
 	case BTN_TOUCH:
-		if (e->value == 0 && !device->is_mt)
+		if (e->value == 0 && !device->is_mt) {
 			notify_touch(device->seat, time, 0, 0, 0,
 				     WL_TOUCH_UP);
+			notify_touch_frame(device->seat);
+		}
 		break;
 	default:
 		notify_key(device->seat,
@@ -116,32 +125,102 @@ evdev_process_key(struct evdev_device *device, struct input_event *e, int time)
 }
 
 static void
-evdev_process_touch(struct evdev_device *device, struct input_event *e)
+evdev_flush_touch(struct evdev_device *device, uint32_t time)
+{
+	struct weston_seat *master = device->seat;
+	uint32_t dirty = device->mt.dirty;
+	uint32_t bit;
+	uint8_t pending;
+	wl_fixed_t x, y;
+	int slot;
+
+	if (!dirty)
+		return;
+
+	/* All contacts that changed since the last flush go out together,
+	 * closed by a single frame. */
+	for (slot = 0; dirty; slot++, dirty >>= 1) {
+		if (!(dirty & 1))
+			continue;
+
+		bit = 1u << slot;
+		pending = device->mt.pending[slot];
+		device->mt.pending[slot] = 0;
+
+		if ((pending & EVDEV_ABSOLUTE_MT_UP) &&
+		    (device->mt.active & bit)) {
+			notify_touch(master, time, slot, 0, 0, WL_TOUCH_UP);
+			device->mt.active &= ~bit;
+		}
+
+		if (pending & EVDEV_ABSOLUTE_MT_DOWN) {
+			weston_output_transform_coordinate(device->output,
+							   device->mt.x[slot],
+							   device->mt.y[slot],
+							   &x, &y);
+			notify_touch(master, time, slot, x, y, WL_TOUCH_DOWN);
+			device->mt.active |= bit;
+		} else if ((pending & EVDEV_ABSOLUTE_MT_MOTION) &&
+			   (device->mt.active & bit)) {
+			weston_output_transform_coordinate(device->output,
+							   device->mt.x[slot],
+							   device->mt.y[slot],
+							   &x, &y);
+			notify_touch(master, time, slot, x, y,
+				     WL_TOUCH_MOTION);
+		}
+	}
+
+	device->mt.dirty = 0;
+	notify_touch_frame(master);
+}
+
+static void
+evdev_process_touch(struct evdev_device *device, struct input_event *e,
+		    uint64_t time_us)
 {
 	const int screen_width = device->output->current->width;
 	const int screen_height = device->output->current->height;
+	int slot = device->mt.slot;
+	uint32_t bit;
 
-	switch (e->code) {
-	case ABS_MT_SLOT:
+	if (e->code == ABS_MT_SLOT) {
 		device->mt.slot = e->value;
-		break;
+		return;
+	}
+
+	if (slot < 0 || slot >= MAX_SLOTS)
+		return;
+	bit = 1u << slot;
+
+	switch (e->code) {
 	case ABS_MT_TRACKING_ID:
+		/* A contact that starts and ends before the report is
+		 * flushed: send what we have first to keep the order. */
+		if (device->mt.pending[slot] & EVDEV_ABSOLUTE_MT_DOWN)
+			evdev_flush_touch(device, time_us / 1000);
+
+		/* A new tracking id on an active slot also ends the
+		 * previous contact. */
+		if (device->mt.active & bit)
+			device->mt.pending[slot] |= EVDEV_ABSOLUTE_MT_UP;
 		if (e->value >= 0)
-			device->pending_events |= EVDEV_ABSOLUTE_MT_DOWN;
-		else
-			device->pending_events |= EVDEV_ABSOLUTE_MT_UP;
+			device->mt.pending[slot] |= EVDEV_ABSOLUTE_MT_DOWN;
+		device->mt.dirty |= bit;
 		break;
 	case ABS_MT_POSITION_X:
-		device->mt.x[device->mt.slot] =
+		device->mt.x[slot] =
 			(e->value - device->abs.min_x) * screen_width /
 			(device->abs.max_x - device->abs.min_x);
-		device->pending_events |= EVDEV_ABSOLUTE_MT_MOTION;
+		device->mt.pending[slot] |= EVDEV_ABSOLUTE_MT_MOTION;
+		device->mt.dirty |= bit;
 		break;
 	case ABS_MT_POSITION_Y:
-		device->mt.y[device->mt.slot] =
+		device->mt.y[slot] =
 			(e->value - device->abs.min_y) * screen_height /
 			(device->abs.max_y - device->abs.min_y);
-		device->pending_events |= EVDEV_ABSOLUTE_MT_MOTION;
+		device->mt.pending[slot] |= EVDEV_ABSOLUTE_MT_MOTION;
+		device->mt.dirty |= bit;
 		break;
 	}
 }
@@ -171,7 +250,7 @@ evdev_process_absolute_motion(struct evdev_device *device,
 
 static inline void
 evdev_process_relative(struct evdev_device *device,
-		       struct input_event *e, uint32_t time)
+		       struct input_event *e, uint64_t time_us)
 {
 	switch (e->code) {
 	case REL_X:
@@ -189,7 +268,7 @@ evdev_process_relative(struct evdev_device *device,
 		case 1:
 			/* Scroll up */
 			notify_axis(device->seat,
-				    time,
+				    time_us,
 				    WL_POINTER_AXIS_VERTICAL_SCROLL,
 				    -1 * e->value * DEFAULT_AXIS_STEP_DISTANCE);
 			break;
@@ -204,7 +283,7 @@ evdev_process_relative(struct evdev_device *device,
 		case 1:
 			/* Scroll right */
 			notify_axis(device->seat,
-				    time,
+				    time_us,
 				    WL_POINTER_AXIS_HORIZONTAL_SCROLL,
 				    e->value * DEFAULT_AXIS_STEP_DISTANCE);
 			break;
@@ -216,10 +295,11 @@ evdev_process_relative(struct evdev_device *device,
 }
 
 static inline void
-evdev_process_absolute(struct evdev_device *device, struct input_event *e)
+evdev_process_absolute(struct evdev_device *device, struct input_event *e,
+		       uint64_t time_us)
 {
 	if (device->is_mt) {
-		evdev_process_touch(device, e);
+		evdev_process_touch(device, e, time_us);
 	} else {
 		evdev_process_absolute_motion(device, e);
 	}
@@ -270,48 +350,23 @@ transform_absolute(struct evdev_device *device)
 }
 
 static void
-evdev_flush_motion(struct evdev_device *device, uint32_t time)
+evdev_flush_motion(struct evdev_device *device, uint64_t time_us)
 {
 	struct weston_seat *master = device->seat;
+	uint32_t time = time_us / 1000;
 	wl_fixed_t x, y;
-	int slot;
 
 	if (!(device->pending_events & EVDEV_SYN))
 		return;
 
-	slot = device->mt.slot;
 	device->pending_events &= ~EVDEV_SYN;
 	if (device->pending_events & EVDEV_RELATIVE_MOTION) {
-		notify_motion(master, time, device->rel.dx, device->rel.dy);
+		notify_motion(master, time_us, device->rel.dx, device->rel.dy);
 		device->pending_events &= ~EVDEV_RELATIVE_MOTION;
 		device->rel.dx = 0;
 		device->rel.dy = 0;
 	}
-	if (device->pending_events & EVDEV_ABSOLUTE_MT_DOWN) {
-		weston_output_transform_coordinate(device->output,
-						   device->mt.x[slot],
-						   device->mt.y[slot],
-						   &x, &y);
-		notify_touch(master, time,
-			     device->mt.slot, x, y, WL_TOUCH_DOWN);
-		device->pending_events &= ~EVDEV_ABSOLUTE_MT_DOWN;
-		device->pending_events &= ~EVDEV_ABSOLUTE_MT_MOTION;
-	}
-	if (device->pending_events & EVDEV_ABSOLUTE_MT_MOTION) {
-		weston_output_transform_coordinate(device->output,
-						   device->mt.x[slot],
-						   device->mt.y[slot],
-						   &x, &y);
-		notify_touch(master, time,
-			     device->mt.slot, x, y, WL_TOUCH_MOTION);
-		device->pending_events &= ~EVDEV_ABSOLUTE_MT_DOWN;
-		device->pending_events &= ~EVDEV_ABSOLUTE_MT_MOTION;
-	}
-	if (device->pending_events & EVDEV_ABSOLUTE_MT_UP) {
-		notify_touch(master, time, device->mt.slot, 0, 0,
-			     WL_TOUCH_UP);
-		device->pending_events &= ~EVDEV_ABSOLUTE_MT_UP;
-	}
+	evdev_flush_touch(device, time);
 	if (device->pending_events & EVDEV_ABSOLUTE_MOTION) {
 		transform_absolute(device);
 		weston_output_transform_coordinate(device->output,
@@ -325,8 +380,9 @@ evdev_flush_motion(struct evdev_device *device, uint32_t time)
 			else
 				notify_touch(master, time, 0,
 					     x, y, WL_TOUCH_MOTION);
+			notify_touch_frame(master);
 		} else
-			notify_motion_absolute(master, time, x, y);
+			notify_motion_absolute(master, time_us, x, y);
 		device->pending_events &= ~EVDEV_ABSOLUTE_MOTION;
 	}
 }
@@ -335,17 +391,17 @@ static void
 fallback_process(struct evdev_dispatch *dispatch,
 		 struct evdev_device *device,
 		 struct input_event *event,
-		 uint32_t time)
+		 uint64_t time_us)
 {
 	switch (event->type) {
 	case EV_REL:
-		evdev_process_relative(device, event, time);
+		evdev_process_relative(device, event, time_us);
 		break;
 	case EV_ABS:
-		evdev_process_absolute(device, event);
+		evdev_process_absolute(device, event, time_us);
 		break;
 	case EV_KEY:
-		evdev_process_key(device, event, time);
+		evdev_process_key(device, event, time_us);
 		break;
 	case EV_SYN: /* FIXME: does not handle SYN_REPORT value 1
 			or SYN_DROPPED */
@@ -377,31 +433,35 @@ fallback_dispatch_create(void)
 	return dispatch;
 }
 
-static void
+void
 evdev_process_events(struct evdev_device *device,
 		     struct input_event *ev, int count)
 {
 	struct evdev_dispatch *dispatch = device->dispatch;
 	struct input_event *e, *end;
-	uint32_t time = 0;
+	uint64_t time_us = 0;
+
+	if (device->record_id)
+		evdev_record_events(device, ev, count);
 
 	device->pending_events = 0;
 
 	e = ev;
 	end = e + count;
 	for (e = ev; e < end; e++) {
-		time = e->time.tv_sec * 1000 + e->time.tv_usec / 1000;
+		time_us = (uint64_t) e->time.tv_sec * 1000000 +
+			e->time.tv_usec;
 
 		/* we try to minimize the amount of notifications to be
 		 * forwarded to the compositor, so we accumulate motion
 		 * events and send as a bunch */
 		if (!is_motion_event(e))
-			evdev_flush_motion(device, time);
+			evdev_flush_motion(device, time_us);
 
-		dispatch->interface->process(dispatch, device, e, time);
+		dispatch->interface->process(dispatch, device, e, time_us);
 	}
 
-	evdev_flush_motion(device, time);
+	evdev_flush_motion(device, time_us);
 }
 
 static int
@@ -439,14 +499,45 @@ evdev_device_data(int fd, uint32_t mask, void *data)
 	return 1;
 }
 
+static void
+evdev_describe_device(struct evdev_device *device)
+{
+	struct evdev_device_description *desc = &device->desc;
+	unsigned int i;
+
+	memset(desc, 0, sizeof *desc);
+	strcpy(desc->name, "unknown");
+	ioctl(device->fd, EVIOCGNAME(sizeof(desc->name)), desc->name);
+	desc->name[sizeof(desc->name) - 1] = '\0';
+	ioctl(device->fd, EVIOCGID, &desc->id);
+
+	ioctl(device->fd, EVIOCGBIT(0, sizeof(desc->ev_bits)), desc->ev_bits);
+	if (TEST_BIT(desc->ev_bits, EV_ABS)) {
+		ioctl(device->fd, EVIOCGBIT(EV_ABS, sizeof(desc->abs_bits)),
+		      desc->abs_bits);
+		for (i = 0; i < ABS_CNT; i++)
+			if (TEST_BIT(desc->abs_bits, i))
+				ioctl(device->fd, EVIOCGABS(i),
+				      &desc->absinfo[i]);
+	}
+	if (TEST_BIT(desc->ev_bits, EV_REL))
+		ioctl(device->fd, EVIOCGBIT(EV_REL, sizeof(desc->rel_bits)),
+		      desc->rel_bits);
+	if (TEST_BIT(desc->ev_bits, EV_KEY))
+		ioctl(device->fd, EVIOCGBIT(EV_KEY, sizeof(desc->key_bits)),
+		      desc->key_bits);
+	ioctl(device->fd, EVIOCGPROP(sizeof(desc->prop_bits)),
+	      desc->prop_bits);
+}
+
 static int
 evdev_handle_device(struct evdev_device *device)
 {
-	struct input_absinfo absinfo;
-	unsigned long ev_bits[NBITS(EV_MAX)];
-	unsigned long abs_bits[NBITS(ABS_MAX)];
-	unsigned long rel_bits[NBITS(REL_MAX)];
-	unsigned long key_bits[NBITS(KEY_MAX)];
+	const struct evdev_device_description *desc = &device->desc;
+	const unsigned long *ev_bits = desc->ev_bits;
+	const unsigned long *abs_bits = desc->abs_bits;
+	const unsigned long *rel_bits = desc->rel_bits;
+	const unsigned long *key_bits = desc->key_bits;
 	int has_key, has_abs;
 	unsigned int i;
 
@@ -454,13 +545,9 @@ evdev_handle_device(struct evdev_device *device)
 	has_abs = 0;
 	device->caps = 0;
 
-	ioctl(device->fd, EVIOCGBIT(0, sizeof(ev_bits)), ev_bits);
 	if (TEST_BIT(ev_bits, EV_ABS)) {
 		has_abs = 1;
 
-		ioctl(device->fd, EVIOCGBIT(EV_ABS, sizeof(abs_bits)),
-		      abs_bits);
-
 		if (TEST_BIT(abs_bits, ABS_WHEEL) ||
 		    TEST_BIT(abs_bits, ABS_GAS) ||
 		    TEST_BIT(abs_bits, ABS_BRAKE) ||
@@ -471,15 +558,13 @@ evdev_handle_device(struct evdev_device *device)
 		}
 
 		if (TEST_BIT(abs_bits, ABS_X)) {
-			ioctl(device->fd, EVIOCGABS(ABS_X), &absinfo);
-			device->abs.min_x = absinfo.minimum;
-			device->abs.max_x = absinfo.maximum;
+			device->abs.min_x = desc->absinfo[ABS_X].minimum;
+			device->abs.max_x = desc->absinfo[ABS_X].maximum;
 			device->caps |= EVDEV_MOTION_ABS;
 		}
 		if (TEST_BIT(abs_bits, ABS_Y)) {
-			ioctl(device->fd, EVIOCGABS(ABS_Y), &absinfo);
-			device->abs.min_y = absinfo.minimum;
-			device->abs.max_y = absinfo.maximum;
+			device->abs.min_y = desc->absinfo[ABS_Y].minimum;
+			device->abs.max_y = desc->absinfo[ABS_Y].maximum;
 			device->caps |= EVDEV_MOTION_ABS;
 		}
                 /* We only handle the slotted Protocol B in weston.
@@ -487,19 +572,21 @@ evdev_handle_device(struct evdev_device *device)
                    require mtdev for conversion. */
 		if (TEST_BIT(abs_bits, ABS_MT_POSITION_X) &&
 		    TEST_BIT(abs_bits, ABS_MT_POSITION_Y)) {
-			ioctl(device->fd, EVIOCGABS(ABS_MT_POSITION_X),
-			      &absinfo);
-			device->abs.min_x = absinfo.minimum;
-			device->abs.max_x = absinfo.maximum;
-			ioctl(device->fd, EVIOCGABS(ABS_MT_POSITION_Y),
-			      &absinfo);
-			device->abs.min_y = absinfo.minimum;
-			device->abs.max_y = absinfo.maximum;
+			device->abs.min_x =
+				desc->absinfo[ABS_MT_POSITION_X].minimum;
+			device->abs.max_x =
+				desc->absinfo[ABS_MT_POSITION_X].maximum;
+			device->abs.min_y =
+				desc->absinfo[ABS_MT_POSITION_Y].minimum;
+			device->abs.max_y =
+				desc->absinfo[ABS_MT_POSITION_Y].maximum;
 			device->is_mt = 1;
 			device->caps |= EVDEV_TOUCH;
 
 			if (!TEST_BIT(abs_bits, ABS_MT_SLOT)) {
-				device->mtdev = mtdev_new_open(device->fd);
+				if (device->fd >= 0)
+					device->mtdev =
+						mtdev_new_open(device->fd);
 				if (!device->mtdev) {
 					evdev_log(device,
 						  "mtdev required but failed to open\n");
@@ -507,22 +594,17 @@ evdev_handle_device(struct evdev_device *device)
 				}
 				device->mt.slot = device->mtdev->caps.slot.value;
 			} else {
-				ioctl(device->fd, EVIOCGABS(ABS_MT_SLOT),
-				      &absinfo);
-				device->mt.slot = absinfo.value;
+				device->mt.slot =
+					desc->absinfo[ABS_MT_SLOT].value;
 			}
 		}
 	}
 	if (TEST_BIT(ev_bits, EV_REL)) {
-		ioctl(device->fd, EVIOCGBIT(EV_REL, sizeof(rel_bits)),
-		      rel_bits);
 		if (TEST_BIT(rel_bits, REL_X) || TEST_BIT(rel_bits, REL_Y))
 			device->caps |= EVDEV_MOTION_REL;
 	}
 	if (TEST_BIT(ev_bits, EV_KEY)) {
 		has_key = 1;
-		ioctl(device->fd, EVIOCGBIT(EV_KEY, sizeof(key_bits)),
-		      key_bits);
 		if (TEST_BIT(key_bits, BTN_TOOL_FINGER) &&
 		    !TEST_BIT(key_bits, BTN_TOOL_PEN) &&
 		    has_abs) {
@@ -587,12 +669,11 @@ evdev_configure_device(struct evdev_device *device)
 	return 0;
 }
 
-struct evdev_device *
-evdev_device_create(struct weston_seat *seat, const char *path, int device_fd)
+static struct evdev_device *
+evdev_device_alloc(struct weston_seat *seat, const char *path, int device_fd)
 {
 	struct evdev_device *device;
 	struct weston_compositor *ec;
-	char devname[256] = "unknown";
 
 	device = zalloc(sizeof *device);
 	if (device == NULL)
@@ -611,25 +692,72 @@ evdev_device_create(struct weston_seat *seat, const char *path, int device_fd)
 	device->rel.dy = 0;
 	device->dispatch = NULL;
 	device->fd = device_fd;
+	wl_list_init(&device->link);
 
-	ioctl(device->fd, EVIOCGNAME(sizeof(devname)), devname);
-	devname[sizeof(devname) - 1] = '\0';
-	device->devname = strdup(devname);
+	return device;
+}
 
-	if (!evdev_handle_device(device)) {
-		evdev_device_destroy(device);
-		return EVDEV_UNHANDLED_DEVICE;
-	}
+static int
+evdev_device_setup(struct evdev_device *device)
+{
+	device->devname = strdup(device->desc.name);
+
+	if (!evdev_handle_device(device))
+		return 0;
 
 	if (evdev_configure_device(device) == -1)
-		goto err;
+		return -1;
 
 	/* If the dispatch was not set up use the fallback. */
 	if (device->dispatch == NULL)
 		device->dispatch = fallback_dispatch_create();
 	if (device->dispatch == NULL)
+		return -1;
+
+	evdev_record_add_device(device);
+
+	return 1;
+}
+
+struct evdev_device *
+evdev_device_create(struct weston_seat *seat, const char *path, int device_fd)
+{
+	struct evdev_device *device;
+	struct weston_compositor *ec = seat->compositor;
+	int ret;
+#ifdef EVIOCSCLOCKID
+	int clockid = CLOCK_MONOTONIC;
+#endif
+
+	device = evdev_device_alloc(seat, path, device_fd);
+	if (device == NULL)
+		return NULL;
+
+	evdev_describe_device(device);
+
+#ifdef EVIOCSCLOCKID
+	/* Have the kernel stamp events with the same clock as
+	 * weston_compositor_get_time_usec(), so that input latency can be
+	 * measured against it. */
+	if (ioctl(device->fd, EVIOCSCLOCKID, &clockid) < 0)
+		weston_log("evdev: %s: failed to select monotonic clock\n",
+			   device->desc.name);
+#endif
+
+	ret = evdev_device_setup(device);
+	if (ret == 0) {
+		evdev_device_destroy(device);
+		return EVDEV_UNHANDLED_DEVICE;
+	}
+	if (ret < 0)
 		goto err;
 
+	/* Prefer the reader thread, fall back to reading the device
+	 * from the input loop. */
+	device->reader = evdev_reader_add_device(device);
+	if (device->reader)
+		return device;
+
 	device->source = wl_event_loop_add_fd(ec->input_loop, device->fd,
 					      WL_EVENT_READABLE,
 					      evdev_device_data, device);
@@ -643,11 +771,69 @@ err:
 	return NULL;
 }
 
+/* Create a device that has no kernel counterpart; its events are fed
+ * to evdev_process_events() by the input replay code.  replay may be
+ * NULL, in which case the device runs on the compositor clock. */
+struct evdev_device *
+evdev_device_create_replay(struct weston_seat *seat, const char *path,
+			   const struct evdev_device_description *desc,
+			   struct evdev_replay *replay)
+{
+	struct evdev_device *device;
+	int ret;
+
+	device = evdev_device_alloc(seat, path, -1);
+	if (device == NULL)
+		return NULL;
+
+	device->desc = *desc;
+	device->replay = replay;
+
+	ret = evdev_device_setup(device);
+	if (ret == 0) {
+		evdev_device_destroy(device);
+		return EVDEV_UNHANDLED_DEVICE;
+	}
+	if (ret < 0) {
+		evdev_device_destroy(device);
+		return NULL;
+	}
+
+	return device;
+}
+
+/* The clock the device's event timestamps are on.  A replay runs its
+ * own clock, at the recorded rate times the replay speed. */
+uint64_t
+evdev_device_get_time_usec(struct evdev_device *device)
+{
+	if (device->replay)
+		return evdev_replay_get_time_usec(device->replay);
+
+	return weston_compositor_get_time_usec();
+}
+
+/* Convert a timeout on the device clock to a wall clock timer period,
+ * as passed to wl_event_source_timer_update(). */
+uint32_t
+evdev_device_timeout(struct evdev_device *device, uint32_t msecs)
+{
+	if (device->replay)
+		return evdev_replay_timeout(device->replay, msecs);
+
+	return msecs;
+}
+
 void
 evdev_device_destroy(struct evdev_device *device)
 {
 	struct evdev_dispatch *dispatch;
 
+	if (device->reader)
+		evdev_reader_remove_device(device->reader, device);
+	if (device->record_id)
+		evdev_record_remove_device(device);
+
 	dispatch = device->dispatch;
 	if (dispatch)
 		dispatch->interface->destroy(dispatch);
@@ -658,7 +844,8 @@ evdev_device_destroy(struct evdev_device *device)
 		wl_list_remove(&device->link);
 	if (device->mtdev)
 		mtdev_close_delete(device->mtdev);
-	close(device->fd);
+	if (device->fd >= 0)
+		close(device->fd);
 	free(device->devname);
 	free(device->devnode);
 	free(device);
@@ -681,6 +868,9 @@ evdev_notify_keyboard_focus(struct weston_seat *seat,
 
 	memset(all_keys, 0, sizeof all_keys);
 	wl_list_for_each(device, evdev_devices, link) {
+		if (device->fd < 0)
+			continue;
+
 		memset(evdev_keys, 0, sizeof evdev_keys);
 		ret = ioctl(device->fd,
 			    EVIOCGKEY(sizeof evdev_keys), evdev_keys);
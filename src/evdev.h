@@ -26,7 +26,7 @@
 #include <linux/input.h>
 #include <wayland-util.h>
 
-#define MAX_SLOTS 16
+#define MAX_SLOTS 32
 
 enum evdev_event_type {
 	EVDEV_ABSOLUTE_MOTION = (1 << 0),
@@ -45,15 +45,46 @@ enum evdev_device_capability {
 	EVDEV_TOUCH = (1 << 4),
 };
 
+/* copied from udev/extras/input_id/input_id.c */
+/* we must use this kernel-compatible implementation */
+#define BITS_PER_LONG (sizeof(unsigned long) * 8)
+#define NBITS(x) ((((x)-1)/BITS_PER_LONG)+1)
+#define OFF(x)  ((x)%BITS_PER_LONG)
+#define BIT(x)  (1UL<<OFF(x))
+#define LONG(x) ((x)/BITS_PER_LONG)
+#define TEST_BIT(array, bit)    ((array[LONG(bit)] >> OFF(bit)) & 1)
+/* end copied */
+
+/* Everything evdev asks the kernel about a device when setting it up.
+ * It is read with ioctls for real devices, and from the recording for
+ * replayed ones, see evdev-record.c. */
+struct evdev_device_description {
+	char name[256];
+	struct input_id id;
+	unsigned long ev_bits[NBITS(EV_MAX)];
+	unsigned long abs_bits[NBITS(ABS_MAX)];
+	unsigned long rel_bits[NBITS(REL_MAX)];
+	unsigned long key_bits[NBITS(KEY_MAX)];
+	unsigned long prop_bits[NBITS(INPUT_PROP_MAX)];
+	struct input_absinfo absinfo[ABS_CNT];
+};
+
+struct evdev_reader;
+struct evdev_replay;
+
 struct evdev_device {
 	struct weston_seat *seat;
 	struct wl_list link;
 	struct wl_event_source *source;
+	struct evdev_reader *reader;
 	struct weston_output *output;
 	struct evdev_dispatch *dispatch;
 	char *devnode;
 	char *devname;
-	int fd;
+	int fd; /* -1 for replayed devices */
+	struct evdev_replay *replay; /* NULL unless replayed */
+	struct evdev_device_description desc;
+	uint32_t record_id; /* 0 when not being recorded */
 	struct {
 		int min_x, max_x, min_y, max_y;
 		int32_t x, y;
@@ -66,6 +97,11 @@ struct evdev_device {
 		int slot;
 		int32_t x[MAX_SLOTS];
 		int32_t y[MAX_SLOTS];
+		/* EVDEV_ABSOLUTE_MT_* changes per slot since the last
+		 * flush; bit n of dirty is set when slot n has any */
+		uint8_t pending[MAX_SLOTS];
+		uint32_t dirty;
+		uint32_t active; /* slots with a contact down */
 	} mt;
 	struct mtdev *mtdev;
 
@@ -79,26 +115,17 @@ struct evdev_device {
 	int is_mt;
 };
 
-/* copied from udev/extras/input_id/input_id.c */
-/* we must use this kernel-compatible implementation */
-#define BITS_PER_LONG (sizeof(unsigned long) * 8)
-#define NBITS(x) ((((x)-1)/BITS_PER_LONG)+1)
-#define OFF(x)  ((x)%BITS_PER_LONG)
-#define BIT(x)  (1UL<<OFF(x))
-#define LONG(x) ((x)/BITS_PER_LONG)
-#define TEST_BIT(array, bit)    ((array[LONG(bit)] >> OFF(bit)) & 1)
-/* end copied */
-
 #define EVDEV_UNHANDLED_DEVICE ((struct evdev_device *) 1)
 
 struct evdev_dispatch;
 
 struct evdev_dispatch_interface {
-	/* Process an evdev input event. */
+	/* Process an evdev input event, time_us being the event's
+	 * CLOCK_MONOTONIC timestamp in microseconds. */
 	void (*process)(struct evdev_dispatch *dispatch,
 			struct evdev_device *device,
 			struct input_event *event,
-			uint32_t time);
+			uint64_t time_us);
 
 	/* Destroy an event dispatch handler and free all its resources. */
 	void (*destroy)(struct evdev_dispatch *dispatch);
@@ -117,6 +144,17 @@ evdev_led_update(struct evdev_device *device, enum weston_led leds);
 struct evdev_device *
 evdev_device_create(struct weston_seat *seat, const char *path, int device_fd);
 
+struct evdev_device *
+evdev_device_create_replay(struct weston_seat *seat, const char *path,
+			   const struct evdev_device_description *desc,
+			   struct evdev_replay *replay);
+
+uint64_t
+evdev_device_get_time_usec(struct evdev_device *device);
+
+uint32_t
+evdev_device_timeout(struct evdev_device *device, uint32_t msecs);
+
 void
 evdev_device_destroy(struct evdev_device *device);
 
@@ -126,4 +164,39 @@ evdev_notify_keyboard_focus(struct weston_seat *seat,
 
 void
 evdev_log(struct evdev_device *device, const char *fmt, ...);
+
+void
+evdev_process_events(struct evdev_device *device,
+		     struct input_event *ev, int count);
+
+struct evdev_reader *
+evdev_reader_add_device(struct evdev_device *device);
+
+void
+evdev_reader_remove_device(struct evdev_reader *reader,
+			   struct evdev_device *device);
+
+void
+evdev_record_add_device(struct evdev_device *device);
+
+void
+evdev_record_events(struct evdev_device *device,
+		    struct input_event *ev, int count);
+
+void
+evdev_record_remove_device(struct evdev_device *device);
+
+struct evdev_replay *
+evdev_replay_create(struct weston_seat *seat, const char *path,
+		    double speed);
+
+void
+evdev_replay_destroy(struct evdev_replay *replay);
+
+uint64_t
+evdev_replay_get_time_usec(struct evdev_replay *replay);
+
+uint32_t
+evdev_replay_timeout(struct evdev_replay *replay, uint32_t msecs);
+
 #endif /* EVDEV_H */
@@ -24,6 +24,7 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <limits.h>
 #include <math.h>
 
@@ -35,9 +36,9 @@
 void
 weston_filter_dispatch(struct weston_motion_filter *filter,
 		       struct weston_motion_params *motion,
-		       void *data, uint32_t time)
+		       void *data, uint64_t time_us)
 {
-	filter->interface->filter(filter, motion, data, time);
+	filter->interface->filter(filter, motion, data, time_us);
 }
 
 /*
@@ -45,13 +46,13 @@ weston_filter_dispatch(struct weston_motion_filter *filter,
  */
 
 #define MAX_VELOCITY_DIFF	1.0
-#define MOTION_TIMEOUT		300 /* (ms) */
+#define MOTION_TIMEOUT		300000 /* (us) */
 #define NUM_POINTER_TRACKERS	16
 
 struct pointer_tracker {
 	double dx;
 	double dy;
-	uint32_t time;
+	uint64_t time;
 	int dir;
 };
 
@@ -61,6 +62,13 @@ struct pointer_accelerator {
 
 	accel_profile_func_t profile;
 
+	/* Optional profile lookup table, see
+	 * pointer_accelerator_set_table(). */
+	double *table;
+	int table_size;
+	double table_start; /* velocity of the first entry */
+	double table_scale; /* entries per velocity unit */
+
 	double velocity;
 	double last_velocity;
 	int last_dx;
@@ -82,12 +90,20 @@ enum directions {
 	UNDEFINED_DIRECTION = 0xff
 };
 
+/* tan(4.5°) and tan(40.5°) scaled by 10^6: a motion within 4.5° of a
+ * compass point only marks that octant, otherwise both neighbouring
+ * octants are marked. */
+#define TAN_SCALE	1000000
+#define TAN_4_5		78702
+#define TAN_40_5	854081
+
 static int
 get_direction(int dx, int dy)
 {
 	int dir = UNDEFINED_DIRECTION;
-	int d1, d2;
-	double r;
+	int ax = abs(dx), ay = abs(dy);
+	int64_t major, minor;
+	int axis, diagonal;
 
 	if (abs(dx) < 2 && abs(dy) < 2) {
 		if (dx > 0 && dy > 0)
@@ -108,21 +124,30 @@ get_direction(int dx, int dy)
 			dir = NE | N | NW;
 	}
 	else {
-		/* Calculate r within the interval  [0 to 8)
-		 *
-		 * r = [0 .. 2π] where 0 is North
-		 * d_f = r / 2π  ([0 .. 1))
-		 * d_8 = 8 * d_f
-		 */
-		r = atan2(dy, dx);
-		r = fmod(r + 2.5*M_PI, 2*M_PI);
-		r *= 4*M_1_PI;
+		/* Find the nearest axis and diagonal and how far the
+		 * motion is from the axis, without trigonometry. */
+		if (ax >= ay) {
+			axis = dx > 0 ? E : W;
+			major = ax;
+			minor = ay;
+		} else {
+			axis = dy > 0 ? S : N;
+			major = ay;
+			minor = ax;
+		}
+
+		if (dy < 0)
+			diagonal = dx > 0 ? NE : NW;
+		else
+			diagonal = dx > 0 ? SE : SW;
 
 		/* Mark one or two close enough octants */
-		d1 = (int)(r + 0.9) % 8;
-		d2 = (int)(r + 0.1) % 8;
-
-		dir = (1 << d1) | (1 << d2);
+		if (minor * TAN_SCALE < major * TAN_4_5)
+			dir = axis;
+		else if (minor * TAN_SCALE >= major * TAN_40_5)
+			dir = diagonal;
+		else
+			dir = axis | diagonal;
 	}
 
 	return dir;
@@ -131,7 +156,7 @@ get_direction(int dx, int dy)
 static void
 feed_trackers(struct pointer_accelerator *accel,
 	      double dx, double dy,
-	      uint32_t time)
+	      uint64_t time)
 {
 	int i, current;
 	struct pointer_tracker *trackers = accel->trackers;
@@ -160,7 +185,7 @@ tracker_by_offset(struct pointer_accelerator *accel, unsigned int offset)
 }
 
 static double
-calculate_tracker_velocity(struct pointer_tracker *tracker, uint32_t time)
+calculate_tracker_velocity(struct pointer_tracker *tracker, uint64_t time)
 {
 	int dx;
 	int dy;
@@ -169,11 +194,13 @@ calculate_tracker_velocity(struct pointer_tracker *tracker, uint32_t time)
 	dx = tracker->dx;
 	dy = tracker->dy;
 	distance = sqrt(dx*dx + dy*dy);
-	return distance / (double)(time - tracker->time);
+	/* Velocity stays in units per millisecond, as the acceleration
+	 * profiles expect, but is measured at microsecond resolution. */
+	return distance * 1000.0 / (double)(time - tracker->time);
 }
 
 static double
-calculate_velocity(struct pointer_accelerator *accel, uint32_t time)
+calculate_velocity(struct pointer_accelerator *accel, uint64_t time)
 {
 	struct pointer_tracker *tracker;
 	double velocity;
@@ -225,16 +252,36 @@ calculate_velocity(struct pointer_accelerator *accel, uint32_t time)
 	return result;
 }
 
+static double
+table_lookup(struct pointer_accelerator *accel, double velocity)
+{
+	double pos = (velocity - accel->table_start) * accel->table_scale;
+	int i;
+
+	if (pos <= 0.0)
+		return accel->table[0];
+	if (pos >= accel->table_size - 1)
+		return accel->table[accel->table_size - 1];
+
+	i = (int) pos;
+	pos -= i;
+
+	return accel->table[i] + (accel->table[i + 1] - accel->table[i]) * pos;
+}
+
 static double
 acceleration_profile(struct pointer_accelerator *accel,
-		     void *data, double velocity, uint32_t time)
+		     void *data, double velocity, uint64_t time)
 {
+	if (accel->table)
+		return table_lookup(accel, velocity);
+
 	return accel->profile(&accel->base, data, velocity, time);
 }
 
 static double
 calculate_acceleration(struct pointer_accelerator *accel,
-		       void *data, double velocity, uint32_t time)
+		       void *data, double velocity, uint64_t time)
 {
 	double factor;
 
@@ -276,7 +323,7 @@ apply_softening(struct pointer_accelerator *accel,
 static void
 accelerator_filter(struct weston_motion_filter *filter,
 		   struct weston_motion_params *motion,
-		   void *data, uint32_t time)
+		   void *data, uint64_t time)
 {
 	struct pointer_accelerator *accel =
 		(struct pointer_accelerator *) filter;
@@ -304,6 +351,7 @@ accelerator_destroy(struct weston_motion_filter *filter)
 	struct pointer_accelerator *accel =
 		(struct pointer_accelerator *) filter;
 
+	free(accel->table);
 	free(accel->trackers);
 	free(accel);
 }
@@ -326,6 +374,10 @@ create_pointer_accelator_filter(accel_profile_func_t profile)
 	wl_list_init(&filter->base.link);
 
 	filter->profile = profile;
+	filter->table = NULL;
+	filter->table_size = 0;
+	filter->table_start = 0.0;
+	filter->table_scale = 0.0;
 	filter->last_velocity = 0.0;
 	filter->last_dx = 0;
 	filter->last_dy = 0;
@@ -336,3 +388,71 @@ create_pointer_accelator_filter(accel_profile_func_t profile)
 
 	return &filter->base;
 }
+
+/* Replace the profile function of a pointer accelerator with a lookup
+ * table: factors[i] is the acceleration at velocity i * step (in units
+ * per millisecond).  Velocities in between are interpolated linearly,
+ * velocities beyond the last entry use the last factor. */
+WL_EXPORT int
+pointer_accelerator_set_table(struct weston_motion_filter *filter,
+			      const double *factors, int count, double step)
+{
+	struct pointer_accelerator *accel =
+		(struct pointer_accelerator *) filter;
+	double *table;
+
+	if (filter->interface != &accelerator_interface ||
+	    count < 1 || step <= 0.0)
+		return -1;
+
+	table = malloc(count * sizeof *table);
+	if (table == NULL)
+		return -1;
+
+	memcpy(table, factors, count * sizeof *table);
+
+	free(accel->table);
+	accel->table = table;
+	accel->table_size = count;
+	accel->table_start = 0.0;
+	accel->table_scale = 1.0 / step;
+
+	return 0;
+}
+
+/* Precompute the profile function of a pointer accelerator at count
+ * evenly spaced velocities from min_velocity to max_velocity and use
+ * the table from then on.  Velocities outside that range use the first
+ * or last factor, so a profile that is constant below min_velocity and
+ * above max_velocity and linear in between is reproduced exactly.  The
+ * profile must not depend on time. */
+WL_EXPORT int
+pointer_accelerator_sample_profile(struct weston_motion_filter *filter,
+				   void *data, double min_velocity,
+				   double max_velocity, int count)
+{
+	struct pointer_accelerator *accel =
+		(struct pointer_accelerator *) filter;
+	double *factors, step;
+	int i, ret;
+
+	if (filter->interface != &accelerator_interface ||
+	    count < 2 || min_velocity < 0.0 || max_velocity <= min_velocity)
+		return -1;
+
+	factors = malloc(count * sizeof *factors);
+	if (factors == NULL)
+		return -1;
+
+	step = (max_velocity - min_velocity) / (count - 1);
+	for (i = 0; i < count; i++)
+		factors[i] = accel->profile(filter, data,
+					    min_velocity + i * step, 0);
+
+	ret = pointer_accelerator_set_table(filter, factors, count, step);
+	if (ret == 0)
+		accel->table_start = min_velocity;
+	free(factors);
+
+	return ret;
+}
@@ -36,13 +36,13 @@ struct weston_motion_filter;
 WL_EXPORT void
 weston_filter_dispatch(struct weston_motion_filter *filter,
 		       struct weston_motion_params *motion,
-		       void *data, uint32_t time);
+		       void *data, uint64_t time_us);
 
 
 struct weston_motion_filter_interface {
 	void (*filter)(struct weston_motion_filter *filter,
 		       struct weston_motion_params *motion,
-		       void *data, uint32_t time);
+		       void *data, uint64_t time_us);
 	void (*destroy)(struct weston_motion_filter *filter);
 };
 
@@ -57,9 +57,18 @@ create_linear_acceleration_filter(double speed);
 typedef double (*accel_profile_func_t)(struct weston_motion_filter *filter,
 				       void *data,
 				       double velocity,
-				       uint32_t time);
+				       uint64_t time_us);
 
 WL_EXPORT struct weston_motion_filter *
 create_pointer_accelator_filter(accel_profile_func_t filter);
 
+WL_EXPORT int
+pointer_accelerator_set_table(struct weston_motion_filter *filter,
+			      const double *factors, int count, double step);
+
+WL_EXPORT int
+pointer_accelerator_sample_profile(struct weston_motion_filter *filter,
+				   void *data, double min_velocity,
+				   double max_velocity, int count);
+
 #endif // _FILTER_H_
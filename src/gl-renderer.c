@@ -26,25 +26,56 @@
 #include <GLES2/gl2ext.h>
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 #include <float.h>
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <linux/input.h>
 
 #include "gl-renderer.h"
+#include "region-simplify.h"
+#include "../shared/os-compatibility.h"
 
 #include <EGL/eglext.h>
 #include "weston-egl-ext.h"
 
+/* Fragment shaders are generated from a texture type and a set of
+ * feature bits. Each combination is a variant, compiled on first use.
+ */
+enum gl_shader_texture {
+	SHADER_TEXTURE_RGBA,
+	SHADER_TEXTURE_EGL_EXTERNAL,
+	SHADER_TEXTURE_Y_UV,
+	SHADER_TEXTURE_Y_U_V,
+	SHADER_TEXTURE_Y_XUXV,
+	SHADER_SOLID
+};
+
+#define SHADER_TEXTURE_MASK	0x07
+#define SHADER_OPAQUE		0x08	/* ignore the alpha channel */
+#define SHADER_ALPHA		0x10	/* multiply by the alpha uniform */
+#define SHADER_DEBUG		0x20	/* fragment shader debug tint */
+#define SHADER_VARIANT_COUNT	0x40
+
 struct gl_shader {
 	GLuint program;
-	GLuint vertex_shader, fragment_shader;
+	GLuint fragment_shader;
+	int failed;
 	GLint proj_uniform;
-	GLint tex_uniforms[3];
 	GLint alpha_uniform;
 	GLint color_uniform;
-	const char *vertex_source, *fragment_source;
+
+	/* Uniform values last set on the program, so that
+	 * unchanged values are not sent again. */
+	GLfloat proj[16];
+	GLfloat alpha;
+	GLfloat color[4];
 };
 
 #define BUFFER_DAMAGE_COUNT 2
@@ -62,13 +93,17 @@ enum buffer_type {
 
 struct gl_surface_state {
 	GLfloat color[4];
-	struct gl_shader *shader;
+	uint32_t shader_variant;
 
 	GLuint textures[3];
 	int num_textures;
 	int needs_full_upload;
 	pixman_region32_t texture_damage;
 
+	/* Pixel buffer object used to stream wl_shm contents. */
+	GLuint pbo;
+	int pbo_size; /* in bytes */
+
 	EGLImageKHR images[3];
 	GLenum target;
 	int num_images;
@@ -77,6 +112,21 @@ struct gl_surface_state {
 	enum buffer_type buffer_type;
 	int pitch; /* in pixels */
 	int height; /* in pixels */
+
+	/* Format of the wl_shm texture storage. */
+	GLenum gl_format;
+	GLenum gl_pixel_type;
+};
+
+/* Released wl_shm texture storage, kept for reuse by surfaces
+ * attaching a buffer of the same size and format. */
+struct gl_pool_texture {
+	GLuint texture;
+	GLenum format;
+	GLenum pixel_type;
+	int width, height; /* in pixels */
+	int size; /* in bytes */
+	struct wl_list link;
 };
 
 struct gl_renderer {
@@ -103,6 +153,19 @@ struct gl_renderer {
 	PFNEGLDESTROYIMAGEKHRPROC destroy_image;
 
 	int has_unpack_subimage;
+	int has_pbo;
+
+	struct {
+		uint32_t full;
+		uint32_t partial;
+		uint64_t bytes;
+	} upload_stats;
+
+	struct {
+		struct wl_list list; /* most recently released first */
+		int size; /* in bytes */
+		uint32_t hits, misses;
+	} texture_pool;
 
 	PFNEGLBINDWAYLANDDISPLAYWL bind_display;
 	PFNEGLUNBINDWAYLANDDISPLAYWL unbind_display;
@@ -113,15 +176,17 @@ struct gl_renderer {
 
 	int has_egl_buffer_age;
 
-	struct gl_shader texture_shader_rgba;
-	struct gl_shader texture_shader_rgbx;
-	struct gl_shader texture_shader_egl_external;
-	struct gl_shader texture_shader_y_uv;
-	struct gl_shader texture_shader_y_u_v;
-	struct gl_shader texture_shader_y_xuxv;
-	struct gl_shader invert_color_shader;
-	struct gl_shader solid_shader;
+	GLuint vertex_shader;
+	struct gl_shader shaders[SHADER_VARIANT_COUNT];
 	struct gl_shader *current_shader;
+
+	/* On-disk program binary cache, see GL_OES_get_program_binary. */
+	char *shader_cache_dir;
+	uint32_t shader_cache_key;
+#ifdef GL_OES_get_program_binary
+	PFNGLGETPROGRAMBINARYOESPROC get_program_binary;
+	PFNGLPROGRAMBINARYOESPROC program_binary;
+#endif
 };
 
 static inline struct gl_output_state *
@@ -609,11 +674,55 @@ texture_region(struct weston_surface *es, pixman_region32_t *region,
 	return nvtx;
 }
 
+static struct gl_shader *
+get_shader(struct gl_renderer *gr, uint32_t variant);
+
+static void
+use_shader(struct gl_renderer *gr, struct gl_shader *shader)
+{
+	if (gr->current_shader == shader)
+		return;
+	glUseProgram(shader->program);
+	gr->current_shader = shader;
+}
+
+static void
+shader_set_proj(struct gl_shader *shader, const GLfloat *proj)
+{
+	if (memcmp(shader->proj, proj, sizeof shader->proj) == 0)
+		return;
+
+	memcpy(shader->proj, proj, sizeof shader->proj);
+	glUniformMatrix4fv(shader->proj_uniform, 1, GL_FALSE, proj);
+}
+
+static void
+shader_set_alpha(struct gl_shader *shader, GLfloat alpha)
+{
+	if (shader->alpha_uniform == -1 || shader->alpha == alpha)
+		return;
+
+	shader->alpha = alpha;
+	glUniform1f(shader->alpha_uniform, alpha);
+}
+
+static void
+shader_set_color(struct gl_shader *shader, const GLfloat *color)
+{
+	if (shader->color_uniform == -1 ||
+	    memcmp(shader->color, color, sizeof shader->color) == 0)
+		return;
+
+	memcpy(shader->color, color, sizeof shader->color);
+	glUniform4fv(shader->color_uniform, 1, color);
+}
+
 static void
 triangle_fan_debug(struct weston_surface *surface, int first, int count)
 {
 	struct weston_compositor *compositor = surface->compositor;
 	struct gl_renderer *gr = get_renderer(compositor);
+	struct gl_shader *shader;
 	int i;
 	GLushort *buffer;
 	GLushort *index;
@@ -641,9 +750,9 @@ triangle_fan_debug(struct weston_surface *surface, int first, int count)
 		*index++ = first + i;
 	}
 
-	glUseProgram(gr->solid_shader.program);
-	glUniform4fv(gr->solid_shader.color_uniform, 1,
-			color[color_idx++ % ARRAY_LENGTH(color)]);
+	shader = get_shader(gr, SHADER_SOLID);
+	glUseProgram(shader->program);
+	shader_set_color(shader, color[color_idx++ % ARRAY_LENGTH(color)]);
 	glDrawElements(GL_LINES, nelems, GL_UNSIGNED_SHORT, buffer);
 	glUseProgram(gr->current_shader->program);
 	free(buffer);
@@ -717,45 +826,18 @@ use_output(struct weston_output *output)
 	return 0;
 }
 
-static int
-shader_init(struct gl_shader *shader, struct gl_renderer *gr,
-		   const char *vertex_source, const char *fragment_source);
-
-static void
-use_shader(struct gl_renderer *gr, struct gl_shader *shader)
-{
-	if (!shader->program) {
-		int ret;
-
-		ret =  shader_init(shader, gr,
-				   shader->vertex_source,
-				   shader->fragment_source);
-
-		if (ret < 0)
-			weston_log("warning: failed to compile shader\n");
-	}
-
-	if (gr->current_shader == shader)
-		return;
-	glUseProgram(shader->program);
-	gr->current_shader = shader;
-}
-
+/* The shader must be in use. Sampler uniforms are set once, when the
+ * program is created. */
 static void
 shader_uniforms(struct gl_shader *shader,
 		       struct weston_surface *surface,
 		       struct weston_output *output)
 {
-	int i;
 	struct gl_surface_state *gs = get_surface_state(surface);
 
-	glUniformMatrix4fv(shader->proj_uniform,
-			   1, GL_FALSE, output->matrix.d);
-	glUniform4fv(shader->color_uniform, 1, gs->color);
-	glUniform1f(shader->alpha_uniform, surface->alpha);
-
-	for (i = 0; i < gs->num_textures; i++)
-		glUniform1i(shader->tex_uniforms[i], i);
+	shader_set_proj(shader, output->matrix.d);
+	shader_set_color(shader, gs->color);
+	shader_set_alpha(shader, surface->alpha);
 }
 
 static void
@@ -769,6 +851,8 @@ draw_surface(struct weston_surface *es, struct weston_output *output,
 	pixman_region32_t repaint;
 	/* non-opaque region in surface coordinates: */
 	pixman_region32_t surface_blend;
+	struct gl_shader *shader;
+	uint32_t variant;
 	GLint filter;
 	int i;
 
@@ -783,12 +867,21 @@ draw_surface(struct weston_surface *es, struct weston_output *output,
 	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 
 	if (gr->fan_debug) {
-		use_shader(gr, &gr->solid_shader);
-		shader_uniforms(&gr->solid_shader, es, output);
+		shader = get_shader(gr, SHADER_SOLID);
+		use_shader(gr, shader);
+		shader_uniforms(shader, es, output);
 	}
 
-	use_shader(gr, gs->shader);
-	shader_uniforms(gs->shader, es, output);
+	/* Only pay for the alpha multiplication when it does something. */
+	variant = gs->shader_variant;
+	if (es->alpha < 1.0)
+		variant |= SHADER_ALPHA;
+	if (gr->fragment_shader_debug)
+		variant |= SHADER_DEBUG;
+
+	shader = get_shader(gr, variant);
+	use_shader(gr, shader);
+	shader_uniforms(shader, es, output);
 
 	if (es->transform.enabled || output->zoom.active || output->scale != es->buffer_scale)
 		filter = GL_LINEAR;
@@ -808,14 +901,16 @@ draw_surface(struct weston_surface *es, struct weston_output *output,
 	pixman_region32_subtract(&surface_blend, &surface_blend, &es->opaque);
 
 	if (pixman_region32_not_empty(&es->opaque)) {
-		if (gs->shader == &gr->texture_shader_rgba) {
+		if ((variant & (SHADER_TEXTURE_MASK | SHADER_OPAQUE)) ==
+		    SHADER_TEXTURE_RGBA) {
 			/* Special case for RGBA textures with possibly
 			 * bad data in alpha channel: use the shader
 			 * that forces texture alpha = 1.0.
 			 * Xwayland surfaces need this.
 			 */
-			use_shader(gr, &gr->texture_shader_rgbx);
-			shader_uniforms(&gr->texture_shader_rgbx, es, output);
+			shader = get_shader(gr, variant | SHADER_OPAQUE);
+			use_shader(gr, shader);
+			shader_uniforms(shader, es, output);
 		}
 
 		if (es->alpha < 1.0)
@@ -827,7 +922,8 @@ draw_surface(struct weston_surface *es, struct weston_output *output,
 	}
 
 	if (pixman_region32_not_empty(&surface_blend)) {
-		use_shader(gr, gs->shader);
+		shader = get_shader(gr, variant);
+		use_shader(gr, shader);
 		glEnable(GL_BLEND);
 		repaint_region(es, &repaint, &surface_blend);
 	}
@@ -841,12 +937,13 @@ out:
 static void
 repaint_surfaces(struct weston_output *output, pixman_region32_t *damage)
 {
-	struct weston_compositor *compositor = output->compositor;
-	struct weston_surface *surface;
+	struct weston_surface **surfaces = output->visible_surfaces.data;
+	size_t i = output->visible_surfaces.size / sizeof *surfaces;
 
-	wl_list_for_each_reverse(surface, &compositor->surface_list, link)
-		if (surface->plane == &compositor->primary_plane)
-			draw_surface(surface, output, damage);
+	/* Only the primary plane surfaces not hidden by opaque ones,
+	 * as collected by the core for this output. */
+	while (i-- > 0)
+		draw_surface(surfaces[i], output, damage);
 }
 
 
@@ -931,18 +1028,19 @@ draw_border(struct weston_output *output)
 {
 	struct weston_compositor *ec = output->compositor;
 	struct gl_renderer *gr = get_renderer(ec);
-	struct gl_shader *shader = &gr->texture_shader_rgba;
+	struct gl_shader *shader;
+	uint32_t variant = SHADER_TEXTURE_RGBA;
 	GLfloat *v;
 	int n;
 
+	if (gr->fragment_shader_debug)
+		variant |= SHADER_DEBUG;
+	shader = get_shader(gr, variant);
+
 	glDisable(GL_BLEND);
 	use_shader(gr, shader);
 
-	glUniformMatrix4fv(shader->proj_uniform,
-			   1, GL_FALSE, output->matrix.d);
-
-	glUniform1i(shader->tex_uniforms[0], 0);
-	glUniform1f(shader->alpha_uniform, 1);
+	shader_set_proj(shader, output->matrix.d);
 
 	n = texture_border(output);
 
@@ -1103,20 +1201,128 @@ gl_renderer_read_pixels(struct weston_output *output,
 	return 0;
 }
 
+/* Once this share of the buffer is damaged, re-uploading the whole
+ * buffer in a single call is cheaper than a series of sub-image
+ * uploads. */
+#define FULL_UPLOAD_DAMAGE_PERCENT 60
+
+/* Cost of one sub-image upload call (glPixelStorei and
+ * glTexSubImage2D), expressed in bytes of texture data, and the
+ * maximum number of uploads per surface and flush. */
+#define UPLOAD_CALL_OVERHEAD 8192
+#define UPLOAD_MAX_BOXES 32
+
+/* Convert the surface-local 'damage' to buffer coordinates. */
+static void
+damage_to_buffer(struct weston_surface *surface, pixman_region32_t *damage,
+		 pixman_region32_t *buffer_damage)
+{
+	pixman_box32_t *rectangles, r;
+	int i, n;
+
+	rectangles = pixman_region32_rectangles(damage, &n);
+	for (i = 0; i < n; i++) {
+		r = weston_surface_to_buffer_rect(surface, rectangles[i]);
+		pixman_region32_union_rect(buffer_damage, buffer_damage,
+					   r.x1, r.y1,
+					   r.x2 - r.x1, r.y2 - r.y1);
+	}
+}
+
+static int
+damage_wants_full_upload(pixman_region32_t *buffer_damage,
+			 int pitch, int height)
+{
+	pixman_box32_t *rectangles;
+	int64_t area = 0;
+	int i, n;
+
+	rectangles = pixman_region32_rectangles(buffer_damage, &n);
+	for (i = 0; i < n; i++)
+		area += (int64_t) (rectangles[i].x2 - rectangles[i].x1) *
+			(rectangles[i].y2 - rectangles[i].y1);
+
+	return area * 100 >= (int64_t) pitch * height *
+		FULL_UPLOAD_DAMAGE_PERCENT;
+}
+
+/* Copy the rows covered by 'boxes' into the surface's pixel buffer
+ * object and leave it bound to GL_PIXEL_UNPACK_BUFFER, so that the
+ * following glTex(Sub)Image2D calls source from it. The copy out of
+ * the wl_shm buffer still happens here, on the CPU; what no longer
+ * waits is the texture transfer, which the GPU does from the PBO.
+ * The storage is orphaned first, so we never stall on an upload still
+ * in flight from the previous frame.
+ *
+ * The layout matches the wl_shm buffer.  Returns 1 when the PBO is
+ * bound, and upload_source() then turns buffer offsets into PBO
+ * offsets instead of client pointers.
+ */
+static int
+stage_upload(struct gl_surface_state *gs, uint8_t *data, int stride,
+	     int height, pixman_box32_t *boxes, int nboxes)
+{
+#ifdef GL_NV_pixel_buffer_object
+	int i;
+
+	if (!gs->pbo)
+		glGenBuffers(1, &gs->pbo);
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER_NV, gs->pbo);
+
+	gs->pbo_size = stride * height;
+	if (!boxes) {
+		glBufferData(GL_PIXEL_UNPACK_BUFFER_NV, gs->pbo_size, data,
+			     GL_STREAM_DRAW);
+		return 1;
+	}
+
+	glBufferData(GL_PIXEL_UNPACK_BUFFER_NV, gs->pbo_size, NULL,
+		     GL_STREAM_DRAW);
+
+	for (i = 0; i < nboxes; i++)
+		glBufferSubData(GL_PIXEL_UNPACK_BUFFER_NV,
+				boxes[i].y1 * stride,
+				(boxes[i].y2 - boxes[i].y1) * stride,
+				data + boxes[i].y1 * stride);
+
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+static void *
+upload_source(uint8_t *data, int staged, size_t offset)
+{
+	if (staged)
+		return (void *) (uintptr_t) offset;
+
+	return data + offset;
+}
+
+static void
+unstage_upload(struct gl_renderer *gr)
+{
+#ifdef GL_NV_pixel_buffer_object
+	if (gr->has_pbo)
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER_NV, 0);
+#endif
+}
+
 static void
 gl_renderer_flush_damage(struct weston_surface *surface)
 {
 	struct gl_renderer *gr = get_renderer(surface->compositor);
 	struct gl_surface_state *gs = get_surface_state(surface);
 	struct weston_buffer *buffer = gs->buffer_ref.buffer;
+	struct region_simplify_cost cost;
+	pixman_region32_t buffer_damage, rows;
+	pixman_box32_t boxes[UPLOAD_MAX_BOXES], *r;
 	GLenum format;
-	int pixel_type;
-
-#ifdef GL_EXT_unpack_subimage
-	pixman_box32_t *rectangles;
-	void *data;
-	int i, n;
-#endif
+	int pixel_type, stride;
+	uint8_t *data;
+	int i, n, staged = 0;
 
 	pixman_region32_union(&gs->texture_damage,
 			      &gs->texture_damage, &surface->damage);
@@ -1135,61 +1341,112 @@ gl_renderer_flush_damage(struct weston_surface *surface)
 	if (!pixman_region32_not_empty(&gs->texture_damage))
 		goto done;
 
-	switch (wl_shm_buffer_get_format(buffer->shm_buffer)) {
-	case WL_SHM_FORMAT_XRGB8888:
-	case WL_SHM_FORMAT_ARGB8888:
-		format = GL_BGRA_EXT;
-		pixel_type = GL_UNSIGNED_BYTE;
-		break;
-	case WL_SHM_FORMAT_RGB565:
-		format = GL_RGB;
-		pixel_type = GL_UNSIGNED_SHORT_5_6_5;
-		break;
-	default:
-		weston_log("warning: unknown shm buffer format\n");
-		format = GL_BGRA_EXT;
-		pixel_type = GL_UNSIGNED_BYTE;
-	}
+	format = gs->gl_format;
+	pixel_type = gs->gl_pixel_type;
+	data = wl_shm_buffer_get_data(buffer->shm_buffer);
+	stride = wl_shm_buffer_get_stride(buffer->shm_buffer);
+
+	pixman_region32_init(&buffer_damage);
+	damage_to_buffer(surface, &gs->texture_damage, &buffer_damage);
+
+	if (!gs->needs_full_upload &&
+	    damage_wants_full_upload(&buffer_damage,
+				     gs->pitch, buffer->height))
+		gs->needs_full_upload = 1;
 
 	glBindTexture(GL_TEXTURE_2D, gs->textures[0]);
 
-	if (!gr->has_unpack_subimage) {
-		glTexImage2D(GL_TEXTURE_2D, 0, format,
-			     gs->pitch, buffer->height, 0,
-			     format, pixel_type,
-			     wl_shm_buffer_get_data(buffer->shm_buffer));
+	if (gs->needs_full_upload) {
+		pixman_region32_fini(&buffer_damage);
 
-		goto done;
-	}
+		if (gr->has_pbo)
+			staged = stage_upload(gs, data, stride,
+					      buffer->height, NULL, 0);
 
-#ifdef GL_EXT_unpack_subimage
-	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, gs->pitch);
-	data = wl_shm_buffer_get_data(buffer->shm_buffer);
+		gr->upload_stats.full++;
+		gr->upload_stats.bytes += stride * buffer->height;
 
-	if (gs->needs_full_upload) {
-		glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, 0);
-		glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, 0);
+		/* The texture storage was allocated with the buffer's
+		 * format in attach, so never re-specify it here. */
+#ifdef GL_EXT_unpack_subimage
+		if (gr->has_unpack_subimage) {
+			glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, gs->pitch);
+			glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, 0);
+			glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, 0);
+		}
+#endif
 		glTexSubImage2D(GL_TEXTURE_2D, 0,
 				0, 0, gs->pitch, buffer->height,
-				format, pixel_type, data);
+				format, pixel_type,
+				upload_source(data, staged, 0));
 		goto done;
 	}
 
-	rectangles = pixman_region32_rectangles(&gs->texture_damage, &n);
-	for (i = 0; i < n; i++) {
-		pixman_box32_t r;
+	gr->upload_stats.partial++;
 
-		r = weston_surface_to_buffer_rect(surface, rectangles[i]);
+	cost.bytes_per_pixel = stride / gs->pitch;
+	cost.call_overhead = UPLOAD_CALL_OVERHEAD;
+	cost.max_boxes = UPLOAD_MAX_BOXES;
+
+	if (!gr->has_unpack_subimage) {
+		/* Without GL_EXT_unpack_subimage we cannot skip pixels
+		 * within a row, but whole rows are contiguous in the
+		 * buffer, so upload the damaged full-width bands.
+		 */
+		pixman_region32_init(&rows);
+		r = pixman_region32_rectangles(&buffer_damage, &n);
+		for (i = 0; i < n; i++)
+			pixman_region32_union_rect(&rows, &rows, 0, r[i].y1,
+						   gs->pitch,
+						   r[i].y2 - r[i].y1);
+		n = region_simplify(&rows, &cost, boxes);
+		pixman_region32_fini(&rows);
+		pixman_region32_fini(&buffer_damage);
+
+		if (gr->has_pbo)
+			staged = stage_upload(gs, data, stride,
+					      buffer->height, boxes, n);
+
+		for (i = 0; i < n; i++) {
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, boxes[i].y1,
+					gs->pitch, boxes[i].y2 - boxes[i].y1,
+					format, pixel_type,
+					upload_source(data, staged,
+						      boxes[i].y1 * stride));
+			gr->upload_stats.bytes +=
+				(boxes[i].y2 - boxes[i].y1) * stride;
+		}
+
+		goto done;
+	}
+
+	n = region_simplify(&buffer_damage, &cost, boxes);
+	pixman_region32_fini(&buffer_damage);
 
-		glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, r.x1);
-		glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, r.y1);
-		glTexSubImage2D(GL_TEXTURE_2D, 0, r.x1, r.y1,
-				r.x2 - r.x1, r.y2 - r.y1,
-				format, pixel_type, data);
+	if (gr->has_pbo)
+		staged = stage_upload(gs, data, stride, buffer->height,
+				      boxes, n);
+
+#ifdef GL_EXT_unpack_subimage
+	glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, gs->pitch);
+
+	for (i = 0; i < n; i++) {
+		r = &boxes[i];
+
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS_EXT, r->x1);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS_EXT, r->y1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, r->x1, r->y1,
+				r->x2 - r->x1, r->y2 - r->y1,
+				format, pixel_type,
+				upload_source(data, staged, 0));
+		gr->upload_stats.bytes += (r->x2 - r->x1) * (r->y2 - r->y1) *
+			cost.bytes_per_pixel;
 	}
 #endif
 
 done:
+	unstage_upload(gr);
+
 	pixman_region32_fini(&gs->texture_damage);
 	pixman_region32_init(&gs->texture_damage);
 	gs->needs_full_upload = 0;
@@ -1197,6 +1454,102 @@ done:
 	weston_buffer_reference(&gs->buffer_ref, NULL);
 }
 
+/* Upper bound for the wl_shm texture storage kept around unused in
+ * the pool. The least recently released textures are deleted first. */
+#define TEXTURE_POOL_BUDGET (32 * 1024 * 1024)
+
+static void
+texture_pool_evict(struct gl_renderer *gr, int budget)
+{
+	struct gl_pool_texture *pt;
+
+	while (gr->texture_pool.size > budget) {
+		pt = container_of(gr->texture_pool.list.prev,
+				  struct gl_pool_texture, link);
+		glDeleteTextures(1, &pt->texture);
+		gr->texture_pool.size -= pt->size;
+		wl_list_remove(&pt->link);
+		free(pt);
+	}
+}
+
+static GLuint
+texture_pool_get(struct gl_renderer *gr, GLenum format, GLenum pixel_type,
+		 int width, int height)
+{
+	struct gl_pool_texture *pt;
+	GLuint texture;
+
+	wl_list_for_each(pt, &gr->texture_pool.list, link) {
+		if (pt->format != format || pt->pixel_type != pixel_type ||
+		    pt->width != width || pt->height != height)
+			continue;
+
+		texture = pt->texture;
+		gr->texture_pool.size -= pt->size;
+		gr->texture_pool.hits++;
+		wl_list_remove(&pt->link);
+		free(pt);
+
+		return texture;
+	}
+
+	gr->texture_pool.misses++;
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0,
+		     format, pixel_type, NULL);
+
+	return texture;
+}
+
+static void
+texture_pool_put(struct gl_renderer *gr, GLuint texture, GLenum format,
+		 GLenum pixel_type, int width, int height)
+{
+	struct gl_pool_texture *pt;
+	int size;
+
+	size = width * height *
+		(pixel_type == GL_UNSIGNED_SHORT_5_6_5 ? 2 : 4);
+
+	pt = malloc(sizeof *pt);
+	if (pt == NULL || size > TEXTURE_POOL_BUDGET) {
+		free(pt);
+		glDeleteTextures(1, &texture);
+		return;
+	}
+
+	pt->texture = texture;
+	pt->format = format;
+	pt->pixel_type = pixel_type;
+	pt->width = width;
+	pt->height = height;
+	pt->size = size;
+	wl_list_insert(&gr->texture_pool.list, &pt->link);
+	gr->texture_pool.size += size;
+
+	texture_pool_evict(gr, TEXTURE_POOL_BUDGET);
+}
+
+/* Hand the surface's textures back: wl_shm storage goes to the pool,
+ * anything else (EGLImage siblings) is deleted. */
+static void
+release_textures(struct gl_renderer *gr, struct gl_surface_state *gs)
+{
+	if (gs->buffer_type == BUFFER_TYPE_SHM && gs->num_textures == 1)
+		texture_pool_put(gr, gs->textures[0],
+				 gs->gl_format, gs->gl_pixel_type,
+				 gs->pitch, gs->height);
+	else
+		glDeleteTextures(gs->num_textures, gs->textures);
+
+	gs->num_textures = 0;
+}
+
 static void
 ensure_textures(struct gl_surface_state *gs, int num_textures)
 {
@@ -1224,6 +1577,7 @@ gl_renderer_attach_shm(struct weston_surface *es, struct weston_buffer *buffer,
 	struct weston_compositor *ec = es->compositor;
 	struct gl_renderer *gr = get_renderer(ec);
 	struct gl_surface_state *gs = get_surface_state(es);
+	GLenum format, pixel_type;
 	int pitch;
 
 	buffer->shm_buffer = shm_buffer;
@@ -1232,40 +1586,54 @@ gl_renderer_attach_shm(struct weston_surface *es, struct weston_buffer *buffer,
 
 	switch (wl_shm_buffer_get_format(shm_buffer)) {
 	case WL_SHM_FORMAT_XRGB8888:
-		gs->shader = &gr->texture_shader_rgbx;
+		gs->shader_variant = SHADER_TEXTURE_RGBA | SHADER_OPAQUE;
 		pitch = wl_shm_buffer_get_stride(shm_buffer) / 4;
+		format = GL_BGRA_EXT;
+		pixel_type = GL_UNSIGNED_BYTE;
 		break;
 	case WL_SHM_FORMAT_ARGB8888:
-		gs->shader = &gr->texture_shader_rgba;
+		gs->shader_variant = SHADER_TEXTURE_RGBA;
 		pitch = wl_shm_buffer_get_stride(shm_buffer) / 4;
+		format = GL_BGRA_EXT;
+		pixel_type = GL_UNSIGNED_BYTE;
 		break;
 	case WL_SHM_FORMAT_RGB565:
-		gs->shader = &gr->texture_shader_rgbx;
+		gs->shader_variant = SHADER_TEXTURE_RGBA | SHADER_OPAQUE;
 		pitch = wl_shm_buffer_get_stride(shm_buffer) / 2;
+		format = GL_RGB;
+		pixel_type = GL_UNSIGNED_SHORT_5_6_5;
 		break;
 	default:
 		weston_log("warning: unknown shm buffer format\n");
-		gs->shader = &gr->texture_shader_rgba;
+		gs->shader_variant = SHADER_TEXTURE_RGBA;
 		pitch = wl_shm_buffer_get_stride(shm_buffer) / 4;
+		format = GL_BGRA_EXT;
+		pixel_type = GL_UNSIGNED_BYTE;
 	}
 
-	/* Only allocate a texture if it doesn't match existing one.
-	 * If a switch from DRM allocated buffer to a SHM buffer is
-	 * happening, we need to allocate a new texture buffer. */
+	/* Keep the texture if it matches the new buffer. Otherwise
+	 * trade it for pooled storage of the right size and format,
+	 * which needs a full upload since its contents are stale.
+	 * A switch from DRM allocated buffer to a SHM buffer always
+	 * needs new storage. */
 	if (pitch != gs->pitch ||
 	    buffer->height != gs->height ||
+	    format != gs->gl_format ||
+	    pixel_type != gs->gl_pixel_type ||
 	    gs->buffer_type != BUFFER_TYPE_SHM) {
+		release_textures(gr, gs);
+
 		gs->pitch = pitch;
 		gs->height = buffer->height;
+		gs->gl_format = format;
+		gs->gl_pixel_type = pixel_type;
 		gs->target = GL_TEXTURE_2D;
 		gs->buffer_type = BUFFER_TYPE_SHM;
 		gs->needs_full_upload = 1;
 
-		ensure_textures(gs, 1);
-		glBindTexture(GL_TEXTURE_2D, gs->textures[0]);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_BGRA_EXT,
-			     gs->pitch, buffer->height, 0,
-			     GL_BGRA_EXT, GL_UNSIGNED_BYTE, NULL);
+		gs->textures[0] = texture_pool_get(gr, format, pixel_type,
+						   pitch, buffer->height);
+		gs->num_textures = 1;
 	}
 }
 
@@ -1288,30 +1656,32 @@ gl_renderer_attach_egl(struct weston_surface *es, struct weston_buffer *buffer,
 	for (i = 0; i < gs->num_images; i++)
 		gr->destroy_image(gr->egl_display, gs->images[i]);
 	gs->num_images = 0;
+	if (gs->buffer_type == BUFFER_TYPE_SHM)
+		release_textures(gr, gs);
 	gs->target = GL_TEXTURE_2D;
 	switch (format) {
 	case EGL_TEXTURE_RGB:
 	case EGL_TEXTURE_RGBA:
 	default:
 		num_planes = 1;
-		gs->shader = &gr->texture_shader_rgba;
+		gs->shader_variant = SHADER_TEXTURE_RGBA;
 		break;
 	case EGL_TEXTURE_EXTERNAL_WL:
 		num_planes = 1;
 		gs->target = GL_TEXTURE_EXTERNAL_OES;
-		gs->shader = &gr->texture_shader_egl_external;
+		gs->shader_variant = SHADER_TEXTURE_EGL_EXTERNAL;
 		break;
 	case EGL_TEXTURE_Y_UV_WL:
 		num_planes = 2;
-		gs->shader = &gr->texture_shader_y_uv;
+		gs->shader_variant = SHADER_TEXTURE_Y_UV;
 		break;
 	case EGL_TEXTURE_Y_U_V_WL:
 		num_planes = 3;
-		gs->shader = &gr->texture_shader_y_u_v;
+		gs->shader_variant = SHADER_TEXTURE_Y_U_V;
 		break;
 	case EGL_TEXTURE_Y_XUXV_WL:
 		num_planes = 2;
-		gs->shader = &gr->texture_shader_y_xuxv;
+		gs->shader_variant = SHADER_TEXTURE_Y_XUXV;
 		break;
 	}
 
@@ -1360,8 +1730,12 @@ gl_renderer_attach(struct weston_surface *es, struct weston_buffer *buffer)
 			gs->images[i] = NULL;
 		}
 		gs->num_images = 0;
-		glDeleteTextures(gs->num_textures, gs->textures);
-		gs->num_textures = 0;
+		release_textures(gr, gs);
+		if (gs->pbo) {
+			glDeleteBuffers(1, &gs->pbo);
+			gs->pbo = 0;
+			gs->pbo_size = 0;
+		}
 		gs->buffer_type = BUFFER_TYPE_NULL;
 		return;
 	}
@@ -1385,14 +1759,13 @@ gl_renderer_surface_set_color(struct weston_surface *surface,
 		 float red, float green, float blue, float alpha)
 {
 	struct gl_surface_state *gs = get_surface_state(surface);
-	struct gl_renderer *gr = get_renderer(surface->compositor);
 
 	gs->color[0] = red;
 	gs->color[1] = green;
 	gs->color[2] = blue;
 	gs->color[3] = alpha;
 
-	gs->shader = &gr->solid_shader;
+	gs->shader_variant = SHADER_SOLID;
 }
 
 static int
@@ -1423,7 +1796,9 @@ gl_renderer_destroy_surface(struct weston_surface *surface)
 	struct gl_renderer *gr = get_renderer(surface->compositor);
 	int i;
 
-	glDeleteTextures(gs->num_textures, gs->textures);
+	release_textures(gr, gs);
+	if (gs->pbo)
+		glDeleteBuffers(1, &gs->pbo);
 
 	for (i = 0; i < gs->num_images; i++)
 		gr->destroy_image(gr->egl_display, gs->images[i]);
@@ -1444,15 +1819,25 @@ static const char vertex_shader[] =
 	"   v_texcoord = texcoord;\n"
 	"}\n";
 
-/* Declare common fragment shader uniforms */
 #define FRAGMENT_CONVERT_YUV						\
-	"  y *= alpha;\n"						\
-	"  u *= alpha;\n"						\
-	"  v *= alpha;\n"						\
 	"  gl_FragColor.r = y + 1.59602678 * v;\n"			\
 	"  gl_FragColor.g = y - 0.39176229 * u - 0.81296764 * v;\n"	\
 	"  gl_FragColor.b = y + 2.01723214 * u;\n"			\
-	"  gl_FragColor.a = alpha;\n"
+	"  gl_FragColor.a = 1.0;\n"
+
+static const char fragment_extension_external[] =
+	"#extension GL_OES_EGL_image_external : require\n";
+
+static const char fragment_header[] =
+	"precision mediump float;\n"
+	"varying vec2 v_texcoord;\n"
+	"uniform float alpha;\n";
+
+static const char fragment_opaque[] =
+	"   gl_FragColor.a = 1.0;\n";
+
+static const char fragment_alpha[] =
+	"   gl_FragColor = alpha * gl_FragColor;\n";
 
 static const char fragment_debug[] =
 	"  gl_FragColor = vec4(0.0, 0.3, 0.0, 0.2) + gl_FragColor * 0.8;\n";
@@ -1461,43 +1846,22 @@ static const char fragment_brace[] =
 	"}\n";
 
 static const char texture_fragment_shader_rgba[] =
-	"precision mediump float;\n"
-	"varying vec2 v_texcoord;\n"
 	"uniform sampler2D tex;\n"
-	"uniform float alpha;\n"
 	"void main()\n"
 	"{\n"
-	"   gl_FragColor = alpha * texture2D(tex, v_texcoord)\n;"
-	;
-
-static const char texture_fragment_shader_rgbx[] =
-	"precision mediump float;\n"
-	"varying vec2 v_texcoord;\n"
-	"uniform sampler2D tex;\n"
-	"uniform float alpha;\n"
-	"void main()\n"
-	"{\n"
-	"   gl_FragColor.rgb = alpha * texture2D(tex, v_texcoord).rgb\n;"
-	"   gl_FragColor.a = alpha;\n"
+	"   gl_FragColor = texture2D(tex, v_texcoord)\n;"
 	;
 
 static const char texture_fragment_shader_egl_external[] =
-	"#extension GL_OES_EGL_image_external : require\n"
-	"precision mediump float;\n"
-	"varying vec2 v_texcoord;\n"
 	"uniform samplerExternalOES tex;\n"
-	"uniform float alpha;\n"
 	"void main()\n"
 	"{\n"
-	"   gl_FragColor = alpha * texture2D(tex, v_texcoord)\n;"
+	"   gl_FragColor = texture2D(tex, v_texcoord)\n;"
 	;
 
 static const char texture_fragment_shader_y_uv[] =
-	"precision mediump float;\n"
 	"uniform sampler2D tex;\n"
 	"uniform sampler2D tex1;\n"
-	"varying vec2 v_texcoord;\n"
-	"uniform float alpha;\n"
 	"void main() {\n"
 	"  float y = 1.16438356 * (texture2D(tex, v_texcoord).x - 0.0625);\n"
 	"  float u = texture2D(tex1, v_texcoord).r - 0.5;\n"
@@ -1506,12 +1870,9 @@ static const char texture_fragment_shader_y_uv[] =
 	;
 
 static const char texture_fragment_shader_y_u_v[] =
-	"precision mediump float;\n"
 	"uniform sampler2D tex;\n"
 	"uniform sampler2D tex1;\n"
 	"uniform sampler2D tex2;\n"
-	"varying vec2 v_texcoord;\n"
-	"uniform float alpha;\n"
 	"void main() {\n"
 	"  float y = 1.16438356 * (texture2D(tex, v_texcoord).x - 0.0625);\n"
 	"  float u = texture2D(tex1, v_texcoord).x - 0.5;\n"
@@ -1520,11 +1881,8 @@ static const char texture_fragment_shader_y_u_v[] =
 	;
 
 static const char texture_fragment_shader_y_xuxv[] =
-	"precision mediump float;\n"
 	"uniform sampler2D tex;\n"
 	"uniform sampler2D tex1;\n"
-	"varying vec2 v_texcoord;\n"
-	"uniform float alpha;\n"
 	"void main() {\n"
 	"  float y = 1.16438356 * (texture2D(tex, v_texcoord).x - 0.0625);\n"
 	"  float u = texture2D(tex1, v_texcoord).g - 0.5;\n"
@@ -1533,14 +1891,44 @@ static const char texture_fragment_shader_y_xuxv[] =
 	;
 
 static const char solid_fragment_shader[] =
-	"precision mediump float;\n"
 	"uniform vec4 color;\n"
-	"uniform float alpha;\n"
 	"void main()\n"
 	"{\n"
-	"   gl_FragColor = alpha * color\n;"
+	"   gl_FragColor = color\n;"
 	;
 
+static const char *texture_fragment_shaders[] = {
+	[SHADER_TEXTURE_RGBA] = texture_fragment_shader_rgba,
+	[SHADER_TEXTURE_EGL_EXTERNAL] = texture_fragment_shader_egl_external,
+	[SHADER_TEXTURE_Y_UV] = texture_fragment_shader_y_uv,
+	[SHADER_TEXTURE_Y_U_V] = texture_fragment_shader_y_u_v,
+	[SHADER_TEXTURE_Y_XUXV] = texture_fragment_shader_y_xuxv,
+	[SHADER_SOLID] = solid_fragment_shader,
+};
+
+/* Fill 'sources' with the fragment shader strings for 'variant',
+ * returns how many there are. */
+static int
+fragment_shader_sources(uint32_t variant, const char **sources)
+{
+	int count = 0;
+
+	if ((variant & SHADER_TEXTURE_MASK) == SHADER_TEXTURE_EGL_EXTERNAL)
+		sources[count++] = fragment_extension_external;
+	sources[count++] = fragment_header;
+	sources[count++] =
+		texture_fragment_shaders[variant & SHADER_TEXTURE_MASK];
+	if (variant & SHADER_OPAQUE)
+		sources[count++] = fragment_opaque;
+	if (variant & SHADER_ALPHA)
+		sources[count++] = fragment_alpha;
+	if (variant & SHADER_DEBUG)
+		sources[count++] = fragment_debug;
+	sources[count++] = fragment_brace;
+
+	return count;
+}
+
 static int
 compile_shader(GLenum type, int count, const char **sources)
 {
@@ -1561,66 +1949,266 @@ compile_shader(GLenum type, int count, const char **sources)
 	return s;
 }
 
+/* Program binaries are stored one file per variant and key, the key
+ * being a hash of the GL driver strings and the shader sources.  It is
+ * part of the file name, so that compositors on different GPUs or
+ * drivers keep entries of their own instead of replacing each other's
+ * on every start.  The header repeats the key to catch collisions.  A
+ * mismatch, or a binary the driver refuses, means we compile from
+ * source and overwrite the file.
+ */
+#define SHADER_CACHE_MAGIC	0x57534842	/* "WSHB" */
+#define SHADER_CACHE_MAX_SIZE	(1024 * 1024)
+
+struct shader_cache_header {
+	uint32_t magic;
+	uint32_t key;
+	uint32_t format;
+	uint32_t length;
+};
+
+static uint32_t
+hash_string(uint32_t hash, const char *s)
+{
+	/* FNV-1a */
+	while (s && *s) {
+		hash ^= (unsigned char) *s++;
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
+static int
+shader_cache_load(struct gl_renderer *gr, struct gl_shader *shader,
+		  uint32_t variant, uint32_t key)
+{
+#ifdef GL_OES_get_program_binary
+	struct shader_cache_header header;
+	char path[PATH_MAX];
+	GLint status = 0;
+	void *binary;
+	int fd;
+
+	if (!gr->shader_cache_dir)
+		return -1;
+
+	snprintf(path, sizeof path, "%s/shader-%02x-%08x.bin",
+		 gr->shader_cache_dir, variant, key);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (read(fd, &header, sizeof header) != sizeof header ||
+	    header.magic != SHADER_CACHE_MAGIC || header.key != key ||
+	    header.length > SHADER_CACHE_MAX_SIZE) {
+		close(fd);
+		return -1;
+	}
+
+	binary = malloc(header.length);
+	if (binary &&
+	    read(fd, binary, header.length) == (ssize_t) header.length) {
+		gr->program_binary(shader->program, header.format,
+				   binary, header.length);
+		glGetProgramiv(shader->program, GL_LINK_STATUS, &status);
+	}
+
+	free(binary);
+	close(fd);
+
+	return status ? 0 : -1;
+#else
+	return -1;
+#endif
+}
+
+static void
+shader_cache_save(struct gl_renderer *gr, struct gl_shader *shader,
+		  uint32_t variant, uint32_t key)
+{
+#ifdef GL_OES_get_program_binary
+	struct shader_cache_header header;
+	char path[PATH_MAX], tmp[PATH_MAX];
+	GLint length = 0;
+	GLsizei written;
+	GLenum format;
+	void *binary;
+	int fd, ok;
+
+	if (!gr->shader_cache_dir)
+		return;
+
+	glGetProgramiv(shader->program, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+	if (length <= 0 || length > SHADER_CACHE_MAX_SIZE)
+		return;
+
+	binary = malloc(length);
+	if (!binary)
+		return;
+
+	gr->get_program_binary(shader->program, length, &written,
+			       &format, binary);
+
+	header.magic = SHADER_CACHE_MAGIC;
+	header.key = key;
+	header.format = format;
+	header.length = written;
+
+	/* Write to a temporary file and rename it into place, so that
+	 * another compositor instance never reads a partial binary. */
+	snprintf(path, sizeof path, "%s/shader-%02x-%08x.bin",
+		 gr->shader_cache_dir, variant, key);
+	snprintf(tmp, sizeof tmp, "%s.XXXXXX", path);
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		free(binary);
+		return;
+	}
+
+	ok = write(fd, &header, sizeof header) == sizeof header &&
+		write(fd, binary, written) == written;
+	close(fd);
+
+	if (!ok || rename(tmp, path) < 0)
+		unlink(tmp);
+
+	free(binary);
+#endif
+}
+
+static void
+shader_release(struct gl_shader *shader)
+{
+	if (shader->fragment_shader)
+		glDeleteShader(shader->fragment_shader);
+	if (shader->program)
+		glDeleteProgram(shader->program);
+
+	shader->fragment_shader = 0;
+	shader->program = 0;
+}
+
 static int
 shader_init(struct gl_shader *shader, struct gl_renderer *renderer,
-		   const char *vertex_source, const char *fragment_source)
+	    uint32_t variant)
 {
 	char msg[512];
 	GLint status;
-	int count;
-	const char *sources[3];
-
-	shader->vertex_shader =
-		compile_shader(GL_VERTEX_SHADER, 1, &vertex_source);
-
-	if (renderer->fragment_shader_debug) {
-		sources[0] = fragment_source;
-		sources[1] = fragment_debug;
-		sources[2] = fragment_brace;
-		count = 3;
-	} else {
-		sources[0] = fragment_source;
-		sources[1] = fragment_brace;
-		count = 2;
-	}
+	const char *sources[8];
+	const char *vertex_source = vertex_shader;
+	uint32_t key;
+	int i, count;
+
+	count = fragment_shader_sources(variant, sources);
 
-	shader->fragment_shader =
-		compile_shader(GL_FRAGMENT_SHADER, count, sources);
+	key = renderer->shader_cache_key;
+	for (i = 0; i < count; i++)
+		key = hash_string(key, sources[i]);
 
 	shader->program = glCreateProgram();
-	glAttachShader(shader->program, shader->vertex_shader);
-	glAttachShader(shader->program, shader->fragment_shader);
-	glBindAttribLocation(shader->program, 0, "position");
-	glBindAttribLocation(shader->program, 1, "texcoord");
+	if (shader_cache_load(renderer, shader, variant, key) < 0) {
+		glDeleteProgram(shader->program);
+
+		if (!renderer->vertex_shader)
+			renderer->vertex_shader =
+				compile_shader(GL_VERTEX_SHADER, 1,
+					       &vertex_source);
+
+		shader->fragment_shader =
+			compile_shader(GL_FRAGMENT_SHADER, count, sources);
+
+		shader->program = glCreateProgram();
+		glAttachShader(shader->program, renderer->vertex_shader);
+		glAttachShader(shader->program, shader->fragment_shader);
+		glBindAttribLocation(shader->program, 0, "position");
+		glBindAttribLocation(shader->program, 1, "texcoord");
+
+		glLinkProgram(shader->program);
+		glGetProgramiv(shader->program, GL_LINK_STATUS, &status);
+		if (!status) {
+			glGetProgramInfoLog(shader->program,
+					    sizeof msg, NULL, msg);
+			weston_log("link info: %s\n", msg);
+			shader_release(shader);
+			return -1;
+		}
 
-	glLinkProgram(shader->program);
-	glGetProgramiv(shader->program, GL_LINK_STATUS, &status);
-	if (!status) {
-		glGetProgramInfoLog(shader->program, sizeof msg, NULL, msg);
-		weston_log("link info: %s\n", msg);
-		return -1;
+		shader_cache_save(renderer, shader, variant, key);
 	}
 
 	shader->proj_uniform = glGetUniformLocation(shader->program, "proj");
-	shader->tex_uniforms[0] = glGetUniformLocation(shader->program, "tex");
-	shader->tex_uniforms[1] = glGetUniformLocation(shader->program, "tex1");
-	shader->tex_uniforms[2] = glGetUniformLocation(shader->program, "tex2");
 	shader->alpha_uniform = glGetUniformLocation(shader->program, "alpha");
 	shader->color_uniform = glGetUniformLocation(shader->program, "color");
 
+	/* Uniforms of a freshly linked program are all zero, which is
+	 * what the cached values start out as too. Samplers never
+	 * change, so set them here once and for all. */
+	memset(shader->proj, 0, sizeof shader->proj);
+	memset(shader->color, 0, sizeof shader->color);
+	shader->alpha = 0.0;
+
+	glUseProgram(shader->program);
+	glUniform1i(glGetUniformLocation(shader->program, "tex"), 0);
+	glUniform1i(glGetUniformLocation(shader->program, "tex1"), 1);
+	glUniform1i(glGetUniformLocation(shader->program, "tex2"), 2);
+	glUseProgram(renderer->current_shader ?
+		     renderer->current_shader->program : 0);
+
 	return 0;
 }
 
+static struct gl_shader *
+get_shader(struct gl_renderer *gr, uint32_t variant)
+{
+	struct gl_shader *shader = &gr->shaders[variant];
+
+	if (!shader->program && !shader->failed &&
+	    shader_init(shader, gr, variant) < 0) {
+		weston_log("warning: failed to compile shader\n");
+		shader->failed = 1;
+	}
+
+	return shader;
+}
+
+/* Set up the on-disk program binary cache in $XDG_CACHE_HOME/weston,
+ * if the driver can hand out program binaries at all. */
 static void
-shader_release(struct gl_shader *shader)
+shader_cache_init(struct gl_renderer *gr, const char *extensions)
 {
-	glDeleteShader(shader->vertex_shader);
-	glDeleteShader(shader->fragment_shader);
-	glDeleteProgram(shader->program);
+#ifdef GL_OES_get_program_binary
+	GLint formats = 0;
+	char *path;
 
-	shader->vertex_shader = 0;
-	shader->fragment_shader = 0;
-	shader->program = 0;
+	if (!strstr(extensions, "GL_OES_get_program_binary"))
+		return;
+
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formats);
+	if (formats == 0)
+		return;
+
+	gr->get_program_binary =
+		(void *) eglGetProcAddress("glGetProgramBinaryOES");
+	gr->program_binary =
+		(void *) eglGetProcAddress("glProgramBinaryOES");
+	if (!gr->get_program_binary || !gr->program_binary)
+		return;
+
+	path = os_create_cache_dir();
+	if (!path) {
+		weston_log("failed to create shader cache directory: %m\n");
+		return;
+	}
+
+	gr->shader_cache_dir = path;
+	gr->shader_cache_key =
+		hash_string(hash_string(hash_string(hash_string(2166136261u,
+			(const char *) glGetString(GL_VENDOR)),
+			(const char *) glGetString(GL_RENDERER)),
+			(const char *) glGetString(GL_VERSION)),
+			vertex_shader);
+#endif
 }
 
 static void
@@ -1811,10 +2399,18 @@ static void
 gl_renderer_destroy(struct weston_compositor *ec)
 {
 	struct gl_renderer *gr = get_renderer(ec);
+	int i;
 
 	if (gr->has_bind_display)
 		gr->unbind_display(gr->egl_display, ec->wl_display);
 
+	texture_pool_evict(gr, 0);
+
+	for (i = 0; i < SHADER_VARIANT_COUNT; i++)
+		shader_release(&gr->shaders[i]);
+	if (gr->vertex_shader)
+		glDeleteShader(gr->vertex_shader);
+
 	/* Work around crash in egl_dri2.c's dri2_make_current() - when does this apply? */
 	eglMakeCurrent(gr->egl_display,
 		       EGL_NO_SURFACE, EGL_NO_SURFACE,
@@ -1827,6 +2423,7 @@ gl_renderer_destroy(struct weston_compositor *ec)
 	wl_array_release(&gr->indices);
 	wl_array_release(&gr->vtxcnt);
 
+	free(gr->shader_cache_dir);
 	free(gr);
 }
 
@@ -1915,6 +2512,8 @@ gl_renderer_create(struct weston_compositor *ec, EGLNativeDisplayType display,
 	gr->base.destroy_surface = gl_renderer_destroy_surface;
 	gr->base.destroy = gl_renderer_destroy;
 
+	wl_list_init(&gr->texture_pool.list);
+
 	gr->egl_display = eglGetDisplay(display);
 	if (gr->egl_display == EGL_NO_DISPLAY) {
 		weston_log("failed to create display\n");
@@ -1951,38 +2550,6 @@ gl_renderer_display(struct weston_compositor *ec)
 	return get_renderer(ec)->egl_display;
 }
 
-static int
-compile_shaders(struct weston_compositor *ec)
-{
-	struct gl_renderer *gr = get_renderer(ec);
-
-	gr->texture_shader_rgba.vertex_source = vertex_shader;
-	gr->texture_shader_rgba.fragment_source = texture_fragment_shader_rgba;
-
-	gr->texture_shader_rgbx.vertex_source = vertex_shader;
-	gr->texture_shader_rgbx.fragment_source = texture_fragment_shader_rgbx;
-
-	gr->texture_shader_egl_external.vertex_source = vertex_shader;
-	gr->texture_shader_egl_external.fragment_source =
-		texture_fragment_shader_egl_external;
-
-	gr->texture_shader_y_uv.vertex_source = vertex_shader;
-	gr->texture_shader_y_uv.fragment_source = texture_fragment_shader_y_uv;
-
-	gr->texture_shader_y_u_v.vertex_source = vertex_shader;
-	gr->texture_shader_y_u_v.fragment_source =
-		texture_fragment_shader_y_u_v;
-
-	gr->texture_shader_y_u_v.vertex_source = vertex_shader;
-	gr->texture_shader_y_xuxv.fragment_source =
-		texture_fragment_shader_y_xuxv;
-
-	gr->solid_shader.vertex_source = vertex_shader;
-	gr->solid_shader.fragment_source = solid_fragment_shader;
-
-	return 0;
-}
-
 static void
 fragment_debug_binding(struct weston_seat *seat, uint32_t time, uint32_t key,
 		       void *data)
@@ -1991,20 +2558,9 @@ fragment_debug_binding(struct weston_seat *seat, uint32_t time, uint32_t key,
 	struct gl_renderer *gr = get_renderer(ec);
 	struct weston_output *output;
 
+	/* Selects the SHADER_DEBUG variants from the next repaint on. */
 	gr->fragment_shader_debug ^= 1;
 
-	shader_release(&gr->texture_shader_rgba);
-	shader_release(&gr->texture_shader_rgbx);
-	shader_release(&gr->texture_shader_egl_external);
-	shader_release(&gr->texture_shader_y_uv);
-	shader_release(&gr->texture_shader_y_u_v);
-	shader_release(&gr->texture_shader_y_xuxv);
-	shader_release(&gr->solid_shader);
-
-	/* Force use_shader() to call glUseProgram(), since we need to use
-	 * the recompiled version of the shader. */
-	gr->current_shader = NULL;
-
 	wl_list_for_each(output, &ec->output_list, link)
 		weston_output_damage(output);
 }
@@ -2020,6 +2576,27 @@ fan_debug_repaint_binding(struct weston_seat *seat, uint32_t time, uint32_t key,
 	weston_compositor_damage_all(compositor);
 }
 
+static void
+upload_stats_binding(struct weston_seat *seat, uint32_t time, uint32_t key,
+		     void *data)
+{
+	struct weston_compositor *compositor = data;
+	struct gl_renderer *gr = get_renderer(compositor);
+
+	weston_log("wl_shm texture uploads: %u full, %u partial, "
+		   "%llu bytes\n",
+		   gr->upload_stats.full, gr->upload_stats.partial,
+		   (unsigned long long) gr->upload_stats.bytes);
+	weston_log("wl_shm texture pool: %u hits, %u misses, "
+		   "%d bytes held\n",
+		   gr->texture_pool.hits, gr->texture_pool.misses,
+		   gr->texture_pool.size);
+
+	memset(&gr->upload_stats, 0, sizeof gr->upload_stats);
+	gr->texture_pool.hits = 0;
+	gr->texture_pool.misses = 0;
+}
+
 static int
 gl_renderer_setup(struct weston_compositor *ec, EGLSurface egl_surface)
 {
@@ -2090,9 +2667,16 @@ gl_renderer_setup(struct weston_compositor *ec, EGLSurface egl_surface)
 		gr->has_unpack_subimage = 1;
 #endif
 
+#ifdef GL_NV_pixel_buffer_object
+	if (strstr(extensions, "GL_NV_pixel_buffer_object"))
+		gr->has_pbo = 1;
+#endif
+
 	if (strstr(extensions, "GL_OES_EGL_image_external"))
 		gr->has_egl_image_external = 1;
 
+	shader_cache_init(gr, extensions);
+
 	extensions =
 		(const char *) eglQueryString(gr->egl_display, EGL_EXTENSIONS);
 	if (!extensions) {
@@ -2116,22 +2700,26 @@ gl_renderer_setup(struct weston_compositor *ec, EGLSurface egl_surface)
 
 	glActiveTexture(GL_TEXTURE0);
 
-	if (compile_shaders(ec))
-		return -1;
-
 	weston_compositor_add_debug_binding(ec, KEY_S,
 					    fragment_debug_binding, ec);
 	weston_compositor_add_debug_binding(ec, KEY_F,
 					    fan_debug_repaint_binding, ec);
+	weston_compositor_add_debug_binding(ec, KEY_U,
+					    upload_stats_binding, ec);
 
 	weston_log("GL ES 2 renderer features:\n");
 	weston_log_continue(STAMP_SPACE "read-back format: %s\n",
 		ec->read_format == PIXMAN_a8r8g8b8 ? "BGRA" : "RGBA");
 	weston_log_continue(STAMP_SPACE "wl_shm sub-image to texture: %s\n",
 			    gr->has_unpack_subimage ? "yes" : "no");
+	weston_log_continue(STAMP_SPACE "wl_shm upload via PBO: %s\n",
+			    gr->has_pbo ? "yes" : "no");
 	weston_log_continue(STAMP_SPACE "EGL Wayland extension: %s\n",
 			    gr->has_bind_display ? "yes" : "no");
+	weston_log_continue(STAMP_SPACE "program binary cache: %s\n",
+			    gr->shader_cache_dir ? gr->shader_cache_dir : "no");
 
+	weston_startup_mark("GL renderer set up");
 
 	return 0;
 }
@@ -21,12 +21,16 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <assert.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 #include "../shared/os-compatibility.h"
 #include "compositor.h"
@@ -54,17 +58,26 @@ weston_seat_repick(struct weston_seat *seat)
 	pointer->grab->interface->focus(seat->pointer->grab);
 }
 
+/* Each seat holds at most one idle inhibit on the compositor, taken
+ * while it has keys, buttons or touch points down, so a seat that goes
+ * away with keys held can't keep the compositor from idling. */
 static void
-weston_compositor_idle_inhibit(struct weston_compositor *compositor)
+weston_seat_idle_inhibit(struct weston_seat *seat)
 {
+	struct weston_compositor *compositor = seat->compositor;
+
 	weston_compositor_wake(compositor);
-	compositor->idle_inhibit++;
+	if (seat->idle_inhibit++ == 0)
+		compositor->idle_inhibit++;
 }
 
 static void
-weston_compositor_idle_release(struct weston_compositor *compositor)
+weston_seat_idle_release(struct weston_seat *seat)
 {
-	compositor->idle_inhibit--;
+	struct weston_compositor *compositor = seat->compositor;
+
+	if (seat->idle_inhibit > 0 && --seat->idle_inhibit == 0)
+		compositor->idle_inhibit--;
 	weston_compositor_wake(compositor);
 }
 
@@ -114,7 +127,7 @@ default_grab_focus(struct weston_pointer_grab *grab)
 }
 
 static void
-default_grab_motion(struct weston_pointer_grab *grab, uint32_t time)
+default_grab_motion(struct weston_pointer_grab *grab, uint64_t time_us)
 {
 	struct weston_pointer *pointer = grab->pointer;
 	wl_fixed_t sx, sy;
@@ -123,13 +136,14 @@ default_grab_motion(struct weston_pointer_grab *grab, uint32_t time)
 		weston_surface_from_global_fixed(pointer->focus,
 						 pointer->x, pointer->y,
 						 &sx, &sy);
-		wl_pointer_send_motion(pointer->focus_resource, time, sx, sy);
+		wl_pointer_send_motion(pointer->focus_resource,
+				       time_us / 1000, sx, sy);
 	}
 }
 
 static void
 default_grab_button(struct weston_pointer_grab *grab,
-		    uint32_t time, uint32_t button, uint32_t state_w)
+		    uint64_t time_us, uint32_t button, uint32_t state_w)
 {
 	struct weston_pointer *pointer = grab->pointer;
 	struct weston_compositor *compositor = pointer->seat->compositor;
@@ -143,7 +157,8 @@ default_grab_button(struct weston_pointer_grab *grab,
 	resource = pointer->focus_resource;
 	if (resource) {
 		serial = wl_display_next_serial(display);
-		wl_pointer_send_button(resource, serial, time, button, state_w);
+		wl_pointer_send_button(resource, serial, time_us / 1000,
+				       button, state_w);
 	}
 
 	if (pointer->button_count == 0 &&
@@ -206,10 +221,20 @@ default_grab_touch_motion(struct weston_touch_grab *grab, uint32_t time,
 	}
 }
 
+static void
+default_grab_touch_frame(struct weston_touch_grab *grab)
+{
+	struct weston_touch *touch = grab->touch;
+
+	if (touch->focus_resource)
+		wl_touch_send_frame(touch->focus_resource);
+}
+
 static const struct weston_touch_grab_interface default_touch_grab_interface = {
 	default_grab_touch_down,
 	default_grab_touch_up,
-	default_grab_touch_motion
+	default_grab_touch_motion,
+	default_grab_touch_frame
 };
 
 static void
@@ -228,16 +253,105 @@ default_grab_key(struct weston_keyboard_grab *grab,
 	}
 }
 
+struct resource_map_entry {
+	struct wl_list link;
+	struct wl_client *client;
+	struct wl_resource *resource;
+	struct wl_listener destroy_listener;
+};
+
+static uint32_t
+resource_map_hash(struct wl_client *client)
+{
+	return ((uintptr_t) client >> 4) % WESTON_RESOURCE_MAP_SIZE;
+}
+
+static void
+resource_map_init(struct weston_resource_map *map)
+{
+	int i;
+
+	for (i = 0; i < WESTON_RESOURCE_MAP_SIZE; i++)
+		wl_list_init(&map->buckets[i]);
+}
+
+static void
+resource_map_entry_destroy(struct resource_map_entry *entry)
+{
+	wl_list_remove(&entry->link);
+	wl_list_remove(&entry->destroy_listener.link);
+	free(entry);
+}
+
+static void
+resource_map_handle_resource_destroy(struct wl_listener *listener, void *data)
+{
+	struct resource_map_entry *entry =
+		container_of(listener, struct resource_map_entry,
+			     destroy_listener);
+
+	resource_map_entry_destroy(entry);
+}
+
+static int
+resource_map_insert(struct weston_resource_map *map,
+		    struct wl_resource *resource)
+{
+	struct resource_map_entry *entry;
+	struct wl_client *client = wl_resource_get_client(resource);
+
+	entry = malloc(sizeof *entry);
+	if (entry == NULL)
+		return -1;
+
+	entry->client = client;
+	entry->resource = resource;
+	entry->destroy_listener.notify = resource_map_handle_resource_destroy;
+	wl_resource_add_destroy_listener(resource, &entry->destroy_listener);
+
+	/* Newest first, like wl_resource_find_for_client() on the
+	 * resource list. */
+	wl_list_insert(&map->buckets[resource_map_hash(client)],
+		       &entry->link);
+
+	return 0;
+}
+
 static struct wl_resource *
-find_resource_for_surface(struct wl_list *list, struct weston_surface *surface)
+resource_map_find(struct weston_resource_map *map, struct wl_client *client)
+{
+	struct resource_map_entry *entry;
+
+	wl_list_for_each(entry, &map->buckets[resource_map_hash(client)], link)
+		if (entry->client == client)
+			return entry->resource;
+
+	return NULL;
+}
+
+static void
+resource_map_release(struct weston_resource_map *map)
+{
+	struct resource_map_entry *entry, *next;
+	int i;
+
+	for (i = 0; i < WESTON_RESOURCE_MAP_SIZE; i++)
+		wl_list_for_each_safe(entry, next, &map->buckets[i], link)
+			resource_map_entry_destroy(entry);
+}
+
+static struct wl_resource *
+find_resource_for_surface(struct weston_resource_map *map,
+			  struct weston_surface *surface)
 {
 	if (!surface)
 		return NULL;
 
 	if (!surface->resource)
 		return NULL;
-	
-	return wl_resource_find_for_client(list, wl_resource_get_client(surface->resource));
+
+	return resource_map_find(map,
+				 wl_resource_get_client(surface->resource));
 }
 
 static void
@@ -257,7 +371,7 @@ default_grab_modifiers(struct weston_keyboard_grab *grab, uint32_t serial,
 				   mods_latched, mods_locked, group);
 
 	if (pointer && pointer->focus && pointer->focus != keyboard->focus) {
-		pr = find_resource_for_surface(&keyboard->resource_list,
+		pr = find_resource_for_surface(&keyboard->resource_map,
 					       pointer->focus);
 		if (pr) {
 			wl_keyboard_send_modifiers(pr,
@@ -308,6 +422,7 @@ weston_pointer_create(void)
 		return NULL;
 
 	wl_list_init(&pointer->resource_list);
+	resource_map_init(&pointer->resource_map);
 	pointer->focus_listener.notify = lose_pointer_focus;
 	pointer->default_grab.interface = &default_pointer_grab_interface;
 	pointer->default_grab.pointer = pointer;
@@ -330,6 +445,7 @@ weston_pointer_destroy(struct weston_pointer *pointer)
 		pointer_unmap_sprite(pointer);
 
 	/* XXX: What about pointer->resource_list? */
+	resource_map_release(&pointer->resource_map);
 	if (pointer->focus_resource)
 		wl_list_remove(&pointer->focus_listener.link);
 	free(pointer);
@@ -345,6 +461,7 @@ weston_keyboard_create(void)
 	    return NULL;
 
 	wl_list_init(&keyboard->resource_list);
+	resource_map_init(&keyboard->resource_map);
 	wl_array_init(&keyboard->keys);
 	keyboard->focus_listener.notify = lose_keyboard_focus;
 	keyboard->default_grab.interface = &default_keyboard_grab_interface;
@@ -359,6 +476,7 @@ WL_EXPORT void
 weston_keyboard_destroy(struct weston_keyboard *keyboard)
 {
 	/* XXX: What about keyboard->resource_list? */
+	resource_map_release(&keyboard->resource_map);
 	if (keyboard->focus_resource)
 		wl_list_remove(&keyboard->focus_listener.link);
 	wl_array_release(&keyboard->keys);
@@ -375,6 +493,7 @@ weston_touch_create(void)
 		return NULL;
 
 	wl_list_init(&touch->resource_list);
+	resource_map_init(&touch->resource_map);
 	touch->focus_listener.notify = lose_touch_focus;
 	touch->default_grab.interface = &default_touch_grab_interface;
 	touch->default_grab.touch = touch;
@@ -388,6 +507,7 @@ WL_EXPORT void
 weston_touch_destroy(struct weston_touch *touch)
 {
 	/* XXX: What about touch->resource_list? */
+	resource_map_release(&touch->resource_map);
 	if (touch->focus_resource)
 		wl_list_remove(&touch->focus_listener.link);
 	free(touch);
@@ -430,14 +550,14 @@ weston_pointer_set_focus(struct weston_pointer *pointer,
 		wl_list_remove(&pointer->focus_listener.link);
 	}
 
-	resource = find_resource_for_surface(&pointer->resource_list,
+	resource = find_resource_for_surface(&pointer->resource_map,
 					     surface);
 	if (resource &&
 	    (pointer->focus != surface ||
 	     pointer->focus_resource != resource)) {
 		serial = wl_display_next_serial(display);
 		if (kbd) {
-			kr = find_resource_for_surface(&kbd->resource_list,
+			kr = find_resource_for_surface(&kbd->resource_map,
 						       surface);
 			if (kr) {
 				wl_keyboard_send_modifiers(kr,
@@ -476,7 +596,7 @@ weston_keyboard_set_focus(struct weston_keyboard *keyboard,
 		wl_list_remove(&keyboard->focus_listener.link);
 	}
 
-	resource = find_resource_for_surface(&keyboard->resource_list,
+	resource = find_resource_for_surface(&keyboard->resource_map,
 					     surface);
 	if (resource &&
 	    (keyboard->focus != surface ||
@@ -519,6 +639,9 @@ WL_EXPORT void
 weston_pointer_start_grab(struct weston_pointer *pointer,
 			  struct weston_pointer_grab *grab)
 {
+	/* Motion that happened before the grab belongs to the old one. */
+	weston_pointer_flush_motion(pointer);
+
 	pointer->grab = grab;
 	grab->pointer = pointer;
 	pointer->grab->interface->focus(pointer->grab);
@@ -527,6 +650,9 @@ weston_pointer_start_grab(struct weston_pointer *pointer,
 WL_EXPORT void
 weston_pointer_end_grab(struct weston_pointer *pointer)
 {
+	/* Likewise, motion during the grab is the ending grab's. */
+	weston_pointer_flush_motion(pointer);
+
 	pointer->grab = &pointer->default_grab;
 	pointer->grab->interface->focus(pointer->grab);
 }
@@ -607,7 +733,10 @@ move_pointer(struct weston_seat *seat, wl_fixed_t x, wl_fixed_t y)
 						   ix, iy, NULL))
 			weston_output_update_zoom(output, ZOOM_FOCUS_POINTER);
 
-	if (pointer->sprite) {
+	if (pointer->sprite &&
+	    !weston_surface_move_cursor(pointer->sprite,
+					ix - pointer->hotspot_x,
+					iy - pointer->hotspot_y)) {
 		weston_surface_set_position(pointer->sprite,
 					    ix - pointer->hotspot_x,
 					    iy - pointer->hotspot_y);
@@ -615,9 +744,81 @@ move_pointer(struct weston_seat *seat, wl_fixed_t x, wl_fixed_t y)
 	}
 }
 
+static void
+emit_input_latency(struct weston_seat *seat, uint64_t time_us)
+{
+	struct weston_compositor *ec = seat->compositor;
+	struct weston_input_latency latency;
+
+	if (wl_list_empty(&ec->input_latency_signal.listener_list))
+		return;
+
+	latency.seat = seat;
+	latency.event_time = time_us;
+	latency.dispatch_time = weston_compositor_get_time_usec();
+	wl_signal_emit(&ec->input_latency_signal, &latency);
+}
+
+WL_EXPORT void
+weston_pointer_flush_motion(struct weston_pointer *pointer)
+{
+	if (!pointer->motion_pending)
+		return;
+
+	pointer->motion_pending = 0;
+	pointer->grab->interface->focus(pointer->grab);
+	pointer->grab->interface->motion(pointer->grab, pointer->motion_time);
+	emit_input_latency(pointer->seat, pointer->motion_time);
+}
+
+WL_EXPORT void
+weston_compositor_flush_motion(struct weston_compositor *compositor)
+{
+	struct weston_seat *seat;
+
+	wl_list_for_each(seat, &compositor->seat_list, link)
+		if (seat->pointer)
+			weston_pointer_flush_motion(seat->pointer);
+}
+
+static void
+motion_flush_idle(void *data)
+{
+	struct weston_compositor *compositor = data;
+
+	compositor->motion_flush_source = NULL;
+	weston_compositor_flush_motion(compositor);
+}
+
+static void
+dispatch_motion(struct weston_pointer *pointer, uint64_t time_us)
+{
+	struct weston_compositor *ec = pointer->seat->compositor;
+	struct wl_event_loop *loop;
+
+	pointer->motion_pending = 1;
+	pointer->motion_time = time_us;
+
+	if (!ec->coalesce_motion) {
+		weston_pointer_flush_motion(pointer);
+		return;
+	}
+
+	/* The sprite has already moved; picking and the client motion
+	 * event are deferred until the end of this batch of input, or
+	 * until the next repaint if that comes first.  Anything that
+	 * depends on event order flushes before it is handled. */
+	if (ec->motion_flush_source)
+		return;
+
+	loop = wl_display_get_event_loop(ec->wl_display);
+	ec->motion_flush_source =
+		wl_event_loop_add_idle(loop, motion_flush_idle, ec);
+}
+
 WL_EXPORT void
 notify_motion(struct weston_seat *seat,
-	      uint32_t time, wl_fixed_t dx, wl_fixed_t dy)
+	      uint64_t time_us, wl_fixed_t dx, wl_fixed_t dy)
 {
 	struct weston_compositor *ec = seat->compositor;
 	struct weston_pointer *pointer = seat->pointer;
@@ -625,14 +826,12 @@ notify_motion(struct weston_seat *seat,
 	weston_compositor_wake(ec);
 
 	move_pointer(seat, pointer->x + dx, pointer->y + dy);
-
-	pointer->grab->interface->focus(pointer->grab);
-	pointer->grab->interface->motion(pointer->grab, time);
+	dispatch_motion(pointer, time_us);
 }
 
 WL_EXPORT void
 notify_motion_absolute(struct weston_seat *seat,
-		       uint32_t time, wl_fixed_t x, wl_fixed_t y)
+		       uint64_t time_us, wl_fixed_t x, wl_fixed_t y)
 {
 	struct weston_compositor *ec = seat->compositor;
 	struct weston_pointer *pointer = seat->pointer;
@@ -640,9 +839,7 @@ notify_motion_absolute(struct weston_seat *seat,
 	weston_compositor_wake(ec);
 
 	move_pointer(seat, x, y);
-
-	pointer->grab->interface->focus(pointer->grab);
-	pointer->grab->interface->motion(pointer->grab, time);
+	dispatch_motion(pointer, time_us);
 }
 
 WL_EXPORT void
@@ -660,35 +857,40 @@ weston_surface_activate(struct weston_surface *surface,
 }
 
 WL_EXPORT void
-notify_button(struct weston_seat *seat, uint32_t time, int32_t button,
+notify_button(struct weston_seat *seat, uint64_t time_us, int32_t button,
 	      enum wl_pointer_button_state state)
 {
 	struct weston_compositor *compositor = seat->compositor;
 	struct weston_pointer *pointer = seat->pointer;
-	struct weston_surface *focus =
-		(struct weston_surface *) pointer->focus;
-	uint32_t serial = wl_display_next_serial(compositor->wl_display);
+	struct weston_surface *focus;
+	uint32_t serial;
+
+	weston_pointer_flush_motion(pointer);
+	focus = (struct weston_surface *) pointer->focus;
+	serial = wl_display_next_serial(compositor->wl_display);
 
 	if (state == WL_POINTER_BUTTON_STATE_PRESSED) {
 		if (compositor->ping_handler && focus)
 			compositor->ping_handler(focus, serial);
-		weston_compositor_idle_inhibit(compositor);
+		weston_seat_idle_inhibit(seat);
 		if (pointer->button_count == 0) {
 			pointer->grab_button = button;
-			pointer->grab_time = time;
+			pointer->grab_time = time_us;
 			pointer->grab_x = pointer->x;
 			pointer->grab_y = pointer->y;
 		}
 		pointer->button_count++;
 	} else {
-		weston_compositor_idle_release(compositor);
+		weston_seat_idle_release(seat);
 		pointer->button_count--;
 	}
 
-	weston_compositor_run_button_binding(compositor, seat, time, button,
-					     state);
+	weston_compositor_run_button_binding(compositor, seat, time_us / 1000,
+					     button, state);
 
-	pointer->grab->interface->button(pointer->grab, time, button, state);
+	pointer->grab->interface->button(pointer->grab, time_us,
+					 button, state);
+	emit_input_latency(seat, time_us);
 
 	if (pointer->button_count == 1)
 		pointer->grab_serial =
@@ -696,14 +898,17 @@ notify_button(struct weston_seat *seat, uint32_t time, int32_t button,
 }
 
 WL_EXPORT void
-notify_axis(struct weston_seat *seat, uint32_t time, uint32_t axis,
+notify_axis(struct weston_seat *seat, uint64_t time_us, uint32_t axis,
 	    wl_fixed_t value)
 {
 	struct weston_compositor *compositor = seat->compositor;
 	struct weston_pointer *pointer = seat->pointer;
-	struct weston_surface *focus =
-		(struct weston_surface *) pointer->focus;
-	uint32_t serial = wl_display_next_serial(compositor->wl_display);
+	struct weston_surface *focus;
+	uint32_t serial;
+
+	weston_pointer_flush_motion(pointer);
+	focus = (struct weston_surface *) pointer->focus;
+	serial = wl_display_next_serial(compositor->wl_display);
 
 	if (compositor->ping_handler && focus)
 		compositor->ping_handler(focus, serial);
@@ -714,12 +919,12 @@ notify_axis(struct weston_seat *seat, uint32_t time, uint32_t axis,
 		return;
 
 	if (weston_compositor_run_axis_binding(compositor, seat,
-						   time, axis, value))
+						   time_us / 1000, axis, value))
 		return;
 
 	if (pointer->focus_resource)
-		wl_pointer_send_axis(pointer->focus_resource, time, axis,
-				     value);
+		wl_pointer_send_axis(pointer->focus_resource, time_us / 1000,
+				     axis, value);
 }
 
 #ifdef ENABLE_XKBCOMMON
@@ -835,18 +1040,22 @@ notify_key(struct weston_seat *seat, uint32_t time, uint32_t key,
 	struct weston_surface *focus =
 		(struct weston_surface *) keyboard->focus;
 	struct weston_keyboard_grab *grab = keyboard->grab;
-	uint32_t serial = wl_display_next_serial(compositor->wl_display);
+	uint32_t serial;
 	uint32_t *k, *end;
 
+	if (seat->pointer)
+		weston_pointer_flush_motion(seat->pointer);
+	serial = wl_display_next_serial(compositor->wl_display);
+
 	if (state == WL_KEYBOARD_KEY_STATE_PRESSED) {
 		if (compositor->ping_handler && focus)
 			compositor->ping_handler(focus, serial);
 
-		weston_compositor_idle_inhibit(compositor);
+		weston_seat_idle_inhibit(seat);
 		keyboard->grab_key = key;
 		keyboard->grab_time = time;
 	} else {
-		weston_compositor_idle_release(compositor);
+		weston_seat_idle_release(seat);
 	}
 
 	end = keyboard->keys.data + keyboard->keys.size;
@@ -920,7 +1129,7 @@ notify_keyboard_focus_in(struct weston_seat *seat, struct wl_array *keys,
 	serial = wl_display_next_serial(compositor->wl_display);
 	wl_array_copy(&keyboard->keys, keys);
 	wl_array_for_each(k, &keyboard->keys) {
-		weston_compositor_idle_inhibit(compositor);
+		weston_seat_idle_inhibit(seat);
 		if (update_state == STATE_UPDATE_AUTOMATIC)
 			update_modifier_state(seat, serial, *k,
 					      WL_KEYBOARD_KEY_STATE_PRESSED);
@@ -950,7 +1159,7 @@ notify_keyboard_focus_out(struct weston_seat *seat)
 
 	serial = wl_display_next_serial(compositor->wl_display);
 	wl_array_for_each(k, &keyboard->keys) {
-		weston_compositor_idle_release(compositor);
+		weston_seat_idle_release(seat);
 		update_modifier_state(seat, serial, *k,
 				      WL_KEYBOARD_KEY_STATE_RELEASED);
 	}
@@ -987,7 +1196,7 @@ weston_touch_set_focus(struct weston_seat *seat, struct weston_surface *surface)
 
 	if (surface) {
 		resource =
-			find_resource_for_surface(&seat->touch->resource_list,
+			find_resource_for_surface(&seat->touch->resource_map,
 						  surface);
 		if (!resource) {
 			weston_log("couldn't find resource\n");
@@ -1019,13 +1228,16 @@ notify_touch(struct weston_seat *seat, uint32_t time, int touch_id,
 	struct weston_surface *es;
 	wl_fixed_t sx, sy;
 
+	if (seat->pointer)
+		weston_pointer_flush_motion(seat->pointer);
+
 	/* Update grab's global coordinates. */
 	touch->grab_x = x;
 	touch->grab_y = y;
 
 	switch (touch_type) {
 	case WL_TOUCH_DOWN:
-		weston_compositor_idle_inhibit(ec);
+		weston_seat_idle_inhibit(seat);
 
 		seat->num_tp++;
 
@@ -1066,16 +1278,34 @@ notify_touch(struct weston_seat *seat, uint32_t time, int touch_id,
 		grab->interface->motion(grab, time, touch_id, sx, sy);
 		break;
 	case WL_TOUCH_UP:
-		weston_compositor_idle_release(ec);
+		weston_seat_idle_release(seat);
 		seat->num_tp--;
 
+		/* Focus is dropped in notify_touch_frame(), once the
+		 * client got the frame closing this touch sequence. */
 		grab->interface->up(grab, time, touch_id);
-		if (seat->num_tp == 0)
-			weston_touch_set_focus(seat, NULL);
 		break;
 	}
 }
 
+/**
+ * notify_touch_frame - marks the end of a set of touch point changes.
+ *
+ * Backends call this after the notify_touch() calls of all contacts that
+ * changed in one device report, so clients get a single frame event for
+ * them and can handle the contacts as one update.
+ */
+WL_EXPORT void
+notify_touch_frame(struct weston_seat *seat)
+{
+	struct weston_touch_grab *grab = seat->touch->grab;
+
+	grab->interface->frame(grab);
+
+	if (seat->num_tp == 0)
+		weston_touch_set_focus(seat, NULL);
+}
+
 static void
 pointer_cursor_surface_configure(struct weston_surface *es,
 				 int32_t dx, int32_t dy, int32_t width, int32_t height)
@@ -1179,6 +1409,12 @@ seat_get_pointer(struct wl_client *client, struct wl_resource *resource,
 		return;
 	}
 
+	if (resource_map_insert(&seat->pointer->resource_map, cr) < 0) {
+		wl_resource_destroy(cr);
+		wl_client_post_no_memory(client);
+		return;
+	}
+
 	wl_list_insert(&seat->pointer->resource_list, wl_resource_get_link(cr));
 	wl_resource_set_implementation(cr, &pointer_interface, seat->pointer,
 				       unbind_resource);
@@ -1218,6 +1454,12 @@ seat_get_keyboard(struct wl_client *client, struct wl_resource *resource,
 		return;
 	}
 
+	if (resource_map_insert(&seat->keyboard->resource_map, cr) < 0) {
+		wl_resource_destroy(cr);
+		wl_client_post_no_memory(client);
+		return;
+	}
+
 	wl_list_insert(&seat->keyboard->resource_list, wl_resource_get_link(cr));
 	wl_resource_set_implementation(cr, NULL, seat, unbind_resource);
 
@@ -1258,6 +1500,12 @@ seat_get_touch(struct wl_client *client, struct wl_resource *resource,
 		return;
 	}
 
+	if (resource_map_insert(&seat->touch->resource_map, cr) < 0) {
+		wl_resource_destroy(cr);
+		wl_client_post_no_memory(client);
+		return;
+	}
+
 	wl_list_insert(&seat->touch->resource_list, wl_resource_get_link(cr));
 	wl_resource_set_implementation(cr, NULL, seat, unbind_resource);
 }
@@ -1294,6 +1542,11 @@ bind_seat(struct wl_client *client, void *data, uint32_t version, uint32_t id)
 }
 
 #ifdef ENABLE_XKBCOMMON
+static void
+keymap_job_start(struct weston_compositor *ec);
+static int
+keymap_job_finish(struct weston_compositor *ec);
+
 int
 weston_compositor_xkb_init(struct weston_compositor *ec,
 			   struct xkb_rule_names *names)
@@ -1317,6 +1570,9 @@ weston_compositor_xkb_init(struct weston_compositor *ec,
 	if (!ec->xkb_names.layout)
 		ec->xkb_names.layout = strdup("us");
 
+	if (ec->xkb_info.keymap == NULL && ec->keymap_job == NULL)
+		keymap_job_start(ec);
+
 	return 0;
 }
 
@@ -1341,6 +1597,9 @@ weston_compositor_xkb_destroy(struct weston_compositor *ec)
 	if (!ec->use_xkbcommon)
 		return;
 
+	if (ec->keymap_job)
+		keymap_job_finish(ec);
+
 	free((char *) ec->xkb_names.rules);
 	free((char *) ec->xkb_names.model);
 	free((char *) ec->xkb_names.layout);
@@ -1351,11 +1610,9 @@ weston_compositor_xkb_destroy(struct weston_compositor *ec)
 	xkb_context_unref(ec->xkb_context);
 }
 
-static int
-weston_xkb_info_new_keymap(struct weston_xkb_info *xkb_info)
+static void
+weston_xkb_info_get_indices(struct weston_xkb_info *xkb_info)
 {
-	char *keymap_str;
-
 	xkb_info->shift_mod = xkb_map_mod_get_index(xkb_info->keymap,
 						    XKB_MOD_NAME_SHIFT);
 	xkb_info->caps_mod = xkb_map_mod_get_index(xkb_info->keymap,
@@ -1376,18 +1633,48 @@ weston_xkb_info_new_keymap(struct weston_xkb_info *xkb_info)
 						   XKB_LED_NAME_CAPS);
 	xkb_info->scroll_led = xkb_map_led_get_index(xkb_info->keymap,
 						     XKB_LED_NAME_SCROLL);
+}
+
+/* Logs straight away, or, when building the keymap off the main thread,
+ * keeps the message in messages for keymap_job_finish() to log after
+ * the join: the log is not thread-safe. */
+static void
+keymap_log(struct wl_array *messages, const char *fmt, ...)
+{
+	va_list ap;
+	char **p;
+
+	va_start(ap, fmt);
+	if (messages == NULL) {
+		weston_vlog(fmt, ap);
+	} else {
+		p = wl_array_add(messages, sizeof *p);
+		if (p && vasprintf(p, fmt, ap) < 0)
+			messages->size -= sizeof *p;
+	}
+	va_end(ap);
+}
+
+static int
+weston_xkb_info_new_keymap(struct weston_xkb_info *xkb_info,
+			   struct wl_array *messages)
+{
+	char *keymap_str;
+
+	weston_xkb_info_get_indices(xkb_info);
 
 	keymap_str = xkb_map_get_as_string(xkb_info->keymap);
 	if (keymap_str == NULL) {
-		weston_log("failed to get string version of keymap\n");
+		keymap_log(messages, "failed to get string version of keymap\n");
 		return -1;
 	}
 	xkb_info->keymap_size = strlen(keymap_str) + 1;
 
 	xkb_info->keymap_fd = os_create_anonymous_file(xkb_info->keymap_size);
 	if (xkb_info->keymap_fd < 0) {
-		weston_log("creating a keymap file for %lu bytes failed: %m\n",
-			(unsigned long) xkb_info->keymap_size);
+		keymap_log(messages,
+			   "creating a keymap file for %lu bytes failed: %m\n",
+			   (unsigned long) xkb_info->keymap_size);
 		goto err_keymap_str;
 	}
 
@@ -1395,8 +1682,8 @@ weston_xkb_info_new_keymap(struct weston_xkb_info *xkb_info)
 				     PROT_READ | PROT_WRITE,
 				     MAP_SHARED, xkb_info->keymap_fd, 0);
 	if (xkb_info->keymap_area == MAP_FAILED) {
-		weston_log("failed to mmap() %lu bytes\n",
-			(unsigned long) xkb_info->keymap_size);
+		keymap_log(messages, "failed to mmap() %lu bytes\n",
+			   (unsigned long) xkb_info->keymap_size);
 		goto err_dev_zero;
 	}
 	strcpy(xkb_info->keymap_area, keymap_str);
@@ -1412,29 +1699,349 @@ err_keymap_str:
 	return -1;
 }
 
-static int
-weston_compositor_build_global_keymap(struct weston_compositor *ec)
+/*
+ * Compiling a keymap from RMLVO names dominates startup on slow
+ * machines, so the serialized global keymap is cached in
+ * $XDG_CACHE_HOME/weston.  A cache file has exactly the layout clients
+ * get: the NUL terminated keymap string, followed by the cache key and
+ * a trailer that lie beyond the size sent with wl_keyboard.keymap.  On
+ * a hit the file itself becomes the keymap fd, and only parsing the
+ * already resolved keymap string remains.
+ *
+ * Cache files are never modified in place.  Entries are written to a
+ * temporary file and renamed, and stale ones are unlinked, so a file
+ * mapped by clients never changes under them.
+ */
+#define KEYMAP_CACHE_MAGIC 0x434d4b57 /* "WKMC" */
+
+enum keymap_cache_status {
+	KEYMAP_CACHE_HIT,
+	KEYMAP_CACHE_MISS,	/* no usable entry, store a new one */
+	KEYMAP_CACHE_TAKEN	/* the file holds another key's entry */
+};
+
+struct keymap_cache_trailer {
+	uint32_t magic;
+	uint32_t key_size;
+	uint64_t keymap_size;
+};
+
+static char *
+keymap_cache_key(struct weston_compositor *ec)
 {
-	if (ec->xkb_info.keymap != NULL)
-		return 0;
+	const struct xkb_rule_names *names = &ec->xkb_names;
+	struct stat st;
+	char *path, *key;
+
+	/* The rules file is replaced when xkeyboard-config is upgraded,
+	 * which catches data updates without a rebuild of weston. */
+	memset(&st, 0, sizeof st);
+	if (asprintf(&path, "%s/rules/%s", XKB_CONFIG_ROOT, names->rules) < 0)
+		return NULL;
+	stat(path, &st);
+	free(path);
+
+	if (asprintf(&key,
+		     "xkbcommon %s\n"
+		     "xkeyboard-config %s %lld %lld\n"
+		     "rules %s\nmodel %s\nlayout %s\nvariant %s\n"
+		     "options %s\n",
+		     XKBCOMMON_VERSION, XKEYBOARD_CONFIG_VERSION,
+		     (long long) st.st_mtime, (long long) st.st_size,
+		     names->rules, names->model, names->layout,
+		     names->variant ? names->variant : "",
+		     names->options ? names->options : "") < 0)
+		return NULL;
+
+	return key;
+}
+
+static char *
+keymap_cache_path(const char *key)
+{
+	uint32_t hash = 2166136261u;
+	char *dir, *path;
+	const char *p;
+
+	/* FNV-1a; collisions are caught by comparing the stored key. */
+	for (p = key; *p; p++)
+		hash = (hash ^ (unsigned char) *p) * 16777619u;
+
+	dir = os_create_cache_dir();
+	if (!dir)
+		return NULL;
+
+	if (asprintf(&path, "%s/keymap-%08x.xkb", dir, hash) < 0)
+		path = NULL;
+	free(dir);
+
+	return path;
+}
+
+static enum keymap_cache_status
+keymap_cache_load(struct weston_compositor *ec, struct xkb_context *context,
+		  const char *path, const char *key, struct wl_array *messages)
+{
+	struct weston_xkb_info *xkb_info = &ec->xkb_info;
+	struct keymap_cache_trailer trailer;
+	size_t key_size = strlen(key);
+	char *stored_key = NULL;
+	char *area;
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return KEYMAP_CACHE_MISS;
+
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof trailer ||
+	    pread(fd, &trailer, sizeof trailer,
+		  st.st_size - sizeof trailer) != sizeof trailer)
+		goto err_stale;
+
+	if (trailer.magic != KEYMAP_CACHE_MAGIC ||
+	    trailer.keymap_size == 0 ||
+	    trailer.keymap_size + trailer.key_size + sizeof trailer !=
+			(uint64_t) st.st_size)
+		goto err_stale;
+
+	/* A well-formed entry for another configuration, whose path
+	 * hash collides with ours.  Leave it to its owner. */
+	if (trailer.key_size != key_size)
+		goto err_taken;
+
+	stored_key = malloc(key_size);
+	if (stored_key == NULL)
+		goto err_close;
+	if (pread(fd, stored_key, key_size,
+		  trailer.keymap_size) != (ssize_t) key_size)
+		goto err_stale;
+	if (memcmp(stored_key, key, key_size) != 0)
+		goto err_taken;
+	free(stored_key);
+	stored_key = NULL;
+
+	area = mmap(NULL, trailer.keymap_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (area == MAP_FAILED)
+		goto err_close;
+
+	if (area[trailer.keymap_size - 1] == '\0')
+		xkb_info->keymap =
+			xkb_map_new_from_string(context, area,
+						XKB_MAP_FORMAT_TEXT_V1, 0);
+	if (xkb_info->keymap == NULL) {
+		munmap(area, trailer.keymap_size);
+		goto err_stale;
+	}
+
+	xkb_info->keymap_fd = fd;
+	xkb_info->keymap_area = area;
+	xkb_info->keymap_size = trailer.keymap_size;
+	weston_xkb_info_get_indices(xkb_info);
+
+	return KEYMAP_CACHE_HIT;
+
+err_taken:
+	free(stored_key);
+	close(fd);
+	return KEYMAP_CACHE_TAKEN;
+
+err_stale:
+	keymap_log(messages, "discarding stale keymap cache %s\n", path);
+	unlink(path);
+err_close:
+	free(stored_key);
+	close(fd);
+	return KEYMAP_CACHE_MISS;
+}
+
+static void
+keymap_cache_store(struct weston_compositor *ec,
+		   const char *path, const char *key)
+{
+	struct weston_xkb_info *xkb_info = &ec->xkb_info;
+	struct keymap_cache_trailer trailer;
+	char *tmp;
+	FILE *fp;
+	int fd, ok;
 
-	ec->xkb_info.keymap = xkb_map_new_from_names(ec->xkb_context,
+	if (asprintf(&tmp, "%s.XXXXXX", path) < 0)
+		return;
+
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		free(tmp);
+		return;
+	}
+
+	fp = fdopen(fd, "w");
+	if (fp == NULL) {
+		close(fd);
+		unlink(tmp);
+		free(tmp);
+		return;
+	}
+
+	trailer.magic = KEYMAP_CACHE_MAGIC;
+	trailer.key_size = strlen(key);
+	trailer.keymap_size = xkb_info->keymap_size;
+
+	ok = fwrite(xkb_info->keymap_area, 1, xkb_info->keymap_size, fp) ==
+		xkb_info->keymap_size &&
+	     fwrite(key, 1, trailer.key_size, fp) == trailer.key_size &&
+	     fwrite(&trailer, sizeof trailer, 1, fp) == 1;
+	if (fclose(fp) != 0)
+		ok = 0;
+
+	if (!ok || rename(tmp, path) < 0)
+		unlink(tmp);
+	free(tmp);
+}
+
+static int
+keymap_build(struct weston_compositor *ec, struct xkb_context *context,
+	     struct wl_array *messages)
+{
+	enum keymap_cache_status status = KEYMAP_CACHE_MISS;
+	char *key, *path = NULL;
+	int ret = 0;
+
+	key = keymap_cache_key(ec);
+	if (key)
+		path = keymap_cache_path(key);
+	if (path)
+		status = keymap_cache_load(ec, context, path, key, messages);
+	if (status == KEYMAP_CACHE_HIT)
+		goto out;
+
+	ec->xkb_info.keymap = xkb_map_new_from_names(context,
 						     &ec->xkb_names,
 						     0);
 	if (ec->xkb_info.keymap == NULL) {
-		weston_log("failed to compile global XKB keymap\n");
-		weston_log("  tried rules %s, model %s, layout %s, variant %s, "
-			"options %s\n",
-			ec->xkb_names.rules, ec->xkb_names.model,
-			ec->xkb_names.layout, ec->xkb_names.variant,
-			ec->xkb_names.options);
-		return -1;
+		keymap_log(messages, "failed to compile global XKB keymap\n");
+		keymap_log(messages,
+			   "  tried rules %s, model %s, layout %s, variant %s, "
+			   "options %s\n",
+			   ec->xkb_names.rules, ec->xkb_names.model,
+			   ec->xkb_names.layout, ec->xkb_names.variant,
+			   ec->xkb_names.options);
+		ret = -1;
+		goto out;
 	}
 
-	if (weston_xkb_info_new_keymap(&ec->xkb_info) < 0)
-		return -1;
+	if (weston_xkb_info_new_keymap(&ec->xkb_info, messages) < 0) {
+		ret = -1;
+		goto out;
+	}
 
-	return 0;
+	/* Only ever replace our own or unusable entries, so that two
+	 * configurations sharing a path do not evict each other. */
+	if (path && status == KEYMAP_CACHE_MISS)
+		keymap_cache_store(ec, path, key);
+
+out:
+	free(path);
+	free(key);
+	return ret;
+}
+
+/*
+ * The global keymap is built on a thread of its own from
+ * weston_compositor_xkb_init() on, so loading or compiling it overlaps
+ * with bringing up the backend and renderer.  The first keyboard waits
+ * for it.  The thread uses a private xkb context, as backends may use
+ * the compositor's meanwhile; the keymap keeps the context alive.  Up
+ * to the join, the thread owns ec->xkb_info and only reads the names.
+ * What it has to say is kept in messages and logged after the join.
+ */
+struct weston_keymap_job {
+	struct weston_compositor *compositor;
+	pthread_t thread;
+	uint64_t start, end;	/* usec */
+	struct wl_array messages;	/* char *, to log */
+	int ret;
+};
+
+static void *
+keymap_job_run(void *data)
+{
+	struct weston_keymap_job *job = data;
+	struct xkb_context *context;
+
+	context = xkb_context_new(0);
+	if (context == NULL) {
+		keymap_log(&job->messages, "failed to create XKB context\n");
+		job->ret = -1;
+	} else {
+		job->ret = keymap_build(job->compositor, context,
+					&job->messages);
+		xkb_context_unref(context);
+	}
+	job->end = weston_compositor_get_time_usec();
+
+	return NULL;
+}
+
+static void
+keymap_job_start(struct weston_compositor *ec)
+{
+	struct weston_keymap_job *job;
+
+	job = malloc(sizeof *job);
+	if (job == NULL)
+		return;
+
+	job->compositor = ec;
+	job->start = weston_compositor_get_time_usec();
+	job->ret = -1;
+	wl_array_init(&job->messages);
+	if (pthread_create(&job->thread, NULL, keymap_job_run, job) != 0) {
+		/* Built on demand instead. */
+		free(job);
+		return;
+	}
+
+	ec->keymap_job = job;
+}
+
+static int
+keymap_job_finish(struct weston_compositor *ec)
+{
+	struct weston_keymap_job *job = ec->keymap_job;
+	uint64_t now = weston_compositor_get_time_usec();
+	char **p;
+	int ret;
+
+	pthread_join(job->thread, NULL);
+	ec->keymap_job = NULL;
+
+	wl_array_for_each(p, &job->messages) {
+		weston_log("%s", *p);
+		free(*p);
+	}
+	wl_array_release(&job->messages);
+
+	weston_log("keymap built in %.1f ms off the main thread, "
+		   "waited %.1f ms for it\n",
+		   (job->end - job->start) / 1000.0,
+		   job->end > now ? (job->end - now) / 1000.0 : 0.0);
+
+	ret = job->ret;
+	free(job);
+
+	return ret;
+}
+
+static int
+weston_compositor_build_global_keymap(struct weston_compositor *ec)
+{
+	if (ec->xkb_info.keymap != NULL)
+		return 0;
+
+	if (ec->keymap_job)
+		return keymap_job_finish(ec);
+
+	return keymap_build(ec, ec->xkb_context, NULL);
 }
 #else
 int
@@ -1462,7 +2069,7 @@ weston_seat_init_keyboard(struct weston_seat *seat, struct xkb_keymap *keymap)
 	if (seat->compositor->use_xkbcommon) {
 		if (keymap != NULL) {
 			seat->xkb_info.keymap = xkb_map_ref(keymap);
-			if (weston_xkb_info_new_keymap(&seat->xkb_info) < 0)
+			if (weston_xkb_info_new_keymap(&seat->xkb_info, NULL) < 0)
 				return -1;
 		} else {
 			if (weston_compositor_build_global_keymap(seat->compositor) < 0)
@@ -1561,8 +2168,20 @@ weston_seat_init(struct weston_seat *seat, struct weston_compositor *ec,
 WL_EXPORT void
 weston_seat_release(struct weston_seat *seat)
 {
+	struct weston_compositor *compositor = seat->compositor;
+
 	wl_list_remove(&seat->link);
 
+	/* The idle timer is not rearmed while inhibited.  If this seat
+	 * held the last inhibit, let idle_handler() work out how much of
+	 * the idle time is left, without counting the removal as
+	 * activity. */
+	if (seat->idle_inhibit && --compositor->idle_inhibit == 0 &&
+	    !compositor->idle_timer_armed && compositor->idle_time > 0) {
+		wl_event_source_timer_update(compositor->idle_source, 1);
+		compositor->idle_timer_armed = 1;
+	}
+
 #ifdef ENABLE_XKBCOMMON
 	if (seat->compositor->use_xkbcommon) {
 		if (seat->xkb_state.state != NULL)
@@ -25,6 +25,7 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include "pixman-renderer.h"
 
@@ -39,12 +40,25 @@ struct pixman_output_state {
 struct pixman_surface_state {
 	pixman_image_t *image;
 	struct weston_buffer_reference buffer_ref;
+
+	/* Downscaled copy of the buffer, see thumbnail_get(). */
+	pixman_image_t *thumbnail;
+	float thumbnail_scale_x, thumbnail_scale_y;
+	pixman_region32_t thumbnail_damage;	/* surface coordinates */
+	struct wl_list thumbnail_link;
 };
 
+#define DEFAULT_THUMBNAIL_CACHE_SIZE	(32 * 1024)	/* KiB */
+
 struct pixman_renderer {
 	struct weston_renderer base;
 	int repaint_debug;
 	pixman_image_t *debug_color;
+
+	/* Surfaces with a thumbnail, most recently drawn first. */
+	struct wl_list thumbnail_list;
+	size_t thumbnail_size;
+	size_t thumbnail_cache_size;
 };
 
 static inline struct pixman_output_state *
@@ -247,7 +261,7 @@ repaint_region(struct weston_surface *es, struct weston_output *output,
 
 		/* Convert from surface to global coordinates */
 		if (!es->transform.enabled) {
-			pixman_region32_translate(&final_region, es->geometry.x, es->geometry.y);
+			pixman_region32_translate(&final_region, es->transform.x, es->transform.y);
 		} else {
 			weston_surface_to_global_float(es, 0, 0, &surface_x, &surface_y);
 			pixman_region32_translate(&final_region, (int)surface_x, (int)surface_y);
@@ -337,8 +351,8 @@ repaint_region(struct weston_surface *es, struct weston_output *output,
 		pixman_transform_multiply (&transform, &surface_transform, &transform);
 	} else {
 		pixman_transform_translate(&transform, NULL,
-					   pixman_double_to_fixed ((double)-es->geometry.x),
-					   pixman_double_to_fixed ((double)-es->geometry.y));
+					   pixman_double_to_fixed ((double)-es->transform.x),
+					   pixman_double_to_fixed ((double)-es->transform.y));
 	}
 
 
@@ -416,11 +430,206 @@ repaint_region(struct weston_surface *es, struct weston_output *output,
 	pixman_region32_fini(&final_region);
 }
 
+/* Surfaces the shell holds at a fixed, reduced scale, like in its
+ * overview, are drawn from a thumbnail: a copy of the buffer at the
+ * scale they are drawn at, made with a box filter.  Drawing the
+ * thumbnail is a plain copy, and only the parts of it the client
+ * damaged are scaled down again.  Surfaces whose scale is animating
+ * take the filtered path, since their copy would be remade for every
+ * frame.  Thumbnails are evicted least recently drawn first to stay
+ * under the cache size. */
+static void
+thumbnail_release(struct pixman_renderer *pr, struct pixman_surface_state *ps)
+{
+	if (!ps->thumbnail)
+		return;
+
+	pr->thumbnail_size -= pixman_image_get_stride(ps->thumbnail) *
+		pixman_image_get_height(ps->thumbnail);
+	pixman_image_unref(ps->thumbnail);
+	ps->thumbnail = NULL;
+	wl_list_remove(&ps->thumbnail_link);
+	wl_list_init(&ps->thumbnail_link);
+}
+
+static int
+thumbnail_create(struct pixman_renderer *pr, struct pixman_surface_state *ps,
+		 int width, int height)
+{
+	struct pixman_surface_state *lru;
+	size_t size = width * height * 4;
+
+	if (size > pr->thumbnail_cache_size)
+		return -1;
+
+	while (pr->thumbnail_size + size > pr->thumbnail_cache_size) {
+		lru = container_of(pr->thumbnail_list.prev,
+				   struct pixman_surface_state,
+				   thumbnail_link);
+		thumbnail_release(pr, lru);
+	}
+
+	ps->thumbnail =
+		pixman_image_create_bits(pixman_image_get_format(ps->image),
+					 width, height, NULL, 0);
+	if (!ps->thumbnail)
+		return -1;
+
+	pr->thumbnail_size += pixman_image_get_stride(ps->thumbnail) * height;
+	wl_list_insert(&pr->thumbnail_list, &ps->thumbnail_link);
+
+	return 0;
+}
+
+static void
+thumbnail_update(struct pixman_surface_state *ps)
+{
+	float sx = ps->thumbnail_scale_x, sy = ps->thumbnail_scale_y;
+	int width = pixman_image_get_width(ps->thumbnail);
+	int height = pixman_image_get_height(ps->thumbnail);
+	pixman_transform_t transform;
+	pixman_box32_t *rects;
+	int i, n, x1, y1, x2, y2;
+#if PIXMAN_VERSION >= PIXMAN_VERSION_ENCODE(0, 30, 0)
+	pixman_fixed_t *params;
+	int n_params;
+#endif
+
+	if (!pixman_region32_not_empty(&ps->thumbnail_damage))
+		return;
+
+	pixman_transform_init_scale(&transform,
+				    pixman_double_to_fixed(1.0 / sx),
+				    pixman_double_to_fixed(1.0 / sy));
+	pixman_image_set_transform(ps->image, &transform);
+
+#if PIXMAN_VERSION >= PIXMAN_VERSION_ENCODE(0, 30, 0)
+	params = pixman_filter_create_separable_convolution(&n_params,
+				pixman_double_to_fixed(1.0 / sx),
+				pixman_double_to_fixed(1.0 / sy),
+				PIXMAN_KERNEL_BOX, PIXMAN_KERNEL_BOX,
+				PIXMAN_KERNEL_BOX, PIXMAN_KERNEL_BOX, 1, 1);
+	pixman_image_set_filter(ps->image,
+				PIXMAN_FILTER_SEPARABLE_CONVOLUTION,
+				params, n_params);
+	free(params);
+#else
+	pixman_image_set_filter(ps->image, PIXMAN_FILTER_GOOD, NULL, 0);
+#endif
+
+	/* A damaged source pixel reaches one thumbnail pixel further
+	 * through the filter. */
+	rects = pixman_region32_rectangles(&ps->thumbnail_damage, &n);
+	for (i = 0; i < n; i++) {
+		x1 = floorf(rects[i].x1 * sx) - 1;
+		y1 = floorf(rects[i].y1 * sy) - 1;
+		x2 = MIN(width, (int) ceilf(rects[i].x2 * sx) + 1);
+		y2 = MIN(height, (int) ceilf(rects[i].y2 * sy) + 1);
+		if (x1 < 0)
+			x1 = 0;
+		if (y1 < 0)
+			y1 = 0;
+		if (x1 >= x2 || y1 >= y2)
+			continue;
+
+		pixman_image_composite32(PIXMAN_OP_SRC,
+					 ps->image, NULL, ps->thumbnail,
+					 x1, y1, 0, 0, x1, y1,
+					 x2 - x1, y2 - y1);
+	}
+
+	pixman_region32_clear(&ps->thumbnail_damage);
+}
+
+/* Returns the thumbnail to draw the surface with on this output, or
+ * NULL when it is to be drawn from its buffer. */
+static pixman_image_t *
+thumbnail_get(struct weston_surface *es, struct weston_output *output)
+{
+	struct pixman_renderer *pr = get_renderer(es->compositor);
+	struct pixman_surface_state *ps = get_surface_state(es);
+	struct weston_matrix *matrix = &es->transform.matrix;
+	float sx = matrix->d[0], sy = matrix->d[5];
+
+	if (!es->fixed_scale || !es->transform.enabled ||
+	    matrix->type & (WESTON_MATRIX_TRANSFORM_ROTATE |
+			    WESTON_MATRIX_TRANSFORM_OTHER) ||
+	    sx <= 0.0 || sx >= 1.0 || sy <= 0.0 || sy >= 1.0)
+		return NULL;
+
+	if (!ps->buffer_ref.buffer ||
+	    es->buffer_transform != WL_OUTPUT_TRANSFORM_NORMAL ||
+	    es->buffer_scale != 1 ||
+	    output->transform != WL_OUTPUT_TRANSFORM_NORMAL ||
+	    output->scale != 1)
+		return NULL;
+
+	if (ps->thumbnail &&
+	    (sx != ps->thumbnail_scale_x || sy != ps->thumbnail_scale_y))
+		thumbnail_release(pr, ps);
+
+	if (!ps->thumbnail) {
+		if (thumbnail_create(pr, ps,
+				     ceilf(es->geometry.width * sx),
+				     ceilf(es->geometry.height * sy)) < 0)
+			return NULL;
+		ps->thumbnail_scale_x = sx;
+		ps->thumbnail_scale_y = sy;
+		pixman_region32_fini(&ps->thumbnail_damage);
+		pixman_region32_init_rect(&ps->thumbnail_damage, 0, 0,
+					  es->geometry.width,
+					  es->geometry.height);
+	}
+
+	thumbnail_update(ps);
+
+	wl_list_remove(&ps->thumbnail_link);
+	wl_list_insert(&pr->thumbnail_list, &ps->thumbnail_link);
+
+	return ps->thumbnail;
+}
+
+static void
+repaint_thumbnail(struct weston_surface *es, struct weston_output *output,
+		  pixman_image_t *thumbnail, pixman_region32_t *region)
+{
+	struct pixman_output_state *po = get_output_state(output);
+	pixman_region32_t final_region;
+	pixman_transform_t transform;
+	float x, y;
+
+	pixman_region32_init(&final_region);
+	pixman_region32_copy(&final_region, region);
+	region_global_to_output(output, &final_region);
+	pixman_image_set_clip_region32(po->shadow_image, &final_region);
+
+	/* The thumbnail is at the drawn scale, only its position is left
+	 * to map. */
+	weston_surface_to_global_float(es, 0, 0, &x, &y);
+	pixman_transform_init_translate(&transform,
+					pixman_int_to_fixed(output->x -
+							    (int) roundf(x)),
+					pixman_int_to_fixed(output->y -
+							    (int) roundf(y)));
+	pixman_image_set_transform(thumbnail, &transform);
+	pixman_image_set_filter(thumbnail, PIXMAN_FILTER_NEAREST, NULL, 0);
+
+	pixman_image_composite32(PIXMAN_OP_OVER,
+				 thumbnail, NULL, po->shadow_image,
+				 0, 0, 0, 0, 0, 0,
+				 pixman_image_get_width(po->shadow_image),
+				 pixman_image_get_height(po->shadow_image));
+
+	pixman_image_set_clip_region32(po->shadow_image, NULL);
+	pixman_region32_fini(&final_region);
+}
+
 static void
 draw_surface(struct weston_surface *es, struct weston_output *output,
 	     pixman_region32_t *damage) /* in global coordinates */
 {
 	struct pixman_surface_state *ps = get_surface_state(es);
+	pixman_image_t *thumbnail;
 	/* repaint bounding region in global coordinates: */
 	pixman_region32_t repaint;
 	/* non-opaque region in surface coordinates: */
@@ -443,6 +652,12 @@ draw_surface(struct weston_surface *es, struct weston_output *output,
 		goto out;
 	}
 
+	thumbnail = thumbnail_get(es, output);
+	if (thumbnail) {
+		repaint_thumbnail(es, output, thumbnail, &repaint);
+		goto out;
+	}
+
 	/* TODO: Implement repaint_region_complex() using pixman_composite_trapezoids() */
 	if (es->transform.enabled &&
 	    es->transform.matrix.type != WESTON_MATRIX_TRANSFORM_TRANSLATE) {
@@ -470,12 +685,13 @@ out:
 static void
 repaint_surfaces(struct weston_output *output, pixman_region32_t *damage)
 {
-	struct weston_compositor *compositor = output->compositor;
-	struct weston_surface *surface;
+	struct weston_surface **surfaces = output->visible_surfaces.data;
+	size_t i = output->visible_surfaces.size / sizeof *surfaces;
 
-	wl_list_for_each_reverse(surface, &compositor->surface_list, link)
-		if (surface->plane == &compositor->primary_plane)
-			draw_surface(surface, output, damage);
+	/* Only the primary plane surfaces not hidden by opaque ones,
+	 * as collected by the core for this output. */
+	while (i-- > 0)
+		draw_surface(surfaces[i], output, damage);
 }
 
 static void
@@ -525,32 +741,38 @@ pixman_renderer_repaint_output(struct weston_output *output,
 static void
 pixman_renderer_flush_damage(struct weston_surface *surface)
 {
-	/* No-op for pixman renderer */
+	struct pixman_surface_state *ps = get_surface_state(surface);
+
+	/* Buffers are drawn from directly, only thumbnails are copies. */
+	if (ps->thumbnail)
+		pixman_region32_union(&ps->thumbnail_damage,
+				      &ps->thumbnail_damage, &surface->damage);
 }
 
 static void
 pixman_renderer_attach(struct weston_surface *es, struct weston_buffer *buffer)
 {
+	struct pixman_renderer *pr = get_renderer(es->compositor);
 	struct pixman_surface_state *ps = get_surface_state(es);
 	struct wl_shm_buffer *shm_buffer;
 	pixman_format_code_t pixman_format;
+	pixman_image_t *previous = ps->image;
 
 	weston_buffer_reference(&ps->buffer_ref, buffer);
+	ps->image = NULL;
 
-	if (ps->image) {
-		pixman_image_unref(ps->image);
-		ps->image = NULL;
+	if (!buffer) {
+		thumbnail_release(pr, ps);
+		goto out;
 	}
-
-	if (!buffer)
-		return;
 	
 	shm_buffer = wl_shm_buffer_get(buffer->resource);
 
 	if (! shm_buffer) {
 		weston_log("Pixman renderer supports only SHM buffers\n");
 		weston_buffer_reference(&ps->buffer_ref, NULL);
-		return;
+		thumbnail_release(pr, ps);
+		goto out;
 	}
 
 	switch (wl_shm_buffer_get_format(shm_buffer)) {
@@ -566,7 +788,8 @@ pixman_renderer_attach(struct weston_surface *es, struct weston_buffer *buffer)
 	default:
 		weston_log("Unsupported SHM buffer format\n");
 		weston_buffer_reference(&ps->buffer_ref, NULL);
-		return;
+		thumbnail_release(pr, ps);
+		goto out;
 	break;
 	}
 
@@ -578,6 +801,18 @@ pixman_renderer_attach(struct weston_surface *es, struct weston_buffer *buffer)
 		buffer->width, buffer->height,
 		wl_shm_buffer_get_data(shm_buffer),
 		wl_shm_buffer_get_stride(shm_buffer));
+
+	/* A buffer of the same size and format keeps the thumbnail, the
+	 * damage committed with it brings it up to date. */
+	if (!previous ||
+	    pixman_image_get_width(previous) != buffer->width ||
+	    pixman_image_get_height(previous) != buffer->height ||
+	    pixman_image_get_format(previous) != pixman_format)
+		thumbnail_release(pr, ps);
+
+out:
+	if (previous)
+		pixman_image_unref(previous);
 }
 
 static int
@@ -589,6 +824,8 @@ pixman_renderer_create_surface(struct weston_surface *surface)
 	if (!ps)
 		return -1;
 
+	pixman_region32_init(&ps->thumbnail_damage);
+	wl_list_init(&ps->thumbnail_link);
 	surface->renderer_state = ps;
 
 	return 0;
@@ -619,6 +856,8 @@ pixman_renderer_destroy_surface(struct weston_surface *surface)
 {
 	struct pixman_surface_state *ps = get_surface_state(surface);
 
+	thumbnail_release(get_renderer(surface->compositor), ps);
+	pixman_region32_fini(&ps->thumbnail_damage);
 	if (ps->image) {
 		pixman_image_unref(ps->image);
 		ps->image = NULL;
@@ -659,6 +898,8 @@ WL_EXPORT int
 pixman_renderer_init(struct weston_compositor *ec)
 {
 	struct pixman_renderer *renderer;
+	struct weston_config_section *section;
+	uint32_t cache_size;
 
 	renderer = malloc(sizeof *renderer);
 	if (renderer == NULL)
@@ -666,6 +907,14 @@ pixman_renderer_init(struct weston_compositor *ec)
 
 	renderer->repaint_debug = 0;
 	renderer->debug_color = NULL;
+
+	section = weston_config_get_section(ec->config, "core", NULL, NULL);
+	weston_config_section_get_uint(section, "thumbnail-cache-size",
+				       &cache_size,
+				       DEFAULT_THUMBNAIL_CACHE_SIZE);
+	wl_list_init(&renderer->thumbnail_list);
+	renderer->thumbnail_size = 0;
+	renderer->thumbnail_cache_size = (size_t) cache_size * 1024;
 	renderer->base.read_pixels = pixman_renderer_read_pixels;
 	renderer->base.repaint_output = pixman_renderer_repaint_output;
 	renderer->base.flush_damage = pixman_renderer_flush_damage;
@@ -683,6 +932,8 @@ pixman_renderer_init(struct weston_compositor *ec)
 
 	wl_display_add_shm_format(ec->wl_display, WL_SHM_FORMAT_RGB565);
 
+	weston_startup_mark("pixman renderer set up");
+
 	return 0;
 }
 
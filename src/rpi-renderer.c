@@ -34,6 +34,7 @@
 
 #include "compositor.h"
 #include "rpi-renderer.h"
+#include "region-simplify.h"
 
 /*
  * Dispmanx API offers alpha-blended overlays for hardware compositing.
@@ -73,6 +74,11 @@
 /* If we had a fully featured vc_dispmanx_resource_write_data()... */
 /*#define HAVE_RESOURCE_WRITE_DATA_RECT 1*/
 
+/* Cost of one resource write call in bytes of pixel data, and the
+ * maximum number of writes per resource update. */
+#define RESOURCE_UPLOAD_CALL_OVERHEAD 8192
+#define RESOURCE_UPLOAD_MAX_BOXES 16
+
 struct rpi_resource {
 	DISPMANX_RESOURCE_HANDLE_T handle;
 	int width;
@@ -241,6 +247,19 @@ shm_buffer_get_vc_format(struct wl_shm_buffer *buffer)
 	}
 }
 
+#ifdef HAVE_RESOURCE_WRITE_DATA_RECT
+static int
+shm_buffer_get_bytes_per_pixel(struct wl_shm_buffer *buffer)
+{
+	switch (wl_shm_buffer_get_format(buffer)) {
+	case WL_SHM_FORMAT_RGB565:
+		return 2;
+	default:
+		return 4;
+	}
+}
+#endif
+
 static int
 rpi_resource_update(struct rpi_resource *resource, struct weston_buffer *buffer,
 		    pixman_region32_t *region)
@@ -255,6 +274,8 @@ rpi_resource_update(struct rpi_resource *resource, struct weston_buffer *buffer,
 	int stride;
 	int ret;
 #ifdef HAVE_RESOURCE_WRITE_DATA_RECT
+	struct region_simplify_cost cost;
+	pixman_box32_t boxes[RESOURCE_UPLOAD_MAX_BOXES];
 	int n;
 #endif
 
@@ -278,8 +299,15 @@ rpi_resource_update(struct rpi_resource *resource, struct weston_buffer *buffer,
 					  &write_region, region);
 
 #ifdef HAVE_RESOURCE_WRITE_DATA_RECT
+	/* Merge small rectangles, one write call each costs more than
+	 * writing a few extra pixels. */
+	cost.bytes_per_pixel = shm_buffer_get_bytes_per_pixel(buffer->shm_buffer);
+	cost.call_overhead = RESOURCE_UPLOAD_CALL_OVERHEAD;
+	cost.max_boxes = RESOURCE_UPLOAD_MAX_BOXES;
+	n = region_simplify(&write_region, &cost, boxes);
+	r = boxes;
+
 	/* XXX: Can this do a format conversion, so that scanout does not have to? */
-	r = pixman_region32_rectangles(&write_region, &n);
 	while (n--) {
 		vc_dispmanx_rect_set(&rect, r[n].x1, r[n].y1,
 				     r[n].x2 - r[n].x1, r[n].y2 - r[n].y1);
@@ -158,9 +158,16 @@ struct desktop_shell {
 		struct weston_surface *surface;
 		struct weston_surface_animation *animation;
 		enum fade_type type;
-		struct wl_event_source *startup_timer;
+		struct weston_timer startup_timer;
 	} fade;
 
+	struct {
+		bool active;
+		struct weston_pointer_grab grab;
+		struct wl_list surface_list;
+		struct wl_listener transform_listener;
+	} overview;
+
 	uint32_t binding_modifier;
 	enum animation_type win_animation_type;
 };
@@ -175,11 +182,6 @@ enum shell_surface_type {
 	SHELL_SURFACE_XWAYLAND
 };
 
-struct ping_timer {
-	struct wl_event_source *source;
-	uint32_t serial;
-};
-
 struct shell_surface {
 	struct wl_resource *resource;
 	struct wl_signal destroy_signal;
@@ -220,9 +222,23 @@ struct shell_surface {
 		struct weston_surface *black_surface;
 	} fullscreen;
 
-	struct ping_timer *ping_timer;
+	struct {
+		struct weston_timer timer;
+		uint32_t serial;
+		int pending;
+	} ping;
 
 	struct weston_transform workspace_transform;
+	struct wl_list workspace_sticky_link;
+
+	struct {
+		struct weston_transform transform;
+		struct wl_list link;
+		int32_t cell_x, cell_y, cell_width, cell_height;
+		/* The position and size the transform was fitted to. */
+		float x, y;
+		int32_t width, height;
+	} overview;
 
 	struct weston_output *fullscreen_output;
 	struct weston_output *output;
@@ -313,6 +329,9 @@ destroy_shell_grab_shsurf(struct wl_listener *listener, void *data)
 static void
 popup_grab_end(struct weston_pointer *pointer);
 
+static void
+overview_end(struct desktop_shell *shell);
+
 static void
 shell_grab_start(struct shell_grab *grab,
 		 const struct weston_pointer_grab_interface *interface,
@@ -638,38 +657,36 @@ surface_translate(struct weston_surface *surface, double d)
 	weston_surface_geometry_dirty(surface);
 }
 
+/* Workspaces slide by moving their whole layer, so the cost of a frame
+ * does not depend on the number of windows. */
 static void
-workspace_translate_out(struct workspace *ws, double fraction)
+workspace_translate_out(struct workspace *ws, struct weston_output *output,
+			double fraction)
 {
-	struct weston_surface *surface;
-	unsigned int height;
-	double d;
-
-	wl_list_for_each(surface, &ws->layer.surface_list, layer_link) {
-		height = get_output_height(surface->output);
-		d = height * fraction;
+	unsigned int height = get_output_height(output);
 
-		surface_translate(surface, d);
-	}
+	weston_layer_set_position(&ws->layer, 0, round(height * fraction));
 }
 
 static void
-workspace_translate_in(struct workspace *ws, double fraction)
+workspace_translate_in(struct desktop_shell *shell, struct workspace *ws,
+		       struct weston_output *output, double fraction)
 {
-	struct weston_surface *surface;
-	unsigned int height;
-	double d;
+	struct shell_surface *shsurf;
+	unsigned int height = get_output_height(output);
+	int32_t y;
 
-	wl_list_for_each(surface, &ws->layer.surface_list, layer_link) {
-		height = get_output_height(surface->output);
+	if (fraction > 0)
+		y = round(-(height - height * fraction));
+	else
+		y = round(height + height * fraction);
 
-		if (fraction > 0)
-			d = -(height - height * fraction);
-		else
-			d = height + height * fraction;
+	weston_layer_set_position(&ws->layer, 0, y);
 
-		surface_translate(surface, d);
-	}
+	/* Surfaces taken along to the new workspace stay in place. */
+	wl_list_for_each(shsurf, &shell->workspaces.anim_sticky_list,
+			 workspace_sticky_link)
+		surface_translate(shsurf->surface, -y);
 }
 
 static void
@@ -703,18 +720,19 @@ reverse_workspace_change_animation(struct desktop_shell *shell,
 }
 
 static void
-workspace_deactivate_transforms(struct workspace *ws)
+workspace_release_sticky_surfaces(struct desktop_shell *shell)
 {
-	struct weston_surface *surface;
-	struct shell_surface *shsurf;
+	struct shell_surface *shsurf, *next;
 
-	wl_list_for_each(surface, &ws->layer.surface_list, layer_link) {
-		shsurf = get_shell_surface(surface);
+	wl_list_for_each_safe(shsurf, next, &shell->workspaces.anim_sticky_list,
+			      workspace_sticky_link) {
 		if (!wl_list_empty(&shsurf->workspace_transform.link)) {
 			wl_list_remove(&shsurf->workspace_transform.link);
 			wl_list_init(&shsurf->workspace_transform.link);
 		}
-		weston_surface_geometry_dirty(surface);
+		weston_surface_geometry_dirty(shsurf->surface);
+		wl_list_remove(&shsurf->workspace_sticky_link);
+		wl_list_init(&shsurf->workspace_sticky_link);
 	}
 }
 
@@ -726,8 +744,9 @@ finish_workspace_change_animation(struct desktop_shell *shell,
 	weston_compositor_schedule_repaint(shell->compositor);
 
 	wl_list_remove(&shell->workspaces.animation.link);
-	workspace_deactivate_transforms(from);
-	workspace_deactivate_transforms(to);
+	weston_layer_set_position(&from->layer, 0, 0);
+	weston_layer_set_position(&to->layer, 0, 0);
+	workspace_release_sticky_surfaces(shell);
 	shell->workspaces.anim_to = NULL;
 
 	wl_list_remove(&shell->workspaces.anim_from->layer.link);
@@ -772,13 +791,11 @@ animate_workspace_change_frame(struct weston_animation *animation,
 	y = sin(x);
 
 	if (t < DEFAULT_WORKSPACE_CHANGE_ANIMATION_LENGTH) {
-		weston_compositor_schedule_repaint(shell->compositor);
-
-		workspace_translate_out(from, shell->workspaces.anim_dir * y);
-		workspace_translate_in(to, shell->workspaces.anim_dir * y);
+		workspace_translate_out(from, output,
+					shell->workspaces.anim_dir * y);
+		workspace_translate_in(shell, to, output,
+				       shell->workspaces.anim_dir * y);
 		shell->workspaces.anim_current = y;
-
-		weston_compositor_schedule_repaint(shell->compositor);
 	}
 	else
 		finish_workspace_change_animation(shell, from, to);
@@ -814,7 +831,7 @@ animate_workspace_change(struct desktop_shell *shell,
 
 	wl_list_insert(from->layer.link.prev, &to->layer.link);
 
-	workspace_translate_in(to, 0);
+	workspace_translate_in(shell, to, output, 0);
 
 	restore_focus_state(shell, to);
 
@@ -859,6 +876,7 @@ change_workspace(struct desktop_shell *shell, unsigned int index)
 						  shell->workspaces.anim_from,
 						  shell->workspaces.anim_to);
 
+	overview_end(shell);
 	restore_focus_state(shell, to);
 
 	if (workspace_is_empty(to) && workspace_is_empty(from))
@@ -969,9 +987,9 @@ take_surface_to_workspace_by_seat(struct desktop_shell *shell,
 		update_workspace(shell, index, from, to);
 	else {
 		shsurf = get_shell_surface(surface);
-		if (wl_list_empty(&shsurf->workspace_transform.link))
+		if (wl_list_empty(&shsurf->workspace_sticky_link))
 			wl_list_insert(&shell->workspaces.anim_sticky_list,
-				       &shsurf->workspace_transform.link);
+				       &shsurf->workspace_sticky_link);
 
 		animate_workspace_change(shell, index, from, to);
 	}
@@ -1040,7 +1058,7 @@ noop_grab_focus(struct weston_pointer_grab *grab)
 }
 
 static void
-move_grab_motion(struct weston_pointer_grab *grab, uint32_t time)
+move_grab_motion(struct weston_pointer_grab *grab, uint64_t time_us)
 {
 	struct weston_move_grab *move = (struct weston_move_grab *) grab;
 	struct weston_pointer *pointer = grab->pointer;
@@ -1062,7 +1080,7 @@ move_grab_motion(struct weston_pointer_grab *grab, uint32_t time)
 
 static void
 move_grab_button(struct weston_pointer_grab *grab,
-		 uint32_t time, uint32_t button, uint32_t state_w)
+		 uint64_t time_us, uint32_t button, uint32_t state_w)
 {
 	struct shell_grab *shell_grab = container_of(grab, struct shell_grab,
 						    grab);
@@ -1133,7 +1151,7 @@ struct weston_resize_grab {
 };
 
 static void
-resize_grab_motion(struct weston_pointer_grab *grab, uint32_t time)
+resize_grab_motion(struct weston_pointer_grab *grab, uint64_t time_us)
 {
 	struct weston_resize_grab *resize = (struct weston_resize_grab *) grab;
 	struct weston_pointer *pointer = grab->pointer;
@@ -1185,7 +1203,7 @@ static const struct weston_shell_client shell_client = {
 
 static void
 resize_grab_button(struct weston_pointer_grab *grab,
-		   uint32_t time, uint32_t button, uint32_t state_w)
+		   uint64_t time_us, uint32_t button, uint32_t state_w)
 {
 	struct weston_resize_grab *resize = (struct weston_resize_grab *) grab;
 	struct weston_pointer *pointer = grab->pointer;
@@ -1309,13 +1327,14 @@ busy_cursor_grab_focus(struct weston_pointer_grab *base)
 }
 
 static void
-busy_cursor_grab_motion(struct weston_pointer_grab *grab, uint32_t time)
+busy_cursor_grab_motion(struct weston_pointer_grab *grab,
+			uint64_t time_us)
 {
 }
 
 static void
 busy_cursor_grab_button(struct weston_pointer_grab *base,
-			uint32_t time, uint32_t button, uint32_t state)
+			uint64_t time_us, uint32_t button, uint32_t state)
 {
 	struct shell_grab *grab = (struct shell_grab *) base;
 	struct shell_surface *shsurf = grab->shsurf;
@@ -1364,18 +1383,15 @@ end_busy_cursor(struct shell_surface *shsurf, struct weston_pointer *pointer)
 static void
 ping_timer_destroy(struct shell_surface *shsurf)
 {
-	if (!shsurf || !shsurf->ping_timer)
+	if (!shsurf)
 		return;
 
-	if (shsurf->ping_timer->source)
-		wl_event_source_remove(shsurf->ping_timer->source);
-
-	free(shsurf->ping_timer);
-	shsurf->ping_timer = NULL;
+	weston_timer_cancel(&shsurf->ping.timer);
+	shsurf->ping.pending = 0;
 }
 
-static int
-ping_timeout_handler(void *data)
+static void
+ping_timeout_handler(struct weston_timer *timer, void *data)
 {
 	struct shell_surface *shsurf = data;
 	struct weston_seat *seat;
@@ -1386,15 +1402,12 @@ ping_timeout_handler(void *data)
 	wl_list_for_each(seat, &shsurf->surface->compositor->seat_list, link)
 		if (seat->pointer->focus == shsurf->surface)
 			set_busy_cursor(shsurf, seat->pointer);
-
-	return 1;
 }
 
 static void
 ping_handler(struct weston_surface *surface, uint32_t serial)
 {
 	struct shell_surface *shsurf = get_shell_surface(surface);
-	struct wl_event_loop *loop;
 	int ping_timeout = 200;
 
 	if (!shsurf)
@@ -1405,16 +1418,11 @@ ping_handler(struct weston_surface *surface, uint32_t serial)
 	if (shsurf->surface == shsurf->shell->grab_surface)
 		return;
 
-	if (!shsurf->ping_timer) {
-		shsurf->ping_timer = malloc(sizeof *shsurf->ping_timer);
-		if (!shsurf->ping_timer)
-			return;
-
-		shsurf->ping_timer->serial = serial;
-		loop = wl_display_get_event_loop(surface->compositor->wl_display);
-		shsurf->ping_timer->source =
-			wl_event_loop_add_timer(loop, ping_timeout_handler, shsurf);
-		wl_event_source_timer_update(shsurf->ping_timer->source, ping_timeout);
+	if (!shsurf->ping.pending) {
+		shsurf->ping.pending = 1;
+		shsurf->ping.serial = serial;
+		weston_timer_arm(surface->compositor, &shsurf->ping.timer,
+				 ping_timeout);
 
 		wl_shell_surface_send_ping(shsurf->resource, serial);
 	}
@@ -1464,11 +1472,11 @@ shell_surface_pong(struct wl_client *client, struct wl_resource *resource,
 	struct weston_seat *seat;
 	struct weston_compositor *ec = shsurf->surface->compositor;
 
-	if (shsurf->ping_timer == NULL)
+	if (!shsurf->ping.pending)
 		/* Just ignore unsolicited pong. */
 		return;
 
-	if (shsurf->ping_timer->serial == serial) {
+	if (shsurf->ping.serial == serial) {
 		shsurf->unresponsive = 0;
 		wl_list_for_each(seat, &ec->seat_list, link) {
 			if(seat->pointer)
@@ -2036,7 +2044,7 @@ popup_grab_focus(struct weston_pointer_grab *grab)
 }
 
 static void
-popup_grab_motion(struct weston_pointer_grab *grab, uint32_t time)
+popup_grab_motion(struct weston_pointer_grab *grab, uint64_t time_us)
 {
 	struct weston_pointer *pointer = grab->pointer;
 	wl_fixed_t sx, sy;
@@ -2045,13 +2053,14 @@ popup_grab_motion(struct weston_pointer_grab *grab, uint32_t time)
 		weston_surface_from_global_fixed(pointer->focus,
 						 pointer->x, pointer->y,
 						 &sx, &sy);
-		wl_pointer_send_motion(pointer->focus_resource, time, sx, sy);
+		wl_pointer_send_motion(pointer->focus_resource,
+				       time_us / 1000, sx, sy);
 	}
 }
 
 static void
 popup_grab_button(struct weston_pointer_grab *grab,
-		  uint32_t time, uint32_t button, uint32_t state_w)
+		  uint64_t time_us, uint32_t button, uint32_t state_w)
 {
 	struct wl_resource *resource;
 	struct shell_seat *shseat =
@@ -2063,10 +2072,11 @@ popup_grab_button(struct weston_pointer_grab *grab,
 	resource = grab->pointer->focus_resource;
 	if (resource) {
 		serial = wl_display_get_serial(display);
-		wl_pointer_send_button(resource, serial, time, button, state);
+		wl_pointer_send_button(resource, serial, time_us / 1000,
+				       button, state);
 	} else if (state == WL_POINTER_BUTTON_STATE_RELEASED &&
 		   (shseat->popup_grab.initial_up ||
-		    time - shseat->seat->pointer->grab_time > 500)) {
+		    time_us - shseat->seat->pointer->grab_time > 500000)) {
 		popup_grab_end(grab->pointer);
 	}
 
@@ -2218,6 +2228,13 @@ destroy_shell_surface(struct shell_surface *shsurf)
 	ping_timer_destroy(shsurf);
 	free(shsurf->title);
 
+	if (!wl_list_empty(&shsurf->overview.link)) {
+		wl_list_remove(&shsurf->overview.transform.link);
+		wl_list_remove(&shsurf->overview.link);
+		shsurf->surface->fixed_scale = 0;
+	}
+
+	wl_list_remove(&shsurf->workspace_sticky_link);
 	wl_list_remove(&shsurf->link);
 	free(shsurf);
 }
@@ -2283,7 +2300,8 @@ create_shell_surface(void *shell, struct weston_surface *surface,
 	shsurf->fullscreen.type = WL_SHELL_SURFACE_FULLSCREEN_METHOD_DEFAULT;
 	shsurf->fullscreen.framerate = 0;
 	shsurf->fullscreen.black_surface = NULL;
-	shsurf->ping_timer = NULL;
+	weston_timer_init(&shsurf->ping.timer, ping_timeout_handler, shsurf);
+	shsurf->ping.pending = 0;
 	wl_list_init(&shsurf->fullscreen.transform.link);
 
 	wl_signal_init(&shsurf->destroy_signal);
@@ -2300,6 +2318,9 @@ create_shell_surface(void *shell, struct weston_surface *surface,
 	weston_matrix_init(&shsurf->rotation.rotation);
 
 	wl_list_init(&shsurf->workspace_transform.link);
+	wl_list_init(&shsurf->workspace_sticky_link);
+	wl_list_init(&shsurf->overview.transform.link);
+	wl_list_init(&shsurf->overview.link);
 
 	shsurf->type = SHELL_SURFACE_NONE;
 	shsurf->next_type = SHELL_SURFACE_NONE;
@@ -2785,7 +2806,7 @@ terminate_binding(struct weston_seat *seat, uint32_t time, uint32_t key,
 }
 
 static void
-rotate_grab_motion(struct weston_pointer_grab *grab, uint32_t time)
+rotate_grab_motion(struct weston_pointer_grab *grab, uint64_t time_us)
 {
 	struct rotate_grab *rotate =
 		container_of(grab, struct rotate_grab, base.grab);
@@ -2851,7 +2872,7 @@ rotate_grab_motion(struct weston_pointer_grab *grab, uint32_t time)
 
 static void
 rotate_grab_button(struct weston_pointer_grab *grab,
-		   uint32_t time, uint32_t button, uint32_t state_w)
+		   uint64_t time_us, uint32_t button, uint32_t state_w)
 {
 	struct rotate_grab *rotate =
 		container_of(grab, struct rotate_grab, base.grab);
@@ -3160,23 +3181,23 @@ shell_fade_startup(struct desktop_shell *shell)
 {
 	struct wl_event_loop *loop;
 
-	if (!shell->fade.startup_timer)
+	if (!weston_timer_is_armed(&shell->fade.startup_timer))
 		return;
 
-	wl_event_source_remove(shell->fade.startup_timer);
-	shell->fade.startup_timer = NULL;
+	weston_timer_cancel(&shell->fade.startup_timer);
 
 	loop = wl_display_get_event_loop(shell->compositor->wl_display);
 	wl_event_loop_add_idle(loop, do_shell_fade_startup, shell);
 }
 
-static int
-fade_startup_timeout(void *data)
+static void
+fade_startup_timeout(struct weston_timer *timer, void *data)
 {
 	struct desktop_shell *shell = data;
+	struct wl_event_loop *loop;
 
-	shell_fade_startup(shell);
-	return 0;
+	loop = wl_display_get_event_loop(shell->compositor->wl_display);
+	wl_event_loop_add_idle(loop, do_shell_fade_startup, shell);
 }
 
 static void
@@ -3187,8 +3208,6 @@ shell_fade_init(struct desktop_shell *shell)
 	 * fade-in, in case the desktop-shell client takes too long.
 	 */
 
-	struct wl_event_loop *loop;
-
 	if (shell->fade.surface != NULL) {
 		weston_log("%s: warning: fade surface already exists\n",
 			   __func__);
@@ -3202,10 +3221,7 @@ shell_fade_init(struct desktop_shell *shell)
 	weston_surface_update_transform(shell->fade.surface);
 	weston_surface_damage(shell->fade.surface);
 
-	loop = wl_display_get_event_loop(shell->compositor->wl_display);
-	shell->fade.startup_timer =
-		wl_event_loop_add_timer(loop, fade_startup_timeout, shell);
-	wl_event_source_timer_update(shell->fade.startup_timer, 15000);
+	weston_timer_arm(shell->compositor, &shell->fade.startup_timer, 15000);
 }
 
 static void
@@ -4079,6 +4095,239 @@ switcher_binding(struct weston_seat *seat, uint32_t time, uint32_t key,
 	switcher_next(switcher);
 }
 
+/* The overview tiles the windows of the current workspace over the
+ * default output by adding a scaling transform to each of them.  The
+ * surfaces are marked as held at a fixed scale, so the renderer may
+ * draw them from downscaled copies where it keeps those, and the
+ * overview costs little more than a normal repaint.  A surface that
+ * moves or resizes while in the overview is fitted to its cell again
+ * as its transform is updated for the next frame. */
+#define OVERVIEW_MARGIN 32
+
+static bool
+overview_includes(struct shell_surface *shsurf)
+{
+	if (shsurf->surface->geometry.parent != NULL ||
+	    !weston_surface_is_mapped(shsurf->surface))
+		return false;
+
+	switch (shsurf->type) {
+	case SHELL_SURFACE_TOPLEVEL:
+	case SHELL_SURFACE_MAXIMIZED:
+	case SHELL_SURFACE_XWAYLAND:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Fits the surface to its cell, returns whether the transform
+ * changed. */
+static int
+overview_fit(struct shell_surface *shsurf)
+{
+	struct weston_surface *surface = shsurf->surface;
+	struct weston_matrix *matrix = &shsurf->overview.transform.matrix;
+	float x, y, scale, sx, sy;
+
+	x = surface->geometry.x + surface->transform.layer_x;
+	y = surface->geometry.y + surface->transform.layer_y;
+	if (x == shsurf->overview.x && y == shsurf->overview.y &&
+	    surface->geometry.width == shsurf->overview.width &&
+	    surface->geometry.height == shsurf->overview.height)
+		return 0;
+
+	shsurf->overview.x = x;
+	shsurf->overview.y = y;
+	shsurf->overview.width = surface->geometry.width;
+	shsurf->overview.height = surface->geometry.height;
+
+	sx = (float) shsurf->overview.cell_width / surface->geometry.width;
+	sy = (float) shsurf->overview.cell_height / surface->geometry.height;
+	scale = MIN(MIN(sx, sy), 1.0f);
+
+	weston_matrix_init(matrix);
+	weston_matrix_translate(matrix, -x, -y, 0);
+	weston_matrix_scale(matrix, scale, scale, 1);
+	weston_matrix_translate(matrix,
+				(int) (shsurf->overview.cell_x +
+				       (shsurf->overview.cell_width -
+					surface->geometry.width * scale) / 2),
+				(int) (shsurf->overview.cell_y +
+				       (shsurf->overview.cell_height -
+					surface->geometry.height * scale) / 2),
+				0);
+
+	return 1;
+}
+
+static void
+overview_surface_transform(struct wl_listener *listener, void *data)
+{
+	struct weston_surface *surface = data;
+	struct shell_surface *shsurf = get_shell_surface(surface);
+
+	if (!shsurf || wl_list_empty(&shsurf->overview.link) ||
+	    !overview_fit(shsurf))
+		return;
+
+	weston_surface_geometry_dirty(surface);
+	weston_surface_update_transform(surface);
+}
+
+static void
+overview_layout(struct desktop_shell *shell, struct weston_output *output)
+{
+	struct workspace *ws = get_current_workspace(shell);
+	struct weston_surface *surface;
+	struct shell_surface *shsurf;
+	int n, i, cols, rows, cell_width, cell_height;
+
+	n = 0;
+	wl_list_for_each(surface, &ws->layer.surface_list, layer_link) {
+		shsurf = get_shell_surface(surface);
+		if (shsurf && overview_includes(shsurf))
+			n++;
+	}
+	if (n == 0)
+		return;
+
+	cols = ceil(sqrt(n));
+	rows = (n + cols - 1) / cols;
+	cell_width = (output->width - OVERVIEW_MARGIN) / cols;
+	cell_height = (output->height - OVERVIEW_MARGIN) / rows;
+
+	/* The top of the stack goes in the first cell. */
+	i = 0;
+	wl_list_for_each(surface, &ws->layer.surface_list, layer_link) {
+		shsurf = get_shell_surface(surface);
+		if (!shsurf || !overview_includes(shsurf))
+			continue;
+
+		shsurf->overview.cell_x =
+			output->x + OVERVIEW_MARGIN + (i % cols) * cell_width;
+		shsurf->overview.cell_y =
+			output->y + OVERVIEW_MARGIN + (i / cols) * cell_height;
+		shsurf->overview.cell_width = cell_width - OVERVIEW_MARGIN;
+		shsurf->overview.cell_height = cell_height - OVERVIEW_MARGIN;
+		shsurf->overview.width = 0;
+		overview_fit(shsurf);
+
+		wl_list_insert(surface->geometry.transformation_list.prev,
+			       &shsurf->overview.transform.link);
+		wl_list_insert(shell->overview.surface_list.prev,
+			       &shsurf->overview.link);
+		surface->fixed_scale = 1;
+		weston_surface_geometry_dirty(surface);
+		i++;
+	}
+}
+
+static void
+overview_end(struct desktop_shell *shell)
+{
+	struct shell_surface *shsurf, *next;
+
+	if (!shell->overview.active)
+		return;
+
+	wl_list_for_each_safe(shsurf, next, &shell->overview.surface_list,
+			      overview.link) {
+		wl_list_remove(&shsurf->overview.transform.link);
+		wl_list_init(&shsurf->overview.transform.link);
+		wl_list_remove(&shsurf->overview.link);
+		wl_list_init(&shsurf->overview.link);
+		shsurf->surface->fixed_scale = 0;
+		weston_surface_geometry_dirty(shsurf->surface);
+	}
+
+	wl_list_remove(&shell->overview.transform_listener.link);
+
+	if (shell->overview.grab.pointer->grab == &shell->overview.grab)
+		weston_pointer_end_grab(shell->overview.grab.pointer);
+
+	shell->overview.active = false;
+	weston_compositor_schedule_repaint(shell->compositor);
+}
+
+static void
+overview_grab_motion(struct weston_pointer_grab *grab, uint64_t time_us)
+{
+}
+
+static void
+overview_grab_button(struct weston_pointer_grab *grab,
+		     uint64_t time_us, uint32_t button, uint32_t state_w)
+{
+	struct desktop_shell *shell =
+		container_of(grab, struct desktop_shell, overview.grab);
+	struct weston_pointer *pointer = grab->pointer;
+	struct weston_surface *surface;
+	struct shell_surface *shsurf;
+	wl_fixed_t sx, sy;
+
+	if (state_w != WL_POINTER_BUTTON_STATE_PRESSED)
+		return;
+
+	surface = weston_compositor_pick_surface(shell->compositor,
+						 pointer->x, pointer->y,
+						 &sx, &sy);
+	if (surface)
+		surface = weston_surface_get_main_surface(surface);
+	shsurf = surface ? get_shell_surface(surface) : NULL;
+
+	if (shsurf && wl_list_empty(&shsurf->overview.link))
+		shsurf = NULL;
+
+	overview_end(shell);
+
+	if (shsurf)
+		activate(shell, shsurf->surface, pointer->seat);
+}
+
+static const struct weston_pointer_grab_interface overview_grab_interface = {
+	noop_grab_focus,
+	overview_grab_motion,
+	overview_grab_button,
+};
+
+static void
+overview_binding(struct weston_seat *seat, uint32_t time, uint32_t key,
+		 void *data)
+{
+	struct desktop_shell *shell = data;
+	struct weston_pointer *pointer = seat->pointer;
+
+	if (shell->overview.active) {
+		overview_end(shell);
+		return;
+	}
+
+	if (shell->locked || pointer == NULL ||
+	    shell->workspaces.anim_to != NULL ||
+	    pointer->grab != &pointer->default_grab)
+		return;
+
+	overview_layout(shell, get_default_output(shell->compositor));
+	if (wl_list_empty(&shell->overview.surface_list))
+		return;
+
+	shell->overview.active = true;
+	wl_signal_add(&shell->compositor->transform_signal,
+		      &shell->overview.transform_listener);
+	shell->overview.grab.interface = &overview_grab_interface;
+	weston_pointer_start_grab(pointer, &shell->overview.grab);
+	if (shell->child.desktop_shell) {
+		desktop_shell_send_grab_cursor(shell->child.desktop_shell,
+					       DESKTOP_SHELL_CURSOR_ARROW);
+		weston_pointer_set_focus(pointer, shell->grab_surface,
+					 wl_fixed_from_int(0),
+					 wl_fixed_from_int(0));
+	}
+
+	weston_compositor_schedule_repaint(shell->compositor);
+}
+
 static void
 backlight_binding(struct weston_seat *seat, uint32_t time, uint32_t key,
 		  void *data)
@@ -4343,10 +4592,13 @@ shell_destroy(struct wl_listener *listener, void *data)
 	if (shell->child.client)
 		wl_client_destroy(shell->child.client);
 
+	weston_timer_cancel(&shell->fade.startup_timer);
 	wl_list_remove(&shell->idle_listener.link);
 	wl_list_remove(&shell->wake_listener.link);
 	wl_list_remove(&shell->show_input_panel_listener.link);
 	wl_list_remove(&shell->hide_input_panel_listener.link);
+	if (shell->overview.active)
+		wl_list_remove(&shell->overview.transform_listener.link);
 
 	wl_array_for_each(ws, &shell->workspaces.array)
 		workspace_destroy(*ws);
@@ -4393,6 +4645,8 @@ shell_add_bindings(struct weston_compositor *ec, struct desktop_shell *shell)
 
 	weston_compositor_add_key_binding(ec, KEY_TAB, mod, switcher_binding,
 					  shell);
+	weston_compositor_add_key_binding(ec, KEY_E, mod, overview_binding,
+					  shell);
 	weston_compositor_add_key_binding(ec, KEY_F9, mod, backlight_binding,
 					  ec);
 	weston_compositor_add_key_binding(ec, KEY_BRIGHTNESSDOWN, 0,
@@ -4445,6 +4699,8 @@ module_init(struct weston_compositor *ec,
 		return -1;
 
 	shell->compositor = ec;
+	weston_timer_init(&shell->fade.startup_timer,
+			  fade_startup_timeout, shell);
 
 	shell->destroy_listener.notify = shell_destroy;
 	wl_signal_add(&ec->destroy_signal, &shell->destroy_listener);
@@ -4478,6 +4734,8 @@ module_init(struct weston_compositor *ec,
 
 	wl_array_init(&shell->workspaces.array);
 	wl_list_init(&shell->workspaces.client_list);
+	wl_list_init(&shell->overview.surface_list);
+	shell->overview.transform_listener.notify = overview_surface_transform;
 
 	shell_configuration(shell);
 
@@ -4519,8 +4777,13 @@ module_init(struct weston_compositor *ec,
 
 	shell->child.deathstamp = weston_compositor_get_time();
 
+	/* Started right away rather than from the main loop, so the
+	 * client starts up and loads its images while the remaining
+	 * modules load and the first frame is drawn.  It connects over
+	 * WAYLAND_SOCKET and is served once the loop runs. */
+	launch_desktop_shell_process(shell);
+
 	loop = wl_display_get_event_loop(ec->wl_display);
-	wl_event_loop_add_idle(loop, launch_desktop_shell_process, shell);
 
 	shell->screensaver.timer =
 		wl_event_loop_add_timer(loop, screensaver_timeout, shell);
@@ -0,0 +1,298 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "compositor.h"
+
+/* A hierarchical timer wheel driving all weston_timers from a single
+ * timer event source.  Level 0 has one slot per millisecond, each
+ * further level has slots WHEEL_SIZE times as wide.  Arming and
+ * cancelling a timer is a list operation.  Arming only reprograms the
+ * event source when the new timer expires before the current deadline,
+ * but every wakeup of the source reprograms it once for the wheel's
+ * next piece of work, so steady pings still cost a timerfd update per
+ * wakeup, just not one per ping.  Timers in the higher levels move
+ * down a level whenever the wheel below them wraps around. */
+
+#define WHEEL_BITS	6
+#define WHEEL_SIZE	(1 << WHEEL_BITS)
+#define WHEEL_MASK	(WHEEL_SIZE - 1)
+#define WHEEL_LEVELS	4
+#define WHEEL_RANGE	(1ull << (WHEEL_BITS * WHEEL_LEVELS))
+
+struct weston_timer_wheel {
+	struct wl_event_source *source;
+	uint64_t now;		/* ms, the wheel has run up to here */
+	uint64_t deadline;	/* ms, source armed for this, 0 if not */
+	int count[WHEEL_LEVELS];
+	struct wl_list slots[WHEEL_LEVELS][WHEEL_SIZE];
+};
+
+static uint64_t
+timer_wheel_time(void)
+{
+	return weston_compositor_get_time_usec() / 1000;
+}
+
+static void
+timer_wheel_insert(struct weston_timer_wheel *wheel,
+		   struct weston_timer *timer)
+{
+	uint64_t expire = timer->expire;
+	int level, shift;
+
+	/* Timers beyond the top level wait in its last slot and are
+	 * placed again when it comes around. */
+	if (expire - wheel->now >= WHEEL_RANGE)
+		expire = wheel->now + WHEEL_RANGE - 1;
+
+	for (level = 0; level < WHEEL_LEVELS - 1; level++)
+		if (expire - wheel->now < 1ull << (WHEEL_BITS * (level + 1)))
+			break;
+
+	shift = level * WHEEL_BITS;
+	wl_list_insert(wheel->slots[level][(expire >> shift) & WHEEL_MASK].prev,
+		       &timer->link);
+	timer->wheel = wheel;
+	timer->level = level;
+	wheel->count[level]++;
+}
+
+static void
+timer_wheel_cascade(struct weston_timer_wheel *wheel)
+{
+	struct weston_timer *timer, *next;
+	struct wl_list pending, *slot;
+	int level, shift;
+
+	for (level = 1; level < WHEEL_LEVELS; level++) {
+		shift = level * WHEEL_BITS;
+		if (wheel->now & ((1ull << shift) - 1))
+			break;
+
+		slot = &wheel->slots[level][(wheel->now >> shift) & WHEEL_MASK];
+		wl_list_init(&pending);
+		wl_list_insert_list(&pending, slot);
+		wl_list_init(slot);
+		wl_list_for_each_safe(timer, next, &pending, link) {
+			wheel->count[level]--;
+			timer_wheel_insert(wheel, timer);
+		}
+	}
+}
+
+static void
+timer_wheel_advance(struct weston_timer_wheel *wheel, uint64_t time)
+{
+	struct weston_timer *timer;
+	struct wl_list *slot;
+	uint64_t mask;
+	int level;
+
+	while (wheel->now < time) {
+		/* Nothing can fire before the next slot boundary of the
+		 * lowest level holding timers, skip ahead to it. */
+		mask = 0;
+		for (level = 0; level < WHEEL_LEVELS; level++) {
+			if (wheel->count[level])
+				break;
+			mask = (mask << WHEEL_BITS) | WHEEL_MASK;
+		}
+		if (level == WHEEL_LEVELS || (wheel->now | mask) >= time) {
+			wheel->now = time;
+			break;
+		}
+
+		wheel->now = (wheel->now | mask) + 1;
+		timer_wheel_cascade(wheel);
+
+		slot = &wheel->slots[0][wheel->now & WHEEL_MASK];
+		while (!wl_list_empty(slot)) {
+			timer = container_of(slot->next,
+					     struct weston_timer, link);
+			weston_timer_cancel(timer);
+			timer->func(timer, timer->data);
+		}
+	}
+}
+
+/* Returns when the wheel next has work to do: the expiry of the first
+ * level 0 timer, or the boundary where a higher level slot moves
+ * down, whichever comes first. */
+static uint64_t
+timer_wheel_next(struct weston_timer_wheel *wheel)
+{
+	uint64_t next = UINT64_MAX, start = 0;
+	int level, shift, i;
+
+	for (level = 0; level < WHEEL_LEVELS; level++) {
+		if (wheel->count[level] == 0)
+			continue;
+
+		shift = level * WHEEL_BITS;
+		for (i = 1; i <= WHEEL_SIZE; i++) {
+			start = ((wheel->now >> shift) + i) << shift;
+			if (!wl_list_empty(&wheel->slots[level]
+					   [(start >> shift) & WHEEL_MASK]))
+				break;
+		}
+		if (start < next)
+			next = start;
+	}
+
+	return next;
+}
+
+static void
+timer_wheel_set_deadline(struct weston_timer_wheel *wheel,
+			 uint64_t deadline, uint64_t now)
+{
+	if (wheel->deadline && wheel->deadline <= deadline)
+		return;
+
+	wheel->deadline = deadline;
+	wl_event_source_timer_update(wheel->source,
+				     deadline > now ? deadline - now : 1);
+}
+
+static int
+timer_wheel_handler(void *data)
+{
+	struct weston_timer_wheel *wheel = data;
+	uint64_t next;
+
+	wheel->deadline = 0;
+	timer_wheel_advance(wheel, timer_wheel_time());
+
+	next = timer_wheel_next(wheel);
+	if (next != UINT64_MAX)
+		timer_wheel_set_deadline(wheel, next, timer_wheel_time());
+
+	return 1;
+}
+
+WL_EXPORT void
+weston_timer_init(struct weston_timer *timer,
+		  weston_timer_func_t func, void *data)
+{
+	wl_list_init(&timer->link);
+	timer->wheel = NULL;
+	timer->func = func;
+	timer->data = data;
+}
+
+/* Calls the timer's function once, msecs from now.  Arming an armed
+ * timer moves it. */
+WL_EXPORT void
+weston_timer_arm(struct weston_compositor *compositor,
+		 struct weston_timer *timer, uint32_t msecs)
+{
+	struct weston_timer_wheel *wheel = compositor->timer_wheel;
+	uint64_t now = timer_wheel_time();
+	int level;
+
+	weston_timer_cancel(timer);
+
+	for (level = 0; level < WHEEL_LEVELS; level++)
+		if (wheel->count[level])
+			break;
+	if (level == WHEEL_LEVELS)
+		wheel->now = now;
+
+	/* The current slot has already run. */
+	timer->expire = now + msecs;
+	if (timer->expire <= wheel->now)
+		timer->expire = wheel->now + 1;
+
+	timer_wheel_insert(wheel, timer);
+	timer_wheel_set_deadline(wheel, timer->expire, now);
+}
+
+WL_EXPORT void
+weston_timer_cancel(struct weston_timer *timer)
+{
+	if (timer->wheel == NULL)
+		return;
+
+	timer->wheel->count[timer->level]--;
+	timer->wheel = NULL;
+	wl_list_remove(&timer->link);
+	wl_list_init(&timer->link);
+}
+
+WL_EXPORT int
+weston_timer_is_armed(struct weston_timer *timer)
+{
+	return timer->wheel != NULL;
+}
+
+struct weston_timer_wheel *
+weston_timer_wheel_create(struct weston_compositor *compositor)
+{
+	struct weston_timer_wheel *wheel;
+	struct wl_event_loop *loop;
+	int level, i;
+
+	wheel = malloc(sizeof *wheel);
+	if (wheel == NULL)
+		return NULL;
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+	wheel->source = wl_event_loop_add_timer(loop, timer_wheel_handler,
+						wheel);
+	if (wheel->source == NULL) {
+		free(wheel);
+		return NULL;
+	}
+
+	wheel->now = timer_wheel_time();
+	wheel->deadline = 0;
+	for (level = 0; level < WHEEL_LEVELS; level++) {
+		wheel->count[level] = 0;
+		for (i = 0; i < WHEEL_SIZE; i++)
+			wl_list_init(&wheel->slots[level][i]);
+	}
+
+	return wheel;
+}
+
+void
+weston_timer_wheel_destroy(struct weston_timer_wheel *wheel)
+{
+	struct weston_timer *timer;
+	int level, i;
+
+	for (level = 0; level < WHEEL_LEVELS; level++)
+		for (i = 0; i < WHEEL_SIZE; i++)
+			while (!wl_list_empty(&wheel->slots[level][i])) {
+				timer = container_of(wheel->slots[level][i].next,
+						     struct weston_timer, link);
+				weston_timer_cancel(timer);
+			}
+
+	wl_event_source_remove(wheel->source);
+	free(wheel);
+}
@@ -26,15 +26,81 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
 
 #include "xwayland.h"
+#include "hash.h"
+
+/* Selections are streamed through at most selection_buffer_size bytes
+ * per direction: X properties are read in chunks of that size, and the
+ * next chunk is only requested once the previous one has been written
+ * to the Wayland client.  The other way, we stop reading the data
+ * source while a full buffer waits for the X client to take it. */
+#define DEFAULT_SELECTION_BUFFER_SIZE	(64 * 1024)
+#define MIN_SELECTION_BUFFER_SIZE	4096
+
+/* A transfer to an X client that makes no progress for this long is
+ * given up on, so a requestor that never takes its data can't hold up
+ * every paste after it. */
+#define SELECTION_TRANSFER_TIMEOUT	5000	/* ms */
+
+static void
+weston_wm_start_property_transfer(struct weston_wm *wm, int fd);
+
+static void
+weston_wm_close_property_transfer(struct weston_wm *wm)
+{
+	if (wm->property_source) {
+		wl_event_source_remove(wm->property_source);
+		wm->property_source = NULL;
+	}
+	free(wm->property_reply);
+	wm->property_reply = NULL;
+	if (wm->property_fd >= 0) {
+		close(wm->property_fd);
+		wm->property_fd = -1;
+	}
+	wm->property_incr = 0;
+}
+
+/* Finish the current transfer and start the oldest queued one. */
+static void
+weston_wm_end_property_transfer(struct weston_wm *wm)
+{
+	int *queue = wm->property_queue.data;
+	int fd;
+
+	weston_wm_close_property_transfer(wm);
+
+	if (wm->property_queue.size == 0)
+		return;
+
+	fd = queue[0];
+	wm->property_queue.size -= sizeof fd;
+	memmove(queue, queue + 1, wm->property_queue.size);
+
+	weston_wm_start_property_transfer(wm, fd);
+}
+
+static void
+weston_wm_flush_property_queue(struct weston_wm *wm)
+{
+	int *fd;
+
+	wl_array_for_each(fd, &wm->property_queue)
+		close(*fd);
+	wm->property_queue.size = 0;
+}
+
+static void
+weston_wm_get_selection_chunk(struct weston_wm *wm);
 
 static int
 weston_wm_write_property(int fd, uint32_t mask, void *data)
 {
 	struct weston_wm *wm = data;
 	unsigned char *property;
-	int len, remainder;
+	int len, remainder, more;
 
 	property = xcb_get_property_value(wm->property_reply);
 	remainder = xcb_get_property_value_length(wm->property_reply) -
@@ -42,67 +108,112 @@ weston_wm_write_property(int fd, uint32_t mask, void *data)
 
 	len = write(fd, property + wm->property_start, remainder);
 	if (len == -1) {
-		free(wm->property_reply);
-		wl_event_source_remove(wm->property_source);
-		close(fd);
+		if (errno == EAGAIN)
+			return 1;
 		weston_log("write error to target fd: %m\n");
+		weston_wm_end_property_transfer(wm);
 		return 1;
 	}
 
-	weston_log("wrote %d (chunk size %d) of %d bytes\n",
-		wm->property_start + len,
-		len, xcb_get_property_value_length(wm->property_reply));
-
 	wm->property_start += len;
-	if (len == remainder) {
-		free(wm->property_reply);
-		wl_event_source_remove(wm->property_source);
+	if (len < remainder)
+		return 1;
 
-		if (wm->incr) {
-			xcb_delete_property(wm->conn,
-					    wm->selection_window,
-					    wm->atom.wl_selection);
-		} else {
+	wl_event_source_remove(wm->property_source);
+	wm->property_source = NULL;
+	more = wm->property_reply->bytes_after > 0;
+	free(wm->property_reply);
+	wm->property_reply = NULL;
+
+	if (more) {
+		weston_wm_get_selection_chunk(wm);
+	} else {
+		/* For incr, deleting the property asks the owner for
+		 * the next piece. */
+		xcb_delete_property(wm->conn,
+				    wm->selection_window,
+				    wm->atom.wl_selection);
+		if (!wm->property_incr) {
 			weston_log("transfer complete\n");
-			close(fd);
+			weston_wm_end_property_transfer(wm);
 		}
 	}
 
+	xcb_flush(wm->conn);
+
 	return 1;
 }
 
 static void
-weston_wm_get_incr_chunk(struct weston_wm *wm)
+weston_wm_selection_chunk_reply(struct weston_wm *wm, void *data,
+				struct weston_wm_window *window,
+				xcb_atom_t atom)
+{
+	xcb_get_property_reply_t *reply = data;
+	int length;
+
+	if (wm->property_fd < 0) {
+		/* The transfer was aborted meanwhile. */
+		free(reply);
+		return;
+	}
+
+	if (reply == NULL) {
+		weston_log("failed to read selection property\n");
+		weston_wm_end_property_transfer(wm);
+		return;
+	}
+
+	if (wm->property_offset == 0)
+		dump_property(wm, wm->atom.wl_selection, reply);
+
+	if (reply->type == wm->atom.incr) {
+		weston_log("starting incr transfer\n");
+		wm->property_incr = 1;
+		free(reply);
+		xcb_delete_property(wm->conn,
+				    wm->selection_window,
+				    wm->atom.wl_selection);
+		return;
+	}
+
+	length = xcb_get_property_value_length(reply);
+	if (length == 0) {
+		/* An empty piece ends an incr transfer. */
+		free(reply);
+		xcb_delete_property(wm->conn,
+				    wm->selection_window,
+				    wm->atom.wl_selection);
+		weston_log("transfer complete\n");
+		weston_wm_end_property_transfer(wm);
+		return;
+	}
+
+	wm->property_reply = reply;
+	wm->property_start = 0;
+	wm->property_offset += length / 4;
+	wm->property_source =
+		wl_event_loop_add_fd(wm->server->loop,
+				     wm->property_fd,
+				     WL_EVENT_WRITABLE,
+				     weston_wm_write_property,
+				     wm);
+}
+
+static void
+weston_wm_get_selection_chunk(struct weston_wm *wm)
 {
 	xcb_get_property_cookie_t cookie;
-	xcb_get_property_reply_t *reply;
 
 	cookie = xcb_get_property(wm->conn,
 				  0, /* delete */
 				  wm->selection_window,
 				  wm->atom.wl_selection,
 				  XCB_GET_PROPERTY_TYPE_ANY,
-				  0, /* offset */
-				  0x1fffffff /* length */);
-
-	reply = xcb_get_property_reply(wm->conn, cookie, NULL);
-
-	dump_property(wm, wm->atom.wl_selection, reply);
-
-	if (xcb_get_property_value_length(reply) > 0) {
-		wm->property_start = 0;
-		wm->property_source =
-			wl_event_loop_add_fd(wm->server->loop,
-					     wm->data_source_fd,
-					     WL_EVENT_WRITABLE,
-					     weston_wm_write_property,
-					     wm);
-		wm->property_reply = reply;
-	} else {
-		weston_log("transfer complete\n");
-		close(wm->data_source_fd);
-		free(reply);
-	}
+				  wm->property_offset,
+				  wm->selection_buffer_size / 4);
+	weston_wm_expect_reply(wm, cookie.sequence,
+			       weston_wm_selection_chunk_reply, NULL, 0);
 }
 
 struct x11_data_source {
@@ -123,59 +234,84 @@ data_source_send(struct weston_data_source *base,
 	struct x11_data_source *source = (struct x11_data_source *) base;
 	struct weston_wm *wm = source->wm;
 
-	if (strcmp(mime_type, "text/plain;charset=utf-8") == 0) {
-		/* Get data for the utf8_string target */
-		xcb_convert_selection(wm->conn,
-				      wm->selection_window,
-				      wm->atom.clipboard,
-				      wm->atom.utf8_string,
-				      wm->atom.wl_selection,
-				      XCB_TIME_CURRENT_TIME);
+	int *queued;
+
+	if (strcmp(mime_type, "text/plain;charset=utf-8") != 0) {
+		close(fd);
+		return;
+	}
 
-		xcb_flush(wm->conn);
+	fcntl(fd, F_SETFL, O_WRONLY | O_NONBLOCK);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
 
-		fcntl(fd, F_SETFL, O_WRONLY | O_NONBLOCK);
-		wm->data_source_fd = fcntl(fd, F_DUPFD_CLOEXEC, fd);
+	/* All transfers go through the one wl_selection property, so
+	 * they take turns. */
+	if (wm->property_fd >= 0) {
+		queued = wl_array_add(&wm->property_queue, sizeof *queued);
+		if (queued == NULL) {
+			close(fd);
+			return;
+		}
+		*queued = fd;
+		return;
 	}
+
+	weston_wm_start_property_transfer(wm, fd);
 }
 
 static void
-data_source_cancel(struct weston_data_source *source)
+weston_wm_start_property_transfer(struct weston_wm *wm, int fd)
 {
+	/* Get data for the utf8_string target */
+	xcb_convert_selection(wm->conn,
+			      wm->selection_window,
+			      wm->atom.clipboard,
+			      wm->atom.utf8_string,
+			      wm->atom.wl_selection,
+			      XCB_TIME_CURRENT_TIME);
+
+	xcb_flush(wm->conn);
+
+	wm->property_fd = fd;
+	wm->property_offset = 0;
+	wm->property_incr = 0;
 }
 
 static void
-weston_wm_get_selection_targets(struct weston_wm *wm)
+data_source_cancel(struct weston_data_source *base)
+{
+	struct x11_data_source *source = (struct x11_data_source *) base;
+
+	/* Transfers that have not started yet would read the next
+	 * owner's selection; end them with no data instead. */
+	weston_wm_flush_property_queue(source->wm);
+}
+
+static void
+weston_wm_selection_targets_reply(struct weston_wm *wm, void *data,
+				  struct weston_wm_window *window,
+				  xcb_atom_t atom)
 {
+	xcb_get_property_reply_t *reply = data;
 	struct x11_data_source *source;
 	struct weston_compositor *compositor;
 	struct weston_seat *seat = weston_wm_pick_seat(wm);
-	xcb_get_property_cookie_t cookie;
-	xcb_get_property_reply_t *reply;
 	xcb_atom_t *value;
 	char **p;
 	uint32_t i;
 
-	cookie = xcb_get_property(wm->conn,
-				  1, /* delete */
-				  wm->selection_window,
-				  wm->atom.wl_selection,
-				  XCB_GET_PROPERTY_TYPE_ANY,
-				  0, /* offset */
-				  4096 /* length */);
-
-	reply = xcb_get_property_reply(wm->conn, cookie, NULL);
-
 	dump_property(wm, wm->atom.wl_selection, reply);
 
-	if (reply->type != XCB_ATOM_ATOM) {
+	if (reply == NULL || reply->type != XCB_ATOM_ATOM) {
 		free(reply);
 		return;
 	}
 
 	source = malloc(sizeof *source);
-	if (source == NULL)
+	if (source == NULL) {
+		free(reply);
 		return;
+	}
 
 	wl_signal_init(&source->base.destroy_signal);
 	source->base.accept = data_source_accept;
@@ -201,10 +337,9 @@ weston_wm_get_selection_targets(struct weston_wm *wm)
 }
 
 static void
-weston_wm_get_selection_data(struct weston_wm *wm)
+weston_wm_get_selection_targets(struct weston_wm *wm)
 {
 	xcb_get_property_cookie_t cookie;
-	xcb_get_property_reply_t *reply;
 
 	cookie = xcb_get_property(wm->conn,
 				  1, /* delete */
@@ -212,26 +347,9 @@ weston_wm_get_selection_data(struct weston_wm *wm)
 				  wm->atom.wl_selection,
 				  XCB_GET_PROPERTY_TYPE_ANY,
 				  0, /* offset */
-				  0x1fffffff /* length */);
-
-	reply = xcb_get_property_reply(wm->conn, cookie, NULL);
-
-	if (reply->type == wm->atom.incr) {
-		dump_property(wm, wm->atom.wl_selection, reply);
-		wm->incr = 1;
-		free(reply);
-	} else {
-		dump_property(wm, wm->atom.wl_selection, reply);
-		wm->incr = 0;
-		wm->property_start = 0;
-		wm->property_source =
-			wl_event_loop_add_fd(wm->server->loop,
-					     wm->data_source_fd,
-					     WL_EVENT_WRITABLE,
-					     weston_wm_write_property,
-					     wm);
-		wm->property_reply = reply;
-	}
+				  4096 /* length */);
+	weston_wm_expect_reply(wm, cookie.sequence,
+			       weston_wm_selection_targets_reply, NULL, 0);
 }
 
 static void
@@ -243,34 +361,43 @@ weston_wm_handle_selection_notify(struct weston_wm *wm,
 
 	if (selection_notify->property == XCB_ATOM_NONE) {
 		/* convert selection failed */
+		if (selection_notify->target != wm->atom.targets)
+			weston_wm_end_property_transfer(wm);
 	} else if (selection_notify->target == wm->atom.targets) {
 		weston_wm_get_selection_targets(wm);
-	} else {
-		weston_wm_get_selection_data(wm);
+	} else if (wm->property_fd >= 0) {
+		wm->property_offset = 0;
+		weston_wm_get_selection_chunk(wm);
 	}
 }
 
-static const size_t incr_chunk_size = 64 * 1024;
-
 static void
-weston_wm_send_selection_notify(struct weston_wm *wm, xcb_atom_t property)
+send_selection_notify(struct weston_wm *wm,
+		      const xcb_selection_request_event_t *request,
+		      xcb_atom_t property)
 {
 	xcb_selection_notify_event_t selection_notify;
 
 	memset(&selection_notify, 0, sizeof selection_notify);
 	selection_notify.response_type = XCB_SELECTION_NOTIFY;
 	selection_notify.sequence = 0;
-	selection_notify.time = wm->selection_request.time;
-	selection_notify.requestor = wm->selection_request.requestor;
-	selection_notify.selection = wm->selection_request.selection;
-	selection_notify.target = wm->selection_request.target;
+	selection_notify.time = request->time;
+	selection_notify.requestor = request->requestor;
+	selection_notify.selection = request->selection;
+	selection_notify.target = request->target;
 	selection_notify.property = property;
 
 	xcb_send_event(wm->conn, 0, /* propagate */
-		       wm->selection_request.requestor,
+		       request->requestor,
 		       XCB_EVENT_MASK_NO_EVENT, (char *) &selection_notify);
 }
 
+static void
+weston_wm_send_selection_notify(struct weston_wm *wm, xcb_atom_t property)
+{
+	send_selection_notify(wm, &wm->selection_request, property);
+}
+
 static void
 weston_wm_send_targets(struct weston_wm *wm)
 {
@@ -328,59 +455,135 @@ weston_wm_flush_source_data(struct weston_wm *wm)
 	return length;
 }
 
+static void
+weston_wm_stop_reading_data_source(struct weston_wm *wm)
+{
+	if (wm->data_source_event) {
+		wl_event_source_remove(wm->data_source_event);
+		wm->data_source_event = NULL;
+	}
+}
+
+/* Top-level windows are watched by the window manager anyway; for
+ * others, such as xterm's VT100 window, we ask for the property deletes
+ * that drive an incr transfer and for the destroy that ends it early. */
+static void
+weston_wm_watch_requestor(struct weston_wm *wm)
+{
+	xcb_window_t requestor = wm->selection_request.requestor;
+	uint32_t values[1];
+
+	if (hash_table_lookup(wm->window_hash, requestor))
+		return;
+
+	values[0] = XCB_EVENT_MASK_STRUCTURE_NOTIFY |
+		XCB_EVENT_MASK_PROPERTY_CHANGE;
+	xcb_change_window_attributes(wm->conn, requestor,
+				     XCB_CW_EVENT_MASK, values);
+	wm->selection_watched = requestor;
+}
+
+static void
+weston_wm_unwatch_requestor(struct weston_wm *wm)
+{
+	uint32_t values[1];
+
+	if (wm->selection_watched == XCB_WINDOW_NONE)
+		return;
+
+	values[0] = XCB_EVENT_MASK_NO_EVENT;
+	xcb_change_window_attributes(wm->conn, wm->selection_watched,
+				     XCB_CW_EVENT_MASK, values);
+	wm->selection_watched = XCB_WINDOW_NONE;
+}
+
+/* The transfer to the requestor is over, whether it succeeded or not. */
+static void
+weston_wm_release_requestor(struct weston_wm *wm)
+{
+	weston_wm_unwatch_requestor(wm);
+	weston_timer_cancel(&wm->selection_transfer_timer);
+	wm->selection_request.requestor = XCB_NONE;
+}
+
+static void
+weston_wm_end_data_source_transfer(struct weston_wm *wm)
+{
+	weston_wm_stop_reading_data_source(wm);
+	if (wm->data_source_fd >= 0) {
+		close(wm->data_source_fd);
+		wm->data_source_fd = -1;
+	}
+	wl_array_release(&wm->source_data);
+	wl_array_init(&wm->source_data);
+	wm->incr = 0;
+	wm->flush_property_on_delete = 0;
+	weston_wm_release_requestor(wm);
+}
+
+static void
+weston_wm_selection_transfer_timeout(struct weston_timer *timer, void *data)
+{
+	struct weston_wm *wm = data;
+
+	weston_log("selection transfer stalled, giving up\n");
+
+	/* Without incr, the requestor is still waiting for an answer. */
+	if (!wm->incr)
+		weston_wm_send_selection_notify(wm, XCB_ATOM_NONE);
+	weston_wm_end_data_source_transfer(wm);
+	xcb_flush(wm->conn);
+}
+
 static int
 weston_wm_read_data_source(int fd, uint32_t mask, void *data)
 {
 	struct weston_wm *wm = data;
+	uint32_t incr_size;
 	int len, current, available;
 	void *p;
 
 	current = wm->source_data.size;
-	if (wm->source_data.size < incr_chunk_size)
-		p = wl_array_add(&wm->source_data, incr_chunk_size);
-	else
-		p = (char *) wm->source_data.data + wm->source_data.size;
-	available = wm->source_data.alloc - current;
+	p = (char *) wm->source_data.data + current;
+	available = wm->selection_buffer_size - current;
 
 	len = read(fd, p, available);
 	if (len == -1) {
+		if (errno == EAGAIN)
+			return 1;
 		weston_log("read error from data source: %m\n");
 		weston_wm_send_selection_notify(wm, XCB_ATOM_NONE);
-		wl_event_source_remove(wm->property_source);
-		close(fd);
-		wl_array_release(&wm->source_data);
+		weston_wm_end_data_source_transfer(wm);
+		return 1;
 	}
 
-	weston_log("read %d (available %d, mask 0x%x) bytes: \"%.*s\"\n",
-		len, available, mask, len, (char *) p);
+	weston_timer_arm(wm->server->compositor, &wm->selection_transfer_timer,
+			 SELECTION_TRANSFER_TIMEOUT);
 
 	wm->source_data.size = current + len;
-	if (wm->source_data.size >= incr_chunk_size) {
+	if (wm->source_data.size >= wm->selection_buffer_size) {
+		/* The buffer is full; stop reading until the X client
+		 * has taken what we have. */
 		if (!wm->incr) {
 			weston_log("got %zu bytes, starting incr\n",
 				wm->source_data.size);
 			wm->incr = 1;
+			incr_size = wm->selection_buffer_size;
 			xcb_change_property(wm->conn,
 					    XCB_PROP_MODE_REPLACE,
 					    wm->selection_request.requestor,
 					    wm->selection_request.property,
 					    wm->atom.incr,
 					    32, /* format */
-					    1, &incr_chunk_size);
+					    1, &incr_size);
 			wm->selection_property_set = 1;
 			wm->flush_property_on_delete = 1;
-			wl_event_source_remove(wm->property_source);
+			weston_wm_stop_reading_data_source(wm);
 			weston_wm_send_selection_notify(wm, wm->selection_request.property);
 		} else if (wm->selection_property_set) {
-			weston_log("got %zu bytes, waiting for "
-				"property delete\n", wm->source_data.size);
-
 			wm->flush_property_on_delete = 1;
-			wl_event_source_remove(wm->property_source);
+			weston_wm_stop_reading_data_source(wm);
 		} else {
-			weston_log("got %zu bytes, "
-				"property deleted, seting new property\n",
-				wm->source_data.size);
 			weston_wm_flush_source_data(wm);
 		}
 	} else if (len == 0 && !wm->incr) {
@@ -388,33 +591,25 @@ weston_wm_read_data_source(int fd, uint32_t mask, void *data)
 		/* Non-incr transfer all done. */
 		weston_wm_flush_source_data(wm);
 		weston_wm_send_selection_notify(wm, wm->selection_request.property);
-		xcb_flush(wm->conn);
-		wl_event_source_remove(wm->property_source);
+		weston_wm_stop_reading_data_source(wm);
 		close(fd);
+		wm->data_source_fd = -1;
 		wl_array_release(&wm->source_data);
-		wm->selection_request.requestor = XCB_NONE;
+		wl_array_init(&wm->source_data);
+		weston_wm_release_requestor(wm);
 	} else if (len == 0 && wm->incr) {
 		weston_log("incr transfer complete\n");
 
 		wm->flush_property_on_delete = 1;
-		if (wm->selection_property_set) {
-			weston_log("got %zu bytes, waiting for "
-				"property delete\n", wm->source_data.size);
-		} else {
-			weston_log("got %zu bytes, "
-				"property deleted, seting new property\n",
-				wm->source_data.size);
+		if (!wm->selection_property_set)
 			weston_wm_flush_source_data(wm);
-		}
-		xcb_flush(wm->conn);
-		wl_event_source_remove(wm->property_source);
-		close(wm->data_source_fd);
-		wm->data_source_fd = -1;
+		weston_wm_stop_reading_data_source(wm);
 		close(fd);
-	} else {
-		weston_log("nothing happened, buffered the bytes\n");
+		wm->data_source_fd = -1;
 	}
 
+	xcb_flush(wm->conn);
+
 	return 1;
 }
 
@@ -431,14 +626,27 @@ weston_wm_send_data(struct weston_wm *wm, xcb_atom_t target, const char *mime_ty
 		return;
 	}
 
+	wl_array_release(&wm->source_data);
 	wl_array_init(&wm->source_data);
+	if (!wl_array_add(&wm->source_data, wm->selection_buffer_size)) {
+		weston_log("failed to allocate selection buffer\n");
+		close(p[0]);
+		close(p[1]);
+		weston_wm_send_selection_notify(wm, XCB_ATOM_NONE);
+		return;
+	}
+	wm->source_data.size = 0;
+
 	wm->selection_target = target;
+	weston_wm_watch_requestor(wm);
+	weston_timer_arm(wm->server->compositor, &wm->selection_transfer_timer,
+			 SELECTION_TRANSFER_TIMEOUT);
 	wm->data_source_fd = p[0];
-	wm->property_source = wl_event_loop_add_fd(wm->server->loop,
-						   wm->data_source_fd,
-						   WL_EVENT_READABLE,
-						   weston_wm_read_data_source,
-						   wm);
+	wm->data_source_event = wl_event_loop_add_fd(wm->server->loop,
+						     wm->data_source_fd,
+						     WL_EVENT_READABLE,
+						     weston_wm_read_data_source,
+						     wm);
 
 	source = seat->selection_data_source;
 	source->send(source, mime_type, p[1]);
@@ -449,17 +657,16 @@ weston_wm_send_incr_chunk(struct weston_wm *wm)
 {
 	int length;
 
-	weston_log("property deleted\n");
-
 	wm->selection_property_set = 0;
 	if (wm->flush_property_on_delete) {
-		weston_log("setting new property, %zu bytes\n",
-			wm->source_data.size);
+		weston_timer_arm(wm->server->compositor,
+				 &wm->selection_transfer_timer,
+				 SELECTION_TRANSFER_TIMEOUT);
 		wm->flush_property_on_delete = 0;
 		length = weston_wm_flush_source_data(wm);
 
 		if (wm->data_source_fd >= 0) {
-			wm->property_source =
+			wm->data_source_event =
 				wl_event_loop_add_fd(wm->server->loop,
 						     wm->data_source_fd,
 						     WL_EVENT_READABLE,
@@ -472,8 +679,10 @@ weston_wm_send_incr_chunk(struct weston_wm *wm)
 			 * the transfer. */
 			wm->flush_property_on_delete = 1;
 			wl_array_release(&wm->source_data);
+			wl_array_init(&wm->source_data);
 		} else {
-			wm->selection_request.requestor = XCB_NONE;
+			wm->incr = 0;
+			weston_wm_release_requestor(wm);
 		}
 	}
 }
@@ -488,8 +697,10 @@ weston_wm_handle_selection_property_notify(struct weston_wm *wm,
 	if (property_notify->window == wm->selection_window) {
 		if (property_notify->state == XCB_PROPERTY_NEW_VALUE &&
 		    property_notify->atom == wm->atom.wl_selection &&
-		    wm->incr)
-			weston_wm_get_incr_chunk(wm);
+		    wm->property_incr && wm->property_fd >= 0) {
+			wm->property_offset = 0;
+			weston_wm_get_selection_chunk(wm);
+		}
 		return 1;
 	} else if (property_notify->window == wm->selection_request.requestor) {
 		if (property_notify->state == XCB_PROPERTY_DELETE &&
@@ -510,11 +721,19 @@ weston_wm_handle_selection_request(struct weston_wm *wm,
 		(xcb_selection_request_event_t *) event;
 
 	weston_log("selection request, %s, ",
-		get_atom_name(wm->conn, selection_request->selection));
+		get_atom_name(wm, selection_request->selection));
 	weston_log_continue("target %s, ",
-		get_atom_name(wm->conn, selection_request->target));
+		get_atom_name(wm, selection_request->target));
 	weston_log_continue("property %s\n",
-		get_atom_name(wm->conn, selection_request->property));
+		get_atom_name(wm, selection_request->property));
+
+	/* One transfer at a time; the request we are serving is kept
+	 * in wm->selection_request until it is done. */
+	if (wm->data_source_fd >= 0 || wm->flush_property_on_delete) {
+		weston_log("selection transfer in progress, refusing\n");
+		send_selection_notify(wm, selection_request, XCB_ATOM_NONE);
+		return;
+	}
 
 	wm->selection_request = *selection_request;
 	wm->incr = 0;
@@ -591,11 +810,68 @@ weston_wm_handle_xfixes_selection_notify(struct weston_wm *wm,
 	xcb_flush(wm->conn);
 }
 
+/* The window manager only selects structure events on the root and
+ * on frames, so those reported on a window about itself come from
+ * watching a requestor, and are no business of the window manager's.
+ * Every structure event starts with the window it was reported on and
+ * the window it is about, so the destroy layout does for all of them. */
+static int
+weston_wm_handle_watched_event(struct weston_wm *wm,
+			       xcb_generic_event_t *event)
+{
+	xcb_destroy_notify_event_t *notify =
+		(xcb_destroy_notify_event_t *) event;
+
+	switch (event->response_type & ~0x80) {
+	case XCB_DESTROY_NOTIFY:
+	case XCB_UNMAP_NOTIFY:
+	case XCB_MAP_NOTIFY:
+	case XCB_REPARENT_NOTIFY:
+	case XCB_CONFIGURE_NOTIFY:
+	case XCB_GRAVITY_NOTIFY:
+	case XCB_CIRCULATE_NOTIFY:
+		break;
+	default:
+		return 0;
+	}
+
+	if (notify->event != notify->window ||
+	    hash_table_lookup(wm->window_hash, notify->window))
+		return 0;
+
+	if ((event->response_type & ~0x80) == XCB_DESTROY_NOTIFY) {
+		if (notify->window == wm->selection_watched)
+			wm->selection_watched = XCB_WINDOW_NONE;
+		if (notify->window == wm->selection_request.requestor &&
+		    (wm->data_source_fd >= 0 ||
+		     wm->flush_property_on_delete)) {
+			weston_log("selection requestor went away\n");
+			weston_wm_end_data_source_transfer(wm);
+		}
+	}
+
+	return 1;
+}
+
 int
 weston_wm_handle_selection_event(struct weston_wm *wm,
 				 xcb_generic_event_t *event)
 {
+	xcb_destroy_notify_event_t *destroy_notify;
+
+	if (weston_wm_handle_watched_event(wm, event))
+		return 1;
+
 	switch (event->response_type & ~0x80) {
+	case XCB_DESTROY_NOTIFY:
+		/* Don't wait for property deletes that won't come. */
+		destroy_notify = (xcb_destroy_notify_event_t *) event;
+		if (destroy_notify->window == wm->selection_request.requestor &&
+		    (wm->data_source_fd >= 0 || wm->flush_property_on_delete)) {
+			weston_log("selection requestor went away\n");
+			weston_wm_end_data_source_transfer(wm);
+		}
+		return 0;
 	case XCB_SELECTION_NOTIFY:
 		weston_wm_handle_selection_notify(wm, event);
 		return 1;
@@ -665,9 +941,25 @@ void
 weston_wm_selection_init(struct weston_wm *wm)
 {
 	struct weston_seat *seat;
-	uint32_t values[1], mask;
+	struct weston_config_section *section;
+	uint32_t values[1], mask, size;
 
 	wm->selection_request.requestor = XCB_NONE;
+	wm->selection_watched = XCB_WINDOW_NONE;
+	weston_timer_init(&wm->selection_transfer_timer,
+			  weston_wm_selection_transfer_timeout, wm);
+	wm->data_source_fd = -1;
+	wm->property_fd = -1;
+	wl_array_init(&wm->property_queue);
+	wl_array_init(&wm->source_data);
+
+	section = weston_config_get_section(wm->server->compositor->config,
+					    "xwayland", NULL, NULL);
+	weston_config_section_get_uint(section, "selection-buffer-size",
+				       &size, DEFAULT_SELECTION_BUFFER_SIZE);
+	if (size < MIN_SELECTION_BUFFER_SIZE)
+		size = MIN_SELECTION_BUFFER_SIZE;
+	wm->selection_buffer_size = size & ~3;
 
 	values[0] = XCB_EVENT_MASK_PROPERTY_CHANGE;
 	wm->selection_window = xcb_generate_id(wm->conn);
@@ -700,3 +992,12 @@ weston_wm_selection_init(struct weston_wm *wm)
 
 	weston_wm_set_selection(&wm->selection_listener, seat);
 }
+
+void
+weston_wm_selection_destroy(struct weston_wm *wm)
+{
+	weston_wm_flush_property_queue(wm);
+	wl_array_release(&wm->property_queue);
+	weston_wm_close_property_transfer(wm);
+	weston_wm_end_data_source_transfer(wm);
+}
@@ -31,6 +31,7 @@
 #include <errno.h>
 #include <unistd.h>
 #include <signal.h>
+#include <xcb/xcbext.h>
 #include <X11/Xcursor/Xcursor.h>
 
 #include "xwayland.h"
@@ -102,7 +103,9 @@ struct weston_wm_window {
 	struct wl_listener surface_destroy_listener;
 	struct wl_event_source *repaint_source;
 	struct wl_event_source *configure_source;
-	int properties_dirty;
+	int pending_replies;
+	int map_pending;
+	int shell_map_pending;
 	int pid;
 	char *machine;
 	char *class;
@@ -117,6 +120,21 @@ struct weston_wm_window {
 	int override_redirect;
 	int fullscreen;
 	int has_alpha;
+	cairo_surface_t *title_surface[2];
+	int title_width;
+	int title_dirty;
+	int drawn_mode;
+	int drawn_width, drawn_height;
+	uint32_t drawn_flags;
+};
+
+/* What the frame window currently shows, so repaints can skip or limit
+ * themselves to what changed. */
+enum frame_mode {
+	FRAME_MODE_NONE = 0,
+	FRAME_MODE_FULLSCREEN,
+	FRAME_MODE_DECORATED,
+	FRAME_MODE_SHADOW
 };
 
 static struct weston_wm_window *
@@ -125,6 +143,13 @@ get_wm_window(struct weston_surface *surface);
 static void
 weston_wm_window_schedule_repaint(struct weston_wm_window *window);
 
+static void
+weston_wm_window_map(struct weston_wm_window *window);
+
+static void
+xserver_map_shell_surface(struct weston_wm *wm,
+			  struct weston_wm_window *window);
+
 static int __attribute__ ((format (printf, 1, 2)))
 wm_log(const char *fmt, ...)
 {
@@ -160,29 +185,157 @@ wm_log_continue(const char *fmt, ...)
 }
 
 
+/* A request whose reply we are waiting for.  Replies are picked up in
+ * sequence order from weston_wm_handle_event(), so the compositor never
+ * blocks on the X server.  The handler owns the reply, which is NULL on
+ * error.  If the window goes away first, the reply is still consumed
+ * but the handler sees a NULL window. */
+struct weston_wm_reply {
+	struct wl_list link;
+	unsigned int sequence;
+	weston_wm_reply_func_t func;
+	struct weston_wm_window *window;
+	xcb_atom_t atom;
+};
+
+void
+weston_wm_expect_reply(struct weston_wm *wm, unsigned int sequence,
+		       weston_wm_reply_func_t func,
+		       struct weston_wm_window *window, xcb_atom_t atom)
+{
+	struct weston_wm_reply *reply;
+
+	reply = zalloc(sizeof *reply);
+	if (reply == NULL) {
+		xcb_discard_reply(wm->conn, sequence);
+		return;
+	}
+
+	reply->sequence = sequence;
+	reply->func = func;
+	reply->window = window;
+	reply->atom = atom;
+	if (window)
+		window->pending_replies++;
+	wl_list_insert(wm->pending_replies.prev, &reply->link);
+}
+
+static int
+weston_wm_dispatch_replies(struct weston_wm *wm)
+{
+	struct weston_wm_reply *r, *next;
+	xcb_generic_error_t *error;
+	void *reply;
+	int count = 0;
+
+	wl_list_for_each_safe(r, next, &wm->pending_replies, link) {
+		reply = NULL;
+		error = NULL;
+		if (!xcb_poll_for_reply(wm->conn, r->sequence, &reply, &error))
+			break;
+
+		wl_list_remove(&r->link);
+		if (r->window)
+			r->window->pending_replies--;
+		r->func(wm, reply, r->window, r->atom);
+		free(error);
+		free(r);
+		count++;
+	}
+
+	return count;
+}
+
+static void
+weston_wm_cancel_replies(struct weston_wm *wm, struct weston_wm_window *window)
+{
+	struct weston_wm_reply *r;
+
+	wl_list_for_each(r, &wm->pending_replies, link)
+		if (r->window == window)
+			r->window = NULL;
+	window->pending_replies = 0;
+}
+
+static void
+weston_wm_release_replies(struct weston_wm *wm)
+{
+	struct weston_wm_reply *r, *next;
+
+	wl_list_for_each_safe(r, next, &wm->pending_replies, link) {
+		xcb_discard_reply(wm->conn, r->sequence);
+		free(r);
+	}
+	wl_list_init(&wm->pending_replies);
+}
+
+/* Marks an atom whose name has been requested but not received yet. */
+static char atom_name_pending[] = "";
+
+static void
+weston_wm_add_atom_name(struct weston_wm *wm, xcb_atom_t atom,
+			const char *name, int length)
+{
+	char *old, *copy;
+
+	copy = strndup(name, length);
+	if (copy == NULL)
+		return;
+
+	old = hash_table_lookup(wm->atom_names, atom);
+	if (old) {
+		hash_table_remove(wm->atom_names, atom);
+		if (old != atom_name_pending)
+			free(old);
+	}
+	hash_table_insert(wm->atom_names, atom, copy);
+}
+
+static void
+atom_name_reply(struct weston_wm *wm, void *data,
+		struct weston_wm_window *window, xcb_atom_t atom)
+{
+	xcb_get_atom_name_reply_t *reply = data;
+
+	/* On error the pending marker stays, so we don't ask again. */
+	if (reply)
+		weston_wm_add_atom_name(wm, atom,
+					xcb_get_atom_name_name(reply),
+					xcb_get_atom_name_name_length(reply));
+	free(reply);
+}
+
+static void
+free_atom_name(void *element, void *data)
+{
+	if (element != atom_name_pending)
+		free(element);
+}
+
+/* Names come from a cache filled asynchronously; an atom we haven't
+ * seen before is printed as a number until its name arrives. */
 const char *
-get_atom_name(xcb_connection_t *c, xcb_atom_t atom)
+get_atom_name(struct weston_wm *wm, xcb_atom_t atom)
 {
 	xcb_get_atom_name_cookie_t cookie;
-	xcb_get_atom_name_reply_t *reply;
-	xcb_generic_error_t *e;
 	static char buffer[64];
+	const char *name;
 
 	if (atom == XCB_ATOM_NONE)
 		return "None";
 
-	cookie = xcb_get_atom_name (c, atom);
-	reply = xcb_get_atom_name_reply (c, cookie, &e);
+	name = hash_table_lookup(wm->atom_names, atom);
+	if (name && name != atom_name_pending)
+		return name;
 
-	if(reply) {
-		snprintf(buffer, sizeof buffer, "%.*s",
-			 xcb_get_atom_name_name_length (reply),
-			 xcb_get_atom_name_name (reply));
-	} else {
-		snprintf(buffer, sizeof buffer, "(atom %u)", atom);
+	if (name == NULL) {
+		cookie = xcb_get_atom_name(wm->conn, atom);
+		weston_wm_expect_reply(wm, cookie.sequence,
+				       atom_name_reply, NULL, atom);
+		hash_table_insert(wm->atom_names, atom, atom_name_pending);
 	}
 
-	free(reply);
+	snprintf(buffer, sizeof buffer, "(atom %u)", atom);
 
 	return buffer;
 }
@@ -270,14 +423,14 @@ dump_property(struct weston_wm *wm,
 	int width, len;
 	uint32_t i;
 
-	width = wm_log_continue("%s: ", get_atom_name(wm->conn, property));
+	width = wm_log_continue("%s: ", get_atom_name(wm, property));
 	if (reply == NULL) {
 		wm_log_continue("(no reply)\n");
 		return;
 	}
 
 	width += wm_log_continue("%s/%d, length %d (value_len %d): ",
-				 get_atom_name(wm->conn, reply->type),
+				 get_atom_name(wm, reply->type),
 				 reply->format,
 				 xcb_get_property_value_length(reply),
 				 reply->value_len);
@@ -296,7 +449,7 @@ dump_property(struct weston_wm *wm,
 	} else if (reply->type == XCB_ATOM_ATOM) {
 		atom_value = xcb_get_property_value(reply);
 		for (i = 0; i < reply->value_len; i++) {
-			name = get_atom_name(wm->conn, atom_value[i]);
+			name = get_atom_name(wm, atom_value[i]);
 			if (width + strlen(name) + 2 > 78) {
 				wm_log_continue("\n    ");
 				width = 4;
@@ -312,124 +465,216 @@ dump_property(struct weston_wm *wm,
 	}
 }
 
-static void
-read_and_dump_property(struct weston_wm *wm,
-		       xcb_window_t window, xcb_atom_t property)
-{
-	xcb_get_property_reply_t *reply;
-	xcb_get_property_cookie_t cookie;
-
-	cookie = xcb_get_property(wm->conn, 0, window,
-				  property, XCB_ATOM_ANY, 0, 2048);
-	reply = xcb_get_property_reply(wm->conn, cookie, NULL);
-
-	dump_property(wm, property, reply);
-
-	free(reply);
-}
-
 /* We reuse some predefined, but otherwise useles atoms */
 #define TYPE_WM_PROTOCOLS	XCB_ATOM_CUT_BUFFER0
 #define TYPE_MOTIF_WM_HINTS	XCB_ATOM_CUT_BUFFER1
 #define TYPE_NET_WM_STATE	XCB_ATOM_CUT_BUFFER2
 
-static void
-weston_wm_window_read_properties(struct weston_wm_window *window)
-{
-	struct weston_wm *wm = window->wm;
+/* The window properties we track.  Atoms that are not predefined are
+ * only known once interned, so those entries name the weston_wm field
+ * holding them instead. */
+struct window_property {
+	xcb_atom_t atom;	/* XCB_ATOM_NONE: see wm_atom */
+	int wm_atom;
+	xcb_atom_t type;
+	int offset;
+};
 
 #define F(field) offsetof(struct weston_wm_window, field)
-	const struct {
-		xcb_atom_t atom;
-		xcb_atom_t type;
-		int offset;
-	} props[] = {
-		{ XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, F(class) },
-		{ XCB_ATOM_WM_NAME, XCB_ATOM_STRING, F(name) },
-		{ XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, F(transient_for) },
-		{ wm->atom.wm_protocols, TYPE_WM_PROTOCOLS, F(protocols) },
-		{ wm->atom.net_wm_state, TYPE_NET_WM_STATE },
-		{ wm->atom.net_wm_window_type, XCB_ATOM_ATOM, F(type) },
-		{ wm->atom.net_wm_name, XCB_ATOM_STRING, F(name) },
-		{ wm->atom.net_wm_pid, XCB_ATOM_CARDINAL, F(pid) },
-		{ wm->atom.motif_wm_hints, TYPE_MOTIF_WM_HINTS, 0 },
-		{ wm->atom.wm_client_machine, XCB_ATOM_WM_CLIENT_MACHINE, F(machine) },
-	};
+#define A(name) XCB_ATOM_NONE, offsetof(struct weston_wm, atom.name)
+static const struct window_property window_props[] = {
+	{ XCB_ATOM_WM_CLASS, 0, XCB_ATOM_STRING, F(class) },
+	{ XCB_ATOM_WM_NAME, 0, XCB_ATOM_STRING, F(name) },
+	{ XCB_ATOM_WM_TRANSIENT_FOR, 0, XCB_ATOM_WINDOW, F(transient_for) },
+	{ A(wm_protocols), TYPE_WM_PROTOCOLS, F(protocols) },
+	{ A(net_wm_state), TYPE_NET_WM_STATE, 0 },
+	{ A(net_wm_window_type), XCB_ATOM_ATOM, F(type) },
+	{ A(net_wm_name), XCB_ATOM_STRING, F(name) },
+	{ A(net_wm_pid), XCB_ATOM_CARDINAL, F(pid) },
+	{ A(motif_wm_hints), TYPE_MOTIF_WM_HINTS, 0 },
+	{ A(wm_client_machine), XCB_ATOM_WM_CLIENT_MACHINE, F(machine) },
+};
+#undef A
 #undef F
 
-	xcb_get_property_cookie_t cookie[ARRAY_LENGTH(props)];
-	xcb_get_property_reply_t *reply;
-	void *p;
+static xcb_atom_t
+window_property_atom(struct weston_wm *wm, const struct window_property *prop)
+{
+	if (prop->atom != XCB_ATOM_NONE)
+		return prop->atom;
+
+	return *(xcb_atom_t *) ((char *) wm + prop->wm_atom);
+}
+
+static const struct window_property *
+weston_wm_lookup_window_property(struct weston_wm *wm, xcb_atom_t atom)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_LENGTH(window_props); i++)
+		if (window_property_atom(wm, &window_props[i]) == atom)
+			return &window_props[i];
+
+	return NULL;
+}
+
+static void
+weston_wm_window_apply_property(struct weston_wm_window *window,
+				xcb_atom_t atom, xcb_get_property_reply_t *reply)
+{
+	struct weston_wm *wm = window->wm;
+	const struct window_property *prop;
+	struct motif_wm_hints *hints;
+	xcb_atom_t *atoms;
 	uint32_t *xid;
-	xcb_atom_t *atom;
+	void *p;
 	uint32_t i;
-	struct motif_wm_hints *hints;
 
-	if (!window->properties_dirty)
+	prop = weston_wm_lookup_window_property(wm, atom);
+	if (prop == NULL)
 		return;
-	window->properties_dirty = 0;
-
-	for (i = 0; i < ARRAY_LENGTH(props); i++)
-		cookie[i] = xcb_get_property(wm->conn,
-					     0, /* delete */
-					     window->id,
-					     props[i].atom,
-					     XCB_ATOM_ANY, 0, 2048);
-
-	window->decorate = !window->override_redirect;
-	for (i = 0; i < ARRAY_LENGTH(props); i++)  {
-		reply = xcb_get_property_reply(wm->conn, cookie[i], NULL);
-		if (!reply)
-			/* Bad window, typically */
-			continue;
-		if (reply->type == XCB_ATOM_NONE) {
-			/* No such property */
-			free(reply);
-			continue;
-		}
 
-		p = ((char *) window + props[i].offset);
+	if (prop->type == TYPE_MOTIF_WM_HINTS)
+		window->decorate = !window->override_redirect;
 
-		switch (props[i].type) {
-		case XCB_ATOM_WM_CLIENT_MACHINE:
-		case XCB_ATOM_STRING:
-			/* FIXME: We're using this for both string and
-			   utf8_string */
-			if (*(char **) p)
-				free(*(char **) p);
+	if (!reply)
+		/* Bad window, typically */
+		return;
+	if (reply->type == XCB_ATOM_NONE)
+		/* No such property */
+		return;
 
-			*(char **) p =
-				strndup(xcb_get_property_value(reply),
-					xcb_get_property_value_length(reply));
-			break;
-		case XCB_ATOM_WINDOW:
-			xid = xcb_get_property_value(reply);
-			*(struct weston_wm_window **) p =
-				hash_table_lookup(wm->window_hash, *xid);
-			break;
-		case XCB_ATOM_CARDINAL:
-		case XCB_ATOM_ATOM:
-			atom = xcb_get_property_value(reply);
-			*(xcb_atom_t *) p = *atom;
-			break;
-		case TYPE_WM_PROTOCOLS:
-			break;
-		case TYPE_NET_WM_STATE:
-			window->fullscreen = 0;
-			atom = xcb_get_property_value(reply);
-			for (i = 0; i < reply->value_len; i++)
-				if (atom[i] == wm->atom.net_wm_state_fullscreen)
-					window->fullscreen = 1;
+	p = ((char *) window + prop->offset);
+
+	switch (prop->type) {
+	case XCB_ATOM_WM_CLIENT_MACHINE:
+	case XCB_ATOM_STRING:
+		/* FIXME: We're using this for both string and
+		   utf8_string */
+		if (*(char **) p)
+			free(*(char **) p);
+
+		*(char **) p =
+			strndup(xcb_get_property_value(reply),
+				xcb_get_property_value_length(reply));
+		break;
+	case XCB_ATOM_WINDOW:
+		if (xcb_get_property_value_length(reply) < 4)
 			break;
-		case TYPE_MOTIF_WM_HINTS:
-			hints = xcb_get_property_value(reply);
-			if (hints->flags & MWM_HINTS_DECORATIONS)
-				window->decorate = hints->decorations > 0;
+		xid = xcb_get_property_value(reply);
+		*(struct weston_wm_window **) p =
+			hash_table_lookup(wm->window_hash, *xid);
+		break;
+	case XCB_ATOM_CARDINAL:
+	case XCB_ATOM_ATOM:
+		if (xcb_get_property_value_length(reply) < 4)
 			break;
-		default:
+		atoms = xcb_get_property_value(reply);
+		*(xcb_atom_t *) p = *atoms;
+		break;
+	case TYPE_WM_PROTOCOLS:
+		break;
+	case TYPE_NET_WM_STATE:
+		window->fullscreen = 0;
+		atoms = xcb_get_property_value(reply);
+		for (i = 0; i < reply->value_len; i++)
+			if (atoms[i] == wm->atom.net_wm_state_fullscreen)
+				window->fullscreen = 1;
+		break;
+	case TYPE_MOTIF_WM_HINTS:
+		if (xcb_get_property_value_length(reply) < (int) sizeof *hints)
 			break;
-		}
-		free(reply);
+		hints = xcb_get_property_value(reply);
+		if (hints->flags & MWM_HINTS_DECORATIONS)
+			window->decorate = hints->decorations > 0;
+		break;
+	default:
+		break;
+	}
+}
+
+static void
+weston_wm_window_properties_ready(struct weston_wm_window *window);
+
+static void
+weston_wm_window_invalidate_title(struct weston_wm_window *window)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (window->title_surface[i])
+			cairo_surface_destroy(window->title_surface[i]);
+		window->title_surface[i] = NULL;
+	}
+	window->title_dirty = 1;
+}
+
+static void
+weston_wm_window_property_reply(struct weston_wm *wm, void *data,
+				struct weston_wm_window *window,
+				xcb_atom_t atom)
+{
+	if (window)
+		weston_wm_window_apply_property(window, atom, data);
+	free(data);
+
+	if (window && window->pending_replies == 0)
+		weston_wm_window_properties_ready(window);
+}
+
+static void
+weston_wm_window_property_changed_reply(struct weston_wm *wm, void *data,
+					struct weston_wm_window *window,
+					xcb_atom_t atom)
+{
+#ifdef WM_DEBUG
+	wm_log("XCB_PROPERTY_NOTIFY: window %d, ", window ? window->id : 0);
+	dump_property(wm, atom, data);
+#endif
+
+	if (window)
+		weston_wm_window_apply_property(window, atom, data);
+	free(data);
+
+	if (window == NULL)
+		return;
+
+	if (atom == wm->atom.net_wm_name || atom == XCB_ATOM_WM_NAME)
+		weston_wm_window_invalidate_title(window);
+
+	if (atom == wm->atom.net_wm_name || atom == XCB_ATOM_WM_NAME ||
+	    atom == wm->atom.motif_wm_hints)
+		weston_wm_window_schedule_repaint(window);
+
+	if (window->pending_replies == 0)
+		weston_wm_window_properties_ready(window);
+}
+
+static void
+weston_wm_window_read_property(struct weston_wm_window *window,
+			       xcb_atom_t atom, weston_wm_reply_func_t func)
+{
+	struct weston_wm *wm = window->wm;
+	xcb_get_property_cookie_t cookie;
+
+	cookie = xcb_get_property(wm->conn,
+				  0, /* delete */
+				  window->id,
+				  atom,
+				  XCB_ATOM_ANY, 0, 2048);
+	weston_wm_expect_reply(wm, cookie.sequence, func, window, atom);
+}
+
+static void
+weston_wm_window_read_properties(struct weston_wm_window *window)
+{
+	xcb_atom_t atom;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_LENGTH(window_props); i++) {
+		atom = window_property_atom(window->wm, &window_props[i]);
+		weston_wm_window_read_property(window, atom,
+					       weston_wm_window_property_reply);
 	}
 }
 
@@ -734,8 +979,6 @@ weston_wm_handle_map_request(struct weston_wm *wm, xcb_generic_event_t *event)
 	xcb_map_request_event_t *map_request =
 		(xcb_map_request_event_t *) event;
 	struct weston_wm_window *window;
-	uint32_t values[3];
-	int x, y, width, height;
 
 	if (our_resource(wm, map_request->window)) {
 		wm_log("XCB_MAP_REQUEST (window %d, ours)\n",
@@ -745,10 +988,27 @@ weston_wm_handle_map_request(struct weston_wm *wm, xcb_generic_event_t *event)
 
 	window = hash_table_lookup(wm->window_hash, map_request->window);
 
-	if (window->frame_id)
+	if (window->frame_id || window->map_pending)
 		return;
 
-	weston_wm_window_read_properties(window);
+	/* The frame depends on the window properties, so wait for the
+	 * reads still in flight. */
+	if (window->pending_replies > 0) {
+		wm_log("XCB_MAP_REQUEST (window %d, waiting for properties)\n",
+		       window->id);
+		window->map_pending = 1;
+		return;
+	}
+
+	weston_wm_window_map(window);
+}
+
+static void
+weston_wm_window_map(struct weston_wm_window *window)
+{
+	struct weston_wm *wm = window->wm;
+	uint32_t values[3];
+	int x, y, width, height;
 
 	weston_wm_window_get_frame_size(window, &width, &height);
 	weston_wm_window_get_child_position(window, &x, &y);
@@ -792,7 +1052,7 @@ weston_wm_handle_map_request(struct weston_wm *wm, xcb_generic_event_t *event)
 	weston_wm_window_set_wm_state(window, ICCCM_NORMAL_STATE);
 	weston_wm_window_set_net_wm_state(window);
 
-	xcb_map_window(wm->conn, map_request->window);
+	xcb_map_window(wm->conn, window->id);
 	xcb_map_window(wm->conn, window->frame_id);
 
 	window->cairo_surface =
@@ -801,6 +1061,7 @@ weston_wm_handle_map_request(struct weston_wm *wm, xcb_generic_event_t *event)
 							     window->frame_id,
 							     &wm->format_rgba,
 							     width, height);
+	window->drawn_mode = FRAME_MODE_NONE;
 
 	hash_table_insert(wm->window_hash, window->frame_id, window);
 }
@@ -840,10 +1101,13 @@ weston_wm_handle_unmap_notify(struct weston_wm *wm, xcb_generic_event_t *event)
 		return;
 
 	window = hash_table_lookup(wm->window_hash, unmap_notify->window);
+	window->map_pending = 0;
+	window->shell_map_pending = 0;
 	if (window->repaint_source)
 		wl_event_source_remove(window->repaint_source);
 	if (window->cairo_surface)
 		cairo_surface_destroy(window->cairo_surface);
+	weston_wm_window_invalidate_title(window);
 
 	if (window->frame_id) {
 		xcb_reparent_window(wm->conn, window->id, wm->wm_window, 0, 0);
@@ -860,51 +1124,188 @@ weston_wm_handle_unmap_notify(struct weston_wm *wm, xcb_generic_event_t *event)
 	window->surface = NULL;
 }
 
+static cairo_surface_t *
+copy_to_similar(cairo_surface_t *target, cairo_surface_t *image)
+{
+	cairo_surface_t *surface;
+	cairo_t *cr;
+
+	surface = cairo_surface_create_similar(target,
+					       CAIRO_CONTENT_COLOR_ALPHA,
+					       cairo_image_surface_get_width(image),
+					       cairo_image_surface_get_height(image));
+	cr = cairo_create(surface);
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(cr, image, 0, 0);
+	cairo_paint(cr);
+	cairo_destroy(cr);
+
+	return surface;
+}
+
+/* The theme with its frame and shadow images uploaded to the X server
+ * once, so frames are tiled from server side pictures instead of
+ * uploading the images on every repaint. */
+static struct theme *
+weston_wm_get_frame_theme(struct weston_wm *wm, cairo_surface_t *target)
+{
+	struct theme *t;
+
+	if (wm->frame_theme)
+		return wm->frame_theme;
+
+	t = malloc(sizeof *t);
+	if (t == NULL)
+		return wm->theme;
+
+	*t = *wm->theme;
+	t->active_frame = copy_to_similar(target, wm->theme->active_frame);
+	t->inactive_frame = copy_to_similar(target, wm->theme->inactive_frame);
+	t->shadow = copy_to_similar(target, wm->theme->shadow);
+	wm->frame_theme = t;
+
+	return t;
+}
+
+static void
+weston_wm_destroy_frame_theme(struct weston_wm *wm)
+{
+	struct theme *t = wm->frame_theme;
+
+	if (t == NULL)
+		return;
+
+	cairo_surface_destroy(t->active_frame);
+	cairo_surface_destroy(t->inactive_frame);
+	cairo_surface_destroy(t->shadow);
+	free(t);
+	wm->frame_theme = NULL;
+}
+
+/* The title text is rendered once per title, width and focus state and
+ * then composited over the title bar. */
+static cairo_surface_t *
+weston_wm_window_get_title(struct weston_wm_window *window, struct theme *t,
+			   int width, uint32_t flags)
+{
+	int active = (flags & THEME_FRAME_ACTIVE) ? 1 : 0;
+	int title_width, title_height;
+	const char *title;
+	cairo_surface_t *surface;
+	cairo_t *cr;
+
+	if (window->title_width != width) {
+		weston_wm_window_invalidate_title(window);
+		window->title_width = width;
+	}
+
+	if (window->title_surface[active])
+		return window->title_surface[active];
+
+	title_width = width - (t->margin + t->width) * 2;
+	title_height = t->titlebar_height - t->width;
+	if (title_width <= 0 || title_height <= 0)
+		return NULL;
+
+	if (window->name)
+		title = window->name;
+	else
+		title = "untitled";
+
+	surface = cairo_surface_create_similar(window->cairo_surface,
+					       CAIRO_CONTENT_COLOR_ALPHA,
+					       title_width, title_height);
+	cr = cairo_create(surface);
+	cairo_translate(cr, -(t->margin + t->width), -t->margin);
+	theme_render_title(t, cr, width, title, flags);
+	cairo_destroy(cr);
+
+	window->title_surface[active] = surface;
+
+	return surface;
+}
+
 static void
 weston_wm_window_draw_decoration(void *data)
 {
 	struct weston_wm_window *window = data;
 	struct weston_wm *wm = window->wm;
 	struct theme *t = wm->theme;
+	cairo_surface_t *title;
 	cairo_t *cr;
-	int x, y, width, height;
-	const char *title;
+	int x, y, width, height, mode;
 	uint32_t flags = 0;
 
-	weston_wm_window_read_properties(window);
-
 	window->repaint_source = NULL;
 
 	weston_wm_window_get_frame_size(window, &width, &height);
 	weston_wm_window_get_child_position(window, &x, &y);
 
-	cairo_xcb_surface_set_size(window->cairo_surface, width, height);
-	cr = cairo_create(window->cairo_surface);
+	if (window->fullscreen)
+		mode = FRAME_MODE_FULLSCREEN;
+	else if (window->decorate)
+		mode = FRAME_MODE_DECORATED;
+	else
+		mode = FRAME_MODE_SHADOW;
 
-	if (window->fullscreen) {
-		/* nothing */
-	} else if (window->decorate) {
-		if (wm->focus_window == window)
-			flags |= THEME_FRAME_ACTIVE;
+	if (wm->focus_window == window)
+		flags |= THEME_FRAME_ACTIVE;
+
+	if (mode != window->drawn_mode ||
+	    width != window->drawn_width || height != window->drawn_height) {
+		/* Size or kind of frame changed, repaint all of it. */
+		cairo_xcb_surface_set_size(window->cairo_surface,
+					   width, height);
+		cr = cairo_create(window->cairo_surface);
+	} else if (mode == FRAME_MODE_DECORATED &&
+		   (flags != window->drawn_flags || window->title_dirty)) {
+		/* Focus or title changed, only the title bar needs
+		 * repainting and only that region gets damaged. */
+		cr = cairo_create(window->cairo_surface);
+		cairo_rectangle(cr, t->margin, t->margin,
+				width - t->margin * 2, t->titlebar_height);
+		cairo_clip(cr);
+	} else {
+		cr = NULL;
+	}
 
-		if (window->name)
-			title = window->name;
-		else
-			title = "untitled";
+	if (cr) {
+		t = weston_wm_get_frame_theme(wm, window->cairo_surface);
+
+		if (mode == FRAME_MODE_FULLSCREEN) {
+			/* nothing */
+		} else if (mode == FRAME_MODE_DECORATED) {
+			theme_render_frame(t, cr, width, height, NULL, flags);
+
+			title = weston_wm_window_get_title(window, t,
+							   width, flags);
+			if (title) {
+				cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+				cairo_set_source_surface(cr, title,
+							 t->margin + t->width,
+							 t->margin);
+				cairo_paint(cr);
+			}
+		} else {
+			cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+			cairo_set_source_rgba(cr, 0, 0, 0, 0);
+			cairo_paint(cr);
+
+			cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+			cairo_set_source_rgba(cr, 0, 0, 0, 0.45);
+			tile_mask(cr, t->shadow, 2, 2, width + 8, height + 8,
+				  64, 64);
+		}
 
-		theme_render_frame(t, cr, width, height, title, flags);
-	} else {
-		cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
-		cairo_set_source_rgba(cr, 0, 0, 0, 0);
-		cairo_paint(cr);
+		cairo_destroy(cr);
 
-		cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
-		cairo_set_source_rgba(cr, 0, 0, 0, 0.45);
-		tile_mask(cr, t->shadow, 2, 2, width + 8, height + 8, 64, 64);
+		window->drawn_mode = mode;
+		window->drawn_width = width;
+		window->drawn_height = height;
+		window->drawn_flags = flags;
+		window->title_dirty = 0;
 	}
 
-	cairo_destroy(cr);
-
 	if (window->surface) {
 		pixman_region32_fini(&window->surface->pending.opaque);
 		if(window->has_alpha) {
@@ -971,18 +1372,52 @@ weston_wm_handle_property_notify(struct weston_wm *wm, xcb_generic_event_t *even
 	if (!window)
 		return;
 
-	window->properties_dirty = 1;
+	/* Only properties we track are read back; the new value is
+	 * applied when the reply comes in. */
+	if (!weston_wm_lookup_window_property(wm, property_notify->atom)) {
+#ifdef WM_DEBUG
+		weston_wm_window_read_property(window, property_notify->atom,
+					       weston_wm_window_property_changed_reply);
+#endif
+		return;
+	}
 
-	wm_log("XCB_PROPERTY_NOTIFY: window %d, ", property_notify->window);
-	if (property_notify->state == XCB_PROPERTY_DELETE)
-		wm_log("deleted\n");
-	else
-		read_and_dump_property(wm, property_notify->window,
-				       property_notify->atom);
+	weston_wm_window_read_property(window, property_notify->atom,
+				       weston_wm_window_property_changed_reply);
+}
 
-	if (property_notify->atom == wm->atom.net_wm_name ||
-	    property_notify->atom == XCB_ATOM_WM_NAME)
-		weston_wm_window_schedule_repaint(window);
+static void
+weston_wm_window_properties_ready(struct weston_wm_window *window)
+{
+	if (window->map_pending) {
+		window->map_pending = 0;
+		weston_wm_window_map(window);
+	}
+
+	if (window->shell_map_pending) {
+		window->shell_map_pending = 0;
+		if (window->surface)
+			xserver_map_shell_surface(window->wm, window);
+	}
+
+	weston_wm_window_schedule_repaint(window);
+}
+
+static void
+weston_wm_window_geometry_reply(struct weston_wm *wm, void *data,
+				struct weston_wm_window *window,
+				xcb_atom_t atom)
+{
+	xcb_get_geometry_reply_t *geometry_reply = data;
+
+	/* technically we should use XRender and check the visual format's
+	alpha_mask, but checking depth is simpler and works in all known cases */
+	if(window && geometry_reply != NULL)
+		window->has_alpha = geometry_reply->depth == 32;
+	free(geometry_reply);
+
+	if (window && window->pending_replies == 0)
+		weston_wm_window_properties_ready(window);
 }
 
 static void
@@ -992,7 +1427,6 @@ weston_wm_window_create(struct weston_wm *wm,
 	struct weston_wm_window *window;
 	uint32_t values[1];
 	xcb_get_geometry_cookie_t geometry_cookie;
-	xcb_get_geometry_reply_t *geometry_reply;
 
 	window = zalloc(sizeof *window);
 	if (window == NULL) {
@@ -1000,24 +1434,22 @@ weston_wm_window_create(struct weston_wm *wm,
 		return;
 	}
 
-	geometry_cookie = xcb_get_geometry(wm->conn, id);
-
-	values[0] = XCB_EVENT_MASK_PROPERTY_CHANGE;
-	xcb_change_window_attributes(wm->conn, id, XCB_CW_EVENT_MASK, values);
-
 	window->wm = wm;
 	window->id = id;
-	window->properties_dirty = 1;
 	window->override_redirect = override;
+	window->decorate = !override;
 	window->width = width;
 	window->height = height;
 
-	geometry_reply = xcb_get_geometry_reply(wm->conn, geometry_cookie, NULL);
-	/* technically we should use XRender and check the visual format's
-	alpha_mask, but checking depth is simpler and works in all known cases */
-	if(geometry_reply != NULL)
-		window->has_alpha = geometry_reply->depth == 32;
-	free(geometry_reply);
+	geometry_cookie = xcb_get_geometry(wm->conn, id);
+	weston_wm_expect_reply(wm, geometry_cookie.sequence,
+			       weston_wm_window_geometry_reply, window, 0);
+
+	/* Select for property changes before reading the properties, so
+	 * no change can fall in between. */
+	values[0] = XCB_EVENT_MASK_PROPERTY_CHANGE;
+	xcb_change_window_attributes(wm->conn, id, XCB_CW_EVENT_MASK, values);
+	weston_wm_window_read_properties(window);
 
 	hash_table_insert(wm->window_hash, id, window);
 }
@@ -1025,6 +1457,9 @@ weston_wm_window_create(struct weston_wm *wm,
 static void
 weston_wm_window_destroy(struct weston_wm_window *window)
 {
+	if (window->pending_replies > 0)
+		weston_wm_cancel_replies(window->wm, window);
+	weston_wm_window_invalidate_title(window);
 	hash_table_remove(window->wm->window_hash, window->id);
 	free(window);
 }
@@ -1216,14 +1651,16 @@ weston_wm_handle_client_message(struct weston_wm *wm,
 
 	window = hash_table_lookup(wm->window_hash, client_message->window);
 
+#ifdef WM_DEBUG
 	wm_log("XCB_CLIENT_MESSAGE (%s %d %d %d %d %d win %d)\n",
-	       get_atom_name(wm->conn, client_message->type),
+	       get_atom_name(wm, client_message->type),
 	       client_message->data.data32[0],
 	       client_message->data.data32[1],
 	       client_message->data.data32[2],
 	       client_message->data.data32[3],
 	       client_message->data.data32[4],
 	       client_message->window);
+#endif
 
 	if (client_message->type == wm->atom.net_wm_moveresize)
 		weston_wm_window_handle_moveresize(window, client_message);
@@ -1489,6 +1926,8 @@ weston_wm_handle_event(int fd, uint32_t mask, void *data)
 		count++;
 	}
 
+	count += weston_wm_dispatch_replies(wm);
+
 	xcb_flush(wm->conn);
 
 	return count;
@@ -1604,6 +2043,9 @@ weston_wm_get_resources(struct weston_wm *wm)
 	for (i = 0; i < ARRAY_LENGTH(atoms); i++) {
 		reply = xcb_intern_atom_reply (wm->conn, cookies[i], NULL);
 		*(xcb_atom_t *) ((char *) wm + atoms[i].offset) = reply->atom;
+		if (!hash_table_lookup(wm->atom_names, reply->atom))
+			weston_wm_add_atom_name(wm, reply->atom, atoms[i].name,
+						strlen(atoms[i].name));
 		free(reply);
 	}
 
@@ -1709,14 +2151,23 @@ weston_wm_create(struct weston_xserver *wxs)
 		return NULL;
 
 	wm->server = wxs;
+	wl_list_init(&wm->pending_replies);
 	wm->window_hash = hash_table_create();
 	if (wm->window_hash == NULL) {
 		free(wm);
 		return NULL;
 	}
 
+	wm->atom_names = hash_table_create();
+	if (wm->atom_names == NULL) {
+		hash_table_destroy(wm->window_hash);
+		free(wm);
+		return NULL;
+	}
+
 	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
 		weston_log("socketpair failed\n");
+		hash_table_destroy(wm->atom_names);
 		hash_table_destroy(wm->window_hash);
 		free(wm);
 		return NULL;
@@ -1731,6 +2182,7 @@ weston_wm_create(struct weston_xserver *wxs)
 	if (xcb_connection_has_error(wm->conn)) {
 		weston_log("xcb_connect_to_fd failed\n");
 		close(sv[0]);
+		hash_table_destroy(wm->atom_names);
 		hash_table_destroy(wm->window_hash);
 		free(wm);
 		return NULL;
@@ -1797,7 +2249,12 @@ weston_wm_destroy(struct weston_wm *wm)
 {
 	/* FIXME: Free windows in hash. */
 	hash_table_destroy(wm->window_hash);
+	hash_table_for_each(wm->atom_names, free_atom_name, NULL);
+	hash_table_destroy(wm->atom_names);
 	weston_wm_destroy_cursors(wm);
+	weston_wm_destroy_frame_theme(wm);
+	weston_wm_selection_destroy(wm);
+	weston_wm_release_replies(wm);
 	xcb_disconnect(wm->conn);
 	wl_event_source_remove(wm->source);
 	wl_list_remove(&wm->selection_listener.link);
@@ -1963,15 +2420,18 @@ xserver_set_window_id(struct wl_client *client, struct wl_resource *resource,
 
 	wm_log("set_window_id %d for surface %p\n", id, surface);
 
-	weston_wm_window_read_properties(window);
-
 	window->surface = (struct weston_surface *) surface;
 	window->surface_destroy_listener.notify = surface_destroy;
 	wl_signal_add(&surface->destroy_signal,
 		      &window->surface_destroy_listener);
 
 	weston_wm_window_schedule_repaint(window);
-	xserver_map_shell_surface(wm, window);
+
+	/* How the shell surface is set up depends on the properties. */
+	if (window->pending_replies > 0)
+		window->shell_map_pending = 1;
+	else
+		xserver_map_shell_surface(wm, window);
 }
 
 const struct xserver_interface xserver_implementation = {
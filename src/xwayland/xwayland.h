@@ -50,10 +50,13 @@ struct weston_wm {
 	struct wl_event_source *source;
 	xcb_screen_t *screen;
 	struct hash_table *window_hash;
+	struct hash_table *atom_names;
+	struct wl_list pending_replies;
 	struct weston_xserver *server;
 	xcb_window_t wm_window;
 	struct weston_wm_window *focus_window;
 	struct theme *theme;
+	struct theme *frame_theme;
 	xcb_cursor_t *cursors;
 	int last_cursor;
 	xcb_render_pictforminfo_t format_rgb, format_rgba;
@@ -65,17 +68,29 @@ struct weston_wm {
 
 	xcb_window_t selection_window;
 	xcb_window_t selection_owner;
-	int incr;
-	int data_source_fd;
+	uint32_t selection_buffer_size;
+
+	/* X selection being copied to a Wayland client */
+	int property_fd;
 	struct wl_event_source *property_source;
 	xcb_get_property_reply_t *property_reply;
 	int property_start;
+	uint32_t property_offset;
+	int property_incr;
+	struct wl_array property_queue; /* fds waiting for their turn */
+
+	/* Wayland selection being copied to an X client */
+	int incr;
+	int data_source_fd;
+	struct wl_event_source *data_source_event;
 	struct wl_array source_data;
 	xcb_selection_request_event_t selection_request;
 	xcb_atom_t selection_target;
 	xcb_timestamp_t selection_timestamp;
 	int selection_property_set;
 	int flush_property_on_delete;
+	xcb_window_t selection_watched;	/* requestor we asked events of */
+	struct weston_timer selection_transfer_timer;
 	struct wl_listener selection_listener;
 
 	struct {
@@ -127,15 +142,28 @@ struct weston_wm {
 	} atom;
 };
 
+struct weston_wm_window;
+
+typedef void (*weston_wm_reply_func_t)(struct weston_wm *wm, void *reply,
+				       struct weston_wm_window *window,
+				       xcb_atom_t atom);
+
+void
+weston_wm_expect_reply(struct weston_wm *wm, unsigned int sequence,
+		       weston_wm_reply_func_t func,
+		       struct weston_wm_window *window, xcb_atom_t atom);
+
 void
 dump_property(struct weston_wm *wm, xcb_atom_t property,
 	      xcb_get_property_reply_t *reply);
 
 const char *
-get_atom_name(xcb_connection_t *c, xcb_atom_t atom);
+get_atom_name(struct weston_wm *wm, xcb_atom_t atom);
 
 void
 weston_wm_selection_init(struct weston_wm *wm);
+void
+weston_wm_selection_destroy(struct weston_wm *wm);
 int
 weston_wm_handle_selection_event(struct weston_wm *wm,
 				 xcb_generic_event_t *event);
@@ -0,0 +1,230 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "../src/compositor.h"
+
+/* Offers a selection larger than the clipboard manager keeps, lets
+ * the offering source go away while the clipboard is still reading it,
+ * and pastes from the clipboard's copy.  The writer must get rid of
+ * every byte without running into a closed pipe, the paste must get
+ * the whole selection even though the copy is dropped halfway, and no
+ * copy may be left as the selection afterwards. */
+
+#define MIME_TYPE		"text/plain;charset=utf-8"
+#define DEFAULT_LIMIT		(64 * 1024)	/* KiB, as in clipboard.c */
+#define EXTRA			(4 * 1024 * 1024)
+
+struct clipboard_test {
+	struct weston_compositor *compositor;
+	struct weston_seat seat;
+	struct weston_data_source source;
+	struct wl_event_source *writer, *reader;
+	off_t total, written, received;
+};
+
+static char
+pattern_byte(off_t offset)
+{
+	return 'a' + offset % 26;
+}
+
+static void
+clipboard_test_finish(struct clipboard_test *test)
+{
+	fprintf(stderr, "wrote %lld bytes, pasted %lld bytes\n",
+		(long long) test->written, (long long) test->received);
+
+	assert(test->written == test->total);
+	assert(test->received == test->total);
+
+	/* The copy went away when it closed the paste, and wasn't put
+	 * back as the selection. */
+	assert(test->seat.selection_data_source == NULL);
+
+	weston_seat_release(&test->seat);
+	wl_display_terminate(test->compositor->wl_display);
+	free(test);
+}
+
+static int
+clipboard_test_read(int fd, uint32_t mask, void *data)
+{
+	struct clipboard_test *test = data;
+	char buffer[65536];
+	ssize_t i, len;
+
+	len = read(fd, buffer, sizeof buffer);
+	if (len < 0) {
+		assert(errno == EAGAIN);
+		return 1;
+	}
+
+	for (i = 0; i < len; i++)
+		assert(buffer[i] == pattern_byte(test->received + i));
+	test->received += len;
+
+	if (len == 0) {
+		wl_event_source_remove(test->reader);
+		close(fd);
+		clipboard_test_finish(test);
+	}
+
+	return 1;
+}
+
+static int
+clipboard_test_write(int fd, uint32_t mask, void *data)
+{
+	struct clipboard_test *test = data;
+	char buffer[65536];
+	off_t i, length;
+	ssize_t len;
+
+	length = test->total - test->written;
+	if (length > (off_t) sizeof buffer)
+		length = sizeof buffer;
+	for (i = 0; i < length; i++)
+		buffer[i] = pattern_byte(test->written + i);
+
+	/* SIGPIPE is ignored, a closed reader shows up as EPIPE. */
+	len = write(fd, buffer, length);
+	if (len < 0) {
+		assert(errno == EAGAIN);
+		return 1;
+	}
+
+	test->written += len;
+	if (test->written == test->total) {
+		wl_event_source_remove(test->writer);
+		close(fd);
+	}
+
+	return 1;
+}
+
+static void
+source_accept(struct weston_data_source *source,
+	      uint32_t serial, const char *mime_type)
+{
+}
+
+static void
+source_send(struct weston_data_source *source,
+	    const char *mime_type, int32_t fd)
+{
+	struct clipboard_test *test =
+		container_of(source, struct clipboard_test, source);
+	struct wl_event_loop *loop =
+		wl_display_get_event_loop(test->compositor->wl_display);
+
+	/* Only the clipboard manager asks, and only once. */
+	assert(strcmp(mime_type, MIME_TYPE) == 0);
+	assert(test->writer == NULL);
+
+	fcntl(fd, F_SETFL, O_WRONLY | O_NONBLOCK);
+	test->writer = wl_event_loop_add_fd(loop, fd, WL_EVENT_WRITABLE,
+					    clipboard_test_write, test);
+	assert(test->writer);
+}
+
+static void
+source_cancel(struct weston_data_source *source)
+{
+}
+
+static void
+clipboard_test(void *data)
+{
+	struct clipboard_test *test = data;
+	struct weston_compositor *compositor = test->compositor;
+	struct wl_event_loop *loop =
+		wl_display_get_event_loop(compositor->wl_display);
+	struct weston_config_section *section;
+	struct weston_data_source *copy;
+	uint32_t limit;
+	char **p;
+	int fds[2];
+
+	section = weston_config_get_section(compositor->config,
+					    "core", NULL, NULL);
+	weston_config_section_get_uint(section, "clipboard-size-limit",
+				       &limit, DEFAULT_LIMIT);
+	test->total = (off_t) limit * 1024 + EXTRA;
+
+	weston_seat_init(&test->seat, compositor, "clipboard-test");
+
+	test->source.resource = NULL;
+	test->source.accept = source_accept;
+	test->source.send = source_send;
+	test->source.cancel = source_cancel;
+	wl_signal_init(&test->source.destroy_signal);
+	wl_array_init(&test->source.mime_types);
+	p = wl_array_add(&test->source.mime_types, sizeof *p);
+	assert(p);
+	*p = strdup(MIME_TYPE);
+
+	weston_seat_set_selection(&test->seat, &test->source,
+				  wl_display_next_serial(compositor->wl_display));
+	assert(test->writer);
+
+	/* The offering client goes away, the clipboard's copy takes
+	 * over the selection while it is still being read. */
+	wl_signal_emit(&test->source.destroy_signal, &test->source);
+	free(*p);
+	wl_array_release(&test->source.mime_types);
+
+	copy = test->seat.selection_data_source;
+	assert(copy && copy != &test->source);
+
+	assert(pipe2(fds, O_CLOEXEC) == 0);
+	fcntl(fds[0], F_SETFL, O_RDONLY | O_NONBLOCK);
+	copy->send(copy, MIME_TYPE, fds[1]);
+	test->reader = wl_event_loop_add_fd(loop, fds[0], WL_EVENT_READABLE,
+					    clipboard_test_read, test);
+	assert(test->reader);
+}
+
+WL_EXPORT int
+module_init(struct weston_compositor *compositor, int *argc, char *argv[])
+{
+	struct clipboard_test *test;
+	struct wl_event_loop *loop;
+
+	test = zalloc(sizeof *test);
+	if (test == NULL)
+		return -1;
+
+	test->compositor = compositor;
+	loop = wl_display_get_event_loop(compositor->wl_display);
+	wl_event_loop_add_idle(loop, clipboard_test, test);
+
+	return 0;
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <assert.h>
+
+#include "filter.h"
+
+/* Runs motion traces through weston_filter_dispatch(), checks that a
+ * sampled acceleration table reproduces its profile function, and
+ * reports the per-event cost of both.  A recorded trace can be given
+ * as a file of "time_us dx dy" lines. */
+
+struct motion_event {
+	uint64_t time_us;
+	double dx, dy;
+};
+
+struct trace {
+	const char *name;
+	struct motion_event *events;
+	int count;
+};
+
+struct profile_params {
+	double constant;
+	double min;
+	double max;
+};
+
+/* Same shape and clamps as the default touchpad profile.  The table
+ * spans the velocities between the two clamps, so interpolating it is
+ * exact whatever their ratio. */
+static const struct profile_params params = { 0.5, 0.16, 1.0 };
+#define TABLE_SIZE 64
+
+static double
+linear_profile(struct weston_motion_filter *filter, void *data,
+	       double velocity, uint64_t time_us)
+{
+	const struct profile_params *p = data;
+	double factor = velocity * p->constant;
+
+	if (factor > p->max)
+		factor = p->max;
+	else if (factor < p->min)
+		factor = p->min;
+
+	return factor;
+}
+
+static void
+trace_init(struct trace *trace, const char *name, int count)
+{
+	trace->name = name;
+	trace->count = count;
+	trace->events = calloc(count, sizeof *trace->events);
+	assert(trace->events);
+}
+
+/* Motion along a circle at a speed that ramps up and down, sampled at
+ * the given report rate, so velocity and direction both vary. */
+static void
+trace_synthetic(struct trace *trace, const char *name, int rate_hz,
+		double seconds)
+{
+	double t, speed, angle;
+	int i, count = rate_hz * seconds;
+
+	trace_init(trace, name, count);
+	for (i = 0; i < count; i++) {
+		t = (double) i / rate_hz;
+		speed = 2000.0 * sin(M_PI * t / seconds);
+		angle = 2.0 * M_PI * t;
+		trace->events[i].time_us = 1000000 + i * 1000000ull / rate_hz;
+		trace->events[i].dx = round(cos(angle) * speed / rate_hz);
+		trace->events[i].dy = round(sin(angle) * speed / rate_hz);
+	}
+}
+
+static int
+trace_load(struct trace *trace, const char *path)
+{
+	FILE *fp;
+	unsigned long long time_us;
+	double dx, dy;
+	int count = 0;
+
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return -1;
+
+	trace_init(trace, path, 1024);
+	while (fscanf(fp, "%llu %lf %lf", &time_us, &dx, &dy) == 3) {
+		if (count == trace->count) {
+			trace->count *= 2;
+			trace->events = realloc(trace->events, trace->count *
+						sizeof *trace->events);
+			assert(trace->events);
+		}
+		trace->events[count].time_us = time_us;
+		trace->events[count].dx = dx;
+		trace->events[count].dy = dy;
+		count++;
+	}
+	fclose(fp);
+	trace->count = count;
+
+	return 0;
+}
+
+static struct weston_motion_filter *
+create_filter(int use_table)
+{
+	struct weston_motion_filter *filter;
+	int ret;
+
+	filter = create_pointer_accelator_filter(linear_profile);
+	assert(filter);
+	if (use_table) {
+		ret = pointer_accelerator_sample_profile(filter,
+							 (void *) &params,
+							 params.min /
+							 params.constant,
+							 params.max /
+							 params.constant,
+							 TABLE_SIZE);
+		assert(ret == 0);
+	}
+
+	return filter;
+}
+
+static double
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double
+run_trace(const struct trace *trace, int use_table,
+	  struct weston_motion_params *out)
+{
+	struct weston_motion_filter *filter = create_filter(use_table);
+	double start;
+	int i;
+
+	start = now_ns();
+	for (i = 0; i < trace->count; i++) {
+		out[i].dx = trace->events[i].dx;
+		out[i].dy = trace->events[i].dy;
+		weston_filter_dispatch(filter, &out[i], (void *) &params,
+				       trace->events[i].time_us);
+	}
+
+	filter->interface->destroy(filter);
+
+	return (now_ns() - start) / trace->count;
+}
+
+static void
+test_trace(const struct trace *trace)
+{
+	struct weston_motion_params *func, *table;
+	double func_ns, table_ns;
+	int i;
+
+	func = calloc(trace->count, sizeof *func);
+	table = calloc(trace->count, sizeof *table);
+	assert(func && table);
+
+	func_ns = run_trace(trace, 0, func);
+	table_ns = run_trace(trace, 1, table);
+
+	for (i = 0; i < trace->count; i++) {
+		assert(fabs(func[i].dx - table[i].dx) < 1e-6);
+		assert(fabs(func[i].dy - table[i].dy) < 1e-6);
+	}
+
+	printf("%s: %d events, %.0f ns/event with profile function, "
+	       "%.0f ns/event with table\n",
+	       trace->name, trace->count, func_ns, table_ns);
+
+	free(func);
+	free(table);
+}
+
+static void
+test_constant_table(void)
+{
+	static const double factor[] = { 2.0 };
+	struct weston_motion_filter *filter;
+	struct weston_motion_params motion;
+	int i, ret;
+
+	filter = create_pointer_accelator_filter(linear_profile);
+	assert(filter);
+	ret = pointer_accelerator_set_table(filter, factor, 0, 1.0);
+	assert(ret < 0);
+	ret = pointer_accelerator_set_table(filter, factor, 1, 0.0);
+	assert(ret < 0);
+	ret = pointer_accelerator_set_table(filter, factor, 1, 1.0);
+	assert(ret == 0);
+
+	/* Softening moves each delta by at most half a unit. */
+	for (i = 0; i < 100; i++) {
+		motion.dx = i % 7;
+		motion.dy = -(i % 5);
+		weston_filter_dispatch(filter, &motion, NULL,
+				       1000000 + i * 8000);
+		assert(fabs(motion.dx - 2.0 * (i % 7)) <= 0.5);
+		assert(fabs(motion.dy + 2.0 * (i % 5)) <= 0.5);
+	}
+
+	filter->interface->destroy(filter);
+}
+
+int main(int argc, char *argv[])
+{
+	struct trace trace;
+	int i;
+
+	test_constant_table();
+
+	trace_synthetic(&trace, "125 Hz", 125, 4.0);
+	test_trace(&trace);
+	free(trace.events);
+
+	trace_synthetic(&trace, "1000 Hz", 1000, 4.0);
+	test_trace(&trace);
+	free(trace.events);
+
+	for (i = 1; i < argc; i++) {
+		if (trace_load(&trace, argv[i]) < 0) {
+			fprintf(stderr, "failed to load %s\n", argv[i]);
+			return 1;
+		}
+		test_trace(&trace);
+		free(trace.events);
+	}
+
+	return 0;
+}
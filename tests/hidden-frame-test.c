@@ -0,0 +1,273 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <assert.h>
+
+#include "../src/compositor.h"
+
+/* Covers a surface with an opaque one and keeps the output repainting.
+ * The frame callbacks of the covered surface must go out once, right
+ * away, then no sooner than the hidden frame interval and not much
+ * later, however many frames are drawn meanwhile.  Uncovering the
+ * surface must release its held callback with the next repaint. */
+
+#define INTERVAL	250	/* ms, a hidden-frame-rate of 4 */
+#define TICK		16	/* ms between repaints we ask for */
+#define POLL		5	/* ms */
+#define MAX_LATENESS	100	/* ms */
+#define UNCOVER_DELAY	100	/* ms into the interval */
+
+enum phase {
+	PHASE_FIRST,		/* the first callback goes out at once */
+	PHASE_THROTTLED,	/* the next one waits for the interval */
+	PHASE_UNCOVER,		/* the one after that, until uncovered */
+	PHASE_RELEASED
+};
+
+struct test_callback {
+	struct weston_frame_callback base;
+	struct hidden_frame_test *test;
+};
+
+struct hidden_frame_test {
+	struct weston_compositor *compositor;
+	struct weston_output *output;
+	struct weston_layer layer;
+	struct weston_surface *hidden, *occluder;
+	struct wl_client *client;
+	int client_fd;
+	struct wl_event_source *ticker, *poller;
+	struct wl_listener frame_listener;
+
+	enum phase phase;
+	int released;
+	uint32_t release_time, phase_start;
+	int frames;
+};
+
+static void
+test_callback_destroy(struct wl_resource *resource)
+{
+	struct test_callback *cb = wl_resource_get_user_data(resource);
+	struct hidden_frame_test *test = cb->test;
+
+	test->released++;
+	test->release_time = weston_compositor_get_time();
+	wl_list_remove(&cb->base.link);
+	free(cb);
+}
+
+static void
+add_callback(struct hidden_frame_test *test)
+{
+	struct test_callback *cb;
+
+	cb = malloc(sizeof *cb);
+	assert(cb);
+	cb->test = test;
+	cb->base.resource = wl_resource_create(test->client,
+					       &wl_callback_interface, 1, 0);
+	assert(cb->base.resource);
+	wl_resource_set_implementation(cb->base.resource, NULL, cb,
+				       test_callback_destroy);
+	wl_list_insert(test->hidden->frame_callback_list.prev,
+		       &cb->base.link);
+
+	test->released = 0;
+	test->phase_start = weston_compositor_get_time();
+	test->frames = 0;
+}
+
+static void
+handle_frame(struct wl_listener *listener, void *data)
+{
+	struct hidden_frame_test *test =
+		container_of(listener, struct hidden_frame_test,
+			     frame_listener);
+
+	test->frames++;
+}
+
+static int
+ticker_func(void *data)
+{
+	struct hidden_frame_test *test = data;
+
+	weston_surface_damage(test->occluder);
+	wl_event_source_timer_update(test->ticker, TICK);
+
+	return 1;
+}
+
+static void
+hidden_frame_test_finish(struct hidden_frame_test *test)
+{
+	wl_event_source_remove(test->ticker);
+	wl_event_source_remove(test->poller);
+	wl_list_remove(&test->frame_listener.link);
+
+	wl_list_remove(&test->hidden->layer_link);
+	wl_list_remove(&test->occluder->layer_link);
+	wl_list_remove(&test->layer.link);
+	weston_surface_destroy(test->hidden);
+	weston_surface_destroy(test->occluder);
+
+	wl_client_destroy(test->client);
+	close(test->client_fd);
+
+	wl_display_terminate(test->compositor->wl_display);
+	free(test);
+}
+
+static int
+poller_func(void *data)
+{
+	struct hidden_frame_test *test = data;
+	uint32_t now = weston_compositor_get_time();
+	uint32_t elapsed = now - test->phase_start;
+
+	switch (test->phase) {
+	case PHASE_FIRST:
+		assert(elapsed < MAX_LATENESS);
+		if (test->released) {
+			test->phase = PHASE_THROTTLED;
+			add_callback(test);
+		}
+		break;
+	case PHASE_THROTTLED:
+		if (!test->released) {
+			assert(elapsed < INTERVAL + MAX_LATENESS);
+			break;
+		}
+
+		elapsed = test->release_time - test->phase_start;
+		fprintf(stderr, "throttled callback after %u ms, "
+			"%d frames drawn meanwhile\n", elapsed, test->frames);
+		assert(elapsed + 1 >= INTERVAL);
+		assert(test->frames > 1);
+
+		test->phase = PHASE_UNCOVER;
+		add_callback(test);
+		break;
+	case PHASE_UNCOVER:
+		if (elapsed < UNCOVER_DELAY)
+			break;
+		assert(!test->released);
+
+		weston_surface_set_position(test->occluder,
+					    test->output->x + 200,
+					    test->output->y + 200);
+		weston_surface_damage(test->occluder);
+		test->phase = PHASE_RELEASED;
+		test->phase_start = now;
+		break;
+	case PHASE_RELEASED:
+		if (!test->released) {
+			assert(elapsed < MAX_LATENESS);
+			break;
+		}
+
+		fprintf(stderr, "uncovered callback after %u ms\n",
+			test->release_time - test->phase_start);
+		hidden_frame_test_finish(test);
+		return 1;
+	}
+
+	wl_event_source_timer_update(test->poller, POLL);
+
+	return 1;
+}
+
+static struct weston_surface *
+create_surface(struct hidden_frame_test *test, int x, int y, int size)
+{
+	struct weston_surface *surface;
+
+	surface = weston_surface_create(test->compositor);
+	assert(surface);
+	weston_surface_configure(surface, test->output->x + x,
+				 test->output->y + y, size, size);
+	weston_surface_set_color(surface, 0.0, 0.0, 0.0, 1.0);
+	pixman_region32_fini(&surface->opaque);
+	pixman_region32_init_rect(&surface->opaque, 0, 0, size, size);
+
+	/* The top of the layer is its first surface. */
+	wl_list_insert(&test->layer.surface_list, &surface->layer_link);
+
+	return surface;
+}
+
+static void
+hidden_frame_test(void *data)
+{
+	struct hidden_frame_test *test = data;
+	struct weston_compositor *compositor = test->compositor;
+	struct wl_event_loop *loop =
+		wl_display_get_event_loop(compositor->wl_display);
+	int fds[2];
+
+	test->output = container_of(compositor->output_list.next,
+				    struct weston_output, link);
+	test->frame_listener.notify = handle_frame;
+	wl_signal_add(&test->output->frame_signal, &test->frame_listener);
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0);
+	test->client = wl_client_create(compositor->wl_display, fds[0]);
+	assert(test->client);
+	test->client_fd = fds[1];
+
+	weston_layer_init(&test->layer, &compositor->cursor_layer.link);
+	test->hidden = create_surface(test, 10, 10, 50);
+	test->occluder = create_surface(test, 0, 0, 100);
+
+	test->phase = PHASE_FIRST;
+	add_callback(test);
+
+	test->ticker = wl_event_loop_add_timer(loop, ticker_func, test);
+	test->poller = wl_event_loop_add_timer(loop, poller_func, test);
+	assert(test->ticker && test->poller);
+	ticker_func(test);
+	wl_event_source_timer_update(test->poller, POLL);
+}
+
+WL_EXPORT int
+module_init(struct weston_compositor *compositor, int *argc, char *argv[])
+{
+	struct hidden_frame_test *test;
+	struct wl_event_loop *loop;
+
+	test = zalloc(sizeof *test);
+	if (test == NULL)
+		return -1;
+
+	test->compositor = compositor;
+	compositor->hidden_frame_interval = INTERVAL;
+	loop = wl_display_get_event_loop(compositor->wl_display);
+	wl_event_loop_add_idle(loop, hidden_frame_test, test);
+
+	return 0;
+}
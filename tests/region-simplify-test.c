@@ -0,0 +1,241 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "region-simplify.h"
+
+#define MAX_BOXES 16
+
+static const struct region_simplify_cost cost = {
+	4,		/* bytes_per_pixel */
+	4096,		/* call_overhead */
+	MAX_BOXES
+};
+
+/* Simplify 'region' and check the result: no more boxes than allowed,
+ * no overlap between boxes, and every damaged pixel covered. Returns
+ * the number of boxes and stores the pixel count in 'area'.
+ */
+static int
+check_simplify(pixman_region32_t *region, const struct region_simplify_cost *c,
+	       int64_t *area)
+{
+	pixman_box32_t boxes[MAX_BOXES];
+	pixman_region32_t covered, missing;
+	int i, j, n;
+
+	n = region_simplify(region, c, boxes);
+	assert(n >= 0 && n <= c->max_boxes);
+
+	pixman_region32_init(&covered);
+	*area = 0;
+	for (i = 0; i < n; i++) {
+		assert(boxes[i].x1 < boxes[i].x2);
+		assert(boxes[i].y1 < boxes[i].y2);
+		for (j = i + 1; j < n; j++)
+			assert(boxes[i].x2 <= boxes[j].x1 ||
+			       boxes[j].x2 <= boxes[i].x1 ||
+			       boxes[i].y2 <= boxes[j].y1 ||
+			       boxes[j].y2 <= boxes[i].y1);
+
+		pixman_region32_union_rect(&covered, &covered,
+					   boxes[i].x1, boxes[i].y1,
+					   boxes[i].x2 - boxes[i].x1,
+					   boxes[i].y2 - boxes[i].y1);
+		*area += (int64_t) (boxes[i].x2 - boxes[i].x1) *
+			(boxes[i].y2 - boxes[i].y1);
+	}
+
+	pixman_region32_init(&missing);
+	pixman_region32_subtract(&missing, region, &covered);
+	assert(!pixman_region32_not_empty(&missing));
+
+	pixman_region32_fini(&missing);
+	pixman_region32_fini(&covered);
+
+	return n;
+}
+
+static void
+test_empty(void)
+{
+	pixman_region32_t region;
+	int64_t area;
+
+	pixman_region32_init(&region);
+	assert(check_simplify(&region, &cost, &area) == 0);
+	assert(area == 0);
+	pixman_region32_fini(&region);
+}
+
+static void
+test_single(void)
+{
+	pixman_region32_t region;
+	int64_t area;
+
+	pixman_region32_init_rect(&region, 10, 20, 300, 200);
+	assert(check_simplify(&region, &cost, &area) == 1);
+	assert(area == 300 * 200);
+	pixman_region32_fini(&region);
+}
+
+/* Two small boxes in opposite corners must not be merged into one
+ * box covering the whole buffer. */
+static void
+test_far_apart(void)
+{
+	pixman_region32_t region;
+	int64_t area;
+
+	pixman_region32_init_rect(&region, 0, 0, 16, 16);
+	pixman_region32_union_rect(&region, &region, 2000, 1000, 16, 16);
+	assert(check_simplify(&region, &cost, &area) == 2);
+	assert(area == 2 * 16 * 16);
+	pixman_region32_fini(&region);
+}
+
+/* A terminal redrawing glyph cells with a one pixel gap between them:
+ * the gaps are cheap, each text line should become a single box. */
+static void
+test_terminal_glyphs(void)
+{
+	pixman_region32_t region;
+	int64_t area;
+	int row, col;
+
+	pixman_region32_init(&region);
+	for (row = 0; row < 4; row++)
+		for (col = 0; col < 80; col++)
+			pixman_region32_union_rect(&region, &region,
+						   col * 9, row * 100,
+						   8, 16);
+
+	assert(pixman_region32_n_rects(&region) == 4 * 80);
+	assert(check_simplify(&region, &cost, &area) == 4);
+	assert(area == 4 * (80 * 9 - 1) * 16);
+	pixman_region32_fini(&region);
+}
+
+/* A dense grid of tiny boxes, far more than the box budget. */
+static void
+test_grid_budget(void)
+{
+	pixman_region32_t region;
+	int64_t area;
+	int x, y;
+
+	pixman_region32_init(&region);
+	for (y = 0; y < 50; y++)
+		for (x = 0; x < 50; x++)
+			pixman_region32_union_rect(&region, &region,
+						   x * 40, y * 40, 4, 4);
+
+	assert(check_simplify(&region, &cost, &area) <= MAX_BOXES);
+	pixman_region32_fini(&region);
+}
+
+/* Without any call overhead, merging is only done to meet the box
+ * budget. */
+static void
+test_no_overhead(void)
+{
+	static const struct region_simplify_cost free_calls = {
+		4, 0, MAX_BOXES
+	};
+	pixman_region32_t region;
+	int64_t area;
+	int i;
+
+	pixman_region32_init(&region);
+	for (i = 0; i < 8; i++)
+		pixman_region32_union_rect(&region, &region,
+					   i * 100, i * 100, 10, 10);
+
+	assert(check_simplify(&region, &free_calls, &area) == 8);
+	assert(area == 8 * 10 * 10);
+	pixman_region32_fini(&region);
+}
+
+/* Merging the first box of the second band into the box above it
+ * grows that box over the next box of the band, which then has to be
+ * merged in too, however much it wastes. */
+static void
+test_grown_overlap(void)
+{
+	static const pixman_box32_t rects[] = {
+		{  48,  0,  91, 19 }, {  95,  0, 126, 19 },
+		{ 201,  0, 225, 19 }, { 282,  0, 302, 19 },
+		{ 336,  0, 356, 19 },
+		{ 182, 19, 210, 24 }, { 216, 19, 276, 24 },
+	};
+	static const struct region_simplify_cost merge_cost = {
+		4, 2428, MAX_BOXES
+	};
+	pixman_region32_t region;
+	int64_t area;
+
+	pixman_region32_init_rects(&region, rects,
+				   sizeof rects / sizeof rects[0]);
+	check_simplify(&region, &merge_cost, &area);
+	pixman_region32_fini(&region);
+}
+
+static void
+test_random(void)
+{
+	pixman_region32_t region;
+	int64_t area;
+	int i, j;
+
+	srandom(4);
+	for (i = 0; i < 100; i++) {
+		pixman_region32_init(&region);
+		for (j = 0; j < 200; j++)
+			pixman_region32_union_rect(&region, &region,
+						   random() % 1920,
+						   random() % 1080,
+						   1 + random() % 64,
+						   1 + random() % 64);
+
+		check_simplify(&region, &cost, &area);
+		pixman_region32_fini(&region);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	test_empty();
+	test_single();
+	test_far_apart();
+	test_terminal_glyphs();
+	test_grid_budget();
+	test_no_overhead();
+	test_grown_overlap();
+	test_random();
+
+	return 0;
+}
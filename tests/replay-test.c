@@ -0,0 +1,267 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "../src/compositor.h"
+#include "../src/evdev.h"
+
+/* Records a mouse through WESTON_INPUT_RECORD, plays the recording
+ * back faster than it was made and checks that every event arrives,
+ * that the replayed timestamps keep their recorded spacing, and that
+ * the replay clock and timeouts handed to the dispatchers run at the
+ * replay speed. */
+
+#define MOTIONS		50
+#define INTERVAL	10000	/* us between recorded reports */
+#define CLICK		50000	/* us between button press and release */
+#define SPEED		10.0
+#define MAX_WAIT	5000	/* ms */
+
+struct counting_grab {
+	struct weston_pointer_grab grab;
+	int motion, button;
+	uint64_t press_time, release_time;
+};
+
+struct replay_test {
+	struct weston_compositor *compositor;
+	struct weston_seat seat;
+	struct counting_grab grab;
+	struct evdev_replay *replay;
+	struct wl_event_source *timer;
+	char path[64];
+	uint64_t start;
+	int waited;
+};
+
+static void
+counting_focus(struct weston_pointer_grab *grab)
+{
+}
+
+static void
+counting_motion(struct weston_pointer_grab *grab, uint64_t time_us)
+{
+	struct counting_grab *c = (struct counting_grab *) grab;
+
+	c->motion++;
+}
+
+static void
+counting_button(struct weston_pointer_grab *grab,
+		uint64_t time_us, uint32_t button, uint32_t state)
+{
+	struct counting_grab *c = (struct counting_grab *) grab;
+
+	assert(button == BTN_LEFT);
+	if (state == WL_POINTER_BUTTON_STATE_PRESSED)
+		c->press_time = time_us;
+	else
+		c->release_time = time_us;
+	c->button++;
+}
+
+static const struct weston_pointer_grab_interface counting_grab_interface = {
+	counting_focus,
+	counting_motion,
+	counting_button
+};
+
+static void
+describe_mouse(struct evdev_device_description *desc)
+{
+	memset(desc, 0, sizeof *desc);
+	snprintf(desc->name, sizeof desc->name, "recorded mouse");
+
+	desc->ev_bits[LONG(EV_KEY)] |= BIT(EV_KEY);
+	desc->ev_bits[LONG(EV_REL)] |= BIT(EV_REL);
+	desc->key_bits[LONG(BTN_LEFT)] |= BIT(BTN_LEFT);
+	desc->rel_bits[LONG(REL_X)] |= BIT(REL_X);
+	desc->rel_bits[LONG(REL_Y)] |= BIT(REL_Y);
+}
+
+static void
+send_report(struct evdev_device *device, uint64_t time_us,
+	    uint16_t type, uint16_t code, int32_t value)
+{
+	struct input_event ev[3];
+	int i, count = 0;
+
+	if (type == EV_REL) {
+		ev[count].type = EV_REL;
+		ev[count].code = REL_X;
+		ev[count++].value = value;
+		ev[count].type = EV_REL;
+		ev[count].code = REL_Y;
+		ev[count++].value = value;
+	} else {
+		ev[count].type = type;
+		ev[count].code = code;
+		ev[count++].value = value;
+	}
+	ev[count].type = EV_SYN;
+	ev[count].code = SYN_REPORT;
+	ev[count++].value = 0;
+
+	for (i = 0; i < count; i++) {
+		ev[i].time.tv_sec = time_us / 1000000;
+		ev[i].time.tv_usec = time_us % 1000000;
+	}
+
+	evdev_process_events(device, ev, count);
+}
+
+static void
+record_mouse(struct replay_test *test)
+{
+	struct evdev_device_description desc;
+	struct evdev_device *device;
+	uint64_t time = 1000000;
+	int i;
+
+	describe_mouse(&desc);
+	device = evdev_device_create_replay(&test->seat, "replay:mouse",
+					    &desc, NULL);
+	assert(device && device != EVDEV_UNHANDLED_DEVICE);
+	assert(device->record_id != 0);
+
+	for (i = 0; i < MOTIONS; i++, time += INTERVAL)
+		send_report(device, time, EV_REL, 0, 1);
+	send_report(device, time, EV_KEY, BTN_LEFT, 1);
+	send_report(device, time + CLICK, EV_KEY, BTN_LEFT, 0);
+
+	/* Removing the device flushes the recording. */
+	evdev_device_destroy(device);
+}
+
+static void
+replay_test_finish(struct replay_test *test)
+{
+	struct counting_grab *grab = &test->grab;
+	uint64_t wall, recorded, now;
+
+	wall = weston_compositor_get_time_usec() - test->start;
+	recorded = MOTIONS * INTERVAL + CLICK;
+	now = evdev_replay_get_time_usec(test->replay);
+
+	fprintf(stderr, "%d motion and %d button events, "
+		"%.1f ms recorded replayed in %.1f ms\n",
+		grab->motion, grab->button, recorded / 1000.0, wall / 1000.0);
+
+	assert(grab->motion == MOTIONS);
+	assert(grab->release_time - grab->press_time == CLICK);
+	assert(wall < recorded);
+
+	/* Timestamps taken by the dispatchers themselves, such as the
+	 * touchpad's timeout handler, must not go back behind the
+	 * replayed events. */
+	assert(now >= grab->release_time);
+
+	weston_pointer_end_grab(test->seat.pointer);
+	evdev_replay_destroy(test->replay);
+	weston_seat_release(&test->seat);
+	wl_event_source_remove(test->timer);
+	unlink(test->path);
+
+	wl_display_terminate(test->compositor->wl_display);
+	free(test);
+}
+
+static int
+replay_test_poll(void *data)
+{
+	struct replay_test *test = data;
+
+	if (test->grab.button == 2) {
+		replay_test_finish(test);
+		return 1;
+	}
+
+	test->waited += 10;
+	assert(test->waited < MAX_WAIT);
+	wl_event_source_timer_update(test->timer, 10);
+
+	return 1;
+}
+
+static void
+replay_test(void *data)
+{
+	struct replay_test *test = data;
+	struct wl_event_loop *loop;
+	int fd;
+
+	snprintf(test->path, sizeof test->path,
+		 "/tmp/weston-replay-test-XXXXXX");
+	fd = mkstemp(test->path);
+	assert(fd >= 0);
+	close(fd);
+
+	/* The recorder opens its file when the first device shows up. */
+	setenv("WESTON_INPUT_RECORD", test->path, 1);
+	weston_seat_init(&test->seat, test->compositor, "replay-test");
+	record_mouse(test);
+	unsetenv("WESTON_INPUT_RECORD");
+
+	assert(test->seat.pointer);
+	memset(&test->grab, 0, sizeof test->grab);
+	test->grab.grab.interface = &counting_grab_interface;
+	weston_pointer_start_grab(test->seat.pointer, &test->grab.grab);
+
+	test->start = weston_compositor_get_time_usec();
+	test->replay = evdev_replay_create(&test->seat, test->path, SPEED);
+	assert(test->replay);
+
+	/* Dispatcher timeouts shrink with the replay speed, but a
+	 * running timer is never rounded down to a disarmed one. */
+	assert(evdev_replay_timeout(test->replay, 180) == 180 / SPEED);
+	assert(evdev_replay_timeout(test->replay, 1) == 1);
+	assert(evdev_replay_timeout(test->replay, 0) == 0);
+
+	loop = wl_display_get_event_loop(test->compositor->wl_display);
+	test->timer = wl_event_loop_add_timer(loop, replay_test_poll, test);
+	assert(test->timer);
+	wl_event_source_timer_update(test->timer, 10);
+}
+
+WL_EXPORT int
+module_init(struct weston_compositor *compositor, int *argc, char *argv[])
+{
+	struct replay_test *test;
+	struct wl_event_loop *loop;
+
+	test = zalloc(sizeof *test);
+	if (test == NULL)
+		return -1;
+
+	test->compositor = compositor;
+	loop = wl_display_get_event_loop(compositor->wl_display);
+	wl_event_loop_add_idle(loop, replay_test, test);
+
+	return 0;
+}
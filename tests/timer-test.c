@@ -0,0 +1,143 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "../src/compositor.h"
+
+/* Arms timers across every level of the compositor's timer wheel and
+ * checks that each fires exactly once, never early and not much late,
+ * that cancelled timers stay quiet and that a timer can re-arm itself
+ * from its own callback. */
+
+#define TIMERS		1000
+#define MAX_DELAY	1000
+#define LONG_DELAY	4500	/* past the second level */
+#define MAX_LATENESS	50
+
+struct test_timer {
+	struct weston_timer timer;
+	struct timer_test *test;
+	uint64_t expire;
+	int fired;
+	int cancelled;
+	int rearm;
+};
+
+struct timer_test {
+	struct weston_compositor *compositor;
+	struct test_timer timers[TIMERS + 1];
+	int remaining;
+	int max_lateness;
+};
+
+static void
+timer_fired(struct weston_timer *timer, void *data)
+{
+	struct test_timer *t = data;
+	struct timer_test *test = t->test;
+	uint64_t now = weston_compositor_get_time_usec() / 1000;
+	int i;
+
+	assert(!weston_timer_is_armed(timer));
+	assert(!t->cancelled);
+	assert(now >= t->expire);
+	if (now - t->expire > (uint64_t) test->max_lateness)
+		test->max_lateness = now - t->expire;
+
+	if (t->rearm) {
+		t->rearm = 0;
+		t->expire = now + 10;
+		weston_timer_arm(test->compositor, timer, 10);
+		return;
+	}
+
+	t->fired++;
+	assert(t->fired == 1);
+	if (--test->remaining > 0)
+		return;
+
+	for (i = 0; i <= TIMERS; i++)
+		assert(test->timers[i].fired == !test->timers[i].cancelled);
+
+	fprintf(stderr, "all timers fired, at most %d ms late\n",
+		test->max_lateness);
+	assert(test->max_lateness < MAX_LATENESS);
+
+	wl_display_terminate(test->compositor->wl_display);
+	free(test);
+}
+
+static void
+timer_test(void *data)
+{
+	struct timer_test *test = data;
+	struct test_timer *t;
+	uint64_t start, end;
+	uint32_t delay;
+	int i;
+
+	srandom(4711);
+	start = weston_compositor_get_time_usec();
+	for (i = 0; i <= TIMERS; i++) {
+		t = &test->timers[i];
+		delay = i == TIMERS ? LONG_DELAY : random() % MAX_DELAY;
+		t->test = test;
+		t->expire = weston_compositor_get_time_usec() / 1000 + delay;
+		t->rearm = i % 10 == 1;
+		weston_timer_init(&t->timer, timer_fired, t);
+		weston_timer_arm(test->compositor, &t->timer, delay);
+		assert(weston_timer_is_armed(&t->timer));
+	}
+	end = weston_compositor_get_time_usec();
+
+	for (i = 0; i < TIMERS; i += 7) {
+		weston_timer_cancel(&test->timers[i].timer);
+		test->timers[i].cancelled = 1;
+	}
+	for (i = 0; i <= TIMERS; i++)
+		if (!test->timers[i].cancelled)
+			test->remaining++;
+
+	fprintf(stderr, "armed %d timers in %.0f ns each\n", TIMERS + 1,
+		(end - start) * 1000.0 / (TIMERS + 1));
+}
+
+WL_EXPORT int
+module_init(struct weston_compositor *compositor, int *argc, char *argv[])
+{
+	struct timer_test *test;
+	struct wl_event_loop *loop;
+
+	test = zalloc(sizeof *test);
+	if (test == NULL)
+		return -1;
+
+	test->compositor = compositor;
+	loop = wl_display_get_event_loop(compositor->wl_display);
+	wl_event_loop_add_idle(loop, timer_test, test);
+
+	return 0;
+}
@@ -0,0 +1,274 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "../src/compositor.h"
+#include "../src/evdev.h"
+
+/* Replays a ten finger slotted touchscreen through the evdev code and
+ * counts what reaches the touch grab: every contact that changed in a
+ * report must arrive exactly once, followed by one frame.  The touches
+ * land on a surface covering the first output, which is in the surface
+ * list once the output has repainted. */
+
+#define FINGERS		10
+#define REPORTS		200
+
+struct touch_frame_test {
+	struct weston_compositor *compositor;
+	struct weston_layer layer;
+	struct weston_surface *surface;
+	struct wl_listener frame_listener;
+};
+
+struct counting_grab {
+	struct weston_touch_grab grab;
+	int down, up, motion, frame;
+	int last_frame_events;
+	int events;
+};
+
+static void
+counting_down(struct weston_touch_grab *grab, uint32_t time,
+	      int touch_id, wl_fixed_t sx, wl_fixed_t sy)
+{
+	struct counting_grab *c = (struct counting_grab *) grab;
+
+	c->down++;
+	c->events++;
+}
+
+static void
+counting_up(struct weston_touch_grab *grab, uint32_t time, int touch_id)
+{
+	struct counting_grab *c = (struct counting_grab *) grab;
+
+	c->up++;
+	c->events++;
+}
+
+static void
+counting_motion(struct weston_touch_grab *grab, uint32_t time,
+		int touch_id, wl_fixed_t sx, wl_fixed_t sy)
+{
+	struct counting_grab *c = (struct counting_grab *) grab;
+
+	c->motion++;
+	c->events++;
+}
+
+static void
+counting_frame(struct weston_touch_grab *grab)
+{
+	struct counting_grab *c = (struct counting_grab *) grab;
+
+	c->frame++;
+	c->last_frame_events = c->events;
+	c->events = 0;
+}
+
+static const struct weston_touch_grab_interface counting_grab_interface = {
+	counting_down,
+	counting_up,
+	counting_motion,
+	counting_frame
+};
+
+static void
+describe_touchscreen(struct evdev_device_description *desc)
+{
+	memset(desc, 0, sizeof *desc);
+	snprintf(desc->name, sizeof desc->name, "replayed touch table");
+
+	desc->ev_bits[LONG(EV_KEY)] |= BIT(EV_KEY);
+	desc->ev_bits[LONG(EV_ABS)] |= BIT(EV_ABS);
+	desc->key_bits[LONG(BTN_TOUCH)] |= BIT(BTN_TOUCH);
+	desc->abs_bits[LONG(ABS_MT_SLOT)] |= BIT(ABS_MT_SLOT);
+	desc->abs_bits[LONG(ABS_MT_TRACKING_ID)] |= BIT(ABS_MT_TRACKING_ID);
+	desc->abs_bits[LONG(ABS_MT_POSITION_X)] |= BIT(ABS_MT_POSITION_X);
+	desc->abs_bits[LONG(ABS_MT_POSITION_Y)] |= BIT(ABS_MT_POSITION_Y);
+
+	desc->absinfo[ABS_MT_SLOT].maximum = MAX_SLOTS - 1;
+	desc->absinfo[ABS_MT_TRACKING_ID].maximum = 65535;
+	desc->absinfo[ABS_MT_POSITION_X].maximum = 32767;
+	desc->absinfo[ABS_MT_POSITION_Y].maximum = 32767;
+}
+
+static struct input_event *
+add_event(struct wl_array *events, uint64_t time_us,
+	  uint16_t type, uint16_t code, int32_t value)
+{
+	struct input_event *e;
+
+	e = wl_array_add(events, sizeof *e);
+	assert(e);
+	e->time.tv_sec = time_us / 1000000;
+	e->time.tv_usec = time_us % 1000000;
+	e->type = type;
+	e->code = code;
+	e->value = value;
+
+	return e;
+}
+
+/* One report moving every finger; the first report puts them down and
+ * the last lifts them. */
+static void
+add_report(struct wl_array *events, int report, uint64_t time_us)
+{
+	int i;
+
+	for (i = 0; i < FINGERS; i++) {
+		add_event(events, time_us, EV_ABS, ABS_MT_SLOT, i);
+		if (report == 0)
+			add_event(events, time_us, EV_ABS,
+				  ABS_MT_TRACKING_ID, 100 + i);
+		if (report == REPORTS - 1) {
+			add_event(events, time_us, EV_ABS,
+				  ABS_MT_TRACKING_ID, -1);
+			continue;
+		}
+		add_event(events, time_us, EV_ABS, ABS_MT_POSITION_X,
+			  1000 + i * 3000 + report * 10);
+		add_event(events, time_us, EV_ABS, ABS_MT_POSITION_Y,
+			  1000 + i * 2000 + report * 7);
+	}
+	add_event(events, time_us, EV_SYN, SYN_REPORT, 0);
+}
+
+static void
+touch_frame_test(void *data)
+{
+	struct touch_frame_test *test = data;
+	struct weston_compositor *compositor = test->compositor;
+	struct evdev_device_description desc;
+	struct evdev_device *device;
+	struct weston_seat seat;
+	struct counting_grab grab;
+	struct wl_array events;
+	int evdev_events, i;
+
+	memset(&seat, 0, sizeof seat);
+	weston_seat_init(&seat, compositor, "touch-frame-test");
+
+	describe_touchscreen(&desc);
+	device = evdev_device_create_replay(&seat, "replay:touch", &desc,
+					    NULL);
+	assert(device && device != EVDEV_UNHANDLED_DEVICE);
+	assert(seat.touch);
+
+	memset(&grab, 0, sizeof grab);
+	grab.grab.interface = &counting_grab_interface;
+	weston_touch_start_grab(seat.touch, &grab.grab);
+
+	/* Feed the reports in batches of varying size, as a reader thread
+	 * handing over whatever it read would. */
+	wl_array_init(&events);
+	evdev_events = 0;
+	for (i = 0; i < REPORTS; i++) {
+		add_report(&events, i, 1000000 + i * 8000);
+		if (i % 3 == 2 || i == REPORTS - 1) {
+			evdev_events += events.size / sizeof(struct input_event);
+			evdev_process_events(device, events.data,
+					     events.size /
+					     sizeof(struct input_event));
+			events.size = 0;
+		}
+	}
+	wl_array_release(&events);
+
+	fprintf(stderr, "%d evdev events, %d down, %d motion, %d up, "
+		"%d frames\n", evdev_events, grab.down, grab.motion, grab.up,
+		grab.frame);
+
+	assert(grab.down == FINGERS);
+	assert(grab.up == FINGERS);
+	assert(grab.motion == FINGERS * (REPORTS - 2));
+	assert(grab.frame == REPORTS);
+	assert(grab.last_frame_events == FINGERS);
+	assert(grab.events == 0);
+
+	weston_touch_end_grab(seat.touch);
+	evdev_device_destroy(device);
+	weston_seat_release(&seat);
+
+	weston_surface_destroy(test->surface);
+	wl_list_remove(&test->layer.link);
+	free(test);
+
+	wl_display_terminate(compositor->wl_display);
+}
+
+static void
+output_frame(struct wl_listener *listener, void *data)
+{
+	struct touch_frame_test *test =
+		container_of(listener, struct touch_frame_test,
+			     frame_listener);
+	struct wl_event_loop *loop;
+
+	/* Run outside of the repaint that got the surface picked. */
+	wl_list_remove(&test->frame_listener.link);
+	loop = wl_display_get_event_loop(test->compositor->wl_display);
+	wl_event_loop_add_idle(loop, touch_frame_test, test);
+}
+
+WL_EXPORT int
+module_init(struct weston_compositor *compositor, int *argc, char *argv[])
+{
+	struct touch_frame_test *test;
+	struct weston_output *output;
+
+	output = container_of(compositor->output_list.next,
+			      struct weston_output, link);
+
+	test = zalloc(sizeof *test);
+	if (test == NULL)
+		return -1;
+
+	test->compositor = compositor;
+	weston_layer_init(&test->layer, &compositor->cursor_layer.link);
+
+	test->surface = weston_surface_create(compositor);
+	if (test->surface == NULL) {
+		free(test);
+		return -1;
+	}
+	weston_surface_configure(test->surface, output->x, output->y,
+				 output->width, output->height);
+	pixman_region32_fini(&test->surface->input);
+	pixman_region32_init_rect(&test->surface->input, 0, 0,
+				  output->width, output->height);
+	wl_list_insert(&test->layer.surface_list,
+		       &test->surface->layer_link);
+
+	test->frame_listener.notify = output_frame;
+	wl_signal_add(&output->frame_signal, &test->frame_listener);
+	weston_compositor_schedule_repaint(compositor);
+
+	return 0;
+}
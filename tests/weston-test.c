@@ -125,7 +125,7 @@ move_pointer(struct wl_client *client, struct wl_resource *resource,
 
 	test->compositor->focus = 1;
 
-	notify_motion(seat, 100,
+	notify_motion(seat, 100000,
 		      wl_fixed_from_int(x) - pointer->x,
 		      wl_fixed_from_int(y) - pointer->y);
 
@@ -141,7 +141,7 @@ send_button(struct wl_client *client, struct wl_resource *resource,
 
 	test->compositor->focus = 1;
 
-	notify_button(seat, 100, button, state);
+	notify_button(seat, 100000, button, state);
 }
 
 static void
@@ -0,0 +1,707 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config.h>
+#include "weston-test-client-helper.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <xcb/xcb.h>
+
+/* Pastes a 1 GB selection between a Wayland and an X client, in both
+ * directions, and checks that the compositor streams it: every byte
+ * arrives, sent through INCR on the X side, while the compositor's
+ * resident size stays flat.  The Wayland selection also offers a first
+ * mime type nobody serves, so the clipboard manager doesn't keep its
+ * own copy.  The X selection only has the one type, so the clipboard
+ * manager reads it first and our paste waits its turn. */
+
+#define SELECTION_SIZE		(1024ull * 1024 * 1024)
+#define RSS_SLACK_KB		(32 * 1024)
+#define RSS_SAMPLE_INTERVAL	(64 * 1024 * 1024)
+#define TEXT_MIME_TYPE		"text/plain;charset=utf-8"
+#define X_CHUNK_SIZE		(64 * 1024)
+
+struct selection_test {
+	struct client *client;
+	struct wl_data_device_manager *manager;
+	struct wl_data_source *source;
+	int source_fd;
+	uint64_t written;
+
+	struct wl_data_device *device;
+	struct wl_data_offer *offer;
+	int offer_has_text;
+	int sink_fd;
+
+	xcb_connection_t *conn;
+	xcb_window_t window;
+	xcb_atom_t clipboard, clipboard_manager, utf8_string, incr, property;
+	xcb_atom_t targets;
+	int incr_started;
+
+	/* The request we're answering as the X selection owner. */
+	xcb_window_t requestor;
+	xcb_atom_t request_property;
+	int serving, sent_final;
+
+	int done;
+	uint64_t received;
+	uint64_t next_sample;
+
+	pid_t compositor_pid;
+	long rss_start_kb, rss_max_kb;
+};
+
+static char
+pattern_byte(uint64_t offset)
+{
+	return 'a' + offset % 26;
+}
+
+static long
+read_rss_kb(pid_t pid)
+{
+	char path[64], line[256];
+	long rss = -1;
+	FILE *fp;
+
+	snprintf(path, sizeof path, "/proc/%d/status", pid);
+	fp = fopen(path, "r");
+	if (fp == NULL)
+		return -1;
+
+	while (fgets(line, sizeof line, fp))
+		if (sscanf(line, "VmRSS: %ld kB", &rss) == 1)
+			break;
+	fclose(fp);
+
+	return rss;
+}
+
+static void
+sample_rss(struct selection_test *test)
+{
+	long rss = read_rss_kb(test->compositor_pid);
+
+	if (rss > test->rss_max_kb)
+		test->rss_max_kb = rss;
+}
+
+static void
+data_source_target(void *data, struct wl_data_source *source,
+		   const char *mime_type)
+{
+}
+
+static void
+data_source_send(void *data, struct wl_data_source *source,
+		 const char *mime_type, int32_t fd)
+{
+	struct selection_test *test = data;
+
+	if (strcmp(mime_type, TEXT_MIME_TYPE) != 0 || test->source_fd >= 0) {
+		close(fd);
+		return;
+	}
+
+	fcntl(fd, F_SETFL, O_WRONLY | O_NONBLOCK);
+	test->source_fd = fd;
+}
+
+static void
+data_source_cancelled(void *data, struct wl_data_source *source)
+{
+}
+
+static const struct wl_data_source_listener data_source_listener = {
+	data_source_target,
+	data_source_send,
+	data_source_cancelled
+};
+
+static void
+write_source(struct selection_test *test)
+{
+	char buffer[65536];
+	uint64_t i, length;
+	ssize_t len;
+
+	length = SELECTION_SIZE - test->written;
+	if (length > sizeof buffer)
+		length = sizeof buffer;
+	for (i = 0; i < length; i++)
+		buffer[i] = pattern_byte(test->written + i);
+
+	len = write(test->source_fd, buffer, length);
+	if (len < 0) {
+		assert(errno == EAGAIN);
+		return;
+	}
+
+	test->written += len;
+	if (test->written == SELECTION_SIZE) {
+		close(test->source_fd);
+		test->source_fd = -1;
+	}
+}
+
+static xcb_atom_t
+intern_atom(xcb_connection_t *conn, const char *name)
+{
+	xcb_intern_atom_reply_t *reply;
+	xcb_atom_t atom;
+
+	reply = xcb_intern_atom_reply(conn,
+				      xcb_intern_atom(conn, 0, strlen(name),
+						      name),
+				      NULL);
+	assert(reply);
+	atom = reply->atom;
+	free(reply);
+
+	return atom;
+}
+
+static xcb_window_t
+get_owner(struct selection_test *test, xcb_atom_t selection)
+{
+	xcb_get_selection_owner_reply_t *reply;
+	xcb_window_t owner;
+
+	reply = xcb_get_selection_owner_reply(test->conn,
+					      xcb_get_selection_owner(test->conn,
+								      selection),
+					      NULL);
+	assert(reply);
+	owner = reply->owner;
+	free(reply);
+
+	return owner;
+}
+
+static void
+read_property(struct selection_test *test)
+{
+	xcb_get_property_reply_t *reply;
+	const char *value;
+	int i, length;
+
+	reply = xcb_get_property_reply(test->conn,
+				       xcb_get_property(test->conn, 1,
+							test->window,
+							test->property,
+							XCB_GET_PROPERTY_TYPE_ANY,
+							0, 0x1fffffff),
+				       NULL);
+	assert(reply);
+
+	if (reply->type == test->incr) {
+		/* The delete above asks for the first piece. */
+		test->incr_started = 1;
+		free(reply);
+		return;
+	}
+
+	length = xcb_get_property_value_length(reply);
+	value = xcb_get_property_value(reply);
+	for (i = 0; i < length; i++)
+		assert(value[i] == pattern_byte(test->received + i));
+	test->received += length;
+	free(reply);
+
+	if (length == 0 || !test->incr_started)
+		test->done = 1;
+
+	if (test->received >= test->next_sample) {
+		sample_rss(test);
+		test->next_sample += RSS_SAMPLE_INTERVAL;
+	}
+}
+
+static void
+send_x_selection_notify(struct selection_test *test,
+			xcb_selection_request_event_t *request,
+			xcb_atom_t property)
+{
+	xcb_selection_notify_event_t notify;
+
+	memset(&notify, 0, sizeof notify);
+	notify.response_type = XCB_SELECTION_NOTIFY;
+	notify.time = request->time;
+	notify.requestor = request->requestor;
+	notify.selection = request->selection;
+	notify.target = request->target;
+	notify.property = property;
+
+	xcb_send_event(test->conn, 0, request->requestor,
+		       XCB_EVENT_MASK_NO_EVENT, (char *) &notify);
+}
+
+static void
+handle_selection_request(struct selection_test *test,
+			 xcb_selection_request_event_t *request)
+{
+	xcb_atom_t targets[2];
+	uint32_t values[1], size;
+
+	if (request->target == test->targets) {
+		targets[0] = test->targets;
+		targets[1] = test->utf8_string;
+		xcb_change_property(test->conn, XCB_PROP_MODE_REPLACE,
+				    request->requestor, request->property,
+				    XCB_ATOM_ATOM, 32, 2, targets);
+		send_x_selection_notify(test, request, request->property);
+		return;
+	}
+
+	/* The window manager runs one paste at a time, so a new request
+	 * means it gave up on the one we were serving. */
+	if (request->target != test->utf8_string) {
+		send_x_selection_notify(test, request, XCB_ATOM_NONE);
+		return;
+	}
+
+	test->requestor = request->requestor;
+	test->request_property = request->property;
+	test->serving = 1;
+	test->sent_final = 0;
+	test->written = 0;
+
+	/* Watch for the requestor deleting each piece. */
+	values[0] = XCB_EVENT_MASK_PROPERTY_CHANGE;
+	xcb_change_window_attributes(test->conn, request->requestor,
+				     XCB_CW_EVENT_MASK, values);
+
+	size = X_CHUNK_SIZE;
+	xcb_change_property(test->conn, XCB_PROP_MODE_REPLACE,
+			    request->requestor, request->property,
+			    test->incr, 32, 1, &size);
+	send_x_selection_notify(test, request, request->property);
+}
+
+static void
+send_x_chunk(struct selection_test *test)
+{
+	char buffer[X_CHUNK_SIZE];
+	uint64_t i, length;
+
+	if (test->sent_final) {
+		/* The requestor deleted the empty piece, we're done. */
+		test->serving = 0;
+		return;
+	}
+
+	length = SELECTION_SIZE - test->written;
+	if (length > sizeof buffer)
+		length = sizeof buffer;
+	for (i = 0; i < length; i++)
+		buffer[i] = pattern_byte(test->written + i);
+	test->written += length;
+
+	xcb_change_property(test->conn, XCB_PROP_MODE_REPLACE,
+			    test->requestor, test->request_property,
+			    test->utf8_string, 8, length, buffer);
+	if (length == 0)
+		test->sent_final = 1;
+}
+
+static void
+handle_x_events(struct selection_test *test)
+{
+	xcb_generic_event_t *event;
+	xcb_selection_notify_event_t *selection_notify;
+	xcb_property_notify_event_t *property_notify;
+
+	while ((event = xcb_poll_for_event(test->conn))) {
+		switch (event->response_type & ~0x80) {
+		case XCB_SELECTION_NOTIFY:
+			selection_notify =
+				(xcb_selection_notify_event_t *) event;
+			assert(selection_notify->property == test->property);
+			read_property(test);
+			break;
+		case XCB_PROPERTY_NOTIFY:
+			property_notify = (xcb_property_notify_event_t *) event;
+			if (test->incr_started &&
+			    property_notify->atom == test->property &&
+			    property_notify->state == XCB_PROPERTY_NEW_VALUE)
+				read_property(test);
+			else if (test->serving &&
+				 property_notify->window == test->requestor &&
+				 property_notify->atom == test->request_property &&
+				 property_notify->state == XCB_PROPERTY_DELETE)
+				send_x_chunk(test);
+			break;
+		case XCB_SELECTION_REQUEST:
+			handle_selection_request(test,
+				(xcb_selection_request_event_t *) event);
+			break;
+		}
+		free(event);
+	}
+
+	xcb_flush(test->conn);
+}
+
+static void
+connect_x(struct selection_test *test)
+{
+	xcb_screen_t *screen;
+	uint32_t values[1];
+	int i;
+
+	test->conn = xcb_connect(NULL, NULL);
+	assert(test->conn && !xcb_connection_has_error(test->conn));
+
+	test->clipboard = intern_atom(test->conn, "CLIPBOARD");
+	test->clipboard_manager = intern_atom(test->conn, "CLIPBOARD_MANAGER");
+	test->utf8_string = intern_atom(test->conn, "UTF8_STRING");
+	test->incr = intern_atom(test->conn, "INCR");
+	test->targets = intern_atom(test->conn, "TARGETS");
+	test->property = intern_atom(test->conn, "WESTON_SELECTION_TEST");
+
+	/* The window manager claims CLIPBOARD_MANAGER once it's up. */
+	for (i = 0; get_owner(test, test->clipboard_manager) == XCB_NONE; i++) {
+		assert(i < 1000);
+		usleep(10000);
+	}
+
+	screen = xcb_setup_roots_iterator(xcb_get_setup(test->conn)).data;
+	test->window = xcb_generate_id(test->conn);
+	values[0] = XCB_EVENT_MASK_PROPERTY_CHANGE;
+	xcb_create_window(test->conn, XCB_COPY_FROM_PARENT, test->window,
+			  screen->root, 0, 0, 10, 10, 0,
+			  XCB_WINDOW_CLASS_INPUT_OUTPUT, screen->root_visual,
+			  XCB_CW_EVENT_MASK, values);
+	xcb_flush(test->conn);
+}
+
+static void
+data_offer_offer(void *data, struct wl_data_offer *offer, const char *type)
+{
+	struct selection_test *test = data;
+
+	if (strcmp(type, TEXT_MIME_TYPE) == 0)
+		test->offer_has_text = 1;
+}
+
+static const struct wl_data_offer_listener data_offer_listener = {
+	data_offer_offer
+};
+
+static void
+data_device_data_offer(void *data, struct wl_data_device *device,
+		       struct wl_data_offer *offer)
+{
+	struct selection_test *test = data;
+
+	test->offer_has_text = 0;
+	wl_data_offer_add_listener(offer, &data_offer_listener, test);
+}
+
+static void
+data_device_enter(void *data, struct wl_data_device *device,
+		  uint32_t serial, struct wl_surface *surface,
+		  wl_fixed_t x, wl_fixed_t y, struct wl_data_offer *offer)
+{
+}
+
+static void
+data_device_leave(void *data, struct wl_data_device *device)
+{
+}
+
+static void
+data_device_motion(void *data, struct wl_data_device *device,
+		   uint32_t time, wl_fixed_t x, wl_fixed_t y)
+{
+}
+
+static void
+data_device_drop(void *data, struct wl_data_device *device)
+{
+}
+
+static void
+data_device_selection(void *data, struct wl_data_device *device,
+		      struct wl_data_offer *offer)
+{
+	struct selection_test *test = data;
+
+	if (test->offer)
+		wl_data_offer_destroy(test->offer);
+	test->offer = offer;
+}
+
+static const struct wl_data_device_listener data_device_listener = {
+	data_device_data_offer,
+	data_device_enter,
+	data_device_leave,
+	data_device_motion,
+	data_device_drop,
+	data_device_selection
+};
+
+static void
+bind_data_device(struct selection_test *test)
+{
+	struct client *client = test->client;
+	struct global *global;
+
+	wl_list_for_each(global, &client->global_list, link)
+		if (strcmp(global->interface, "wl_data_device_manager") == 0)
+			test->manager =
+				wl_registry_bind(client->wl_registry,
+						 global->name,
+						 &wl_data_device_manager_interface,
+						 1);
+	assert(test->manager);
+
+	test->device =
+		wl_data_device_manager_get_data_device(test->manager,
+						       client->input->wl_seat);
+	wl_data_device_add_listener(test->device, &data_device_listener, test);
+}
+
+static void
+set_wayland_selection(struct selection_test *test)
+{
+	struct client *client = test->client;
+	int i;
+
+	bind_data_device(test);
+
+	test->source = wl_data_device_manager_create_data_source(test->manager);
+	wl_data_source_add_listener(test->source, &data_source_listener, test);
+	wl_data_source_offer(test->source, "application/x-weston-test");
+	wl_data_source_offer(test->source, TEXT_MIME_TYPE);
+
+	wl_data_device_set_selection(test->device, test->source, 0);
+	client_roundtrip(client);
+
+	/* Wait for the window manager to take the X selection. */
+	for (i = 0; get_owner(test, test->clipboard) == XCB_NONE; i++) {
+		assert(i < 1000);
+		usleep(10000);
+		client_roundtrip(client);
+	}
+}
+
+static void
+transfer(struct selection_test *test)
+{
+	struct wl_display *display = test->client->wl_display;
+	struct pollfd fds[3];
+	int nfds;
+
+	xcb_convert_selection(test->conn, test->window, test->clipboard,
+			      test->utf8_string, test->property,
+			      XCB_CURRENT_TIME);
+	xcb_flush(test->conn);
+
+	while (!test->done) {
+		wl_display_dispatch_pending(display);
+		wl_display_flush(display);
+
+		fds[0].fd = wl_display_get_fd(display);
+		fds[0].events = POLLIN;
+		fds[1].fd = xcb_get_file_descriptor(test->conn);
+		fds[1].events = POLLIN;
+		nfds = 2;
+		if (test->source_fd >= 0) {
+			fds[2].fd = test->source_fd;
+			fds[2].events = POLLOUT;
+			nfds = 3;
+		}
+
+		handle_x_events(test);
+		if (test->done)
+			break;
+
+		assert(poll(fds, nfds, 10000) > 0);
+
+		if (fds[0].revents & POLLIN)
+			assert(wl_display_dispatch(display) >= 0);
+		if (nfds == 3 && fds[2].revents)
+			write_source(test);
+	}
+}
+
+static void
+set_x_selection(struct selection_test *test)
+{
+	struct client *client = test->client;
+	int i;
+
+	bind_data_device(test);
+
+	/* The selection goes to the client with keyboard focus. */
+	wl_test_activate_surface(client->test->wl_test,
+				 client->surface->wl_surface);
+
+	xcb_set_selection_owner(test->conn, test->window, test->clipboard,
+				XCB_CURRENT_TIME);
+	xcb_flush(test->conn);
+
+	/* Answer the window manager's TARGETS request and wait for the
+	 * selection to show up on the Wayland side. */
+	for (i = 0; test->offer == NULL || !test->offer_has_text; i++) {
+		assert(i < 1000);
+		usleep(10000);
+		handle_x_events(test);
+		client_roundtrip(client);
+	}
+}
+
+static void
+read_sink(struct selection_test *test)
+{
+	char buffer[65536];
+	ssize_t i, len;
+
+	len = read(test->sink_fd, buffer, sizeof buffer);
+	if (len < 0) {
+		assert(errno == EAGAIN);
+		return;
+	}
+
+	for (i = 0; i < len; i++)
+		assert(buffer[i] == pattern_byte(test->received + i));
+	test->received += len;
+
+	if (len == 0) {
+		close(test->sink_fd);
+		test->sink_fd = -1;
+		test->done = 1;
+	}
+
+	if (test->received >= test->next_sample) {
+		sample_rss(test);
+		test->next_sample += RSS_SAMPLE_INTERVAL;
+	}
+}
+
+static void
+transfer_from_x(struct selection_test *test)
+{
+	struct wl_display *display = test->client->wl_display;
+	struct pollfd fds[3];
+	int p[2];
+
+	assert(pipe(p) == 0);
+	fcntl(p[0], F_SETFL, O_RDONLY | O_NONBLOCK);
+	wl_data_offer_receive(test->offer, TEXT_MIME_TYPE, p[1]);
+	close(p[1]);
+	test->sink_fd = p[0];
+
+	while (!test->done) {
+		wl_display_dispatch_pending(display);
+		wl_display_flush(display);
+		handle_x_events(test);
+
+		fds[0].fd = wl_display_get_fd(display);
+		fds[0].events = POLLIN;
+		fds[1].fd = xcb_get_file_descriptor(test->conn);
+		fds[1].events = POLLIN;
+		fds[2].fd = test->sink_fd;
+		fds[2].events = POLLIN;
+
+		assert(poll(fds, 3, 10000) > 0);
+
+		if (fds[0].revents & POLLIN)
+			assert(wl_display_dispatch(display) >= 0);
+		if (fds[2].revents)
+			read_sink(test);
+	}
+}
+
+TEST(xwayland_selection_streaming)
+{
+	struct selection_test test;
+
+	memset(&test, 0, sizeof test);
+	test.source_fd = -1;
+	test.sink_fd = -1;
+	test.next_sample = RSS_SAMPLE_INTERVAL;
+	test.compositor_pid = getppid();
+
+	test.client = client_create(100, 100, 100, 100);
+	connect_x(&test);
+	set_wayland_selection(&test);
+
+	test.rss_start_kb = read_rss_kb(test.compositor_pid);
+	test.rss_max_kb = test.rss_start_kb;
+
+	transfer(&test);
+	sample_rss(&test);
+
+	fprintf(stderr, "transferred %llu bytes, compositor rss %ld kB -> "
+		"max %ld kB\n", (unsigned long long) test.received,
+		test.rss_start_kb, test.rss_max_kb);
+
+	assert(test.incr_started);
+	assert(test.written == SELECTION_SIZE);
+	assert(test.received == SELECTION_SIZE);
+	if (test.rss_start_kb > 0)
+		assert(test.rss_max_kb - test.rss_start_kb < RSS_SLACK_KB);
+
+	xcb_disconnect(test.conn);
+	exit(EXIT_SUCCESS);
+}
+
+TEST(xwayland_selection_streaming_from_x)
+{
+	struct selection_test test;
+
+	memset(&test, 0, sizeof test);
+	test.source_fd = -1;
+	test.sink_fd = -1;
+	test.next_sample = RSS_SAMPLE_INTERVAL;
+	test.compositor_pid = getppid();
+
+	test.client = client_create(100, 100, 100, 100);
+	connect_x(&test);
+	set_x_selection(&test);
+
+	test.rss_start_kb = read_rss_kb(test.compositor_pid);
+	test.rss_max_kb = test.rss_start_kb;
+
+	transfer_from_x(&test);
+	sample_rss(&test);
+
+	fprintf(stderr, "transferred %llu bytes, compositor rss %ld kB -> "
+		"max %ld kB\n", (unsigned long long) test.received,
+		test.rss_start_kb, test.rss_max_kb);
+
+	assert(test.received == SELECTION_SIZE);
+	if (test.rss_start_kb > 0)
+		assert(test.rss_max_kb - test.rss_start_kb < RSS_SLACK_KB);
+
+	xcb_disconnect(test.conn);
+	exit(EXIT_SUCCESS);
+}